@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Advanced/XUSGAnimation.h"
+
+using namespace std;
+using namespace XUSG;
+
+static void printUsage()
+{
+	cerr << "Usage: AnimConverter [-t tolerance] [-r radians] [-s tolerance] "
+		"<input.sdkmesh_anim> <output> [<input> <output> ...]" << endl;
+	cerr << "  -t, -r and -s set the translation, rotation and scaling tolerances." << endl;
+}
+
+static string narrow(const wstring &str)
+{
+	string result;
+	for (const auto c : str) result.push_back(c < 0x80 ? static_cast<char>(c) : '?');
+
+	return result;
+}
+
+// One line per clip: size, keys, maximum errors and decode speed
+static void printReport(const wstring &fileName, const CompressedAnimation::Report &report)
+{
+	const auto name = narrow(fileName.substr(fileName.find_last_of(L"/\\") + 1));
+	cout << left << setw(32) << name.substr(0, 31) << right << fixed <<
+		setw(10) << report.RawBytes << setw(10) << report.CompressedBytes <<
+		setw(8) << setprecision(1) << 100.0 * report.CompressedBytes / report.RawBytes << "%" <<
+		setw(10) << report.NumSourceKeys << setw(10) << report.NumStoredKeys <<
+		setw(6) << report.NumIdentityChannels << setw(6) << report.NumConstantChannels <<
+		setw(10) << setprecision(5) << report.MaxTranslationError <<
+		setw(10) << report.MaxRotationError << setw(10) << report.MaxScalingError <<
+		setw(10) << setprecision(2) << report.DecodeTimePerKey << endl;
+}
+
+static int run(const vector<wstring> &args)
+{
+	CompressedAnimation::Settings settings;
+	vector<wstring> fileNames;
+	for (size_t i = 0; i < args.size(); ++i)
+	{
+		const auto isOption = args[i] == L"-t" || args[i] == L"-r" || args[i] == L"-s";
+		if (isOption && i + 1 < args.size())
+		{
+			const auto tolerance = static_cast<float>(wcstod(args[i + 1].c_str(), nullptr));
+			if (args[i] == L"-t") settings.TranslationTolerance = tolerance;
+			else if (args[i] == L"-r") settings.RotationTolerance = tolerance;
+			else settings.ScalingTolerance = tolerance;
+			++i;
+		}
+		else fileNames.push_back(args[i]);
+	}
+
+	if (fileNames.empty() || fileNames.size() % 2)
+	{
+		printUsage();
+
+		return EXIT_FAILURE;
+	}
+
+	cout << left << setw(32) << "Clip" << right << setw(10) << "Raw" << setw(10) << "Packed" <<
+		setw(9) << "Ratio" << setw(10) << "Keys" << setw(10) << "Stored" << setw(6) << "Id" <<
+		setw(6) << "Const" << setw(10) << "MaxT" << setw(10) << "MaxR" << setw(10) << "MaxS" <<
+		setw(10) << "ns/key" << endl;
+
+	auto result = EXIT_SUCCESS;
+	for (size_t i = 0; i < fileNames.size(); i += 2)
+	{
+		CompressedAnimation::Report report;
+		if (CompressedAnimation::Convert(fileNames[i].c_str(), fileNames[i + 1].c_str(), settings, &report))
+			printReport(fileNames[i], report);
+		else
+		{
+			cerr << narrow(fileNames[i]) << ": conversion failed." << endl;
+			result = EXIT_FAILURE;
+		}
+	}
+
+	return result;
+}
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t *argv[])
+{
+	return run(vector<wstring>(argv + 1, argv + argc));
+}
+#else
+int main(int argc, char *argv[])
+{
+	vector<wstring> args;
+	for (auto i = 1; i < argc; ++i)
+	{
+		const string arg(argv[i]);
+		args.emplace_back(arg.cbegin(), arg.cend());
+	}
+
+	return run(args);
+}
+#endif
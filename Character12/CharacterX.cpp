@@ -19,6 +19,7 @@ CharacterX::CharacterX(uint32_t width, uint32_t height, std::wstring name) :
 	m_frameIndex(0),
 	m_viewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height)),
 	m_scissorRect(0, 0, static_cast<long>(width), static_cast<long>(height)),
+	m_numCharacters(1),
 	m_pausing(false),
 	m_tracking(false)
 {
@@ -137,13 +138,33 @@ void CharacterX::LoadAssets()
 	m_graphicsPipelineCache = make_shared<Graphics::PipelineCache>(m_device);
 	m_computePipelineCache = make_shared<Compute::PipelineCache>(m_device);
 	m_pipelineLayoutCache = make_shared<PipelineLayoutCache>(m_device);
+	m_ringBuffer = make_shared<RingBuffer>();
 
 	// Create the shaders.
 	{
 		m_shaderPool->CreateShader(Shader::Stage::VS, VS_BASE_PASS, L"VSBasePass.cso");
+		m_shaderPool->CreateShader(Shader::Stage::VS, VS_BASE_PASS_OCT, L"VSBasePassOct.cso");
+		m_shaderPool->CreateShader(Shader::Stage::VS, VS_BASE_PASS_OCT_QUANTIZED, L"VSBasePassOctQuant.cso");
+		m_shaderPool->CreateShader(Shader::Stage::VS, VS_BASE_PASS_SKINNING, L"VSBasePassSkinning.cso");
+		m_shaderPool->CreateShader(Shader::Stage::VS, VS_BASE_PASS_SKINNING_COMPACT, L"VSBasePassSkinningCompact.cso");
 		m_shaderPool->CreateShader(Shader::Stage::PS, PS_BASE_PASS, L"PSBasePass.cso");
 		m_shaderPool->CreateShader(Shader::Stage::PS, PS_ALPHA_TEST, L"PSAlphaTest.cso");
 		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING, L"CSSkinning.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_BATCH, L"CSSkinningBatch.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_COMPACT, L"CSSkinningCompact.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_BATCH_COMPACT, L"CSSkinningBatchCompact.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_LBS4, L"CSSkinningLBS4.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_LBS2, L"CSSkinningLBS2.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_RIGID, L"CSSkinningRigid.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_RIGID_COMPACT, L"CSSkinningRigidCompact.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_OCT, L"CSSkinningOct.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_OCT_QUANTIZED, L"CSSkinningOctQuant.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_COMPACT_OCT, L"CSSkinningCompactOct.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_COMPACT_OCT_QUANTIZED, L"CSSkinningCompactOctQuant.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_BATCH_OCT, L"CSSkinningBatchOct.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_BATCH_OCT_QUANTIZED, L"CSSkinningBatchOctQuant.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_BATCH_COMPACT_OCT, L"CSSkinningBatchCompactOct.cso");
+		m_shaderPool->CreateShader(Shader::Stage::CS, CS_SKINNING_BATCH_COMPACT_OCT_QUANTIZED, L"CSSkinningBatchCompactOctQuant.cso");
 	}
 
 	// Create the command list.
@@ -154,19 +175,76 @@ void CharacterX::LoadAssets()
 	{
 		m_inputLayout = Character::CreateInputLayout(*m_graphicsPipelineCache);
 		const auto textureCache = make_shared<TextureCache::element_type>(0);
-		const auto characterMesh = Character::LoadSDKMesh(m_device, L"Media/Bright/Stars.sdkmesh",
-			L"Media/Bright/Stars.sdkmesh_anim", textureCache);
-		if (!characterMesh) ThrowIfFailed(E_FAIL);
-		m_character = make_unique<Character>(m_device, m_commandList, L"Stars");
-		if (!m_character) ThrowIfFailed(E_FAIL);
-		if (!m_character->Init(m_inputLayout, characterMesh, m_shaderPool,
-			m_graphicsPipelineCache, m_computePipelineCache,
-			m_pipelineLayoutCache, m_descriptorTableCache))
+
+		// The asset uploads are batched on a copy queue, which the direct queue waits for
+		m_uploadManager = make_shared<UploadManager>();
+		if (!m_uploadManager || !m_uploadManager->Create(m_device, 32 << 20, L"AssetUpload"))
+			ThrowIfFailed(E_FAIL);
+
+		// Job system for the parallel asset loading and character update; the assets are
+		// prepared on the workers, and uploaded by the loader on this thread
+		m_jobSystem = make_unique<JobSystem>();
+		MeshLoader meshLoader(m_device, m_jobSystem.get(), m_uploadManager, textureCache);
+		const auto characterMesh = meshLoader.LoadCharacterSDKMesh(L"Media/Bright/Stars.sdkmesh",
+			L"Media/Bright/Stars.sdkmesh_anim");
+		if (!characterMesh || !meshLoader.Flush()) ThrowIfFailed(E_FAIL);
+
+		// Animation LOD for crowds: drop the update rate and the leaf bones with distance
+		static const Character::AnimationLOD animationLODs[] =
+		{
+			{ 0.25f, 1, 0, false },
+			{ 0.1f, 2, 1, true },
+			{ 0.0f, 4, 2, true }
+		};
+
+		// Crowds are bound by the palette bandwidth, so their bones are compact
+		const auto boneFormat = m_numCharacters > 1 ? Character::BONE_FORMAT_COMPACT : Character::BONE_FORMAT_DQ_SCALE;
+
+		// The characters share the mesh and the animation clip, and stand on a grid
+		const auto gridSize = static_cast<uint32_t>(ceil(sqrt(static_cast<float>(m_numCharacters))));
+		const auto spacing = 8.0f;
+		m_characters.resize(m_numCharacters);
+		for (auto i = 0u; i < m_numCharacters; ++i)
+		{
+			auto &character = m_characters[i];
+			character = make_unique<Character>(m_device, m_commandList, L"Stars");
+			if (!character) ThrowIfFailed(E_FAIL);
+			if (!character->Init(m_inputLayout, characterMesh, m_shaderPool,
+				m_graphicsPipelineCache, m_computePipelineCache,
+				m_pipelineLayoutCache, m_descriptorTableCache, m_ringBuffer,
+				nullptr, nullptr, nullptr, 0, Format(0), Format(0), boneFormat))
+				ThrowIfFailed(E_FAIL);
+
+			const auto x = (i % gridSize - (gridSize - 1) * 0.5f) * spacing;
+			const auto z = (i / gridSize) * spacing;
+			character->InitPosition(XMFLOAT4(x, 0.0f, z, 0.0f));
+			if (m_numCharacters > 1)
+				character->SetAnimationLODs(animationLODs, static_cast<uint8_t>(size(animationLODs)));
+		}
+
+		// Crowds are skinned with a single dispatch
+		if (m_numCharacters > 1)
+		{
+			m_skinningBatcher = make_unique<SkinningBatcher>(m_device, m_commandList, L"Crowd");
+			if (!m_skinningBatcher) ThrowIfFailed(E_FAIL);
+			for (const auto &character : m_characters) m_skinningBatcher->Register(character.get());
+			if (!m_skinningBatcher->Init(m_shaderPool, m_computePipelineCache,
+				m_pipelineLayoutCache, m_descriptorTableCache, m_ringBuffer))
+				ThrowIfFailed(E_FAIL);
+		}
+
+		// Ring buffer for the per-frame constants and bone palettes, with space for the frames
+		// in flight and the one being written
+		auto dynamicDataSize = 0u;
+		for (const auto &character : m_characters) dynamicDataSize += character->GetDynamicDataSize();
+		if (m_skinningBatcher) dynamicDataSize += m_skinningBatcher->GetDynamicDataSize();
+		if (!m_ringBuffer->Create(m_device, dynamicDataSize * (FrameCount + 1), L"DynamicRing"))
 			ThrowIfFailed(E_FAIL);
 	}
 
-	// Close the command list and execute it to begin the initial GPU setup.
+	// Close the command list and execute it to begin the initial GPU setup, after the asset uploads.
 	ThrowIfFailed(m_commandList.Close());
+	ThrowIfFailed(m_commandQueue->Wait(m_uploadManager->GetFence().get(), m_uploadManager->GetFenceValue()));
 	ID3D12CommandList *const ppCommandLists[] = { m_commandList.GetCommandList().get() };
 	m_commandQueue->ExecuteCommandLists(static_cast<uint32_t>(size(ppCommandLists)), ppCommandLists);
 
@@ -186,6 +264,7 @@ void CharacterX::LoadAssets()
 		// list in our main loop but for now, we just want to wait for setup to 
 		// complete before continuing.
 		WaitForGpu();
+		m_uploadManager->Reclaim();
 	}
 
 	// Projection
@@ -223,8 +302,13 @@ void CharacterX::OnUpdate()
 	const auto proj = XMLoadFloat4x4(&m_proj);
 	const auto viewProj = view * proj;
 
-	// Character
-	m_character->Update(m_frameIndex, time, viewProj, &XMMatrixIdentity(), nullptr, false);
+	// Characters: evaluate the poses and write the bone palettes in parallel, and join
+	// before the command list is recorded
+	if (m_skinningBatcher) m_skinningBatcher->Update();
+	m_jobSystem->ParallelFor(m_numCharacters, [&](uint32_t i)
+	{
+		m_characters[i]->Update(m_frameIndex, time, viewProj, nullptr, nullptr, nullptr, 0, false);
+	});
 }
 
 // Render the scene.
@@ -325,6 +409,17 @@ void CharacterX::OnMouseLeave()
 	m_tracking = false;
 }
 
+void CharacterX::ParseCommandLineArgs(WCHAR* argv[], int argc)
+{
+	DXFramework::ParseCommandLineArgs(argv, argc);
+
+	for (auto i = 1; i < argc; ++i)
+	{
+		if ((_wcsicmp(argv[i], L"-crowd") == 0 || _wcsicmp(argv[i], L"/crowd") == 0) && i + 1 < argc)
+			m_numCharacters = (max)(static_cast<uint32_t>(_wtoi(argv[++i])), 1u);
+	}
+}
+
 void CharacterX::PopulateCommandList()
 {
 	// Command list allocators can only be reset when the associated 
@@ -338,7 +433,8 @@ void CharacterX::PopulateCommandList()
 	ThrowIfFailed(m_commandList.Reset(m_commandAllocators[m_frameIndex], nullptr));
 
 	// Skinning
-	m_character->Skinning(true);
+	if (m_skinningBatcher) m_skinningBatcher->Skinning(true);
+	else for (auto i = 0u; i < m_numCharacters; ++i) m_characters[i]->Skinning(i == 0);
 
 	// Set necessary state.
 	m_commandList.RSSetViewports(1, &m_viewport);
@@ -354,7 +450,8 @@ void CharacterX::PopulateCommandList()
 	m_commandList.ClearDepthStencilView(m_depth.GetDSV(), D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
 	//m_commandList.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	m_character->RenderTransformed(SUBSET_FULL, Model::CBV_MATRICES, Model::BASE_PASS);
+	for (const auto &character : m_characters)
+		character->RenderTransformed(SUBSET_FULL, Model::CBV_MATRICES, Model::BASE_PASS);
 
 	// Indicate that the back buffer will now be used to present.
 	m_renderTargets[m_frameIndex].Barrier(m_commandList, D3D12_RESOURCE_STATE_PRESENT);
@@ -379,6 +476,7 @@ void CharacterX::MoveToNextFrame()
 	// Schedule a Signal command in the queue.
 	const auto currentFenceValue = m_fenceValues[m_frameIndex];
 	ThrowIfFailed(m_commandQueue->Signal(m_fence.get(), currentFenceValue));
+	m_ringBuffer->EndFrame(currentFenceValue);
 
 	// Update the frame index.
 	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
@@ -389,6 +487,7 @@ void CharacterX::MoveToNextFrame()
 		ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_frameIndex], m_fenceEvent));
 		WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
 	}
+	m_ringBuffer->Reclaim(m_fence->GetCompletedValue());
 
 	// Set the fence value for the next frame.
 	m_fenceValues[m_frameIndex] = currentFenceValue + 1;
@@ -412,8 +511,23 @@ double CharacterX::CalculateFrameStats(float *pTimeStep)
 		frameCnt = 0;
 		elapsedTime = totalTime;
 
+		// Animated bones and bone palette uploads of the last frame
+		auto bonesEvaluated = 0u, bonesSkipped = 0u;
+		auto paletteSize = 0u, referenceSize = 0u;
+		for (const auto &character : m_characters)
+		{
+			bonesEvaluated += character->GetPoseStats().FrameBonesEvaluated;
+			bonesSkipped += character->GetPoseStats().FrameBonesSkipped;
+
+			const auto paletteStats = character->GetPaletteStats();
+			paletteSize += paletteStats.UploadSize;
+			referenceSize += paletteStats.ReferenceSize;
+		}
+
 		wstringstream windowText;
 		windowText << setprecision(2) << fixed << L"    fps: " << fps;
+		windowText << L"    bones evaluated: " << bonesEvaluated << L", skipped: " << bonesSkipped;
+		windowText << L"    palettes: " << paletteSize / 1024.0f << L" KB (" << referenceSize / 1024.0f << L" KB in DQ-scale)";
 		SetCustomWindowText(windowText.str().c_str());
 	}
 
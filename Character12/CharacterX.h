@@ -15,6 +15,9 @@
 #include "StepTimer.h"
 #include "Core/XUSG.h"
 #include "Advanced/XUSGCharacter.h"
+#include "Advanced/XUSGJobSystem.h"
+#include "Advanced/XUSGMeshLoader.h"
+#include "Advanced/XUSGSkinningBatcher.h"
 
 using namespace DirectX;
 
@@ -41,6 +44,8 @@ public:
 	virtual void OnMouseWheel(float deltaZ, float posX, float posY);
 	virtual void OnMouseLeave();
 
+	virtual void ParseCommandLineArgs(WCHAR* argv[], int argc);
+
 private:
 	static const uint32_t FrameCount = XUSG::Model::GetFrameCount();
 
@@ -49,6 +54,8 @@ private:
 	std::shared_ptr<XUSG::Compute::PipelineCache>	m_computePipelineCache;
 	std::shared_ptr<XUSG::PipelineLayoutCache>		m_pipelineLayoutCache;
 	std::shared_ptr<XUSG::DescriptorTableCache>		m_descriptorTableCache;
+	std::shared_ptr<XUSG::RingBuffer>				m_ringBuffer;
+	std::shared_ptr<XUSG::UploadManager>			m_uploadManager;
 
 	// Pipeline objects.
 	XUSG::InputLayout		m_inputLayout;
@@ -64,7 +71,10 @@ private:
 	XUSG::CommandList		m_commandList;
 
 	// App resources.
-	std::unique_ptr<XUSG::Character> m_character;
+	std::vector<std::unique_ptr<XUSG::Character>> m_characters;
+	std::unique_ptr<XUSG::JobSystem> m_jobSystem;
+	std::unique_ptr<XUSG::SkinningBatcher> m_skinningBatcher;
+	uint32_t	m_numCharacters;
 	XUSG::RenderTargetTable	m_rtvTables[FrameCount];
 	XUSG::DepthStencil		m_depth;
 	XMFLOAT4X4	m_proj;
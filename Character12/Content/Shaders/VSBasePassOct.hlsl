@@ -0,0 +1,8 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Octahedral normal and tangent, with the binormal reconstructed from a sign bit
+#define VERTEX_OCT 1
+
+#include "VSBasePass.hlsl"
@@ -0,0 +1,9 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Octahedral normal and tangent, and 16-bit positions in the bounding box
+#define VERTEX_OCT 1
+#define VERTEX_QUANTIZED 1
+
+#include "VSBasePass.hlsl"
@@ -0,0 +1,8 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Skin the source vertices in the vertex shader, instead of reading the skinned VB
+#define INLINE_SKINNING 1
+
+#include "VSBasePass.hlsl"
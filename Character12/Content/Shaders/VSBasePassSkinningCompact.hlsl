@@ -0,0 +1,11 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Bones in 8 dwords with a sparse scaling stream
+#define COMPACT_BONES 1
+
+// Skin the source vertices in the vertex shader, instead of reading the skinned VB
+#define INLINE_SKINNING 1
+
+#include "VSBasePass.hlsl"
@@ -0,0 +1,13 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Definitions
+//--------------------------------------------------------------------------------------
+#define	_CHARACTER_
+
+// Skin the source vertices in the vertex shader, instead of reading the skinned VB
+#define INLINE_SKINNING 1
+
+#include "VSBasePass.hlsli"
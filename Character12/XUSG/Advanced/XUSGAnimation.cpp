@@ -0,0 +1,1320 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "Core/XUSGMacros.h"
+#include "XUSGAnimation.h"
+#include "XUSGAnimationKernel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(_XM_SSE_INTRINSICS_)
+#include <xmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+//--------------------------------------------------------------------------------------
+// SSE operations of the group kernel, 2 passes of 4 lanes per group
+//--------------------------------------------------------------------------------------
+#if defined(_XM_SSE_INTRINSICS_)
+namespace
+{
+	struct AnimationSSE
+	{
+		using V = __m128;
+		static const uint32_t Width = 4;
+
+		static V Load(const float *p) { return _mm_loadu_ps(p); }
+		static void Store(float *p, V a) { _mm_storeu_ps(p, a); }
+		static V Set(float f) { return _mm_set_ps1(f); }
+		static V Add(V a, V b) { return _mm_add_ps(a, b); }
+		static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+		static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+		static V Div(V a, V b) { return _mm_div_ps(a, b); }
+		static V Sqrt(V a) { return _mm_sqrt_ps(a); }
+		static V Xor(V a, V b) { return _mm_xor_ps(a, b); }
+		static V And(V a, V b) { return _mm_and_ps(a, b); }
+
+		// Transpose the 4 SoA component registers into one matrix row per bone
+		static void StoreRows(XMFLOAT4X4 *pOut, uint32_t row, V a, V b, V c, V d)
+		{
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+			_mm_storeu_ps(pOut[0].m[row], a);
+			_mm_storeu_ps(pOut[1].m[row], b);
+			_mm_storeu_ps(pOut[2].m[row], c);
+			_mm_storeu_ps(pOut[3].m[row], d);
+		}
+	};
+}
+
+// AVX2 needs the CPU support, and the OS saving the YMM registers
+static bool isAVX2Supported()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	C_RETURN(info[0] < 7, false);
+
+	__cpuid(info, 1);
+	const auto osxsave = 1 << 27;
+	const auto avx = 1 << 28;
+	C_RETURN((info[2] & (osxsave | avx)) != (osxsave | avx), false);
+	C_RETURN((_xgetbv(0) & 0x6) != 0x6, false);
+
+	__cpuidex(info, 7, 0);
+
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__)
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
+#endif
+
+//--------------------------------------------------------------------------------------
+// Scalar reference of the group kernel
+//--------------------------------------------------------------------------------------
+static void interpolateLane(float tr[3], float q[4], float sc[3], const AnimationTracks::KeyGroup &k0,
+	const AnimationTracks::KeyGroup &k1, float blend, uint32_t j)
+{
+	for (auto i = 0u; i < 3; ++i)
+	{
+		tr[i] = k0.Translation[i][j] + (k1.Translation[i][j] - k0.Translation[i][j]) * blend;
+		sc[i] = k0.Scaling[i][j] + (k1.Scaling[i][j] - k0.Scaling[i][j]) * blend;
+	}
+
+	auto dot = 0.0f;
+	for (auto i = 0u; i < 4; ++i) dot += k0.Rotation[i][j] * k1.Rotation[i][j];
+	const auto sign = dot < 0.0f ? -1.0f : 1.0f;
+
+	auto len = 0.0f;
+	for (auto i = 0u; i < 4; ++i)
+	{
+		q[i] = k0.Rotation[i][j] + (k1.Rotation[i][j] * sign - k0.Rotation[i][j]) * blend;
+		len += q[i] * q[i];
+	}
+	len = sqrt(len);
+	for (auto i = 0u; i < 4; ++i) q[i] /= len;
+}
+
+static void evaluateGroupReference(XMFLOAT4X4 *pOut, const AnimationTracks::KeyGroup &k0,
+	const AnimationTracks::KeyGroup &k1, float blend)
+{
+	for (auto j = 0u; j < AnimationTracks::GroupWidth; ++j)
+	{
+		float tr[3], q[4], sc[3];
+		interpolateLane(tr, q, sc, k0, k1, blend, j);
+
+		const auto &x = q[0], &y = q[1], &z = q[2], &w = q[3];
+		pOut[j] = XMFLOAT4X4(
+			(1.0f - 2.0f * (y * y + z * z)) * sc[0], 2.0f * (x * y + z * w) * sc[0], 2.0f * (x * z - y * w) * sc[0], 0.0f,
+			2.0f * (x * y - z * w) * sc[1], (1.0f - 2.0f * (x * x + z * z)) * sc[1], 2.0f * (y * z + x * w) * sc[1], 0.0f,
+			2.0f * (x * z + y * w) * sc[2], 2.0f * (y * z - x * w) * sc[2], (1.0f - 2.0f * (x * x + y * y)) * sc[2], 0.0f,
+			tr[0], tr[1], tr[2], 1.0f);
+	}
+}
+
+static void evaluateGroupReference(BoneTransform *pOut, const AnimationTracks::KeyGroup &k0,
+	const AnimationTracks::KeyGroup &k1, float blend)
+{
+	for (auto j = 0u; j < AnimationTracks::GroupWidth; ++j)
+	{
+		float tr[3], q[4], sc[3];
+		interpolateLane(tr, q, sc, k0, k1, blend, j);
+
+		pOut[j].Rotation = XMFLOAT4(q);
+		pOut[j].Translation = XMFLOAT3(tr);
+		pOut[j].Scaling = XMFLOAT3(sc);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Bone transform
+//--------------------------------------------------------------------------------------
+BoneTransform BoneTransform::Identity()
+{
+	return BoneTransform{ XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) };
+}
+
+BoneTransform BoneTransform::FromMatrix(FXMMATRIX m)
+{
+	XMVECTOR scaling, rotation, translation;
+	XMMatrixDecompose(&scaling, &rotation, &translation, m);
+
+	BoneTransform transform;
+	XMStoreFloat4(&transform.Rotation, rotation);
+	XMStoreFloat3(&transform.Translation, translation);
+	XMStoreFloat3(&transform.Scaling, scaling);
+
+	return transform;
+}
+
+// Uniformly scaled rotation without reflection: the rows are orthogonal, of the same length
+bool BoneTransform::FromUniformMatrix(BoneTransform &transform, FXMMATRIX m)
+{
+	static const auto tolerance = 1e-4f;
+
+	const auto lengthSq = XMVectorGetX(XMVector3LengthSq(m.r[0]));
+	C_RETURN(lengthSq <= 0.0f, false);
+	C_RETURN(fabs(XMVectorGetX(XMVector3LengthSq(m.r[1])) - lengthSq) > tolerance * lengthSq, false);
+	C_RETURN(fabs(XMVectorGetX(XMVector3LengthSq(m.r[2])) - lengthSq) > tolerance * lengthSq, false);
+	C_RETURN(fabs(XMVectorGetX(XMVector3Dot(m.r[0], m.r[1]))) > tolerance * lengthSq, false);
+	C_RETURN(fabs(XMVectorGetX(XMVector3Dot(m.r[0], m.r[2]))) > tolerance * lengthSq, false);
+	C_RETURN(fabs(XMVectorGetX(XMVector3Dot(m.r[1], m.r[2]))) > tolerance * lengthSq, false);
+	C_RETURN(XMVectorGetX(XMVector3Dot(XMVector3Cross(m.r[0], m.r[1]), m.r[2])) < 0.0f, false);
+
+	const auto scale = sqrt(lengthSq);
+	const auto invScale = XMVectorReplicate(1.0f / scale);
+
+	XMMATRIX rotation;
+	rotation.r[0] = XMVectorSetW(m.r[0] * invScale, 0.0f);
+	rotation.r[1] = XMVectorSetW(m.r[1] * invScale, 0.0f);
+	rotation.r[2] = XMVectorSetW(m.r[2] * invScale, 0.0f);
+	rotation.r[3] = g_XMIdentityR3;
+
+	XMStoreFloat4(&transform.Rotation, XMQuaternionNormalize(XMQuaternionRotationMatrix(rotation)));
+	XMStoreFloat3(&transform.Translation, m.r[3]);
+	transform.Scaling = XMFLOAT3(scale, scale, scale);
+
+	return true;
+}
+
+BoneTransform BoneTransform::Compose(const BoneTransform &local, const BoneTransform &parent)
+{
+	// Scale, rotate, and then translate the local transform by the parent
+	const auto parentRotation = XMLoadFloat4(&parent.Rotation);
+	const auto parentScaling = XMLoadFloat3(&parent.Scaling);
+	const auto translation = XMVector3Rotate(XMLoadFloat3(&local.Translation) * parentScaling, parentRotation);
+
+	BoneTransform transform;
+	XMStoreFloat4(&transform.Rotation, XMQuaternionMultiply(XMLoadFloat4(&local.Rotation), parentRotation));
+	XMStoreFloat3(&transform.Translation, translation + XMLoadFloat3(&parent.Translation));
+	XMStoreFloat3(&transform.Scaling, XMLoadFloat3(&local.Scaling) * parentScaling);
+
+	return transform;
+}
+
+BoneTransform BoneTransform::Blend(const BoneTransform &a, const BoneTransform &b, float t)
+{
+	// Nlerp the rotations along the shortest arc, and lerp the rest
+	const auto qa = XMLoadFloat4(&a.Rotation);
+	auto qb = XMLoadFloat4(&b.Rotation);
+	if (XMVectorGetX(XMVector4Dot(qa, qb)) < 0.0f) qb = XMVectorNegate(qb);
+
+	BoneTransform transform;
+	XMStoreFloat4(&transform.Rotation, XMQuaternionNormalize(XMVectorLerp(qa, qb, t)));
+	XMStoreFloat3(&transform.Translation, XMVectorLerp(XMLoadFloat3(&a.Translation), XMLoadFloat3(&b.Translation), t));
+	XMStoreFloat3(&transform.Scaling, XMVectorLerp(XMLoadFloat3(&a.Scaling), XMLoadFloat3(&b.Scaling), t));
+
+	return transform;
+}
+
+XMMATRIX BoneTransform::ToMatrix() const
+{
+	const auto scaling = XMLoadFloat3(&Scaling);
+
+	auto m = XMMatrixRotationQuaternion(XMLoadFloat4(&Rotation));
+	m.r[0] *= XMVectorSplatX(scaling);
+	m.r[1] *= XMVectorSplatY(scaling);
+	m.r[2] *= XMVectorSplatZ(scaling);
+	m.r[3] = XMVectorSetW(XMLoadFloat3(&Translation), 1.0f);
+
+	return m;
+}
+
+// Convert the rotation and translation to a unit dual quaternion, and append the scaling
+XMMATRIX BoneTransform::ToDualQuat() const
+{
+	const auto &q = Rotation;
+	const auto &t = Translation;
+
+	XMMATRIX dualQuat;
+	dualQuat.r[0] = XMLoadFloat4(&Rotation);
+	dualQuat.r[1] = XMVectorSet(
+		0.5f * (t.x * q.w + t.y * q.z - t.z * q.y),
+		0.5f * (-t.x * q.z + t.y * q.w + t.z * q.x),
+		0.5f * (t.x * q.y - t.y * q.x + t.z * q.w),
+		-0.5f * (t.x * q.x + t.y * q.y + t.z * q.z));
+	dualQuat.r[2] = XMLoadFloat3(&Scaling);
+	dualQuat.r[3] = g_XMZero;
+
+	return dualQuat;
+}
+
+//--------------------------------------------------------------------------------------
+// Animation tracks
+//--------------------------------------------------------------------------------------
+template<typename T>
+static void evaluateTracks(const AnimationTracks &tracks, AnimationKernel kernel, T *pLocalTransforms,
+	uint32_t key, uint32_t nextKey, float blend, const uint8_t *pGroupHeights, uint8_t minHeight)
+{
+	const auto numTracks = tracks.GetNumTracks();
+	const auto numGroups = tracks.GetNumGroups();
+
+	T groupTransforms[AnimationTracks::GroupWidth];
+	for (auto g = 0u; g < numGroups; ++g)
+	{
+		if (pGroupHeights && pGroupHeights[g] < minHeight) continue;
+
+		// The last group may be partial, so it is evaluated into the scratch
+		const auto first = AnimationTracks::GroupWidth * g;
+		const auto count = (min)(AnimationTracks::GroupWidth, numTracks - first);
+		const auto pOut = count < AnimationTracks::GroupWidth ? groupTransforms : &pLocalTransforms[first];
+		const auto &k0 = *tracks.GetKeyGroup(key, g);
+		const auto &k1 = *tracks.GetKeyGroup(nextKey, g);
+
+		switch (kernel)
+		{
+#if defined(_XM_SSE_INTRINSICS_)
+		case ANIMATION_KERNEL_AVX2:
+			AnimationSIMD::EvaluateGroupAVX2(pOut, k0, k1, blend);
+			break;
+		case ANIMATION_KERNEL_SSE:
+			AnimationSIMD::EvaluateGroup<AnimationSSE>(pOut, k0, k1, blend);
+			break;
+#endif
+		default:
+			evaluateGroupReference(pOut, k0, k1, blend);
+		}
+
+		if (pOut == groupTransforms) memcpy(&pLocalTransforms[first], groupTransforms, sizeof(T) * count);
+	}
+}
+
+AnimationTracks::AnimationTracks() :
+	m_keyGroups(0),
+	m_numTracks(0),
+	m_numKeys(0),
+	m_numGroups(0),
+	m_kernel(GetBestKernel())
+{
+}
+
+AnimationTracks::~AnimationTracks()
+{
+}
+
+bool AnimationTracks::Create(const SDKAnimationFrameData *pFrameData, uint32_t numTracks, uint32_t numKeys)
+{
+	Destroy();
+	N_RETURN(pFrameData && numTracks > 0 && numKeys > 0, false);
+
+	m_numTracks = numTracks;
+	m_numKeys = numKeys;
+	m_numGroups = (numTracks + GroupWidth - 1) / GroupWidth;
+	m_keyGroups.resize(m_numGroups * m_numKeys);
+
+	// Transpose the keys; unused lanes keep identity transforms
+	for (auto k = 0u; k < m_numKeys; ++k)
+	{
+		for (auto g = 0u; g < m_numGroups; ++g)
+		{
+			auto &keyGroup = m_keyGroups[m_numGroups * k + g];
+
+			for (auto j = 0u; j < GroupWidth; ++j)
+			{
+				const auto i = GroupWidth * g + j;
+				auto data = i < numTracks ? pFrameData[i].pAnimationData[k] :
+					SDKAnimationData{ XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) };
+
+				// Bake the zero quaternion as identity
+				const auto &r = data.Orientation;
+				if (r.x == 0.0f && r.y == 0.0f && r.z == 0.0f && r.w == 0.0f) data.Orientation.w = 1.0f;
+
+				keyGroup.Translation[0][j] = data.Translation.x;
+				keyGroup.Translation[1][j] = data.Translation.y;
+				keyGroup.Translation[2][j] = data.Translation.z;
+				keyGroup.Rotation[0][j] = data.Orientation.x;
+				keyGroup.Rotation[1][j] = data.Orientation.y;
+				keyGroup.Rotation[2][j] = data.Orientation.z;
+				keyGroup.Rotation[3][j] = data.Orientation.w;
+				keyGroup.Scaling[0][j] = data.Scaling.x;
+				keyGroup.Scaling[1][j] = data.Scaling.y;
+				keyGroup.Scaling[2][j] = data.Scaling.z;
+			}
+		}
+	}
+
+	return true;
+}
+
+void AnimationTracks::Destroy()
+{
+	m_keyGroups.clear();
+	m_keyGroups.shrink_to_fit();
+	m_numTracks = 0;
+	m_numKeys = 0;
+	m_numGroups = 0;
+}
+
+void AnimationTracks::Evaluate(XMFLOAT4X4 *pLocalTransforms, uint32_t key,
+	uint32_t nextKey, float blend) const
+{
+	evaluateTracks(*this, m_kernel, pLocalTransforms, key, nextKey, blend, nullptr, 0);
+}
+
+void AnimationTracks::EvaluateReference(XMFLOAT4X4 *pLocalTransforms, uint32_t key,
+	uint32_t nextKey, float blend) const
+{
+	evaluateTracks(*this, ANIMATION_KERNEL_SCALAR, pLocalTransforms, key, nextKey, blend, nullptr, 0);
+}
+
+void AnimationTracks::Evaluate(BoneTransform *pLocalTransforms, uint32_t key,
+	uint32_t nextKey, float blend, const uint8_t *pGroupHeights, uint8_t minHeight) const
+{
+	evaluateTracks(*this, m_kernel, pLocalTransforms, key, nextKey, blend, pGroupHeights, minHeight);
+}
+
+void AnimationTracks::EvaluateReference(BoneTransform *pLocalTransforms, uint32_t key,
+	uint32_t nextKey, float blend, const uint8_t *pGroupHeights, uint8_t minHeight) const
+{
+	evaluateTracks(*this, ANIMATION_KERNEL_SCALAR, pLocalTransforms, key, nextKey, blend, pGroupHeights, minHeight);
+}
+
+SDKAnimationData AnimationTracks::GetKey(uint32_t track, uint32_t key) const
+{
+	const auto &keyGroup = *GetKeyGroup(key, track / GroupWidth);
+	const auto j = track % GroupWidth;
+
+	SDKAnimationData data;
+	data.Translation = XMFLOAT3(keyGroup.Translation[0][j], keyGroup.Translation[1][j], keyGroup.Translation[2][j]);
+	data.Orientation = XMFLOAT4(keyGroup.Rotation[0][j], keyGroup.Rotation[1][j], keyGroup.Rotation[2][j], keyGroup.Rotation[3][j]);
+	data.Scaling = XMFLOAT3(keyGroup.Scaling[0][j], keyGroup.Scaling[1][j], keyGroup.Scaling[2][j]);
+
+	return data;
+}
+
+void AnimationTracks::DecodeKey(SDKAnimationData *pKeyData, uint32_t key) const
+{
+	for (auto i = 0u; i < m_numTracks; ++i) pKeyData[i] = GetKey(i, key);
+}
+
+bool AnimationTracks::SetKernel(AnimationKernel kernel)
+{
+	C_RETURN(kernel > GetBestKernel(), false);
+	m_kernel = kernel;
+
+	return true;
+}
+
+AnimationKernel AnimationTracks::GetKernel() const
+{
+	return m_kernel;
+}
+
+AnimationKernel AnimationTracks::GetBestKernel()
+{
+#if defined(_XM_SSE_INTRINSICS_)
+	static const auto kernel = isAVX2Supported() ? ANIMATION_KERNEL_AVX2 : ANIMATION_KERNEL_SSE;
+
+	return kernel;
+#else
+	return ANIMATION_KERNEL_SCALAR;
+#endif
+}
+
+uint32_t AnimationTracks::GetNumTracks() const
+{
+	return m_numTracks;
+}
+
+uint32_t AnimationTracks::GetNumKeys() const
+{
+	return m_numKeys;
+}
+
+uint32_t AnimationTracks::GetNumGroups() const
+{
+	return m_numGroups;
+}
+
+const AnimationTracks::KeyGroup *AnimationTracks::GetKeyGroup(uint32_t key, uint32_t group) const
+{
+	return &m_keyGroups[m_numGroups * key + group];
+}
+
+//--------------------------------------------------------------------------------------
+// Compressed animation format
+//--------------------------------------------------------------------------------------
+struct CompressedAnimation::Header
+{
+	uint32_t	Magic;
+	uint32_t	Version;
+	uint32_t	NumFrames;
+	uint32_t	NumAnimationKeys;
+	uint32_t	AnimationFPS;
+	uint32_t	NumChannels;
+	uint32_t	NumKeyIndices;
+	uint32_t	NumValues;
+};
+
+struct CompressedAnimation::FrameData
+{
+	char		FrameName[MAX_FRAME_NAME];
+	uint32_t	Channels[3];	// Translation, rotation and scaling; identity channels are INVALID_CHANNEL
+};
+
+struct CompressedAnimation::Channel
+{
+	uint32_t	NumKeys;		// 0 for a constant channel
+	uint32_t	KeyOffset;		// Into the key indices
+	uint32_t	ValueOffset;	// Into the values, 3 words per key
+	float		Base[4];		// Constant value, or the minimum of the quantization range
+	float		Extent[4];		// Extent of the quantization range
+};
+
+static const uint32_t INVALID_CHANNEL = UINT32_MAX;
+static const auto SQRT2 = 1.41421356f;
+
+enum AnimationChannel : uint8_t
+{
+	CHANNEL_TRANSLATION,
+	CHANNEL_ROTATION,
+	CHANNEL_SCALING,
+
+	NUM_CHANNEL
+};
+
+static XMVECTOR loadChannel(const SDKAnimationData &data, uint8_t channel)
+{
+	switch (channel)
+	{
+	case CHANNEL_TRANSLATION:
+		return XMLoadFloat3(&data.Translation);
+	case CHANNEL_ROTATION:
+	{
+		const auto quat = XMLoadFloat4(&data.Orientation);
+		return XMVector4Equal(quat, g_XMZero) ? XMQuaternionIdentity() : XMQuaternionNormalize(quat);
+	}
+	default:
+		return XMLoadFloat3(&data.Scaling);
+	}
+}
+
+static void storeChannel(SDKAnimationData &data, uint8_t channel, FXMVECTOR value)
+{
+	switch (channel)
+	{
+	case CHANNEL_TRANSLATION:
+		XMStoreFloat3(&data.Translation, value);
+		break;
+	case CHANNEL_ROTATION:
+		XMStoreFloat4(&data.Orientation, value);
+		break;
+	default:
+		XMStoreFloat3(&data.Scaling, value);
+	}
+}
+
+// Error between 2 channel values: distance for translation and scale, angle for rotation
+static float channelError(FXMVECTOR a, FXMVECTOR b, uint8_t channel)
+{
+	if (channel == CHANNEL_ROTATION)
+	{
+		// Rotation angle from the chord length, which stays precise for small angles
+		const auto chord = (min)(XMVectorGetX(XMVector4Length(XMVectorSubtract(a, b))),
+			XMVectorGetX(XMVector4Length(XMVectorAdd(a, b))));
+		return 4.0f * asin((min)(chord * 0.5f, 1.0f));
+	}
+
+	return XMVectorGetX(XMVector3Length(XMVectorSubtract(a, b)));
+}
+
+static XMVECTOR interpolateChannel(FXMVECTOR a, FXMVECTOR b, float t, uint8_t channel)
+{
+	if (channel == CHANNEL_ROTATION)
+	{
+		const auto c = XMVectorGetX(XMVector4Dot(a, b)) < 0.0f ? XMVectorNegate(b) : b;
+		return XMQuaternionNormalize(XMVectorLerp(a, c, t));
+	}
+
+	return XMVectorLerp(a, b, t);
+}
+
+// Smallest three: the largest component is dropped and the others are quantized to 15 bits
+static void encodeQuaternion(uint16_t *pWords, FXMVECTOR quat)
+{
+	XMFLOAT4 q;
+	XMStoreFloat4(&q, quat);
+	float c[] = { q.x, q.y, q.z, q.w };
+
+	auto largest = 0u;
+	for (auto i = 1u; i < 4; ++i) largest = fabs(c[i]) > fabs(c[largest]) ? i : largest;
+	const auto sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+	uint64_t bits = largest;
+	for (auto i = 0u, j = 0u; i < 4; ++i)
+	{
+		if (i == largest) continue;
+		const auto v = (min)((max)(c[i] * sign * SQRT2 * 0.5f + 0.5f, 0.0f), 1.0f);
+		bits |= static_cast<uint64_t>(static_cast<uint32_t>(v * 32767.0f + 0.5f)) << (2 + 15 * j++);
+	}
+
+	pWords[0] = static_cast<uint16_t>(bits);
+	pWords[1] = static_cast<uint16_t>(bits >> 16);
+	pWords[2] = static_cast<uint16_t>(bits >> 32);
+}
+
+static XMVECTOR decodeQuaternion(const uint16_t *pWords)
+{
+	const auto bits = static_cast<uint64_t>(pWords[0]) | (static_cast<uint64_t>(pWords[1]) << 16) |
+		(static_cast<uint64_t>(pWords[2]) << 32);
+	const auto largest = static_cast<uint32_t>(bits & 0x3);
+
+	float c[4];
+	auto sum = 0.0f;
+	for (auto i = 0u, j = 0u; i < 4; ++i)
+	{
+		if (i == largest) continue;
+		const auto v = static_cast<float>((bits >> (2 + 15 * j++)) & 0x7fff) / 32767.0f;
+		c[i] = (v * 2.0f - 1.0f) / SQRT2;
+		sum += c[i] * c[i];
+	}
+	c[largest] = sqrt((max)(1.0f - sum, 0.0f));
+
+	return XMQuaternionNormalize(XMVectorSet(c[0], c[1], c[2], c[3]));
+}
+
+// Translation and scale, quantized to 16 bits over the channel range
+static XMVECTOR decodeValue(const uint16_t *pWords, const float base[4], const float extent[4])
+{
+	const auto norm = XMVectorScale(XMVectorSet(pWords[0], pWords[1], pWords[2], 0.0f), 1.0f / 65535.0f);
+
+	return XMVectorMultiplyAdd(norm, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(extent)),
+		XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(base)));
+}
+
+// File stream of a wide path; other than MSVC, the standard library only takes narrow ones
+template<typename Stream>
+static Stream openFile(const wchar_t *fileName, ios::openmode mode)
+{
+#ifdef _MSC_VER
+	return Stream(fileName, mode);
+#else
+	const wstring wideName(fileName);
+	string name;
+	for (const auto &c : wideName) name.push_back(static_cast<char>(c));
+
+	return Stream(name, mode);
+#endif
+}
+
+// Read a raw .sdkmesh_anim file
+static bool loadRawAnimation(const wchar_t *fileName, vector<uint8_t> &animation)
+{
+	auto fileStream = openFile<ifstream>(fileName, ios::in | ios::binary);
+	M_RETURN(!fileStream, cerr, "Failed to open the file.", false);
+
+	// Read header
+	SDKAnimationFileHeader fileheader;
+	M_RETURN(!fileStream.read(reinterpret_cast<char*>(&fileheader), sizeof(SDKAnimationFileHeader)),
+		cerr, "Failed to read the file.", false);
+
+	// Allocate
+	animation.resize(static_cast<size_t>(sizeof(SDKAnimationFileHeader) + fileheader.AnimationDataSize));
+
+	// Read it all in
+	M_RETURN(!fileStream.seekg(0), cerr, "Failed to read the file.", false);
+
+	const auto cBytes = static_cast<streamsize>(animation.size());
+	M_RETURN(!fileStream.read(reinterpret_cast<char*>(animation.data()), cBytes),
+		cerr, "Failed to read the file.", false);
+
+	fileStream.close();
+
+	return true;
+}
+
+CompressedAnimation::CompressedAnimation() :
+	m_data(0),
+	m_pHeader(nullptr),
+	m_pFrameData(nullptr),
+	m_pChannels(nullptr),
+	m_pKeyIndices(nullptr),
+	m_pValues(nullptr)
+{
+}
+
+CompressedAnimation::~CompressedAnimation()
+{
+}
+
+bool CompressedAnimation::Create(const AnimationClip &clip, const Settings &settings)
+{
+	Destroy();
+	M_RETURN(!clip.GetHeader() || clip.IsCompressed(), cerr, "A raw animation is required.", false);
+
+	const auto &header = *clip.GetHeader();
+	const auto &tracks = clip.GetTracks();
+	M_RETURN(header.FrameTransformType != FTT_RELATIVE, cerr,
+		"Only relative frame transforms can be compressed.", false);
+	M_RETURN(header.NumAnimationKeys < 2 || header.NumAnimationKeys > UINT16_MAX, cerr,
+		"Unsupported number of animation keys.", false);
+
+	const float tolerances[] = { settings.TranslationTolerance, settings.RotationTolerance, settings.ScalingTolerance };
+	const XMVECTOR identities[] = { g_XMZero, XMQuaternionIdentity(), g_XMOne };
+	const auto numKeys = header.NumAnimationKeys;
+
+	vector<FrameData> frames(header.NumFrames);
+	vector<Channel> channels;
+	vector<uint16_t> keyIndices;
+	vector<uint16_t> values;
+	vector<XMVECTOR> source(numKeys);
+	vector<XMVECTOR> quantized(numKeys);
+	vector<uint16_t> words(3 * numKeys);
+	vector<uint32_t> keys;
+
+	for (auto i = 0u; i < header.NumFrames; ++i)
+	{
+		auto &frame = frames[i];
+		memcpy(frame.FrameName, clip.GetFrameName(i), sizeof(frame.FrameName));
+
+		for (uint8_t c = 0; c < NUM_CHANNEL; ++c)
+		{
+			const auto tolerance = tolerances[c];
+			for (auto k = 0u; k < numKeys; ++k)
+			{
+				// Keep the rotations in a continuous hemisphere
+				source[k] = loadChannel(tracks.GetKey(i, k), c);
+				if (c == CHANNEL_ROTATION && k > 0 && XMVectorGetX(XMVector4Dot(source[k], source[k - 1])) < 0.0f)
+					source[k] = XMVectorNegate(source[k]);
+			}
+
+			// Remove identity channels
+			auto isIdentity = true;
+			auto isConstant = true;
+			for (auto k = 0u; k < numKeys; ++k)
+			{
+				isIdentity = isIdentity && channelError(source[k], identities[c], c) <= tolerance;
+				isConstant = isConstant && channelError(source[k], source[0], c) <= tolerance;
+			}
+
+			frame.Channels[c] = INVALID_CHANNEL;
+			if (isIdentity) continue;
+
+			frame.Channels[c] = static_cast<uint32_t>(channels.size());
+			Channel channel = {};
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(channel.Base), source[0]);
+			if (!isConstant)
+			{
+				// Quantize all the keys first, over the range of the whole channel, so that
+				// the key reduction below bounds the error of the decoded values
+				if (c != CHANNEL_ROTATION)
+				{
+					auto vMin = source[0];
+					auto vMax = vMin;
+					for (auto k = 1u; k < numKeys; ++k)
+					{
+						vMin = XMVectorMin(vMin, source[k]);
+						vMax = XMVectorMax(vMax, source[k]);
+					}
+					XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(channel.Base), vMin);
+					XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(channel.Extent), XMVectorSubtract(vMax, vMin));
+				}
+
+				for (auto k = 0u; k < numKeys; ++k)
+				{
+					const auto pWords = &words[3 * k];
+					if (c == CHANNEL_ROTATION)
+					{
+						encodeQuaternion(pWords, source[k]);
+						quantized[k] = decodeQuaternion(pWords);
+					}
+					else
+					{
+						XMFLOAT4 v;
+						XMStoreFloat4(&v, source[k]);
+						const float comps[] = { v.x, v.y, v.z };
+						for (auto j = 0u; j < 3; ++j)
+						{
+							const auto extent = channel.Extent[j];
+							const auto n = extent > 0.0f ? (comps[j] - channel.Base[j]) / extent : 0.0f;
+							pWords[j] = static_cast<uint16_t>((min)((max)(n, 0.0f), 1.0f) * 65535.0f + 0.5f);
+						}
+						quantized[k] = decodeValue(pWords, channel.Base, channel.Extent);
+					}
+				}
+
+				// Greedy key reduction: key 0 is the reference pose and key 1 starts the loop,
+				// then extend each segment as long as the skipped keys stay within the tolerance
+				keys.assign({ 0, 1 });
+				for (auto a = 1u; a < numKeys - 1;)
+				{
+					auto b = a + 1;
+					for (auto e = b + 1; e < numKeys; ++e)
+					{
+						auto isValid = true;
+						for (auto k = a + 1; k < e && isValid; ++k)
+						{
+							const auto t = static_cast<float>(k - a) / (e - a);
+							isValid = channelError(interpolateChannel(quantized[a], quantized[e], t, c), source[k], c) <= tolerance;
+						}
+						if (!isValid) break;
+						b = e;
+					}
+					keys.push_back(b);
+					a = b;
+				}
+
+				channel.NumKeys = static_cast<uint32_t>(keys.size());
+				channel.KeyOffset = static_cast<uint32_t>(keyIndices.size());
+				channel.ValueOffset = static_cast<uint32_t>(values.size());
+
+				for (const auto &k : keys)
+				{
+					keyIndices.push_back(static_cast<uint16_t>(k));
+					values.insert(values.end(), &words[3 * k], &words[3 * k + 3]);
+				}
+			}
+
+			channels.push_back(channel);
+		}
+	}
+
+	// Layout: header, frame data, channels, key indices, then values
+	const auto frameDataSize = sizeof(FrameData) * frames.size();
+	const auto channelSize = sizeof(Channel) * channels.size();
+	const auto keyIndexSize = sizeof(uint16_t) * keyIndices.size();
+	m_data.resize(sizeof(Header) + frameDataSize + channelSize + keyIndexSize + sizeof(uint16_t) * values.size());
+
+	const auto pHeader = reinterpret_cast<Header*>(m_data.data());
+	pHeader->Magic = Magic;
+	pHeader->Version = Version;
+	pHeader->NumFrames = header.NumFrames;
+	pHeader->NumAnimationKeys = numKeys;
+	pHeader->AnimationFPS = header.AnimationFPS;
+	pHeader->NumChannels = static_cast<uint32_t>(channels.size());
+	pHeader->NumKeyIndices = static_cast<uint32_t>(keyIndices.size());
+	pHeader->NumValues = static_cast<uint32_t>(values.size());
+
+	auto pDst = m_data.data() + sizeof(Header);
+	memcpy(pDst, frames.data(), frameDataSize);
+	memcpy(pDst += frameDataSize, channels.data(), channelSize);
+	memcpy(pDst += channelSize, keyIndices.data(), keyIndexSize);
+	memcpy(pDst += keyIndexSize, values.data(), sizeof(uint16_t) * values.size());
+	fixup();
+
+	return true;
+}
+
+bool CompressedAnimation::Load(const wchar_t *fileName)
+{
+	Destroy();
+
+	auto fileStream = openFile<ifstream>(fileName, ios::in | ios::binary | ios::ate);
+	M_RETURN(!fileStream, cerr, "Failed to open the file.", false);
+
+	const auto fileSize = static_cast<size_t>(fileStream.tellg());
+	M_RETURN(fileSize < sizeof(Header), cerr, "Invalid compressed animation.", false);
+	m_data.resize(fileSize);
+
+	M_RETURN(!fileStream.seekg(0), cerr, "Failed to read the file.", false);
+	M_RETURN(!fileStream.read(reinterpret_cast<char*>(m_data.data()), fileSize),
+		cerr, "Failed to read the file.", false);
+	fileStream.close();
+
+	if (!validate())
+	{
+		Destroy();
+		M_RETURN(true, cerr, "Invalid compressed animation.", false);
+	}
+	fixup();
+
+	return true;
+}
+
+bool CompressedAnimation::Save(const wchar_t *fileName) const
+{
+	M_RETURN(IsEmpty(), cerr, "No compressed animation is created.", false);
+
+	auto fileStream = openFile<ofstream>(fileName, ios::out | ios::binary | ios::trunc);
+	M_RETURN(!fileStream, cerr, "Failed to open the file.", false);
+	M_RETURN(!fileStream.write(reinterpret_cast<const char*>(m_data.data()), m_data.size()),
+		cerr, "Failed to write the file.", false);
+	fileStream.close();
+
+	return true;
+}
+
+void CompressedAnimation::Destroy()
+{
+	m_data.clear();
+	m_data.shrink_to_fit();
+	m_pHeader = nullptr;
+	m_pFrameData = nullptr;
+	m_pChannels = nullptr;
+	m_pKeyIndices = nullptr;
+	m_pValues = nullptr;
+}
+
+void CompressedAnimation::DecodeKey(SDKAnimationData *pKeyData, uint32_t key) const
+{
+	const XMVECTOR identities[] = { g_XMZero, XMQuaternionIdentity(), g_XMOne };
+
+	for (auto i = 0u; i < m_pHeader->NumFrames; ++i)
+	{
+		for (uint8_t c = 0; c < NUM_CHANNEL; ++c)
+		{
+			const auto &channelIndex = m_pFrameData[i].Channels[c];
+			if (channelIndex == INVALID_CHANNEL)
+			{
+				storeChannel(pKeyData[i], c, identities[c]);
+				continue;
+			}
+
+			const auto &channel = m_pChannels[channelIndex];
+			if (channel.NumKeys == 0)
+			{
+				storeChannel(pKeyData[i], c, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(channel.Base)));
+				continue;
+			}
+
+			// Find the stored keys around the key
+			const auto pKeys = &m_pKeyIndices[channel.KeyOffset];
+			const auto n = static_cast<uint32_t>(upper_bound(pKeys, pKeys + channel.NumKeys, key) - pKeys);
+			const auto k0 = n > 0 ? n - 1 : 0;
+			const auto k1 = (min)(k0 + 1, channel.NumKeys - 1);
+
+			const auto decode = [&](uint32_t k)
+			{
+				const auto pWords = &m_pValues[channel.ValueOffset + 3 * k];
+
+				return c == CHANNEL_ROTATION ? decodeQuaternion(pWords) : decodeValue(pWords, channel.Base, channel.Extent);
+			};
+
+			auto value = decode(k0);
+			if (pKeys[k0] != key && k1 != k0)
+			{
+				const auto t = static_cast<float>(key - pKeys[k0]) / (pKeys[k1] - pKeys[k0]);
+				value = interpolateChannel(value, decode(k1), t, c);
+			}
+
+			storeChannel(pKeyData[i], c, value);
+		}
+	}
+}
+
+void CompressedAnimation::Measure(const AnimationClip &source, Report &report) const
+{
+	const auto numFrames = m_pHeader->NumFrames;
+	const auto numKeys = m_pHeader->NumAnimationKeys;
+
+	report.CompressedBytes = m_data.size();
+	report.NumChannels = numFrames * NUM_CHANNEL;
+	report.NumIdentityChannels = 0;
+	report.NumConstantChannels = 0;
+	report.NumSourceKeys = static_cast<uint64_t>(report.NumChannels) * numKeys;
+	report.NumStoredKeys = 0;
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		for (const auto &channelIndex : m_pFrameData[i].Channels)
+		{
+			if (channelIndex == INVALID_CHANNEL) ++report.NumIdentityChannels;
+			else if (m_pChannels[channelIndex].NumKeys == 0) ++report.NumConstantChannels;
+			report.NumStoredKeys += channelIndex == INVALID_CHANNEL ? 0 :
+				(max)(m_pChannels[channelIndex].NumKeys, 1u);
+		}
+	}
+
+	// Errors against the source
+	float maxErrors[NUM_CHANNEL] = {};
+	vector<SDKAnimationData> keyData(numFrames);
+	vector<SDKAnimationData> sourceKeyData(numFrames);
+	for (auto k = 0u; k < numKeys; ++k)
+	{
+		DecodeKey(keyData.data(), k);
+		source.DecodeKey(sourceKeyData.data(), k);
+		for (auto i = 0u; i < numFrames; ++i)
+			for (uint8_t c = 0; c < NUM_CHANNEL; ++c)
+				maxErrors[c] = (max)(maxErrors[c], channelError(loadChannel(keyData[i], c),
+					loadChannel(sourceKeyData[i], c), c));
+	}
+	report.MaxTranslationError = maxErrors[CHANNEL_TRANSLATION];
+	report.MaxRotationError = maxErrors[CHANNEL_ROTATION];
+	report.MaxScalingError = maxErrors[CHANNEL_SCALING];
+
+	// Decode speed
+	const auto numPasses = 16u;
+	const auto start = chrono::high_resolution_clock::now();
+	for (auto p = 0u; p < numPasses; ++p)
+		for (auto k = 0u; k < numKeys; ++k) DecodeKey(keyData.data(), k);
+	const chrono::duration<double, nano> duration = chrono::high_resolution_clock::now() - start;
+	report.DecodeTimePerKey = duration.count() / (static_cast<double>(numPasses) * numKeys * (max)(numFrames, 1u));
+}
+
+bool CompressedAnimation::IsEmpty() const
+{
+	return m_pHeader == nullptr;
+}
+
+uint32_t CompressedAnimation::GetNumFrames() const
+{
+	return m_pHeader ? m_pHeader->NumFrames : 0;
+}
+
+uint32_t CompressedAnimation::GetNumAnimationKeys() const
+{
+	return m_pHeader ? m_pHeader->NumAnimationKeys : 0;
+}
+
+uint32_t CompressedAnimation::GetAnimationFPS() const
+{
+	return m_pHeader ? m_pHeader->AnimationFPS : 0;
+}
+
+const char *CompressedAnimation::GetFrameName(uint32_t frame) const
+{
+	return m_pFrameData[frame].FrameName;
+}
+
+size_t CompressedAnimation::GetDataSize() const
+{
+	return m_data.size();
+}
+
+bool CompressedAnimation::Convert(const wchar_t *srcFileName, const wchar_t *dstFileName,
+	const Settings &settings, Report *pReport)
+{
+	AnimationClip clip;
+	N_RETURN(clip.Load(srcFileName), false);
+	M_RETURN(clip.IsCompressed(), cerr, "The animation is already compressed.", false);
+
+	CompressedAnimation compressed;
+	N_RETURN(compressed.Create(clip, settings), false);
+	N_RETURN(compressed.Save(dstFileName), false);
+
+	if (pReport)
+	{
+		compressed.Measure(clip, *pReport);
+		pReport->RawBytes = sizeof(SDKAnimationFileHeader) + clip.GetHeader()->AnimationDataSize;
+	}
+
+	return true;
+}
+
+bool CompressedAnimation::validate() const
+{
+	const auto &header = *reinterpret_cast<const Header*>(m_data.data());
+	C_RETURN(header.Magic != Magic || header.Version != Version, false);
+
+	// The tables must fit in the data
+	const auto size = static_cast<uint64_t>(m_data.size());
+	const auto tableSize = sizeof(Header) + sizeof(FrameData) * static_cast<uint64_t>(header.NumFrames) +
+		sizeof(Channel) * static_cast<uint64_t>(header.NumChannels) +
+		sizeof(uint16_t) * (static_cast<uint64_t>(header.NumKeyIndices) + header.NumValues);
+	C_RETURN(tableSize > size, false);
+
+	// Key indices are 16-bit
+	C_RETURN(header.NumAnimationKeys > UINT16_MAX + 1u, false);
+
+	const auto pFrameData = reinterpret_cast<const FrameData*>(m_data.data() + sizeof(Header));
+	const auto pChannels = reinterpret_cast<const Channel*>(&pFrameData[header.NumFrames]);
+	const auto pKeyIndices = reinterpret_cast<const uint16_t*>(&pChannels[header.NumChannels]);
+	for (auto i = 0u; i < header.NumFrames; ++i)
+		for (const auto &channelIndex : pFrameData[i].Channels)
+			C_RETURN(channelIndex != INVALID_CHANNEL && channelIndex >= header.NumChannels, false);
+
+	// The keys of each channel must lie within the streams, in increasing order
+	for (auto i = 0u; i < header.NumChannels; ++i)
+	{
+		const auto &channel = pChannels[i];
+		C_RETURN(static_cast<uint64_t>(channel.KeyOffset) + channel.NumKeys > header.NumKeyIndices, false);
+		C_RETURN(channel.ValueOffset + 3ull * channel.NumKeys > header.NumValues, false);
+
+		const auto pKeys = &pKeyIndices[channel.KeyOffset];
+		for (auto k = 0u; k < channel.NumKeys; ++k)
+			C_RETURN(pKeys[k] >= header.NumAnimationKeys || (k > 0 && pKeys[k] <= pKeys[k - 1]), false);
+	}
+
+	return true;
+}
+
+void CompressedAnimation::fixup()
+{
+	m_pHeader = reinterpret_cast<const Header*>(m_data.data());
+	m_pFrameData = reinterpret_cast<const FrameData*>(m_data.data() + sizeof(Header));
+	m_pChannels = reinterpret_cast<const Channel*>(&m_pFrameData[m_pHeader->NumFrames]);
+	m_pKeyIndices = reinterpret_cast<const uint16_t*>(&m_pChannels[m_pHeader->NumChannels]);
+	m_pValues = &m_pKeyIndices[m_pHeader->NumKeyIndices];
+}
+
+//--------------------------------------------------------------------------------------
+// Animation clip
+//--------------------------------------------------------------------------------------
+AnimationClip::AnimationClip() :
+	m_animation(0),
+	m_pHeader(nullptr),
+	m_pFrameData(nullptr),
+	m_tracks(),
+	m_compressedAnimation(),
+	m_isUniformScaling(true)
+{
+}
+
+AnimationClip::~AnimationClip()
+{
+}
+
+bool AnimationClip::Load(const wchar_t *fileName)
+{
+	// Detect the format
+	auto fileStream = openFile<ifstream>(fileName, ios::in | ios::binary);
+	M_RETURN(!fileStream, cerr, "Failed to open the file.", false);
+
+	uint32_t magic;
+	M_RETURN(!fileStream.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t)),
+		cerr, "Failed to read the file.", false);
+	fileStream.close();
+
+	if (magic == CompressedAnimation::Magic)
+	{
+		N_RETURN(m_compressedAnimation.Load(fileName), false);
+
+		// Only the header is kept uncompressed
+		m_animation.assign(sizeof(SDKAnimationFileHeader), 0);
+		const auto pHeader = reinterpret_cast<SDKAnimationFileHeader*>(m_animation.data());
+		pHeader->FrameTransformType = FTT_RELATIVE;
+		pHeader->NumFrames = m_compressedAnimation.GetNumFrames();
+		pHeader->NumAnimationKeys = m_compressedAnimation.GetNumAnimationKeys();
+		pHeader->AnimationFPS = m_compressedAnimation.GetAnimationFPS();
+		pHeader->AnimationDataOffset = sizeof(SDKAnimationFileHeader);
+		fixup();
+
+		return true;
+	}
+
+	vector<uint8_t> animation;
+	N_RETURN(loadRawAnimation(fileName, animation), false);
+
+	return Create(move(animation));
+}
+
+bool AnimationClip::Create(vector<uint8_t> &&animation)
+{
+	M_RETURN(animation.size() < sizeof(SDKAnimationFileHeader), cerr, "Invalid animation.", false);
+
+	// The frame table and the keys of every frame must lie within the image
+	const auto &header = *reinterpret_cast<const SDKAnimationFileHeader*>(animation.data());
+	const auto size = static_cast<uint64_t>(animation.size());
+	const auto keyDataSize = sizeof(SDKAnimationData) * static_cast<uint64_t>(header.NumAnimationKeys);
+	M_RETURN(header.AnimationDataOffset > size || header.NumFrames >
+		(size - header.AnimationDataOffset) / sizeof(SDKAnimationFrameData), cerr, "Invalid animation.", false);
+
+	const auto pFrameData = reinterpret_cast<const SDKAnimationFrameData*>(animation.data() + header.AnimationDataOffset);
+	for (auto i = 0u; i < header.NumFrames; ++i)
+	{
+		const auto offset = pFrameData[i].DataOffset + sizeof(SDKAnimationFileHeader);
+		M_RETURN(offset < pFrameData[i].DataOffset || offset > size || keyDataSize > size - offset,
+			cerr, "Invalid animation.", false);
+	}
+
+	m_compressedAnimation.Destroy();
+	m_animation = move(animation);
+	fixup();
+
+	return true;
+}
+
+bool AnimationClip::Save(const wchar_t *fileName) const
+{
+	M_RETURN(!m_pHeader, cerr, "No animation is loaded.", false);
+	C_RETURN(IsCompressed(), m_compressedAnimation.Save(fileName));
+
+	// Layout: header, frame data, then the keys of each frame gathered back from the tracks
+	const auto numFrames = m_pHeader->NumFrames;
+	const auto numKeys = m_pHeader->NumAnimationKeys;
+	const auto frameDataSize = sizeof(SDKAnimationFrameData) * numFrames;
+	const auto keyDataSize = sizeof(SDKAnimationData) * numKeys;
+
+	vector<uint8_t> animation(sizeof(SDKAnimationFileHeader) + frameDataSize + keyDataSize * numFrames);
+	const auto pHeader = reinterpret_cast<SDKAnimationFileHeader*>(animation.data());
+	*pHeader = *m_pHeader;
+	pHeader->AnimationDataSize = frameDataSize + keyDataSize * numFrames;
+	pHeader->AnimationDataOffset = sizeof(SDKAnimationFileHeader);
+
+	const auto pFrameData = reinterpret_cast<SDKAnimationFrameData*>(animation.data() + pHeader->AnimationDataOffset);
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		memcpy(pFrameData[i].FrameName, m_pFrameData[i].FrameName, sizeof(pFrameData[i].FrameName));
+		pFrameData[i].DataOffset = frameDataSize + keyDataSize * i;
+
+		const auto pData = reinterpret_cast<SDKAnimationData*>(animation.data() +
+			sizeof(SDKAnimationFileHeader) + pFrameData[i].DataOffset);
+		for (auto k = 0u; k < numKeys; ++k) pData[k] = m_tracks.GetKey(i, k);
+	}
+
+	auto fileStream = openFile<ofstream>(fileName, ios::out | ios::binary | ios::trunc);
+	M_RETURN(!fileStream, cerr, "Failed to open the file.", false);
+	M_RETURN(!fileStream.write(reinterpret_cast<const char*>(animation.data()), animation.size()),
+		cerr, "Failed to write the file.", false);
+	fileStream.close();
+
+	return true;
+}
+
+void AnimationClip::DecodeKey(SDKAnimationData *pKeyData, uint32_t key) const
+{
+	if (IsCompressed()) m_compressedAnimation.DecodeKey(pKeyData, key);
+	else m_tracks.DecodeKey(pKeyData, key);
+}
+
+bool AnimationClip::IsCompressed() const
+{
+	return !m_compressedAnimation.IsEmpty();
+}
+
+bool AnimationClip::IsUniformScaling() const
+{
+	return m_isUniformScaling;
+}
+
+const SDKAnimationFileHeader *AnimationClip::GetHeader() const
+{
+	return m_pHeader;
+}
+
+const char *AnimationClip::GetFrameName(uint32_t track) const
+{
+	return IsCompressed() ? m_compressedAnimation.GetFrameName(track) : m_pFrameData[track].FrameName;
+}
+
+const AnimationTracks &AnimationClip::GetTracks() const
+{
+	return m_tracks;
+}
+
+const CompressedAnimation &AnimationClip::GetCompressedAnimation() const
+{
+	return m_compressedAnimation;
+}
+
+size_t AnimationClip::GetMemoryUsage() const
+{
+	return m_animation.capacity() + m_compressedAnimation.GetDataSize() +
+		sizeof(AnimationTracks::KeyGroup) * m_tracks.GetNumGroups() * m_tracks.GetNumKeys();
+}
+
+void AnimationClip::fixup()
+{
+	m_pHeader = reinterpret_cast<SDKAnimationFileHeader*>(m_animation.data());
+
+	if (IsCompressed())
+	{
+		// Keys are decoded on demand
+		m_pFrameData = nullptr;
+		m_tracks.Destroy();
+		m_isUniformScaling = checkUniformScaling();
+
+		return;
+	}
+
+	m_pFrameData = reinterpret_cast<SDKAnimationFrameData*>(m_animation.data() + m_pHeader->AnimationDataOffset);
+
+	const auto BaseOffset = sizeof(SDKAnimationFileHeader);
+	for (auto i = 0u; i < m_pHeader->NumFrames; ++i)
+		m_pFrameData[i].pAnimationData = reinterpret_cast<SDKAnimationData*>
+			(m_animation.data() + m_pFrameData[i].DataOffset + BaseOffset);
+
+	// Transpose the keys into SoA tracks for the SIMD evaluation
+	m_tracks.Create(m_pFrameData, m_pHeader->NumFrames, m_pHeader->NumAnimationKeys);
+
+	// Drop the keys, and keep only the header and the frame table
+	const auto frameTableSize = static_cast<size_t>(m_pHeader->AnimationDataOffset) +
+		sizeof(SDKAnimationFrameData) * m_pHeader->NumFrames;
+	for (auto i = 0u; i < m_pHeader->NumFrames; ++i) m_pFrameData[i].pAnimationData = nullptr;
+	m_animation.resize(frameTableSize);
+	m_animation.shrink_to_fit();
+
+	m_pHeader = reinterpret_cast<SDKAnimationFileHeader*>(m_animation.data());
+	m_pFrameData = reinterpret_cast<SDKAnimationFrameData*>(m_animation.data() + m_pHeader->AnimationDataOffset);
+	m_isUniformScaling = checkUniformScaling();
+}
+
+// Scan the keys once, so that the meshes know whether the bones may compose in QTS form
+bool AnimationClip::checkUniformScaling() const
+{
+	static const auto tolerance = 1e-4f;
+
+	vector<SDKAnimationData> keyData(m_pHeader->NumFrames);
+	for (auto k = 0u; k < m_pHeader->NumAnimationKeys; ++k)
+	{
+		DecodeKey(keyData.data(), k);
+		for (const auto &data : keyData)
+		{
+			const auto &s = data.Scaling;
+			const auto maxScale = (max)(fabs(s.x), (max)(fabs(s.y), fabs(s.z)));
+			C_RETURN(fabs(s.x - s.y) > tolerance * maxScale || fabs(s.x - s.z) > tolerance * maxScale, false);
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Animation clip registry
+//--------------------------------------------------------------------------------------
+mutex AnimationClipRegistry::s_mutex;
+unordered_map<wstring, weak_ptr<const AnimationClip>> AnimationClipRegistry::s_clips;
+
+shared_ptr<const AnimationClip> AnimationClipRegistry::GetClip(const wstring &fileName)
+{
+	{
+		lock_guard<mutex> lock(s_mutex);
+		const auto clipIter = s_clips.find(fileName);
+		if (clipIter != s_clips.end())
+		{
+			const auto clip = clipIter->second.lock();
+			if (clip) return clip;
+		}
+	}
+
+	// Load outside the lock, so that the load pipelines read different clips in parallel
+	const auto newClip = make_shared<AnimationClip>();
+	N_RETURN(newClip->Load(fileName.c_str()), nullptr);
+
+	// Keep the clip registered by another thread loading the same file meanwhile
+	lock_guard<mutex> lock(s_mutex);
+	auto &entry = s_clips[fileName];
+	auto clip = entry.lock();
+	if (!clip)
+	{
+		entry = newClip;
+		clip = newClip;
+	}
+
+	return clip;
+}
+
+size_t AnimationClipRegistry::GetNumClips()
+{
+	lock_guard<mutex> lock(s_mutex);
+
+	size_t numClips = 0;
+	for (const auto &entry : s_clips) numClips += entry.second.expired() ? 0 : 1;
+
+	return numClips;
+}
+
+size_t AnimationClipRegistry::GetMemoryUsage()
+{
+	lock_guard<mutex> lock(s_mutex);
+
+	size_t memoryUsage = 0;
+	for (const auto &entry : s_clips)
+	{
+		const auto clip = entry.second.lock();
+		memoryUsage += clip ? clip->GetMemoryUsage() : 0;
+	}
+
+	return memoryUsage;
+}
@@ -0,0 +1,289 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <DirectXMath.h>
+
+#define MAX_FRAME_NAME			100
+
+namespace XUSG
+{
+	enum FrameTransformType
+	{
+		FTT_RELATIVE = 0,
+		FTT_ABSOLUTE		// This is not currently used but is here to support absolute transformations in the future
+	};
+
+	// Instruction sets of the animation track kernels, from the slowest
+	enum AnimationKernel : uint8_t
+	{
+		ANIMATION_KERNEL_SCALAR,
+		ANIMATION_KERNEL_SSE,
+		ANIMATION_KERNEL_AVX2
+	};
+
+	//--------------------------------------------------------------------------------------
+	// .sdkmesh_anim file structures
+	//--------------------------------------------------------------------------------------
+#pragma pack(push, 8)
+
+	struct SDKAnimationFileHeader
+	{
+		uint32_t	Version;
+		uint8_t		IsBigEndian;
+		uint32_t	FrameTransformType;
+		uint32_t	NumFrames;
+		uint32_t	NumAnimationKeys;
+		uint32_t	AnimationFPS;
+		uint64_t	AnimationDataSize;
+		uint64_t	AnimationDataOffset;
+	};
+
+	struct SDKAnimationData
+	{
+		DirectX::XMFLOAT3 Translation;
+		DirectX::XMFLOAT4 Orientation;
+		DirectX::XMFLOAT3 Scaling;
+	};
+
+	struct SDKAnimationFrameData
+	{
+		char FrameName[MAX_FRAME_NAME];
+		union
+		{
+			uint64_t DataOffset;
+			SDKAnimationData* pAnimationData;
+		};
+	};
+
+#pragma pack(pop)
+
+	static_assert(sizeof(SDKAnimationFileHeader) == 40, "SDK Mesh structure size incorrect");
+	static_assert(sizeof(SDKAnimationData) == 40, "SDK Mesh structure size incorrect");
+	static_assert(sizeof(SDKAnimationFrameData) == 112, "SDK Mesh structure size incorrect");
+
+	class AnimationClip;
+
+	//--------------------------------------------------------------------------------------
+	// Bone transform in quaternion-translation-scale form, equivalent to the row-vector
+	// matrix scaling * rotation * translation. Composition in this form is exact only for
+	// uniform scales, since a non-uniform parent scale under a rotation shears the child;
+	// skeletons whose bind pose and keys are all uniformly scaled are composed in this
+	// form, so that the dual quaternions are read off without decomposing matrices.
+	//--------------------------------------------------------------------------------------
+	struct BoneTransform
+	{
+		DirectX::XMFLOAT4	Rotation;
+		DirectX::XMFLOAT3	Translation;
+		DirectX::XMFLOAT3	Scaling;
+
+		static BoneTransform Identity();
+		static BoneTransform FromMatrix(DirectX::FXMMATRIX m);	// Decomposes, dropping any shear
+		static bool FromUniformMatrix(BoneTransform &transform, DirectX::FXMMATRIX m);	// False unless uniformly scaled
+		static BoneTransform Compose(const BoneTransform &local, const BoneTransform &parent);
+		static BoneTransform Blend(const BoneTransform &a, const BoneTransform &b, float t);
+
+		DirectX::XMMATRIX ToMatrix() const;
+		DirectX::XMMATRIX ToDualQuat() const;	// Rows: rotation, dual part, and scaling
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Structure-of-arrays animation tracks: the keys of GroupWidth bone tracks are
+	// transposed into per-component streams, so that a whole bone group is interpolated
+	// and converted into local transforms at once. The group layout is the same for all
+	// builds; the kernel evaluating it is chosen at run time from what the CPU supports.
+	//--------------------------------------------------------------------------------------
+	class AnimationTracks
+	{
+	public:
+		static const uint32_t GroupWidth = 8;
+
+		struct KeyGroup
+		{
+			float Translation[3][GroupWidth];
+			float Rotation[4][GroupWidth];
+			float Scaling[3][GroupWidth];
+		};
+
+		AnimationTracks();
+		virtual ~AnimationTracks();
+
+		bool Create(const SDKAnimationFrameData *pFrameData, uint32_t numTracks, uint32_t numKeys);
+		void Destroy();
+
+		// Lerp translations and scales, nlerp rotations between the 2 keys, and output
+		// the local transforms (scaling * rotation * translation) of all tracks
+		void Evaluate(DirectX::XMFLOAT4X4 *pLocalTransforms, uint32_t key,
+			uint32_t nextKey, float blend) const;
+		// Scalar reference path of Evaluate()
+		void EvaluateReference(DirectX::XMFLOAT4X4 *pLocalTransforms, uint32_t key,
+			uint32_t nextKey, float blend) const;
+
+		// Same as above, but output the local transforms in quaternion-translation-scale form;
+		// groups whose height is below minHeight are left untouched
+		void Evaluate(BoneTransform *pLocalTransforms, uint32_t key, uint32_t nextKey, float blend,
+			const uint8_t *pGroupHeights = nullptr, uint8_t minHeight = 0) const;
+		void EvaluateReference(BoneTransform *pLocalTransforms, uint32_t key, uint32_t nextKey, float blend,
+			const uint8_t *pGroupHeights = nullptr, uint8_t minHeight = 0) const;
+
+		// Gather a key of a track, or of all tracks, back from the streams
+		SDKAnimationData GetKey(uint32_t track, uint32_t key) const;
+		void DecodeKey(SDKAnimationData *pKeyData, uint32_t key) const;
+
+		// The best kernel is used by default; a kernel the CPU does not support is refused
+		bool SetKernel(AnimationKernel kernel);
+		AnimationKernel GetKernel() const;
+		static AnimationKernel GetBestKernel();
+
+		uint32_t GetNumTracks() const;
+		uint32_t GetNumKeys() const;
+		uint32_t GetNumGroups() const;
+		const KeyGroup *GetKeyGroup(uint32_t key, uint32_t group) const;
+
+	protected:
+		std::vector<KeyGroup> m_keyGroups;	// Indexed by [key * numGroups + group]
+
+		uint32_t m_numTracks;
+		uint32_t m_numKeys;
+		uint32_t m_numGroups;
+
+		AnimationKernel m_kernel;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Compressed animation clip: identity channels are removed, constant channels keep
+	// a single value, and animated channels keep an error-bounded subset of the keys with
+	// smallest-three quantized rotations and range-quantized translations and scales.
+	//--------------------------------------------------------------------------------------
+	class CompressedAnimation
+	{
+	public:
+		static const uint32_t Magic = 0x434e4158;	// "XANC"
+		static const uint32_t Version = 1;
+
+		struct Settings
+		{
+			float TranslationTolerance = 0.0005f;
+			float RotationTolerance = 0.001f;		// In radians
+			float ScalingTolerance = 0.0005f;
+		};
+
+		struct Report
+		{
+			uint64_t RawBytes;
+			uint64_t CompressedBytes;
+			uint32_t NumChannels;
+			uint32_t NumIdentityChannels;
+			uint32_t NumConstantChannels;
+			uint64_t NumSourceKeys;
+			uint64_t NumStoredKeys;
+			float MaxTranslationError;
+			float MaxRotationError;					// In radians
+			float MaxScalingError;
+			double DecodeTimePerKey;				// In nanoseconds per bone key
+		};
+
+		CompressedAnimation();
+		virtual ~CompressedAnimation();
+
+		bool Create(const AnimationClip &clip, const Settings &settings);
+		bool Load(const wchar_t *fileName);
+		bool Save(const wchar_t *fileName) const;
+		void Destroy();
+
+		// Decode a key of all frames
+		void DecodeKey(SDKAnimationData *pKeyData, uint32_t key) const;
+		void Measure(const AnimationClip &source, Report &report) const;
+
+		bool IsEmpty() const;
+		uint32_t GetNumFrames() const;
+		uint32_t GetNumAnimationKeys() const;
+		uint32_t GetAnimationFPS() const;
+		const char *GetFrameName(uint32_t frame) const;
+		size_t GetDataSize() const;
+
+		static bool Convert(const wchar_t *srcFileName, const wchar_t *dstFileName,
+			const Settings &settings, Report *pReport = nullptr);
+
+	protected:
+		struct Header;
+		struct FrameData;
+		struct Channel;
+
+		bool validate() const;
+		void fixup();
+
+		std::vector<uint8_t> m_data;
+
+		const Header	*m_pHeader;
+		const FrameData	*m_pFrameData;
+		const Channel	*m_pChannels;
+		const uint16_t	*m_pKeyIndices;
+		const uint16_t	*m_pValues;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Animation clip, immutable after creation so that it can be shared by all the meshes
+	// and characters playing it. Per-instance evaluation state lives in AnimationPose.
+	// Only the header and the frame names of a raw clip are kept; its keys live in the
+	// tracks.
+	//--------------------------------------------------------------------------------------
+	class AnimationClip
+	{
+	public:
+		AnimationClip();
+		virtual ~AnimationClip();
+
+		bool Load(const wchar_t *fileName);
+		bool Create(std::vector<uint8_t> &&animation);	// Takes a raw .sdkmesh_anim image
+		bool Save(const wchar_t *fileName) const;
+
+		// Decode a key of all tracks
+		void DecodeKey(SDKAnimationData *pKeyData, uint32_t key) const;
+
+		bool IsCompressed() const;
+		bool IsUniformScaling() const;	// Whether all the keys scale uniformly
+		const SDKAnimationFileHeader *GetHeader() const;
+		const char *GetFrameName(uint32_t track) const;
+		const AnimationTracks &GetTracks() const;
+		const CompressedAnimation &GetCompressedAnimation() const;
+		size_t GetMemoryUsage() const;
+
+	protected:
+		void fixup();
+		bool checkUniformScaling() const;
+
+		std::vector<uint8_t>	m_animation;	// Header and frame table
+		SDKAnimationFileHeader	*m_pHeader;
+		SDKAnimationFrameData	*m_pFrameData;
+		AnimationTracks			m_tracks;
+		CompressedAnimation		m_compressedAnimation;
+		bool					m_isUniformScaling;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Process-wide clip registry keyed by file path; a clip is loaded once and released
+	// when its last user goes away.
+	//--------------------------------------------------------------------------------------
+	class AnimationClipRegistry
+	{
+	public:
+		static std::shared_ptr<const AnimationClip> GetClip(const std::wstring &fileName);
+
+		// Memory accounting of the live clips
+		static size_t GetNumClips();
+		static size_t GetMemoryUsage();
+
+	protected:
+		static std::mutex s_mutex;
+		static std::unordered_map<std::wstring, std::weak_ptr<const AnimationClip>> s_clips;
+	};
+}
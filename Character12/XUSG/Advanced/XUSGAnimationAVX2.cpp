@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Built for AVX2, and only called on CPUs supporting it; see XUSGAnimationKernel.h for what
+// this translation unit may use
+
+#include "XUSGAnimationKernel.h"
+
+#if defined(_XM_SSE_INTRINSICS_)
+#include <immintrin.h>
+
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	struct AnimationAVX2
+	{
+		using V = __m256;
+		static const uint32_t Width = 8;
+
+		static V Load(const float *p) { return _mm256_loadu_ps(p); }
+		// In halves, so that the lanes reloaded one by one are forwarded from the stores
+		static void Store(float *p, V a)
+		{
+			_mm_storeu_ps(p, _mm256_castps256_ps128(a));
+			_mm_storeu_ps(p + 4, _mm256_extractf128_ps(a, 1));
+		}
+		static V Set(float f) { return _mm256_set1_ps(f); }
+		static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+		static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+		static V Sqrt(V a) { return _mm256_sqrt_ps(a); }
+		static V Xor(V a, V b) { return _mm256_xor_ps(a, b); }
+		static V And(V a, V b) { return _mm256_and_ps(a, b); }
+
+		// Transpose the 4 SoA component registers into one matrix row per bone
+		static void StoreRows(XMFLOAT4X4 *pOut, uint32_t row, V a, V b, V c, V d)
+		{
+			const auto t0 = _mm256_unpacklo_ps(a, b);
+			const auto t1 = _mm256_unpacklo_ps(c, d);
+			const auto t2 = _mm256_unpackhi_ps(a, b);
+			const auto t3 = _mm256_unpackhi_ps(c, d);
+			const V rows[] =
+			{
+				_mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0)),
+				_mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2)),
+				_mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+				_mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2))
+			};
+
+			for (auto i = 0u; i < 4; ++i)
+			{
+				_mm_storeu_ps(pOut[i].m[row], _mm256_castps256_ps128(rows[i]));
+				_mm_storeu_ps(pOut[i + 4].m[row], _mm256_extractf128_ps(rows[i], 1));
+			}
+		}
+	};
+}
+
+void AnimationSIMD::EvaluateGroupAVX2(XMFLOAT4X4 *pOut, const AnimationTracks::KeyGroup &k0,
+	const AnimationTracks::KeyGroup &k1, float blend)
+{
+	EvaluateGroup<AnimationAVX2>(pOut, k0, k1, blend);
+}
+
+void AnimationSIMD::EvaluateGroupAVX2(BoneTransform *pOut, const AnimationTracks::KeyGroup &k0,
+	const AnimationTracks::KeyGroup &k1, float blend)
+{
+	EvaluateGroup<AnimationAVX2>(pOut, k0, k1, blend);
+}
+#endif
@@ -0,0 +1,150 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "XUSGAnimation.h"
+
+//--------------------------------------------------------------------------------------
+// Group kernel of the animation tracks, generic over the SIMD operations S of S::Width
+// lanes. It is instantiated once per instruction set, each in a translation unit built
+// for that set, so it only uses S and plain data: no inline function shared with the other
+// translation units gets compiled with a wider instruction set than the build targets.
+//--------------------------------------------------------------------------------------
+namespace XUSG
+{
+	namespace AnimationSIMD
+	{
+		template<typename S>
+		inline void InterpolateLanes(typename S::V tr[3], typename S::V q[4], typename S::V sc[3],
+			const AnimationTracks::KeyGroup &k0, const AnimationTracks::KeyGroup &k1, float blend, uint32_t lane)
+		{
+			using V = typename S::V;
+			const auto t = S::Set(blend);
+			const auto signMask = S::Set(-0.0f);
+
+			// Lerp translation and scale
+			for (auto i = 0u; i < 3; ++i)
+			{
+				const auto t0 = S::Load(&k0.Translation[i][lane]);
+				const auto s0 = S::Load(&k0.Scaling[i][lane]);
+				tr[i] = S::Add(t0, S::Mul(S::Sub(S::Load(&k1.Translation[i][lane]), t0), t));
+				sc[i] = S::Add(s0, S::Mul(S::Sub(S::Load(&k1.Scaling[i][lane]), s0), t));
+			}
+
+			// Nlerp rotation along the shortest arc
+			V q0[4], q1[4];
+			for (auto i = 0u; i < 4; ++i)
+			{
+				q0[i] = S::Load(&k0.Rotation[i][lane]);
+				q1[i] = S::Load(&k1.Rotation[i][lane]);
+			}
+
+			auto dot = S::Mul(q0[0], q1[0]);
+			for (auto i = 1u; i < 4; ++i) dot = S::Add(dot, S::Mul(q0[i], q1[i]));
+			const auto flip = S::And(dot, signMask);
+
+			for (auto i = 0u; i < 4; ++i)
+				q[i] = S::Add(q0[i], S::Mul(S::Sub(S::Xor(q1[i], flip), q0[i]), t));
+
+			auto len = S::Mul(q[0], q[0]);
+			for (auto i = 1u; i < 4; ++i) len = S::Add(len, S::Mul(q[i], q[i]));
+			len = S::Sqrt(len);
+			for (auto i = 0u; i < 4; ++i) q[i] = S::Div(q[i], len);
+		}
+
+		template<typename S>
+		inline void EvaluateLanes(DirectX::XMFLOAT4X4 *pOut, const AnimationTracks::KeyGroup &k0,
+			const AnimationTracks::KeyGroup &k1, float blend, uint32_t lane)
+		{
+			using V = typename S::V;
+			const auto zero = S::Set(0.0f);
+			const auto one = S::Set(1.0f);
+
+			V tr[3], q[4], sc[3];
+			InterpolateLanes<S>(tr, q, sc, k0, k1, blend, lane);
+
+			// Build the rotation matrix rows, scaled per axis
+			const auto x2 = S::Add(q[0], q[0]);
+			const auto y2 = S::Add(q[1], q[1]);
+			const auto z2 = S::Add(q[2], q[2]);
+			const auto xx = S::Mul(q[0], x2);
+			const auto yy = S::Mul(q[1], y2);
+			const auto zz = S::Mul(q[2], z2);
+			const auto xy = S::Mul(q[0], y2);
+			const auto xz = S::Mul(q[0], z2);
+			const auto yz = S::Mul(q[1], z2);
+			const auto xw = S::Mul(q[3], x2);
+			const auto yw = S::Mul(q[3], y2);
+			const auto zw = S::Mul(q[3], z2);
+
+			pOut += lane;
+			S::StoreRows(pOut, 0,
+				S::Mul(S::Sub(one, S::Add(yy, zz)), sc[0]),
+				S::Mul(S::Add(xy, zw), sc[0]),
+				S::Mul(S::Sub(xz, yw), sc[0]),
+				zero);
+			S::StoreRows(pOut, 1,
+				S::Mul(S::Sub(xy, zw), sc[1]),
+				S::Mul(S::Sub(one, S::Add(xx, zz)), sc[1]),
+				S::Mul(S::Add(yz, xw), sc[1]),
+				zero);
+			S::StoreRows(pOut, 2,
+				S::Mul(S::Add(xz, yw), sc[2]),
+				S::Mul(S::Sub(yz, xw), sc[2]),
+				S::Mul(S::Sub(one, S::Add(xx, yy)), sc[2]),
+				zero);
+			S::StoreRows(pOut, 3, tr[0], tr[1], tr[2], one);
+		}
+
+		template<typename S>
+		inline void EvaluateLanes(BoneTransform *pOut, const AnimationTracks::KeyGroup &k0,
+			const AnimationTracks::KeyGroup &k1, float blend, uint32_t lane)
+		{
+			typename S::V tr[3], q[4], sc[3];
+			InterpolateLanes<S>(tr, q, sc, k0, k1, blend, lane);
+
+			// Spill the SoA registers and gather them per bone
+			float translation[3][S::Width], rotation[4][S::Width], scaling[3][S::Width];
+			for (auto i = 0u; i < 3; ++i)
+			{
+				S::Store(translation[i], tr[i]);
+				S::Store(scaling[i], sc[i]);
+			}
+			for (auto i = 0u; i < 4; ++i) S::Store(rotation[i], q[i]);
+
+			for (auto j = 0u; j < S::Width; ++j)
+			{
+				auto &transform = pOut[lane + j];
+				transform.Rotation.x = rotation[0][j];
+				transform.Rotation.y = rotation[1][j];
+				transform.Rotation.z = rotation[2][j];
+				transform.Rotation.w = rotation[3][j];
+				transform.Translation.x = translation[0][j];
+				transform.Translation.y = translation[1][j];
+				transform.Translation.z = translation[2][j];
+				transform.Scaling.x = scaling[0][j];
+				transform.Scaling.y = scaling[1][j];
+				transform.Scaling.z = scaling[2][j];
+			}
+		}
+
+		// Evaluate a whole group, S::Width lanes at a time
+		template<typename S, typename T>
+		inline void EvaluateGroup(T *pOut, const AnimationTracks::KeyGroup &k0,
+			const AnimationTracks::KeyGroup &k1, float blend)
+		{
+			static_assert(AnimationTracks::GroupWidth % S::Width == 0, "The group width must be a multiple of the SIMD width");
+
+			for (auto lane = 0u; lane < AnimationTracks::GroupWidth; lane += S::Width)
+				EvaluateLanes<S>(pOut, k0, k1, blend, lane);
+		}
+
+		// Entry points of the AVX2 kernel, built in their own translation unit
+		void EvaluateGroupAVX2(DirectX::XMFLOAT4X4 *pOut, const AnimationTracks::KeyGroup &k0,
+			const AnimationTracks::KeyGroup &k1, float blend);
+		void EvaluateGroupAVX2(BoneTransform *pOut, const AnimationTracks::KeyGroup &k0,
+			const AnimationTracks::KeyGroup &k1, float blend);
+	}
+}
@@ -8,9 +8,52 @@ using namespace std;
 using namespace DirectX;
 using namespace XUSG;
 
+// Half size of the quantization box of the skinned positions over the bounding radius, if
+// the animated bounds are unknown
+static const auto POSITION_BOX_SCALE = 2.0f;
+// Half size of the quantization box over the largest half extent of the animated bounds,
+// with room for the interpolated poses between the sampled keys
+static const auto POSITION_BOX_MARGIN = 1.125f;
+
 Character::Character(const Device &device, const CommandList &commandList, const wchar_t *name) :
 	Model(device, commandList, name),
 	m_computePipelineCache(nullptr),
+	m_positionBox(0.0f, 0.0f, 0.0f, 1.0f),
+	m_time(-1.0),
+	m_updateStamp(0),
+	m_poseStamp(0),
+	m_paletteStamp(UINT64_MAX),
+	m_uploadStamp(0),
+	m_poseStats(),
+	m_animationLODs(0),
+	m_animationLOD(0),
+	m_boundingSphere(0.0f, 0.0f, 0.0f, 0.0f),
+	m_previousPoseStamp(0),
+	m_poseBlend(1.0f),
+	m_skinningMode(SKINNING_DQS4),
+	m_palette(0),
+	m_firstBones(0),
+	m_paletteOffset(0),
+	m_cpuVertices(0),
+	m_isInlineSkinning(false),
+#if TEMPORAL
+	m_historyPalette(0),
+	m_historyScales(0),
+#endif
+	m_boneFormat(BONE_FORMAT_DQ_SCALE),
+	m_compactBones(0),
+	m_boneScales(0),
+	m_numScaledBones(0),
+	m_scaleOffset(0),
+	m_pBatchedPalette(nullptr),
+	m_pBatchedScales(nullptr),
+	m_batchedPaletteOffset(0),
+	m_batchedScaleOffset(0),
+	m_boneHashes(0),
+	m_meshHashes(0),
+	m_skinnedHashes(0),
+	m_skinnedFrames(0),
+	m_historyFrames(0),
 	m_skinningPipelineLayout(nullptr),
 	m_skinningPipeline(nullptr),
 	m_srvSkinningTables(),
@@ -21,6 +64,8 @@ Character::Character(const Device &device, const CommandList &commandList, const
 #endif
 	m_linkedMeshes(nullptr),
 	m_meshLinks(nullptr),
+	m_linkedBones(0),
+	m_linkedSlots(0),
 	m_cbLinkedMatrices(0),
 	m_cbLinkedShadowMatrices(0)
 {
@@ -37,12 +82,27 @@ bool Character::Init(const InputLayout &inputLayout,
 	const shared_ptr<Compute::PipelineCache> &computePipelineCache,
 	const shared_ptr<PipelineLayoutCache> &pipelineLayoutCache,
 	const shared_ptr<DescriptorTableCache> &descriptorTableCache,
+	const shared_ptr<RingBuffer> &ringBuffer,
 	const shared_ptr<vector<SDKMesh>> &linkedMeshes,
 	const shared_ptr<vector<MeshLink>> &meshLinks,
 	const Format *rtvFormats, uint32_t numRTVs,
-	Format dsvFormat, Format shadowFormat)
+	Format dsvFormat, Format shadowFormat,
+	BoneFormat boneFormat, SkinningMode skinningMode, VertexFormat vertexFormat,
+	bool isInlineSkinning)
 {
+	M_RETURN(boneFormat == BONE_FORMAT_COMPACT && (skinningMode == SKINNING_LBS4 || skinningMode == SKINNING_LBS2),
+		cerr, "The compact bone format requires a dual-quaternion skinning mode.", false);
+	M_RETURN(vertexFormat != VERTEX_FORMAT_HALF && skinningMode != SKINNING_DQS4,
+		cerr, "The compact vertex formats require the SKINNING_DQS4 mode.", false);
+	M_RETURN(vertexFormat != VERTEX_FORMAT_HALF && isInlineSkinning, cerr,
+		"The inline skinning has no skinned VBs for the compact vertex formats.", false);
+
 	m_computePipelineCache = computePipelineCache;
+	m_cpuVertices.clear();
+	m_boneFormat = boneFormat;
+	m_skinningMode = skinningMode;
+	m_vertexFormat = vertexFormat;
+	m_isInlineSkinning = isInlineSkinning;
 
 	// Set the Linked Meshes
 	m_meshLinks = meshLinks;
@@ -50,13 +110,43 @@ bool Character::Init(const InputLayout &inputLayout,
 
 	// Get SDKMesh
 	N_RETURN(Model::Init(inputLayout, mesh, shaderPool, graphicsPipelineCache,
-		pipelineLayoutCache, descriptorTableCache), false);
+		pipelineLayoutCache, descriptorTableCache, ringBuffer), false);
+	m_mesh->InitPose(m_pose);
+
+	// Bounding sphere of all the meshes for the animation LOD
+	const auto numMeshes = m_mesh->GetNumMeshes();
+	auto bMin = XMVectorReplicate(FLT_MAX);
+	auto bMax = XMVectorReplicate(-FLT_MAX);
+	for (auto m = 0u; m < numMeshes; ++m)
+	{
+		const auto center = m_mesh->GetMeshBBoxCenter(m);
+		const auto extents = m_mesh->GetMeshBBoxExtents(m);
+		bMin = XMVectorMin(bMin, center - extents);
+		bMax = XMVectorMax(bMax, center + extents);
+	}
+	if (numMeshes > 0)
+	{
+		const auto radius = XMVectorGetX(XMVector3Length(bMax - bMin)) * 0.5f;
+		XMStoreFloat4(&m_boundingSphere, XMVectorSetW((bMin + bMax) * 0.5f, radius));
+
+		// Quantization box of the skinned positions, a cube around the animated bounds, or
+		// with room for the poses reaching out of the bind-pose bounds without them
+		XMFLOAT3 animatedCenter, animatedExtents;
+		auto center = (bMin + bMax) * 0.5f;
+		auto halfSize = radius * POSITION_BOX_SCALE;
+		if (m_mesh->GetAnimatedBounds(animatedCenter, animatedExtents))
+		{
+			center = XMLoadFloat3(&animatedCenter);
+			halfSize = (max)((max)(animatedExtents.x, animatedExtents.y), animatedExtents.z) * POSITION_BOX_MARGIN;
+		}
+		XMStoreFloat4(&m_positionBox, XMVectorSetW(center - XMVectorReplicate(halfSize), halfSize * 2.0f));
+	}
 
 	// Create buffers
 	N_RETURN(createBuffers(), false);
 
 	// Create VBs that will hold all of the skinned vertices that need to be transformed output
-	N_RETURN(createTransformedStates(), false);
+	if (!isInlineSkinning) N_RETURN(createTransformedStates(), false);
 
 	// Create pipeline layout, pipelines, and descriptor tables
 	N_RETURN(createPipelineLayouts(), false);
@@ -74,21 +164,25 @@ void Character::InitPosition(const XMFLOAT4 &posRot)
 void Character::Update(uint8_t frameIndex, double time)
 {
 	Model::Update(frameIndex);
+
+	// Start a new frame; the pose is evaluated lazily by Skinning()
 	m_time = time;
+	++m_updateStamp;
+	++m_poseStats.NumUpdates;
+	m_poseStats.FrameBonesEvaluated = 0;
+	m_poseStats.FrameBonesSkipped = 0;
 }
 
 void Character::Update(uint8_t frameIndex, double time, CXMMATRIX viewProj, FXMMATRIX *pWorld,
 	FXMMATRIX *pShadowView, FXMMATRIX *pShadows, uint8_t numShadows, bool isTemporal)
 {
-	Model::Update(frameIndex);
+	Update(frameIndex, time);
+	selectAnimationLOD(viewProj, pWorld);
 
 	// Set the bone matrices
-	const auto numMeshes = m_mesh->GetNumMeshes();
-	m_mesh->TransformMesh(XMMatrixIdentity(), time);
-	setSkeletalMatrices(numMeshes);
+	uploadPose();
 
 	SetMatrices(viewProj, pWorld, pShadowView, pShadows, numShadows, isTemporal);
-	m_time = -1.0;
 }
 
 void Character::SetMatrices(CXMMATRIX viewProj, FXMMATRIX *pWorld,
@@ -104,14 +198,19 @@ void Character::SetMatrices(CXMMATRIX viewProj, FXMMATRIX *pWorld,
 	}
 	else world = *pWorld;
 
-	Model::SetMatrices(viewProj, world, pShadowView, pShadows, numShadows, isTemporal);
-
-	if (m_meshLinks)
+	// Dequantize the skinned positions with the world matrix
+	if (m_vertexFormat == VERTEX_FORMAT_OCT_QUANTIZED)
 	{
-		const auto numLinks = static_cast<uint8_t>(m_meshLinks->size());
-		for (auto m = 0ui8; m < numLinks; ++m)
-			setLinkedMatrices(m, viewProj, world, pShadowView, pShadows, numShadows, isTemporal);
+		const auto dequantize = XMMatrixScaling(m_positionBox.w, m_positionBox.w, m_positionBox.w) *
+			XMMatrixTranslation(m_positionBox.x, m_positionBox.y, m_positionBox.z);
+		Model::SetMatrices(viewProj, dequantize * world, pShadowView, pShadows, numShadows, isTemporal);
 	}
+	else Model::SetMatrices(viewProj, world, pShadowView, pShadows, numShadows, isTemporal);
+
+	// Once per bone followed by the links
+	const auto numLinkedBones = static_cast<uint32_t>(m_linkedBones.size());
+	for (auto i = 0u; i < numLinkedBones; ++i)
+		setLinkedMatrices(i, viewProj, world, pShadowView, pShadows, numShadows, isTemporal);
 }
 
 void Character::SetSkinningPipeline()
@@ -120,16 +219,77 @@ void Character::SetSkinningPipeline()
 	m_commandList.SetPipelineState(m_skinningPipeline);
 }
 
+void Character::SetAnimationLODs(const AnimationLOD *pLODs, uint8_t numLODs)
+{
+	m_animationLODs.assign(pLODs, pLODs + numLODs);
+	m_animationLOD = 0;
+}
+
 void Character::Skinning(bool reset)
 {
-	if (m_time >= 0.0) m_mesh->TransformMesh(XMMatrixIdentity(), m_time);
+	uploadPose();
 	skinning(reset);
 }
 
+bool Character::SkinCPU(vector<CPUSkinning::OutputVertex> *pVertices, JobSystem *pJobSystem)
+{
+	const auto numMeshes = m_mesh->GetNumMeshes();
+	for (auto m = 0u; m < numMeshes; ++m)
+		M_RETURN(m_mesh->GetVertexStride(m, 0) != sizeof(CPUSkinning::InputVertex), cerr,
+			"The vertex layout does not match the skinning input.", false);
+
+	// Share the bone palette with the GPU skinning
+	updatePalette();
+
+	// The skinning input is written once, as uploaded, since the file is in its own order
+	if (m_cpuVertices.empty())
+	{
+		m_cpuVertices.resize(m_mesh->GetNumVertexBuffers());
+		for (auto m = 0u; m < numMeshes; ++m)
+		{
+			const auto vb = m_mesh->GetMesh(m)->VertexBuffers[0];
+			if (!m_cpuVertices[vb].empty()) continue;
+			m_cpuVertices[vb].resize(static_cast<size_t>(m_mesh->GetNumVertices(m, 0)));
+			m_mesh->WriteVerticesAt(vb, reinterpret_cast<uint8_t*>(m_cpuVertices[vb].data()));
+		}
+	}
+
+	// Build the batches, one per influence range of each mesh
+	vector<CPUSkinning::Batch> batches;
+	batches.reserve(MAX_INFLUENCES * numMeshes);
+	for (auto m = 0u; m < numMeshes; ++m)
+	{
+		const auto numVertices = static_cast<uint32_t>(m_mesh->GetNumVertices(m, 0));
+		const auto pInput = m_cpuVertices[m_mesh->GetMesh(m)->VertexBuffers[0]].data();
+		const auto &ranges = m_mesh->GetInfluenceRanges(m);
+		pVertices[m].resize(numVertices);
+
+		for (auto i = 0ui8; i < MAX_INFLUENCES; ++i)
+		{
+			const auto firstVertex = ranges.FirstVertices[i];
+			if (ranges.FirstVertices[i + 1] <= firstVertex) continue;
+
+			CPUSkinning::Batch batch;
+			batch.pOutput = pVertices[m].data() + firstVertex;
+			batch.pInput = pInput + firstVertex;
+			batch.NumVertices = ranges.FirstVertices[i + 1] - firstVertex;
+			batch.pPalette = m_palette.data() + m_firstBones[m];
+			batch.Mode = m_skinningMode;
+			batch.NumInfluences = static_cast<uint8_t>(i + 1);
+			batches.push_back(batch);
+		}
+	}
+
+	CPUSkinning::Skin(batches.data(), static_cast<uint32_t>(batches.size()), pJobSystem);
+
+	return true;
+}
+
 void Character::RenderTransformed(SubsetFlags subsetFlags, uint8_t matrixTableIndex,
 	PipelineLayoutIndex layout, uint32_t numInstances)
 {
-	renderTransformed(subsetFlags, matrixTableIndex, layout, numInstances);
+	if (m_isInlineSkinning) renderInline(subsetFlags, matrixTableIndex, layout, numInstances);
+	else renderTransformed(subsetFlags, matrixTableIndex, layout, numInstances);
 	if (m_meshLinks)
 	{
 		const auto numLinks = static_cast<uint8_t>(m_meshLinks->size());
@@ -148,24 +308,109 @@ FXMMATRIX Character::GetWorldMatrix() const
 	return XMLoadFloat4x4(&m_mWorld);
 }
 
+const AnimationPose &Character::GetPose() const
+{
+	return m_pose;
+}
+
+const Character::PoseStats &Character::GetPoseStats() const
+{
+	return m_poseStats;
+}
+
+Character::PaletteStats Character::GetPaletteStats() const
+{
+	const auto numBones = static_cast<uint32_t>(m_palette.size());
+	const auto isCompact = m_boneFormat == BONE_FORMAT_COMPACT;
+
+	PaletteStats stats;
+	stats.NumBones = numBones;
+	stats.NumScaledBones = isCompact ? m_numScaledBones : numBones;
+	stats.UploadSize = getPaletteSize() + (isCompact ? static_cast<uint32_t>(sizeof(XMFLOAT3)) * m_numScaledBones : 0);
+	stats.ReferenceSize = static_cast<uint32_t>(sizeof(XMFLOAT4X3)) * numBones;
+	stats.BytesPerInfluence = getBoneSize();
+
+	return stats;
+}
+
+Character::BoneFormat Character::GetBoneFormat() const
+{
+	return m_boneFormat;
+}
+
+SkinningMode Character::GetSkinningMode() const
+{
+	return m_skinningMode;
+}
+
+Model::VertexFormat Character::GetVertexFormat() const
+{
+	return m_vertexFormat;
+}
+
+bool Character::IsInlineSkinning() const
+{
+	return m_isInlineSkinning;
+}
+
+uint8_t Character::GetAnimationLOD() const
+{
+	return m_animationLOD;
+}
+
+uint64_t Character::GetUpdateStamp() const
+{
+	return m_updateStamp;
+}
+
+uint32_t Character::GetDynamicDataSize(uint8_t numShadows) const
+{
+	const auto cbAlignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+	auto paletteSize = getPaletteSize();
+	if (m_boneFormat == BONE_FORMAT_COMPACT)
+		paletteSize += static_cast<uint32_t>(sizeof(XMFLOAT3) * m_boneScales.size());
+#if TEMPORAL
+	if (m_isInlineSkinning) paletteSize *= 2;	// With the palette of the previous frame
+#endif
+
+	return ALIGN(paletteSize, cbAlignment) + ALIGN(static_cast<uint32_t>(sizeof(CBMatrices)), cbAlignment) +
+		ALIGN(static_cast<uint32_t>(sizeof(XMMATRIX)), cbAlignment) * numShadows;
+}
+
+bool Character::IsPoseResident(uint64_t updateStamp) const
+{
+	// Only the palette copied for the last update is live in the ring buffer: CPU skinning
+	// and failed allocations copy nothing, and the copies of the earlier updates retire
+	// with the fences of their frames
+	return updateStamp > 0 && updateStamp == m_uploadStamp;
+}
+
+float Character::GetPaletteError() const
+{
+	C_RETURN(m_boneFormat != BONE_FORMAT_COMPACT, 0.0f);
+
+	const auto numBones = static_cast<uint32_t>(m_palette.size());
+	vector<XMFLOAT4X3> dualQuats(numBones);
+	CPUSkinning::DecodeCompact(dualQuats.data(), m_compactBones.data(), m_boneScales.data(), numBones);
+
+	auto maxError = 0.0f;
+	for (auto i = 0u; i < numBones; ++i)
+		for (auto r = 0u; r < 4; ++r)
+			for (auto c = 0u; c < 3; ++c)
+				maxError = (max)(fabs(dualQuats[i].m[r][c] - m_palette[i].m[r][c]), maxError);
+
+	return maxError;
+}
+
 shared_ptr<SDKMesh> Character::LoadSDKMesh(const Device &device, const wstring &meshFileName,
 	const wstring &animFileName, const TextureCache &textureCache,
 	const shared_ptr<vector<MeshLink>> &meshLinks,
-	vector<SDKMesh> *linkedMeshes)
+	vector<SDKMesh> *linkedMeshes, const shared_ptr<UploadManager> &uploadManager)
 {
 	// Load the animated mesh
-	const auto mesh = Model::LoadSDKMesh(device, meshFileName, textureCache, false);
-	N_RETURN(mesh->LoadAnimation(animFileName.c_str()), nullptr);
-	mesh->TransformBindPose(XMMatrixIdentity());
-
-	// Fix the frame name to avoid space
-	const auto numFrames = mesh->GetNumFrames();
-	for (auto i = 0u; i < numFrames; ++i)
-	{
-		auto szName = mesh->GetFrame(i)->Name;
-		for (auto j = 0ui8; szName[j] != '\0'; ++j)
-			if (szName[j] == ' ') szName[j] = '_';
-	}
+	const auto mesh = Model::LoadSDKMesh(device, meshFileName, textureCache, false, uploadManager);
+	N_RETURN(mesh, nullptr);
+	N_RETURN(BindSDKMesh(*mesh, AnimationClipRegistry::GetClip(animFileName), meshLinks), nullptr);
 
 	// Load the linked meshes
 	if (meshLinks)
@@ -174,17 +419,38 @@ shared_ptr<SDKMesh> Character::LoadSDKMesh(const Device &device, const wstring &
 		linkedMeshes->resize(numLinks);
 
 		for (auto m = 0ui8; m < numLinks; ++m)
-		{
-			auto &meshInfo = meshLinks->at(m);
-			meshInfo.BoneIndex = mesh->FindFrameIndex(meshInfo.BoneName.c_str());
-			N_RETURN(linkedMeshes->at(m).Create(device.get(), meshInfo.MeshName.c_str(),
-				textureCache), nullptr);
-		}
+			N_RETURN(linkedMeshes->at(m).Create(device.get(), meshLinks->at(m).MeshName.c_str(),
+				textureCache, false, uploadManager), nullptr);
 	}
 
 	return mesh;
 }
 
+bool Character::BindSDKMesh(SDKMesh &mesh, const shared_ptr<const AnimationClip> &clip,
+	const shared_ptr<vector<MeshLink>> &meshLinks)
+{
+	M_RETURN(!clip, cerr, "Failed to load the animation.", false);
+	mesh.SetAnimationClip(clip);
+	mesh.TransformBindPose(XMMatrixIdentity());
+	mesh.ComputeAnimatedBounds();
+
+	// Fix the frame name to avoid space
+	const auto numFrames = mesh.GetNumFrames();
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		auto szName = mesh.GetFrame(i)->Name;
+		for (auto j = 0ui8; szName[j] != '\0'; ++j)
+			if (szName[j] == ' ') szName[j] = '_';
+	}
+
+	// Bones of the linked meshes
+	if (meshLinks)
+		for (auto &meshInfo : *meshLinks)
+			meshInfo.BoneIndex = mesh.FindFrameIndex(meshInfo.BoneName.c_str());
+
+	return true;
+}
+
 bool Character::createTransformedStates()
 {
 	for (auto &vertexBuffers : m_transformedVBs)
@@ -206,7 +472,7 @@ bool Character::createTransformedVBs(VertexBuffer &vertexBuffer)
 		numVertices += static_cast<uint32_t>(m_mesh->GetNumVertices(m, 0));
 	}
 
-	N_RETURN(vertexBuffer.Create(m_device, numVertices, sizeof(Vertex),
+	N_RETURN(vertexBuffer.Create(m_device, numVertices, GetVertexStride(m_vertexFormat),
 		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, PoolType(1), ResourceState(0),
 		numMeshes, firstVertices.data(), numMeshes, firstVertices.data(),
 		numMeshes, firstVertices.data(), m_name.empty() ? nullptr : (m_name + L".TransformedVB").c_str()), false);
@@ -216,29 +482,48 @@ bool Character::createTransformedVBs(VertexBuffer &vertexBuffer)
 
 bool Character::createBuffers()
 {
-	// Bone world matrices
-	auto numElements = 0u;
+	// Bone palette shared by the meshes, written into the ring buffer every frame
+	const auto numBones = m_mesh->GetNumPaletteBones();
 	const auto numMeshes = m_mesh->GetNumMeshes();
-	vector<uint32_t> firstElements(numMeshes);
-	for (auto m = 0u; m < numMeshes; ++m)
+	m_firstBones.resize(numMeshes);
+	for (auto m = 0u; m < numMeshes; ++m) m_firstBones[m] = m_mesh->GetFirstPaletteBone(m);
+	m_palette.resize(numBones);
+	m_boneHashes.resize(numBones);
+	if (m_boneFormat == BONE_FORMAT_COMPACT)
 	{
-		firstElements[m] = numElements;
-		numElements += m_mesh->GetNumInfluences(m);
+		m_compactBones.resize(numBones);
+		m_boneScales.resize(numBones);
 	}
 
-	for (auto i = 0ui8; i < FrameCount; ++i)
+	// No mesh is skinned yet
+	m_meshHashes.assign(numMeshes, 0);
+	m_skinnedHashes.assign(numMeshes, 0);
+	m_skinnedFrames.assign(numMeshes, FrameCount);
+	m_historyFrames.assign(numMeshes, FrameCount);
+
+	// Linked meshes, with the matrices of each bone followed shared by its links
+	m_linkedBones.clear();
+	m_linkedSlots.clear();
+	if (m_meshLinks)
 	{
-		N_RETURN(m_boneWorlds[i].Create(m_device, numElements, sizeof(XMFLOAT4X3), D3D12_RESOURCE_FLAG_NONE,
-			D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ, numMeshes, firstElements.data(), 1, nullptr,
-			m_name.empty() ? nullptr : (m_name + L".BoneWorld" + to_wstring(i)).c_str()), false);
+		for (const auto &meshLink : *m_meshLinks)
+		{
+			const auto it = find(m_linkedBones.cbegin(), m_linkedBones.cend(), meshLink.BoneIndex);
+			m_linkedSlots.push_back(static_cast<uint32_t>(it - m_linkedBones.cbegin()));
+			if (it == m_linkedBones.cend()) m_linkedBones.push_back(meshLink.BoneIndex);
+		}
 	}
 
-	// Linked meshes
-	if (m_meshLinks) m_cbLinkedMatrices.resize(m_meshLinks->size());
+	m_cbLinkedMatrices.resize(m_linkedBones.size());
 	for (auto &cbLinkedMatrices : m_cbLinkedMatrices)
 		N_RETURN(cbLinkedMatrices.Create(m_device, sizeof(CBMatrices[FrameCount]), FrameCount), false);
 
-	if (m_meshLinks) m_cbLinkedShadowMatrices.resize(m_meshLinks->size());
+#if TEMPORAL
+	for (auto &linkedWorldViewProjs : m_linkedWorldViewProjs)
+		linkedWorldViewProjs.resize(m_linkedBones.size());
+#endif
+
+	m_cbLinkedShadowMatrices.resize(m_linkedBones.size());
 	for (auto &cbLinkedMatrix : m_cbLinkedShadowMatrices)
 		N_RETURN(cbLinkedMatrix.Create(m_device, sizeof(XMMATRIX[FrameCount][MAX_SHADOW_CASCADES]),
 			MAX_SHADOW_CASCADES * FrameCount), false);
@@ -251,22 +536,33 @@ bool Character::createPipelineLayouts()
 	D3D12_SHADER_INPUT_BIND_DESC desc;
 
 	// Skinning
+	if (!m_isInlineSkinning)
 	{
+		const auto isCompact = m_boneFormat == BONE_FORMAT_COMPACT;
+		auto cbRanges = 0u;
 		auto roBoneWorld = 0u;
+		auto roScales = roBoneWorld + 1;
 		auto rwVertices = 0u;
-		auto roVertices = roBoneWorld + 1;
+		auto roVertices = isCompact ? roScales + 1 : roBoneWorld + 1;
 
 		// Get compute shader slots
-		const auto reflector = m_shaderPool->GetReflector(Shader::Stage::CS, CS_SKINNING);
+		const auto reflector = m_shaderPool->GetReflector(Shader::Stage::CS, getSkinningShader());
 		if (reflector)
 		{
+			// Get constant buffer slot
+			auto hr = reflector->GetResourceBindingDescByName("cbInfluenceRanges", &desc);
+			if (SUCCEEDED(hr)) cbRanges = desc.BindPoint;
+
 			// Get shader resource slots
-			auto hr = reflector->GetResourceBindingDescByName("g_rwVertices", &desc);
+			hr = reflector->GetResourceBindingDescByName("g_rwVertices", &desc);
 			if (SUCCEEDED(hr)) rwVertices = desc.BindPoint;
 
 			hr = reflector->GetResourceBindingDescByName("g_roDualQuat", &desc);
 			if (SUCCEEDED(hr)) roBoneWorld = desc.BindPoint;
 
+			hr = reflector->GetResourceBindingDescByName("g_roScales", &desc);
+			if (SUCCEEDED(hr)) roScales = desc.BindPoint;
+
 			hr = reflector->GetResourceBindingDescByName("g_roVertices", &desc);
 			if (SUCCEEDED(hr)) roVertices = desc.BindPoint;
 		}
@@ -274,12 +570,21 @@ bool Character::createPipelineLayouts()
 		// Pipeline layout utility
 		Util::PipelineLayout utilPipelineLayout;
 
-		// Input vertices and bone matrices
-		utilPipelineLayout.SetRange(INPUT, DescriptorType::SRV, 1, roBoneWorld,
-				0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
+		// Input vertices
 		utilPipelineLayout.SetRange(INPUT, DescriptorType::SRV, 1, roVertices);
 		utilPipelineLayout.SetShaderStage(INPUT, Shader::Stage::CS);
 
+		// Bone matrices in the ring buffer
+		utilPipelineLayout.SetRootSRV(BONE_WORLDS, roBoneWorld, 0,
+			D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, Shader::Stage::CS);
+
+		// Influence ranges of the mesh, and the quantization box of the positions
+		utilPipelineLayout.SetConstants(INFLUENCE_RANGES, getNumSkinningConstants(), cbRanges, 0, Shader::Stage::CS);
+
+		// Sparse scaling stream of the compact bones
+		if (isCompact) utilPipelineLayout.SetRootSRV(BONE_SCALES, roScales, 0,
+			D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, Shader::Stage::CS);
+
 		// Output vertices
 		utilPipelineLayout.SetRange(OUTPUT, DescriptorType::UAV, 1, rwVertices);
 		utilPipelineLayout.SetShaderStage(OUTPUT, Shader::Stage::CS);
@@ -296,7 +601,7 @@ bool Character::createPipelineLayouts()
 		auto roVertices = 0u;
 
 		// Get vertex shader slots
-		auto reflector = m_shaderPool->GetReflector(Shader::Stage::VS, VS_BASE_PASS);
+		auto reflector = m_shaderPool->GetReflector(Shader::Stage::VS, getBasePassVS());
 		if (reflector)
 		{
 			// Get shader resource slots
@@ -314,11 +619,15 @@ bool Character::createPipelineLayouts()
 			cbPerFrame = SUCCEEDED(hr) ? desc.BindPoint : UINT32_MAX;
 		}
 
-		auto utilPipelineLayout = initPipelineLayout(VS_BASE_PASS, PS_BASE_PASS);
+		auto utilPipelineLayout = initPipelineLayout(getBasePassVS(), PS_BASE_PASS);
 
+		if (m_isInlineSkinning) setInlineSkinningLayout(utilPipelineLayout, getBasePassVS());
 #if TEMPORAL
-		utilPipelineLayout.SetRange(HISTORY, DescriptorType::SRV, 1, roVertices);
-		utilPipelineLayout.SetShaderStage(HISTORY, Shader::Stage::VS);
+		else
+		{
+			utilPipelineLayout.SetRange(HISTORY, DescriptorType::SRV, 1, roVertices);
+			utilPipelineLayout.SetShaderStage(HISTORY, Shader::Stage::VS);
+		}
 #endif
 
 		if (cbPerFrame != UINT32_MAX)
@@ -339,7 +648,7 @@ bool Character::createPipelineLayouts()
 		auto roVertices = 0u;
 
 		// Get vertex shader slots
-		const auto reflector = m_shaderPool->GetReflector(Shader::Stage::VS, VS_DEPTH);
+		const auto reflector = m_shaderPool->GetReflector(Shader::Stage::VS, getDepthVS());
 		if (reflector)
 		{
 			// Get shader resource slots
@@ -348,11 +657,15 @@ bool Character::createPipelineLayouts()
 		}
 #endif
 
-		auto utilPipelineLayout = initPipelineLayout(VS_DEPTH, PS_DEPTH);
+		auto utilPipelineLayout = initPipelineLayout(getDepthVS(), PS_DEPTH);
 
+		if (m_isInlineSkinning) setInlineSkinningLayout(utilPipelineLayout, getDepthVS());
 #if TEMPORAL
-		utilPipelineLayout.SetRange(HISTORY, DescriptorType::SRV, 1, roVertices);
-		utilPipelineLayout.SetShaderStage(HISTORY, Shader::Stage::VS);
+		else
+		{
+			utilPipelineLayout.SetRange(HISTORY, DescriptorType::SRV, 1, roVertices);
+			utilPipelineLayout.SetShaderStage(HISTORY, Shader::Stage::VS);
+		}
 #endif
 
 		X_RETURN(m_pipelineLayouts[DEPTH_PASS], utilPipelineLayout.GetPipelineLayout(*m_pipelineLayoutCache,
@@ -367,25 +680,53 @@ bool Character::createPipelines(const InputLayout &inputLayout, const Format *rt
 	uint32_t numRTVs, Format dsvFormat, Format shadowFormat)
 {
 	// Skinning
+	if (!m_isInlineSkinning)
 	{
 		Compute::State state;
 		state.SetPipelineLayout(m_skinningPipelineLayout);
-		state.SetShader(m_shaderPool->GetShader(Shader::Stage::CS, CS_SKINNING));
+		state.SetShader(m_shaderPool->GetShader(Shader::Stage::CS, getSkinningShader()));
 		X_RETURN(m_skinningPipeline, state.GetPipeline(*m_computePipelineCache,
 			m_name.empty() ? nullptr : (m_name + L".SkinningPipe").c_str()), false);
 	}
 
 	// Rendering
-	return Model::createPipelines(false, inputLayout, rtvFormats, numRTVs, dsvFormat, shadowFormat);
+	C_RETURN(!m_isInlineSkinning, Model::createPipelines(false, inputLayout, rtvFormats,
+		numRTVs, dsvFormat, shadowFormat));
+
+	// The inline skinning reads the source vertices, CS_Input in CSSkinningIO.hlsli
+	const auto offset = 0xffffffff;
+	InputElementTable inputElementDescs =
+	{
+		{ "POSITION",	0, DXGI_FORMAT_R32G32B32_FLOAT,		0, 0,		D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "WEIGHTS",	0, DXGI_FORMAT_R8G8B8A8_UNORM,		0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "BONES",		0, DXGI_FORMAT_R8G8B8A8_UINT,		0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL",		0, DXGI_FORMAT_R16G16B16A16_FLOAT,	0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD",	0, DXGI_FORMAT_R32_UINT,			0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TANGENT",	0, DXGI_FORMAT_R16G16B16A16_FLOAT,	0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "BINORMAL",	0, DXGI_FORMAT_R16G16B16A16_FLOAT,	0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+	};
+	const auto sourceInputLayout = m_pipelineCache->CreateInputLayout(inputElementDescs);
+
+	return Model::createPipelines(false, sourceInputLayout, rtvFormats, numRTVs, dsvFormat, shadowFormat);
 }
 
 bool Character::createDescriptorTables()
 {
+	// The inline skinning binds the palette as root SRVs only
+	C_RETURN(m_isInlineSkinning, true);
+
 	const auto numMeshes = m_mesh->GetNumMeshes();
 
+	m_srvSkinningTables.resize(numMeshes);
+	for (auto m = 0u; m < numMeshes; ++m)
+	{
+		Util::DescriptorTable srvSkinningTable;
+		srvSkinningTable.SetDescriptors(0, 1, &m_mesh->GetVertexBufferSRV(m, 0));
+		X_RETURN(m_srvSkinningTables[m], srvSkinningTable.GetCbvSrvUavTable(*m_descriptorTableCache), false);
+	}
+
 	for (auto i = 0ui8; i < FrameCount; ++i)
 	{
-		m_srvSkinningTables[i].resize(numMeshes);
 		m_uavSkinningTables[i].resize(numMeshes);
 #if TEMPORAL
 		m_srvSkinnedTables[i].resize(numMeshes);
@@ -393,11 +734,6 @@ bool Character::createDescriptorTables()
 
 		for (auto m = 0u; m < numMeshes; ++m)
 		{
-			Util::DescriptorTable srvSkinningTable;
-			const Descriptor srvs[] = { m_boneWorlds[i].GetSRV(m), m_mesh->GetVertexBufferSRV(m, 0) };
-			srvSkinningTable.SetDescriptors(0, static_cast<uint32_t>(size(srvs)), srvs);
-			X_RETURN(m_srvSkinningTables[i][m], srvSkinningTable.GetCbvSrvUavTable(*m_descriptorTableCache), false);
-
 			Util::DescriptorTable uavSkinningTable;
 			uavSkinningTable.SetDescriptors(0, 1, &m_transformedVBs[i].GetUAV(m));
 			X_RETURN(m_uavSkinningTables[i][m], uavSkinningTable.GetCbvSrvUavTable(*m_descriptorTableCache), false);
@@ -413,15 +749,15 @@ bool Character::createDescriptorTables()
 	return true;
 }
 
-void Character::setLinkedMatrices(uint32_t mesh, CXMMATRIX viewProj, CXMMATRIX world,
+void Character::setLinkedMatrices(uint32_t bone, CXMMATRIX viewProj, CXMMATRIX world,
 	FXMMATRIX *pShadowView, FXMMATRIX *pShadows, uint8_t numShadows, bool isTemporal)
 {
 	// Set World-View-Proj matrix
-	const auto influenceMatrix = m_mesh->GetInfluenceMatrix(m_meshLinks->at(mesh).BoneIndex);
+	const auto influenceMatrix = m_mesh->GetInfluenceMatrix(m_linkedBones[bone], m_pose);
 	const auto worldViewProj = influenceMatrix * world * viewProj;
 
 	// Update constant buffers
-	const auto pCBData = reinterpret_cast<CBMatrices*>(m_cbLinkedMatrices[mesh].Map());
+	const auto pCBData = reinterpret_cast<CBMatrices*>(m_cbLinkedMatrices[bone].Map());
 	pCBData->WorldViewProj = XMMatrixTranspose(worldViewProj);
 	pCBData->World = XMMatrixTranspose(world);
 	pCBData->Normal = XMMatrixInverse(nullptr, world);
@@ -440,7 +776,7 @@ void Character::setLinkedMatrices(uint32_t mesh, CXMMATRIX viewProj, CXMMATRIX w
 		for (auto i = 0ui8; i < numShadows; ++i)
 		{
 			const auto shadow = XMMatrixMultiply(model, pShadows[i]);
-			auto &cbData = *reinterpret_cast<XMMATRIX*>(m_cbLinkedShadowMatrices[mesh].Map(m_currentFrame * MAX_SHADOW_CASCADES + i));
+			auto &cbData = *reinterpret_cast<XMMATRIX*>(m_cbLinkedShadowMatrices[bone].Map(m_currentFrame * MAX_SHADOW_CASCADES + i));
 			cbData = XMMatrixTranspose(shadow);
 		}
 	}
@@ -448,15 +784,19 @@ void Character::setLinkedMatrices(uint32_t mesh, CXMMATRIX viewProj, CXMMATRIX w
 #if TEMPORAL
 	if (isTemporal)
 	{
-		XMStoreFloat4x4(&m_linkedWorldViewProjs[m_currentFrame][mesh], worldViewProj);
-		const auto worldViewProjPrev = XMLoadFloat4x4(&m_linkedWorldViewProjs[m_previousFrame][mesh]);
+		XMStoreFloat4x4(&m_linkedWorldViewProjs[m_currentFrame][bone], worldViewProj);
+		const auto worldViewProjPrev = XMLoadFloat4x4(&m_linkedWorldViewProjs[m_previousFrame][bone]);
 		pCBData->WorldViewProjPrev = XMMatrixTranspose(worldViewProjPrev);
 	}
 #endif
 }
 
-void Character::skinning(bool reset)
+void Character::skinning(bool reset, SkinningStats *pStats)
 {
+	// The vertex shaders skin the meshes in the inline skinning, and without the palette
+	// of this frame in the ring buffer, the meshes are skinned by a later frame
+	if (m_isInlineSkinning || m_paletteOffset == UINT32_MAX) return;
+
 	if (reset)
 	{
 		const DescriptorPool descriptorPools[] =
@@ -468,29 +808,66 @@ void Character::skinning(bool reset)
 
 	const auto numMeshes = m_mesh->GetNumMeshes();
 
-	// Set the bone matrices
-	if (m_time >= 0.0) setSkeletalMatrices(numMeshes);
-
-	// Prepare UAV state
-	m_transformedVBs[m_currentFrame].Barrier(m_commandList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-
-	// Skin the vertices and output them to buffers
+	// Skin the vertices and output them to buffers, skipping the meshes with unchanged palettes
+	auto isUAV = false;
 	for (auto m = 0u; m < numMeshes; ++m)
 	{
-		// Setup descriptor tables
-		m_commandList.SetComputeDescriptorTable(INPUT, m_srvSkinningTables[m_currentFrame][m]);
+		if (!prepareSkinning(m))
+		{
+			if (pStats) ++pStats->NumSkipped;
+			continue;
+		}
+
+		if (!isUAV)
+		{
+			// Prepare UAV state
+			m_transformedVBs[m_currentFrame].Barrier(m_commandList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+			// The scale indices are per character
+			if (m_boneFormat == BONE_FORMAT_COMPACT)
+				m_commandList.SetComputeRootShaderResourceView(BONE_SCALES, m_ringBuffer->GetResource(), m_scaleOffset);
+			isUAV = true;
+		}
+
+		// Setup descriptor tables and the bone matrices
+		m_commandList.SetComputeDescriptorTable(INPUT, m_srvSkinningTables[m]);
 		m_commandList.SetComputeDescriptorTable(OUTPUT, m_uavSkinningTables[m_currentFrame][m]);
+		m_commandList.SetComputeRootShaderResourceView(BONE_WORLDS, m_ringBuffer->GetResource(),
+			m_paletteOffset + getBoneSize() * m_firstBones[m]);
 		
-		// Skinning
-		const auto numVertices = static_cast<uint32_t>(m_mesh->GetNumVertices(m, 0));
-		const auto numGroups = ALIGN(numVertices, 64) / 64;
-		m_commandList.Dispatch(static_cast<uint32_t>(numGroups), 1, 1);
+		// Skinning, with each influence range in thread groups of its own for the loops
+		// specialized per influence count
+		const auto &ranges = m_mesh->GetInfluenceRanges(m);
+		uint32_t constants[2 * MAX_INFLUENCES + 5];
+		auto numGroups = 0u;
+		for (auto i = 0u; i < MAX_INFLUENCES; ++i)
+		{
+			constants[i] = ranges.FirstVertices[i];
+			constants[MAX_INFLUENCES + i] = numGroups;
+			numGroups += ALIGN(ranges.FirstVertices[i + 1] - ranges.FirstVertices[i], 64) / 64;
+		}
+		constants[2 * MAX_INFLUENCES] = ranges.FirstVertices[MAX_INFLUENCES];
+		memcpy(&constants[2 * MAX_INFLUENCES + 1], &m_positionBox, sizeof(XMFLOAT4));
+		m_commandList.SetCompute32BitConstants(INFLUENCE_RANGES, getNumSkinningConstants(), constants);
+		m_commandList.Dispatch(numGroups, 1, 1);
+
+		if (pStats)
+		{
+			++pStats->NumDispatches;
+			pStats->NumDescriptorTables += 2;
+			for (auto i = 0u; i < MAX_INFLUENCES; ++i)
+				pStats->NumRanges += ranges.FirstVertices[i + 1] > ranges.FirstVertices[i] ? 1 : 0;
+			pStats->NumGroups += numGroups;
+		}
 	}
 }
 
 void Character::renderTransformed(SubsetFlags subsetFlags, uint8_t matrixTableIndex,
 	PipelineLayoutIndex layout, uint32_t numInstances)
 {
+	// No matrices in the ring buffer for this frame
+	if (m_cbOffsets[matrixTableIndex] == UINT32_MAX) return;
+
 	if (layout != NUM_PIPE_LAYOUT)
 	{
 		const DescriptorPool descriptorPools[] =
@@ -504,21 +881,34 @@ void Character::renderTransformed(SubsetFlags subsetFlags, uint8_t matrixTableIn
 	}
 
 	// Set matrices
-	m_commandList.SetGraphicsDescriptorTable(MATRICES, m_cbvTables[m_currentFrame][matrixTableIndex]);
+	m_commandList.SetGraphicsRootConstantBufferView(MATRICES, m_ringBuffer->GetResource(),
+		m_cbOffsets[matrixTableIndex]);
 
 	const SubsetFlags subsetMasks[] = { SUBSET_OPAQUE, SUBSET_ALPHA_TEST, SUBSET_ALPHA };
 
-	// Prepare VBV state for the vertex buffer of the current frame
-	auto &vertexBuffer = m_transformedVBs[m_currentFrame];
-	vertexBuffer.Barrier(m_commandList, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+	// The meshes are rendered from the vertex buffers they were last skinned into
+	const auto numMeshes = m_mesh->GetNumMeshes();
+	vector<uint8_t> frames(numMeshes);
+#if TEMPORAL
+	vector<uint8_t> historyFrames(numMeshes);
+#endif
+	ResourceState states[FrameCount] = {};
+	for (auto m = 0u; m < numMeshes; ++m)
+	{
+		// Prepare VBV state for the vertex buffer
+		frames[m] = m_skinnedFrames[m] < FrameCount ? m_skinnedFrames[m] : m_currentFrame;
+		states[frames[m]] |= D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
 
 #if TEMPORAL
-	// Prepare SRV state for the vertex buffer of the previous frame, if neccessary
-	auto &prevVertexBuffer = m_transformedVBs[m_previousFrame];
-	prevVertexBuffer.Barrier(m_commandList, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		// Prepare SRV state for the vertex buffer of the previous frame, if neccessary
+		historyFrames[m] = m_historyFrames[m] < FrameCount ? m_historyFrames[m] : m_previousFrame;
+		states[historyFrames[m]] |= D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
 #endif
+	}
+
+	for (auto i = 0ui8; i < FrameCount; ++i)
+		if (states[i]) m_transformedVBs[i].Barrier(m_commandList, states[i]);
 
-	const auto numMeshes = m_mesh->GetNumMeshes();
 	for (const auto &subsetMask : subsetMasks)
 	{
 		if (subsetFlags & subsetMask)
@@ -526,11 +916,11 @@ void Character::renderTransformed(SubsetFlags subsetFlags, uint8_t matrixTableIn
 			for (auto m = 0u; m < numMeshes; ++m)
 			{
 				// Set IA parameters
-				m_commandList.IASetVertexBuffers(0, 1, &vertexBuffer.GetVBV(m));
+				m_commandList.IASetVertexBuffers(0, 1, &m_transformedVBs[frames[m]].GetVBV(m));
 
 #if TEMPORAL
 				// Set historical motion states, if neccessary
-				m_commandList.SetGraphicsDescriptorTable(HISTORY, m_srvSkinnedTables[m_previousFrame][m]);
+				m_commandList.SetGraphicsDescriptorTable(HISTORY, m_srvSkinnedTables[historyFrames[m]][m]);
 #endif
 
 				// Render mesh
@@ -543,6 +933,58 @@ void Character::renderTransformed(SubsetFlags subsetFlags, uint8_t matrixTableIn
 	//if (reset) m_commandList->IASetVertexBuffers(0, 1, nullptr);
 }
 
+void Character::renderInline(SubsetFlags subsetFlags, uint8_t matrixTableIndex,
+	PipelineLayoutIndex layout, uint32_t numInstances)
+{
+	// The palette of this update, if Skinning() is not called; no draws without it or the
+	// matrices in the ring buffer for this frame
+	uploadPose();
+	if (m_paletteOffset == UINT32_MAX || m_cbOffsets[matrixTableIndex] == UINT32_MAX) return;
+
+	if (layout != NUM_PIPE_LAYOUT)
+	{
+		const DescriptorPool descriptorPools[] =
+		{
+			m_descriptorTableCache->GetDescriptorPool(CBV_SRV_UAV_POOL),
+			m_descriptorTableCache->GetDescriptorPool(SAMPLER_POOL)
+		};
+		m_commandList.SetDescriptorPools(static_cast<uint32_t>(size(descriptorPools)), descriptorPools);
+		m_commandList.SetGraphicsPipelineLayout(m_pipelineLayouts[layout]);
+		m_commandList.SetGraphicsDescriptorTable(SAMPLERS, m_samplerTable);
+	}
+
+	// Set matrices
+	m_commandList.SetGraphicsRootConstantBufferView(MATRICES, m_ringBuffer->GetResource(),
+		m_cbOffsets[matrixTableIndex]);
+
+	// Skinning mode, and the offsets of the palette and the scaling stream of the previous frame
+	const uint32_t constants[] = { m_skinningMode, static_cast<uint32_t>(m_palette.size()), m_numScaledBones };
+	m_commandList.SetGraphics32BitConstants(INLINE_CONSTANTS, static_cast<uint32_t>(size(constants)), constants);
+	if (m_boneFormat == BONE_FORMAT_COMPACT)
+		m_commandList.SetGraphicsRootShaderResourceView(INLINE_SCALES, m_ringBuffer->GetResource(), m_scaleOffset);
+
+	const SubsetFlags subsetMasks[] = { SUBSET_OPAQUE, SUBSET_ALPHA_TEST, SUBSET_ALPHA };
+
+	// The meshes are skinned from the source vertex buffers
+	const auto numMeshes = m_mesh->GetNumMeshes();
+	for (const auto &subsetMask : subsetMasks)
+	{
+		if (subsetFlags & subsetMask)
+		{
+			for (auto m = 0u; m < numMeshes; ++m)
+			{
+				// Set IA parameters and the bone palette of the mesh
+				m_commandList.IASetVertexBuffers(0, 1, &m_mesh->GetVertexBufferView(m, 0));
+				m_commandList.SetGraphicsRootShaderResourceView(INLINE_BONES, m_ringBuffer->GetResource(),
+					m_paletteOffset + getBoneSize() * m_firstBones[m]);
+
+				// Render mesh
+				render(m, ~SUBSET_FULL & subsetFlags | subsetMask, layout, numInstances);
+			}
+		}
+	}
+}
+
 #if 0
 void Character::renderLinked(uint32_t mesh, uint8_t matrixTableIndex,
 	PipelineLayoutIndex layout, uint32_t numInstances)
@@ -562,48 +1004,359 @@ void Character::renderLinked(uint32_t mesh, uint8_t matrixTableIndex,
 }
 #endif
 
-void Character::setSkeletalMatrices(uint32_t numMeshes)
+void Character::selectAnimationLOD(CXMMATRIX viewProj, FXMMATRIX *pWorld)
+{
+	if (m_animationLODs.empty()) return;
+
+	XMMATRIX world;
+	if (!pWorld)
+	{
+		const auto translation = XMMatrixTranslation(m_vPosRot.x, m_vPosRot.y, m_vPosRot.z);
+		const auto rotation = XMMatrixRotationY(m_vPosRot.w);
+		world = XMMatrixMultiply(rotation, translation);
+	}
+	else world = *pWorld;
+
+	// Project the bounding sphere: radius * vertical projection scale / view depth
+	const auto center = XMVector4Transform(XMVectorSetW(XMLoadFloat4(&m_boundingSphere), 1.0f), world * viewProj);
+	const auto worldScale = (max)(XMVectorGetX(XMVector3LengthSq(world.r[0])),
+		(max)(XMVectorGetX(XMVector3LengthSq(world.r[1])), XMVectorGetX(XMVector3LengthSq(world.r[2]))));
+	const auto projScale = XMVectorGetX(XMVector3Length(XMMatrixTranspose(viewProj).r[1]));
+	const auto depth = (max)(XMVectorGetW(center), FLT_EPSILON);
+	const auto screenSize = m_boundingSphere.w * sqrt(worldScale) * projScale / depth;
+
+	const auto numLODs = static_cast<uint8_t>(m_animationLODs.size());
+	m_animationLOD = 0;
+	while (m_animationLOD + 1 < numLODs && screenSize < m_animationLODs[m_animationLOD].MinScreenSize)
+		++m_animationLOD;
+}
+
+void Character::evaluatePose()
+{
+	if (m_poseStamp == m_updateStamp) ++m_poseStats.NumReuses;
+	else
+	{
+		const auto pLOD = m_animationLODs.empty() ? nullptr : &m_animationLODs[m_animationLOD];
+		const auto interval = pLOD ? (max)(pLOD->UpdateInterval, static_cast<uint8_t>(1)) : 1u;
+		const auto numBones = m_pose.NumEvaluatedBones + m_pose.NumSkippedBones;
+
+		if (m_poseStamp > 0 && m_updateStamp - m_poseStamp < interval)
+		{
+			// Hold the pose until the LOD interval elapses
+			m_poseStats.FrameBonesSkipped += numBones;
+			m_poseStats.NumBonesSkipped += numBones;
+			m_poseBlend = pLOD->Interpolate && m_previousPoseStamp > 0 ?
+				static_cast<float>(m_updateStamp - m_poseStamp) / interval : 1.0f;
+
+			return;
+		}
+
+		// Keep the last pose as the interpolation source
+		if (pLOD && pLOD->Interpolate)
+		{
+			swap(m_previousPose, m_pose);
+			m_previousPoseStamp = m_poseStamp;
+		}
+		else m_previousPoseStamp = 0;
+
+		m_mesh->TransformMesh(m_pose, XMMatrixIdentity(), m_time, pLOD ? pLOD->MinBoneHeight : 0);
+		m_poseStamp = m_updateStamp;
+		m_poseBlend = m_previousPoseStamp > 0 ? 0.0f : 1.0f;
+		++m_poseStats.NumEvaluations;
+
+		m_poseStats.FrameBonesEvaluated += m_pose.NumEvaluatedBones;
+		m_poseStats.FrameBonesSkipped += m_pose.NumSkippedBones;
+		m_poseStats.NumBonesEvaluated += m_pose.NumEvaluatedBones;
+		m_poseStats.NumBonesSkipped += m_pose.NumSkippedBones;
+	}
+}
+
+void Character::uploadPose()
+{
+	// Nothing to do before the first update, or if the palette of this update is written
+	if (m_updateStamp == 0 || m_uploadStamp == m_updateStamp) return;
+
+	updatePalette();
+
+	// Copy the palette into the ring buffer, or into the shared palette of the batcher;
+	// the scaling stream of the compact bones follows the palette
+	const auto isCompact = m_boneFormat == BONE_FORMAT_COMPACT;
+	const auto paletteSize = getPaletteSize();
+	const auto scaleSize = isCompact ? static_cast<uint32_t>(sizeof(XMFLOAT3)) * m_numScaledBones : 0;
+	const auto pBones = isCompact ? reinterpret_cast<const uint8_t*>(m_compactBones.data()) :
+		reinterpret_cast<const uint8_t*>(m_palette.data());
+
+#if TEMPORAL
+	// The inline skinning replays the palette of the previous frame for the motion history;
+	// it follows the palette, and its scaling stream follows the scaling stream
+	if (m_isInlineSkinning && m_historyPalette.empty())
+	{
+		m_historyPalette.assign(pBones, pBones + paletteSize);
+		m_historyScales.assign(m_boneScales.cbegin(), m_boneScales.cbegin() + (isCompact ? m_numScaledBones : 0));
+	}
+	const auto historySize = m_isInlineSkinning ? paletteSize : 0;
+	const auto historyScaleSize = static_cast<uint32_t>(sizeof(XMFLOAT3) * m_historyScales.size());
+#else
+	const auto historySize = 0u;
+	const auto historyScaleSize = 0u;
+#endif
+
+	auto pPalette = m_pBatchedPalette;
+	auto pScales = m_pBatchedScales;
+	if (pPalette)
+	{
+		m_paletteOffset = m_batchedPaletteOffset;
+		m_scaleOffset = m_batchedScaleOffset;
+	}
+	else
+	{
+		pPalette = reinterpret_cast<uint8_t*>(m_ringBuffer->Allocate(paletteSize + historySize + scaleSize +
+			historyScaleSize, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, &m_paletteOffset));
+		if (!pPalette)
+		{
+			// The commands reading the palette are skipped for this frame
+			m_paletteOffset = UINT32_MAX;
+			m_scaleOffset = UINT32_MAX;
+
+			return;
+		}
+		pScales = reinterpret_cast<XMFLOAT3*>(pPalette + paletteSize + historySize);
+		m_scaleOffset = m_paletteOffset + paletteSize + historySize;
+	}
+
+	memcpy(pPalette, pBones, paletteSize);
+	if (isCompact) memcpy(pScales, m_boneScales.data(), scaleSize);
+
+#if TEMPORAL
+	if (m_isInlineSkinning)
+	{
+		memcpy(pPalette + paletteSize, m_historyPalette.data(), historySize);
+		memcpy(pScales + m_numScaledBones, m_historyScales.data(), historyScaleSize);
+
+		// The palette of the next frame is preceded by this one
+		m_historyPalette.assign(pBones, pBones + paletteSize);
+		m_historyScales.assign(m_boneScales.cbegin(), m_boneScales.cbegin() + (isCompact ? m_numScaledBones : 0));
+	}
+#endif
+	m_uploadStamp = m_updateStamp;
+	++m_poseStats.NumUploads;
+}
+
+void Character::updatePalette()
 {
-	for (auto m = 0u; m < numMeshes; ++m) setBoneMatrices(m);
-	m_boneWorlds[m_currentFrame].Unmap();
+	// Rebuild the palette only if the pose changed
+	if (m_paletteStamp == getResidentStamp(m_updateStamp)) ++m_poseStats.NumReuses;
+	else
+	{
+		evaluatePose();
+		setBoneMatrices();
+		if (m_boneFormat == BONE_FORMAT_COMPACT)
+			m_numScaledBones = CPUSkinning::EncodeCompact(m_compactBones.data(), m_boneScales.data(),
+				m_palette.data(), static_cast<uint32_t>(m_palette.size()));
+		hashPalette();
+		m_paletteStamp = getResidentStamp(m_updateStamp);
+	}
 }
 
-void Character::setBoneMatrices(uint32_t mesh)
+// Stamp of the palette required by the update of the stamp: a held pose keeps its palette
+// across frames unless it is being interpolated
+uint64_t Character::getResidentStamp(uint64_t updateStamp) const
 {
-	const auto pDataBoneWorld = reinterpret_cast<XMFLOAT4X3*>(m_boneWorlds[m_currentFrame].Map(mesh));
+	const auto pLOD = m_animationLODs.empty() ? nullptr : &m_animationLODs[m_animationLOD];
+	const auto isHeld = pLOD && m_poseStamp > 0 && m_poseStamp < updateStamp &&
+		updateStamp - m_poseStamp < pLOD->UpdateInterval;
+
+	return isHeld && !pLOD->Interpolate ? m_poseStamp : updateStamp;
+}
 
-	const auto numBones = m_mesh->GetNumInfluences(mesh);
+// FNV-1a of each bone of the palette, combined over the bones influencing each mesh
+void Character::hashPalette()
+{
+	const auto numWords = static_cast<uint32_t>(sizeof(XMFLOAT4X3) / sizeof(uint32_t));
+	const auto numBones = static_cast<uint32_t>(m_palette.size());
 	for (auto i = 0u; i < numBones; ++i)
 	{
-		const auto qMat = getDualQuat(mesh, i);
-		XMStoreFloat4x3(&pDataBoneWorld[i], XMMatrixTranspose(qMat));
+		const auto pWords = reinterpret_cast<const uint32_t*>(&m_palette[i]);
+
+		auto hash = 14695981039346656037ull;
+		for (auto j = 0u; j < numWords; ++j) hash = (hash ^ pWords[j]) * 1099511628211ull;
+		m_boneHashes[i] = hash;
+	}
+
+	const auto numMeshes = m_mesh->GetNumMeshes();
+	for (auto m = 0u; m < numMeshes; ++m)
+	{
+		const auto pRemap = m_mesh->GetBoneRemap(m);
+		const auto numInfluences = m_mesh->GetNumInfluences(m);
+
+		auto hash = 14695981039346656037ull;
+		for (auto i = 0u; i < numInfluences; ++i) hash = (hash ^ m_boneHashes[pRemap[i]]) * 1099511628211ull;
+		m_meshHashes[m] = hash;
+	}
+}
+
+// Called once per frame for each mesh; returns whether the mesh is skinned into the VB of
+// the current frame, or keeps the VB holding its vertices
+bool Character::prepareSkinning(uint32_t mesh)
+{
+	auto &skinnedFrame = m_skinnedFrames[mesh];
+	m_historyFrames[mesh] = skinnedFrame;
+
+	if (skinnedFrame < FrameCount && m_skinnedHashes[mesh] == m_meshHashes[mesh])
+	{
+		++m_poseStats.NumSkinsSkipped;
+
+		return false;
+	}
+
+	// The vertices of the previous frame are overwritten if they are in the VB of the
+	// current frame, so the motion history restarts
+	if (skinnedFrame >= FrameCount || skinnedFrame == m_currentFrame)
+		m_historyFrames[mesh] = m_currentFrame;
+
+	skinnedFrame = m_currentFrame;
+	m_skinnedHashes[mesh] = m_meshHashes[mesh];
+	++m_poseStats.NumSkins;
+
+	return true;
+}
+
+// Each bone of the palette once, however many meshes it influences
+void Character::setBoneMatrices()
+{
+	const auto isLinear = m_skinningMode == SKINNING_LBS4 || m_skinningMode == SKINNING_LBS2;
+	const auto numBones = static_cast<uint32_t>(m_palette.size());
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		const auto frame = m_mesh->GetPaletteFrame(i);
+		if (isLinear) XMStoreFloat4x3(&m_palette[i], getBoneMatrix(frame));
+		else XMStoreFloat4x3(&m_palette[i], XMMatrixTranspose(getBoneTransform(frame).ToDualQuat()));
+	}
+}
+
+// The exact bone matrix, unless interpolated between the LOD updates
+XMMATRIX Character::getBoneMatrix(uint32_t frame) const
+{
+	C_RETURN(m_poseBlend >= 1.0f, XMLoadFloat4x4(&m_pose.TransformedFrameMatrices[frame]));
+
+	return getBoneTransform(frame).ToMatrix();
+}
+
+// Uniformly scaled skeletons are composed in quaternion-translation-scale form, so only the
+// others decompose their bone matrices
+BoneTransform Character::getBoneTransform(uint32_t frame) const
+{
+	const auto getTransform = [frame](const AnimationPose &pose)
+	{
+		return pose.HasTransforms ? pose.TransformedFrameTransforms[frame] :
+			BoneTransform::FromMatrix(XMLoadFloat4x4(&pose.TransformedFrameMatrices[frame]));
+	};
+
+	const auto transform = getTransform(m_pose);
+	C_RETURN(m_poseBlend >= 1.0f, transform);
+
+	// Interpolate between the LOD updates
+	return BoneTransform::Blend(getTransform(m_previousPose), transform, m_poseBlend);
+}
+
+ComputeShader Character::getSkinningShader(bool isBatched) const
+{
+	const auto isCompact = m_boneFormat == BONE_FORMAT_COMPACT;
+	const auto isQuantized = m_vertexFormat == VERTEX_FORMAT_OCT_QUANTIZED;
+
+	// The compact vertex formats are output by the DQS-4 permutations only
+	if (m_vertexFormat != VERTEX_FORMAT_HALF)
+	{
+		if (isBatched)
+		{
+			if (isCompact) return isQuantized ? CS_SKINNING_BATCH_COMPACT_OCT_QUANTIZED : CS_SKINNING_BATCH_COMPACT_OCT;
+			return isQuantized ? CS_SKINNING_BATCH_OCT_QUANTIZED : CS_SKINNING_BATCH_OCT;
+		}
+
+		if (isCompact) return isQuantized ? CS_SKINNING_COMPACT_OCT_QUANTIZED : CS_SKINNING_COMPACT_OCT;
+		return isQuantized ? CS_SKINNING_OCT_QUANTIZED : CS_SKINNING_OCT;
+	}
+
+	// The batch selects the modes per range
+	C_RETURN(isBatched, isCompact ? CS_SKINNING_BATCH_COMPACT : CS_SKINNING_BATCH);
+
+	switch (m_skinningMode)
+	{
+	case SKINNING_LBS4:
+		return CS_SKINNING_LBS4;
+	case SKINNING_LBS2:
+		return CS_SKINNING_LBS2;
+	case SKINNING_RIGID:
+		return isCompact ? CS_SKINNING_RIGID_COMPACT : CS_SKINNING_RIGID;
+	default:
+		return isCompact ? CS_SKINNING_COMPACT : CS_SKINNING;
 	}
 }
 
-// Convert unit quaternion and translation to unit dual quaternion
-void Character::convertToDQ(XMFLOAT4 &dqTran, CXMVECTOR quat, const XMFLOAT3 &tran) const
+uint32_t Character::getNumSkinningConstants() const
 {
-	XMFLOAT4 dqRot;
-	XMStoreFloat4(&dqRot, quat);
-	dqTran.x = 0.5f * (tran.x * dqRot.w + tran.y * dqRot.z - tran.z * dqRot.y);
-	dqTran.y = 0.5f * (-tran.x * dqRot.z + tran.y * dqRot.w + tran.z * dqRot.x);
-	dqTran.z = 0.5f * (tran.x * dqRot.y - tran.y * dqRot.x + tran.z * dqRot.w);
-	dqTran.w = -0.5f * (tran.x * dqRot.x + tran.y * dqRot.y + tran.z * dqRot.z);
+	// The influence ranges, plus the quantization box of the positions
+	const auto numConstants = 2 * MAX_INFLUENCES + 1;
+
+	return m_vertexFormat == VERTEX_FORMAT_OCT_QUANTIZED ? numConstants + 4 : numConstants;
+}
+
+void Character::setInlineSkinningLayout(Util::PipelineLayout &utilPipelineLayout, VertexShader vs) const
+{
+	D3D12_SHADER_INPUT_BIND_DESC desc;
+	auto cbInlineSkinning = 1u;
+	auto roBoneWorld = 0u;
+	auto roScales = roBoneWorld + 1;
+
+	// Get vertex shader slots
+	const auto reflector = m_shaderPool->GetReflector(Shader::Stage::VS, vs);
+	if (reflector)
+	{
+		// Get constant buffer slot
+		auto hr = reflector->GetResourceBindingDescByName("cbInlineSkinning", &desc);
+		if (SUCCEEDED(hr)) cbInlineSkinning = desc.BindPoint;
+
+		// Get shader resource slots
+		hr = reflector->GetResourceBindingDescByName("g_roDualQuat", &desc);
+		if (SUCCEEDED(hr)) roBoneWorld = desc.BindPoint;
+
+		hr = reflector->GetResourceBindingDescByName("g_roScales", &desc);
+		if (SUCCEEDED(hr)) roScales = desc.BindPoint;
+	}
+
+	// Skinning mode, and the offsets of the palette of the previous frame
+	utilPipelineLayout.SetConstants(INLINE_CONSTANTS, 3, cbInlineSkinning, 0, Shader::Stage::VS);
+
+	// Bone matrices in the ring buffer
+	utilPipelineLayout.SetRootSRV(INLINE_BONES, roBoneWorld, 0,
+		D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, Shader::Stage::VS);
+
+	// Sparse scaling stream of the compact bones
+	if (m_boneFormat == BONE_FORMAT_COMPACT) utilPipelineLayout.SetRootSRV(INLINE_SCALES, roScales, 0,
+		D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, Shader::Stage::VS);
 }
 
-FXMMATRIX Character::getDualQuat(uint32_t mesh, uint32_t influence) const
+VertexShader Character::getBasePassVS() const
 {
-	const auto influenceMatrix = m_mesh->GetMeshInfluenceMatrix(mesh, influence);
+	C_RETURN(!m_isInlineSkinning, Model::getBasePassVS());
+
+	return m_boneFormat == BONE_FORMAT_COMPACT ? VS_BASE_PASS_SKINNING_COMPACT : VS_BASE_PASS_SKINNING;
+}
 
-	XMMATRIX quatMatrix;
-	XMMatrixDecompose(&quatMatrix.r[2], &quatMatrix.r[0], &quatMatrix.r[1], influenceMatrix);
+VertexShader Character::getDepthVS() const
+{
+	C_RETURN(!m_isInlineSkinning, Model::getDepthVS());
 
-	XMFLOAT3 translation;
-	XMStoreFloat3(&translation, quatMatrix.r[1]);
+	return m_boneFormat == BONE_FORMAT_COMPACT ? VS_DEPTH_SKINNING_COMPACT : VS_DEPTH_SKINNING;
+}
 
-	XMFLOAT4 dqTran;
-	convertToDQ(dqTran, quatMatrix.r[0], translation);
-	quatMatrix.r[1] = XMLoadFloat4(&dqTran);
+uint32_t Character::getBoneSize() const
+{
+	return static_cast<uint32_t>(m_boneFormat == BONE_FORMAT_COMPACT ?
+		sizeof(CPUSkinning::CompactBone) : sizeof(XMFLOAT4X3));
+}
 
-	return quatMatrix;
+uint32_t Character::getPaletteSize() const
+{
+	return getBoneSize() * static_cast<uint32_t>(m_palette.size());
 }
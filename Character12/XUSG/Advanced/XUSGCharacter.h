@@ -6,9 +6,12 @@
 
 #include "Core/XUSGComputeState.h"
 #include "XUSGModel.h"
+#include "XUSGSkinning.h"
 
 namespace XUSG
 {
+	class SkinningBatcher;
+
 	class Character :
 		public Model
 	{
@@ -20,6 +23,13 @@ namespace XUSG
 			DirectX::XMUINT4	TanBiNrm;
 		};
 
+		// Bone palette encoding
+		enum BoneFormat : uint8_t
+		{
+			BONE_FORMAT_DQ_SCALE,	// 12 floats per bone: rotation, dual part, and scaling
+			BONE_FORMAT_COMPACT		// 8 dwords per bone, plus a sparse scaling stream; DQS modes only
+		};
+
 		struct MeshLink
 		{
 			std::wstring		MeshName;
@@ -27,6 +37,50 @@ namespace XUSG
 			uint32_t			BoneIndex;
 		};
 
+		// Commands recorded by a skinning pass
+		struct SkinningStats
+		{
+			uint32_t	NumDispatches;
+			uint32_t	NumDescriptorTables;	// Descriptor table binds
+			uint32_t	NumRanges;				// Influence ranges of the mesh instances skinned
+			uint32_t	NumSkipped;				// Mesh instances with unchanged palettes
+			uint32_t	NumGroups;				// Thread groups dispatched
+		};
+
+		// Counters of the per-frame pose state machine
+		struct PoseStats
+		{
+			uint64_t			NumUpdates;			// Frames started by Update()
+			uint64_t			NumEvaluations;		// Poses evaluated by TransformMesh()
+			uint64_t			NumUploads;			// Palettes written to the ring buffer
+			uint64_t			NumReuses;			// Requests served by the evaluated pose or palette
+			uint64_t			NumBonesEvaluated;	// Animated bones sampled in total
+			uint64_t			NumBonesSkipped;	// Animated bones held by LOD in total
+			uint64_t			NumSkins;			// Meshes skinned on the GPU
+			uint64_t			NumSkinsSkipped;	// Meshes with unchanged palettes, not skinned again
+			uint32_t			FrameBonesEvaluated;	// Animated bones sampled in the current frame
+			uint32_t			FrameBonesSkipped;		// Animated bones held by LOD in the current frame
+		};
+
+		// Animation level of detail, selected by the projected size of the bounding sphere
+		struct AnimationLOD
+		{
+			float				MinScreenSize;		// Projected radius relative to the half viewport height
+			uint8_t				UpdateInterval;		// Evaluate the pose every n frames
+			uint8_t				MinBoneHeight;		// Hold the bones with fewer levels of descendants, e.g. fingers
+			bool				Interpolate;		// Blend the last 2 poses in between, one interval late
+		};
+
+		// Bone palette traffic of the current frame
+		struct PaletteStats
+		{
+			uint32_t			NumBones;
+			uint32_t			NumScaledBones;		// Entries in the sparse scaling stream
+			uint32_t			UploadSize;			// Bytes written into the ring buffer
+			uint32_t			ReferenceSize;		// Bytes the same palette takes in BONE_FORMAT_DQ_SCALE
+			uint32_t			BytesPerInfluence;	// Fetched by the skinning shader, scaling excluded
+		};
+
 		Character(const Device &device, const CommandList &commandList, const wchar_t *name = nullptr);
 		virtual ~Character();
 
@@ -37,10 +91,15 @@ namespace XUSG
 			const std::shared_ptr<Compute::PipelineCache> &computePipelineCache,
 			const std::shared_ptr<PipelineLayoutCache> &pipelineLayoutCache,
 			const std::shared_ptr<DescriptorTableCache> &descriptorTableCache,
+			const std::shared_ptr<RingBuffer> &ringBuffer,
 			const std::shared_ptr<std::vector<SDKMesh>> &linkedMeshes = nullptr,
 			const std::shared_ptr<std::vector<MeshLink>> &meshLinks = nullptr,
 			const Format *rtvFormats = nullptr, uint32_t numRTVs = 0,
-			Format dsvFormat = Format(0), Format shadowFormat = Format(0));
+			Format dsvFormat = Format(0), Format shadowFormat = Format(0),
+			BoneFormat boneFormat = BONE_FORMAT_DQ_SCALE,
+			SkinningMode skinningMode = SKINNING_DQS4,
+			VertexFormat vertexFormat = VERTEX_FORMAT_HALF,
+			bool isInlineSkinning = false);
 		void InitPosition(const DirectX::XMFLOAT4 &posRot);
 		void Update(uint8_t frameIndex, double time);
 		void Update(uint8_t frameIndex, double time, DirectX::CXMMATRIX viewProj,
@@ -50,24 +109,65 @@ namespace XUSG
 			DirectX::FXMMATRIX *pShadowView = nullptr, DirectX::FXMMATRIX *pShadows = nullptr,
 			uint8_t numShadows = 0, bool isTemporal = true);
 		void SetSkinningPipeline();
-		void Skinning(bool reset = false);
+		void SetAnimationLODs(const AnimationLOD *pLODs, uint8_t numLODs);	// In decreasing MinScreenSize
+		void Skinning(bool reset = false);	// Only uploads the pose in the inline skinning
+
+		// Renders the skinned VBs, or skins the source VBs in the vertex shader in the inline skinning
 		void RenderTransformed(SubsetFlags subsetFlags = SUBSET_FULL, uint8_t matrixTableIndex = CBV_MATRICES,
 			PipelineLayoutIndex layout = NUM_PIPE_LAYOUT, uint32_t numInstances = 1);
 
+		// Skin the meshes on the CPU with the current pose, e.g. for hit detection;
+		// pVertices receives one vertex array per mesh
+		bool SkinCPU(std::vector<CPUSkinning::OutputVertex> *pVertices, JobSystem *pJobSystem = nullptr);
+
 		const DirectX::XMFLOAT4 &GetPosition() const;
 		DirectX::FXMMATRIX GetWorldMatrix() const;
+		const AnimationPose &GetPose() const;
+		const PoseStats &GetPoseStats() const;
+		PaletteStats GetPaletteStats() const;
+		BoneFormat GetBoneFormat() const;
+		SkinningMode GetSkinningMode() const;
+		VertexFormat GetVertexFormat() const;
+		bool IsInlineSkinning() const;
+		uint8_t GetAnimationLOD() const;
+		uint64_t GetUpdateStamp() const;	// Increased by each Update()
+
+		// Ring buffer space written per frame, for sizing the ring buffer
+		uint32_t GetDynamicDataSize(uint8_t numShadows = 0) const;
+
+		// Whether the bone palette of the update of the stamp, e.g. GetUpdateStamp() when the frame
+		// was recorded, is uploaded and not retired yet
+		bool IsPoseResident(uint64_t updateStamp) const;
+
+		// Largest difference between the decoded compact palette and the reference palette
+		float GetPaletteError() const;
 
 		static std::shared_ptr<SDKMesh> LoadSDKMesh(const Device &device, const std::wstring &meshFileName,
 			const std::wstring &animFileName, const TextureCache &textureCache,
 			const std::shared_ptr<std::vector<MeshLink>> &meshLinks = nullptr,
-			std::vector<SDKMesh> *pLinkedMeshes = nullptr);
+			std::vector<SDKMesh> *pLinkedMeshes = nullptr,
+			const std::shared_ptr<UploadManager> &uploadManager = nullptr);
+
+		// Binds the animation and the links to the loaded mesh, the last CPU stage of LoadSDKMesh()
+		static bool BindSDKMesh(SDKMesh &mesh, const std::shared_ptr<const AnimationClip> &clip,
+			const std::shared_ptr<std::vector<MeshLink>> &meshLinks = nullptr);
 
 	protected:
+		friend class SkinningBatcher;
+
 		enum DescriptorTableSlot : uint8_t
 		{
 			INPUT,
 			OUTPUT,
-			HISTORY = PER_OBJECT
+			BONE_WORLDS,
+			INFLUENCE_RANGES,
+			BONE_SCALES,
+			HISTORY = PER_OBJECT,
+
+			// Base pass and depth pass in the inline skinning
+			INLINE_CONSTANTS = PER_OBJECT,
+			INLINE_BONES = IMMUTABLE + 1,
+			INLINE_SCALES
 		};
 
 		bool createTransformedStates();
@@ -77,43 +177,113 @@ namespace XUSG
 		bool createPipelines(const InputLayout &inputLayout, const Format *rtvFormats,
 			uint32_t numRTVs, Format dsvFormat, Format shadowFormat);
 		bool createDescriptorTables();
-		virtual void setLinkedMatrices(uint32_t mesh, DirectX::CXMMATRIX viewProj,
+		virtual void setLinkedMatrices(uint32_t bone, DirectX::CXMMATRIX viewProj,
 			DirectX::CXMMATRIX world, DirectX::FXMMATRIX *pShadowView,
 			DirectX::FXMMATRIX *pShadows, uint8_t numShadows, bool isTemporal);
-		void skinning(bool reset);
+		void skinning(bool reset, SkinningStats *pStats = nullptr);
 		void renderTransformed(SubsetFlags subsetFlags, uint8_t matrixTableIndex,
 			PipelineLayoutIndex layout, uint32_t numInstances);
+		void renderInline(SubsetFlags subsetFlags, uint8_t matrixTableIndex,
+			PipelineLayoutIndex layout, uint32_t numInstances);
 		void renderLinked(uint32_t mesh, uint8_t matrixTableIndex,
 			PipelineLayoutIndex layout, uint32_t numInstances);
-		void setSkeletalMatrices(uint32_t numMeshes);
-		void setBoneMatrices(uint32_t mesh);
-		void convertToDQ(DirectX::XMFLOAT4 &dqTran, DirectX::CXMVECTOR quat,
-			const DirectX::XMFLOAT3 &tran) const;
-		DirectX::FXMMATRIX getDualQuat(uint32_t mesh, uint32_t influence) const;
+		void selectAnimationLOD(DirectX::CXMMATRIX viewProj, DirectX::FXMMATRIX *pWorld);
+		void evaluatePose();
+		void uploadPose();
+		void updatePalette();
+		uint64_t getResidentStamp(uint64_t updateStamp) const;
+		void hashPalette();
+		bool prepareSkinning(uint32_t mesh);
+		void setBoneMatrices();
+		DirectX::XMMATRIX getBoneMatrix(uint32_t frame) const;
+		BoneTransform getBoneTransform(uint32_t frame) const;
+		ComputeShader getSkinningShader(bool isBatched = false) const;
+		uint32_t getNumSkinningConstants() const;
+		void setInlineSkinningLayout(Util::PipelineLayout &utilPipelineLayout, VertexShader vs) const;
+		virtual VertexShader getBasePassVS() const;
+		virtual VertexShader getDepthVS() const;
+		uint32_t getBoneSize() const;
+		uint32_t getPaletteSize() const;		// Without the scaling stream
 
 		std::shared_ptr<Compute::PipelineCache> m_computePipelineCache;
 
 		VertexBuffer m_transformedVBs[FrameCount];
 		DirectX::XMFLOAT4X4	m_mWorld;
 		DirectX::XMFLOAT4	m_vPosRot;
+		DirectX::XMFLOAT4	m_positionBox;	// Quantization box of the skinned positions: min corner and size
 
+		// Pose state: the pose is evaluated at most once per update, converted into the bone
+		// palette only when it changes, and written once per update into the ring buffer
 		double m_time;
+		AnimationPose m_pose;
+		uint64_t m_updateStamp;
+		uint64_t m_poseStamp;
+		uint64_t m_paletteStamp;
+		uint64_t m_uploadStamp;
+		PoseStats m_poseStats;
 
-		StructuredBuffer m_boneWorlds[FrameCount];
+		// Animation LOD
+		std::vector<AnimationLOD> m_animationLODs;
+		uint8_t m_animationLOD;
+		DirectX::XMFLOAT4 m_boundingSphere;		// Center and radius in object space
+		AnimationPose m_previousPose;			// For interpolation between updates
+		uint64_t m_previousPoseStamp;
+		float m_poseBlend;
+
+		// Bone palette shared by the meshes, see SDKMesh::GetBoneRemap(): per bone, the transposed
+		// rows of the dual quaternion and scaling, or the bone matrix in the linear blend modes
+		SkinningMode m_skinningMode;
+		std::vector<DirectX::XMFLOAT4X3> m_palette;
+		std::vector<uint32_t> m_firstBones;		// Added to the bone indices of each mesh, 0 if remapped
+		uint32_t m_paletteOffset;				// In the ring buffer for the current frame
+		std::vector<std::vector<CPUSkinning::InputVertex>> m_cpuVertices;	// Of each VB as uploaded, for SkinCPU()
+
+		// Inline skinning in the vertex shaders, without the skinned VBs; the palette of the
+		// previous frame follows the palette for the motion history
+		bool m_isInlineSkinning;
+#if TEMPORAL
+		std::vector<uint8_t> m_historyPalette;
+		std::vector<DirectX::XMFLOAT3> m_historyScales;
+#endif
+
+		// Compact encoding of the palette, if selected
+		BoneFormat m_boneFormat;
+		std::vector<CPUSkinning::CompactBone> m_compactBones;
+		std::vector<DirectX::XMFLOAT3> m_boneScales;
+		uint32_t m_numScaledBones;
+		uint32_t m_scaleOffset;					// In the ring buffer for the current frame
+
+		// Shared palette of a SkinningBatcher for the current frame, if any
+		uint8_t *m_pBatchedPalette;
+		DirectX::XMFLOAT3 *m_pBatchedScales;
+		uint32_t m_batchedPaletteOffset;
+		uint32_t m_batchedScaleOffset;
+
+		// Change detection: a mesh is skinned again only if the hash of its palette changes,
+		// and is otherwise rendered from the VB it was last skinned into
+		std::vector<uint64_t> m_boneHashes;		// Of each bone of the current palette
+		std::vector<uint64_t> m_meshHashes;		// Of the current palette
+		std::vector<uint64_t> m_skinnedHashes;	// Of the palette last skinned
+		std::vector<uint8_t> m_skinnedFrames;	// VB holding the latest vertices, or FrameCount
+		std::vector<uint8_t> m_historyFrames;	// VB holding the vertices of the previous frame
 
 		PipelineLayout	m_skinningPipelineLayout;
 		Pipeline		m_skinningPipeline;
-		std::vector<DescriptorTable> m_srvSkinningTables[FrameCount];
+		std::vector<DescriptorTable> m_srvSkinningTables;
 		std::vector<DescriptorTable> m_uavSkinningTables[FrameCount];
 #if TEMPORAL
 		std::vector<DescriptorTable> m_srvSkinnedTables[FrameCount];
 
-		std::vector<DirectX::XMFLOAT4X4> m_linkedWorldViewProjs[FrameCount];
+		std::vector<DirectX::XMFLOAT4X4> m_linkedWorldViewProjs[FrameCount];	// Per linked bone
 #endif
 
 		std::shared_ptr<std::vector<SDKMesh>>	m_linkedMeshes;
 		std::shared_ptr<std::vector<MeshLink>>	m_meshLinks;
 
+		// Matrices of each bone followed by the linked meshes, shared by the links to the bone
+		std::vector<uint32_t> m_linkedBones;	// Frame of each linked bone
+		std::vector<uint32_t> m_linkedSlots;	// Linked bone of each mesh link
+
 		std::vector<ConstantBuffer> m_cbLinkedMatrices;
 		std::vector<ConstantBuffer> m_cbLinkedShadowMatrices;
 	};
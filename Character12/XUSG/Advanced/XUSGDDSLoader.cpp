@@ -407,8 +407,13 @@ static bool FillInitData(uint32_t width, uint32_t height, uint32_t depth,
 static bool CreateTexture(const Device &device, const CommandList &commandList,
 	const DDS_HEADER* header, const uint8_t *bitData, size_t bitSize, size_t maxsize,
 	bool forceSRGB, shared_ptr<ResourceBase> &texture, Resource &uploader,
-	const wchar_t *name)
+	const wchar_t *name, ResourceState dstState)
 {
+	// Uploaded on a copy queue, the texture stays in the common state, and is promoted
+	// implicitly to the shader resource states on its first use
+	const auto initState = dstState == D3D12_RESOURCE_STATE_COMMON ?
+		D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_COPY_DEST;
+
 	const auto width = header->width;
 	auto height = header->height;
 	auto depth = header->depth;
@@ -558,15 +563,14 @@ static bool CreateTexture(const Device &device, const CommandList &commandList,
 			{
 				const auto fmt = forceSRGB ? MakeSRGB(format) : format;
 				success = texture2D->Create(device, twidth, theight, fmt, arraySize, ResourceFlags(0),
-					mipCount - skipMip, 1, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST, isCubeMap, name);
-				if (success) success = texture2D->Upload(commandList, uploader, initData.get(), subresourceCount,
-					D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+					mipCount - skipMip, 1, D3D12_HEAP_TYPE_DEFAULT, initState, isCubeMap, name);
+				if (success) success = texture2D->Upload(commandList, uploader, initData.get(), subresourceCount, dstState);
 			}
 			else if (texture3D)
 			{
 				const auto fmt = forceSRGB ? MakeSRGB(format) : format;
 				success = texture3D->Create(device, twidth, theight, tdepth, fmt, ResourceFlags(0),
-					mipCount - skipMip, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST, name);
+					mipCount - skipMip, D3D12_HEAP_TYPE_DEFAULT, initState, name);
 			}
 			else V_RETURN(ERROR_NOT_SUPPORTED, cerr, false);
 
@@ -585,16 +589,15 @@ static bool CreateTexture(const Device &device, const CommandList &commandList,
 						const auto fmt = forceSRGB ? MakeSRGB(format) : format;
 						texture = make_shared<Texture2D>();
 						success = texture2D->Create(device, width, height, fmt, arraySize, ResourceFlags(0), mipCount,
-							1, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST, isCubeMap, name);
-						if (success) success = texture2D->Upload(commandList, uploader, initData.get(), subresourceCount,
-							D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+							1, D3D12_HEAP_TYPE_DEFAULT, initState, isCubeMap, name);
+						if (success) success = texture2D->Upload(commandList, uploader, initData.get(), subresourceCount, dstState);
 					}
 					else if (texture3D)
 					{
 						const auto fmt = forceSRGB ? MakeSRGB(format) : format;
 						texture = make_shared<Texture3D>();
 						success = texture3D->Create(device, width, height, depth, fmt, ResourceFlags(0),
-							mipCount, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST, name);
+							mipCount, D3D12_HEAP_TYPE_DEFAULT, initState, name);
 					}
 					else V_RETURN(ERROR_NOT_SUPPORTED, cerr, false);
 				}
@@ -645,7 +648,8 @@ Loader::~Loader()
 
 bool Loader::CreateTextureFromMemory(const Device &device, const CommandList &commandList,
 	const uint8_t *ddsData, size_t ddsDataSize, size_t maxsize, bool forceSRGB,
-	std::shared_ptr<ResourceBase>& texture, Resource &uploader, AlphaMode *alphaMode)
+	std::shared_ptr<ResourceBase>& texture, Resource &uploader, AlphaMode *alphaMode,
+	ResourceState dstState)
 {
 	if (alphaMode) *alphaMode = ALPHA_MODE_UNKNOWN;
 	F_RETURN(!device || !ddsData, cerr, E_INVALIDARG, false);
@@ -672,7 +676,7 @@ bool Loader::CreateTextureFromMemory(const Device &device, const CommandList &co
 	C_RETURN(ddsDataSize < offset, false);
 
 	N_RETURN(CreateTexture(device, commandList, header, ddsData + offset, ddsDataSize - offset,
-		maxsize, forceSRGB, texture, uploader, L"DDSTextureLoader"), false);
+		maxsize, forceSRGB, texture, uploader, L"DDSTextureLoader", dstState), false);
 
 	if (alphaMode) *alphaMode = GetAlphaMode(header);
 
@@ -681,7 +685,7 @@ bool Loader::CreateTextureFromMemory(const Device &device, const CommandList &co
 
 bool Loader::CreateTextureFromFile(const Device &device, const CommandList &commandList,
 	const wchar_t *fileName, size_t maxsize, bool forceSRGB, shared_ptr<ResourceBase> &texture,
-	Resource &uploader, AlphaMode *alphaMode)
+	Resource &uploader, AlphaMode *alphaMode, ResourceState dstState)
 {
 	if (alphaMode) *alphaMode = ALPHA_MODE_UNKNOWN;
 	F_RETURN(!device || !fileName, cerr, E_INVALIDARG, false);
@@ -694,13 +698,34 @@ bool Loader::CreateTextureFromFile(const Device &device, const CommandList &comm
 	N_RETURN(LoadTextureDataFromFile(fileName, ddsData, &header, &bitData, &bitSize), false);
 
 	N_RETURN(CreateTexture(device, commandList, header, bitData, bitSize,
-		maxsize, forceSRGB, texture, uploader, fileName), false);
+		maxsize, forceSRGB, texture, uploader, fileName, dstState), false);
 
 	if (alphaMode) *alphaMode = GetAlphaMode(header);
 
 	return true;
 }
 
+bool Loader::ReadTextureFile(const wchar_t *fileName, vector<uint8_t> &ddsData)
+{
+	F_RETURN(!fileName, cerr, E_INVALIDARG, false);
+
+	// Open the file
+	ifstream fileStream(fileName, ios::in | ios::binary);
+	F_RETURN(!fileStream, cerr, GetLastError(), false);
+
+	// Get the file size
+	fileStream.seekg(0, fileStream.end);
+	const auto fileSize = static_cast<uint32_t>(fileStream.tellg());
+	C_RETURN(!fileStream.seekg(0), false);
+
+	// Validated by CreateTextureFromMemory()
+	ddsData.resize(fileSize);
+	F_RETURN(!fileStream.read(reinterpret_cast<char*>(ddsData.data()), fileSize),
+		cerr, GetLastError(), false);
+
+	return true;
+}
+
 size_t Loader::BitsPerPixel(DXGI_FORMAT fmt)
 {
 	switch (fmt)
@@ -22,16 +22,23 @@ namespace XUSG
 		class Loader
 		{
 		public:
+			// Pass the common state as the destination state to upload on a copy queue
+			static const ResourceState ShaderResourceState = ResourceState(
+				D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
 			Loader();
 			virtual ~Loader();
 
 			bool CreateTextureFromMemory(const Device &device, const CommandList &commandList, const uint8_t* ddsData,
 				size_t ddsDataSize, size_t maxsize, bool forceSRGB, std::shared_ptr<ResourceBase> &texture,
-				Resource &uploader, AlphaMode* alphaMode = nullptr);
+				Resource &uploader, AlphaMode* alphaMode = nullptr, ResourceState dstState = ShaderResourceState);
 
 			bool CreateTextureFromFile(const Device &device, const CommandList &commandList, const wchar_t* fileName,
 				size_t maxsize, bool forceSRGB, std::shared_ptr<ResourceBase> &texture, Resource &uploader,
-				AlphaMode* alphaMode = nullptr);
+				AlphaMode* alphaMode = nullptr, ResourceState dstState = ShaderResourceState);
+
+			// Reads the file on any thread, for CreateTextureFromMemory() on the recording thread
+			static bool ReadTextureFile(const wchar_t *fileName, std::vector<uint8_t> &ddsData);
 
 			static size_t BitsPerPixel(DXGI_FORMAT fmt);
 		};
@@ -0,0 +1,180 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include "Core/XUSGMacros.h"
+#include "XUSGJobSystem.h"
+
+using namespace std;
+using namespace XUSG;
+
+// Worker of the running thread, if any
+static thread_local const JobSystem *t_pJobSystem = nullptr;
+static thread_local uint32_t t_worker = 0;
+
+JobSystem::JobSystem(uint32_t numWorkers) :
+	m_queues(0),
+	m_workers(0),
+	m_numQueuedJobs(0),
+	m_numPendingJobs(0),
+	m_nextQueue(0),
+	m_isRunning(true)
+{
+	if (numWorkers == 0)
+	{
+		const auto numCores = thread::hardware_concurrency();
+		numWorkers = numCores > 1 ? numCores - 1 : 1;
+	}
+
+	m_queues.resize(numWorkers + 1);
+	for (auto &queue : m_queues) queue = make_unique<WorkQueue>();
+
+	m_workers.reserve(numWorkers);
+	for (auto i = 0u; i < numWorkers; ++i) m_workers.emplace_back(&JobSystem::work, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	Wait();
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_isRunning = false;
+	}
+	m_workAvailable.notify_all();
+
+	for (auto &worker : m_workers) worker.join();
+}
+
+void JobSystem::Submit(const Job &job, Counter *pCounter)
+{
+	++m_numPendingJobs;
+	if (pCounter) ++*pCounter;
+
+	// Count the job as queued before it can be popped, so that the count never wraps
+	{
+		lock_guard<mutex> lock(m_mutex);
+		++m_numQueuedJobs;
+	}
+
+	// Distribute the jobs round-robin; idle workers steal to rebalance
+	const auto queue = m_nextQueue++ % static_cast<uint32_t>(m_queues.size());
+	{
+		lock_guard<mutex> lock(m_queues[queue]->Mutex);
+		m_queues[queue]->Tasks.push_back({ job, pCounter });
+	}
+	m_workAvailable.notify_one();
+}
+
+void JobSystem::Wait(const Counter &counter)
+{
+	join(&counter, [&counter]() { return counter == 0; });
+}
+
+void JobSystem::Wait()
+{
+	join(nullptr, [this]() { return m_numPendingJobs == 0; });
+}
+
+void JobSystem::ParallelFor(uint32_t numJobs, const function<void(uint32_t)> &job, uint32_t batchSize)
+{
+	Counter counter(0);
+	batchSize = (max)(batchSize, 1u);
+	for (auto i = 0u; i < numJobs; i += batchSize)
+	{
+		const auto end = (min)(i + batchSize, numJobs);
+		Submit([&job, i, end]() { for (auto j = i; j < end; ++j) job(j); }, &counter);
+	}
+
+	Wait(counter);
+}
+
+uint32_t JobSystem::GetNumWorkers() const
+{
+	return static_cast<uint32_t>(m_workers.size());
+}
+
+void JobSystem::work(uint32_t worker)
+{
+	t_pJobSystem = this;
+	t_worker = worker;
+
+	while (true)
+	{
+		Task task;
+		if (pop(worker, task, nullptr) || steal(worker, task, nullptr))
+		{
+			execute(task);
+			continue;
+		}
+
+		unique_lock<mutex> lock(m_mutex);
+		m_workAvailable.wait(lock, [this]() { return !m_isRunning || m_numQueuedJobs > 0; });
+		if (!m_isRunning) break;
+	}
+}
+
+// Take the newest job of the queue, of the counter if any
+bool JobSystem::pop(uint32_t queue, Task &task, const Counter *pCounter)
+{
+	auto &workQueue = *m_queues[queue];
+	lock_guard<mutex> lock(workQueue.Mutex);
+
+	const auto taskIter = find_if(workQueue.Tasks.rbegin(), workQueue.Tasks.rend(),
+		[pCounter](const Task &t) { return !pCounter || t.pCounter == pCounter; });
+	C_RETURN(taskIter == workQueue.Tasks.rend(), false);
+
+	task = move(*taskIter);
+	workQueue.Tasks.erase(next(taskIter).base());
+	--m_numQueuedJobs;
+
+	return true;
+}
+
+// Take the oldest job of another queue, of the counter if any
+bool JobSystem::steal(uint32_t thief, Task &task, const Counter *pCounter)
+{
+	const auto numQueues = static_cast<uint32_t>(m_queues.size());
+	for (auto i = 1u; i < numQueues; ++i)
+	{
+		auto &workQueue = *m_queues[(thief + i) % numQueues];
+		lock_guard<mutex> lock(workQueue.Mutex);
+
+		const auto taskIter = find_if(workQueue.Tasks.begin(), workQueue.Tasks.end(),
+			[pCounter](const Task &t) { return !pCounter || t.pCounter == pCounter; });
+		if (taskIter == workQueue.Tasks.end()) continue;
+
+		task = move(*taskIter);
+		workQueue.Tasks.erase(taskIter);
+		--m_numQueuedJobs;
+
+		return true;
+	}
+
+	return false;
+}
+
+void JobSystem::execute(const Task &task)
+{
+	task.Function();
+	if (task.pCounter) --*task.pCounter;
+	--m_numPendingJobs;
+}
+
+// The waiting thread helps out until done
+void JobSystem::join(const Counter *pCounter, const function<bool()> &isDone)
+{
+	const auto queue = getQueue();
+	while (!isDone())
+	{
+		Task task;
+		if (pop(queue, task, pCounter) || steal(queue, task, pCounter)) execute(task);
+		else this_thread::yield();
+	}
+}
+
+uint32_t JobSystem::getQueue() const
+{
+	return t_pJobSystem == this ? t_worker : static_cast<uint32_t>(m_workers.size());
+}
@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Work-stealing job system: one worker per core, each with its own deque. Workers pop
+	// their own jobs from the back and steal from the front of the others. A job may count
+	// on a counter of its submitter, which Wait(counter) joins: the waiting thread only
+	// helps with the jobs of that counter, so ParallelFor nests inside jobs, and a frame
+	// never waits on unrelated jobs such as the mesh loads.
+	//--------------------------------------------------------------------------------------
+	class JobSystem
+	{
+	public:
+		using Job = std::function<void()>;
+		using Counter = std::atomic<uint32_t>;	// Jobs not finished yet
+
+		JobSystem(uint32_t numWorkers = 0);	// 0 for one worker per core besides the caller
+		virtual ~JobSystem();
+
+		void Submit(const Job &job, Counter *pCounter = nullptr);
+		void Wait(const Counter &counter);	// Until the jobs of the counter have finished
+		void Wait();						// Until every submitted job has finished
+
+		// Run job(i) for i in [0, numJobs) in batches of batchSize, then wait for them
+		void ParallelFor(uint32_t numJobs, const std::function<void(uint32_t)> &job, uint32_t batchSize = 1);
+
+		uint32_t GetNumWorkers() const;
+
+	protected:
+		struct Task
+		{
+			Job			Function;
+			Counter		*pCounter;
+		};
+
+		struct WorkQueue
+		{
+			std::mutex			Mutex;
+			std::deque<Task>	Tasks;
+		};
+
+		void work(uint32_t worker);
+		bool pop(uint32_t queue, Task &task, const Counter *pCounter);
+		bool steal(uint32_t thief, Task &task, const Counter *pCounter);
+		void execute(const Task &task);
+		void join(const Counter *pCounter, const std::function<bool()> &isDone);
+		uint32_t getQueue() const;
+
+		std::vector<std::unique_ptr<WorkQueue>> m_queues;	// The last queue belongs to the other threads
+		std::vector<std::thread> m_workers;
+
+		std::mutex				m_mutex;
+		std::condition_variable	m_workAvailable;
+		std::atomic<uint32_t>	m_numQueuedJobs;
+		std::atomic<uint32_t>	m_numPendingJobs;
+		std::atomic<uint32_t>	m_nextQueue;
+		bool					m_isRunning;
+	};
+}
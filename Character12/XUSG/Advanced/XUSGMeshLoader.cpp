@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "XUSGMeshLoader.h"
+
+using namespace std;
+using namespace XUSG;
+
+MeshLoader::MeshLoader(const Device &device, JobSystem *pJobSystem,
+	const shared_ptr<UploadManager> &uploadManager, const TextureCache &textureCache) :
+	m_device(device),
+	m_pJobSystem(pJobSystem),
+	m_uploadManager(uploadManager),
+	m_textureCache(textureCache),
+	m_preparedMeshes(0),
+	m_numPending(0),
+	m_numJobs(0)
+{
+}
+
+MeshLoader::~MeshLoader()
+{
+	// The jobs refer to the loader
+	m_pJobSystem->Wait(m_numJobs);
+}
+
+shared_ptr<SDKMesh> MeshLoader::LoadSDKMesh(const wstring &meshFileName, bool isStaticMesh)
+{
+	const auto mesh = make_shared<SDKMesh>();
+	N_RETURN(mesh, nullptr);
+	mesh->SetLoading(true);
+	++m_numPending;
+
+	m_pJobSystem->Submit([this, mesh, meshFileName, isStaticMesh]()
+	{
+		setPrepared(mesh.get(), mesh, mesh->Prepare(meshFileName.c_str(), m_textureCache, isStaticMesh));
+	}, &m_numJobs);
+
+	return mesh;
+}
+
+shared_ptr<SDKMesh> MeshLoader::LoadCharacterSDKMesh(const wstring &meshFileName,
+	const wstring &animFileName, const shared_ptr<vector<Character::MeshLink>> &meshLinks,
+	vector<SDKMesh> *pLinkedMeshes)
+{
+	const auto load = make_shared<CharacterLoad>();
+	N_RETURN(load, nullptr);
+	load->Mesh = make_shared<SDKMesh>();
+	N_RETURN(load->Mesh, nullptr);
+	load->MeshLinks = meshLinks;
+	load->Succeeded = true;
+	load->NumDependencies = 2;
+	load->Mesh->SetLoading(true);
+	++m_numPending;
+
+	// The mesh and the clip are read in parallel, and whichever finishes last binds them
+	m_pJobSystem->Submit([this, load, meshFileName]()
+	{
+		if (!load->Mesh->Prepare(meshFileName.c_str(), m_textureCache)) load->Succeeded = false;
+		if (--load->NumDependencies == 0) bindCharacter(load);
+	}, &m_numJobs);
+
+	m_pJobSystem->Submit([this, load, animFileName]()
+	{
+		load->Clip = AnimationClipRegistry::GetClip(animFileName);
+		if (--load->NumDependencies == 0) bindCharacter(load);
+	}, &m_numJobs);
+
+	// The linked meshes only depend on the main mesh for their bones, which are bound with it
+	if (meshLinks)
+	{
+		const auto numLinks = static_cast<uint32_t>(meshLinks->size());
+		pLinkedMeshes->resize(numLinks);
+		for (auto m = 0u; m < numLinks; ++m)
+		{
+			auto &linkedMesh = pLinkedMeshes->at(m);
+			linkedMesh.SetLoading(true);
+			++m_numPending;
+
+			m_pJobSystem->Submit([this, &linkedMesh, meshName = meshLinks->at(m).MeshName]()
+			{
+				setPrepared(&linkedMesh, nullptr, linkedMesh.Prepare(meshName.c_str(), m_textureCache));
+			}, &m_numJobs);
+		}
+	}
+
+	return load->Mesh;
+}
+
+bool MeshLoader::Update()
+{
+	vector<PreparedMesh> preparedMeshes;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		preparedMeshes.swap(m_preparedMeshes);
+	}
+
+	// The failed meshes stay loading
+	auto success = true;
+	for (const auto &mesh : preparedMeshes)
+	{
+		--m_numPending;
+		if (!mesh.Succeeded || !mesh.pMesh->Upload(m_device, m_uploadManager)) success = false;
+	}
+
+	// Start the copy queue on the uploads
+	if (m_uploadManager && !preparedMeshes.empty()) N_RETURN(m_uploadManager->Submit(), false);
+
+	return success;
+}
+
+bool MeshLoader::Flush()
+{
+	// The calling thread joins the workers on the load jobs
+	m_pJobSystem->Wait(m_numJobs);
+
+	return Update();
+}
+
+uint32_t MeshLoader::GetNumPending() const
+{
+	return m_numPending;
+}
+
+void MeshLoader::bindCharacter(const shared_ptr<CharacterLoad> &load)
+{
+	auto &mesh = *load->Mesh;
+	const auto succeeded = load->Succeeded && Character::BindSDKMesh(mesh, load->Clip, load->MeshLinks);
+
+	setPrepared(&mesh, load->Mesh, succeeded);
+}
+
+void MeshLoader::setPrepared(SDKMesh *pMesh, const shared_ptr<SDKMesh> &owner, bool succeeded)
+{
+	if (!succeeded) cerr << "Failed to prepare a mesh." << endl;
+
+	lock_guard<mutex> lock(m_mutex);
+	m_preparedMeshes.push_back({ pMesh, owner, succeeded });
+}
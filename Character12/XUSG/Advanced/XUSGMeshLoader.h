@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "XUSGCharacter.h"
+#include "XUSGJobSystem.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Staged parallel load pipeline: the file mapping, parsing, validation, CPU preprocessing
+	// and texture reads of the meshes, and the animation clips, run as jobs on the job system,
+	// and the prepared meshes are uploaded by Update() on the thread recording the uploads.
+	// A character mesh is bound once both the mesh and its clip are ready, while its linked
+	// meshes are prepared in parallel. The meshes are loading, IsLoading(), from the queuing
+	// until CheckLoadDone() finds their uploads completed on the GPU.
+	//--------------------------------------------------------------------------------------
+	class MeshLoader
+	{
+	public:
+		MeshLoader(const Device &device, JobSystem *pJobSystem,
+			const std::shared_ptr<UploadManager> &uploadManager, const TextureCache &textureCache);
+		virtual ~MeshLoader();
+
+		// The linked meshes and the mesh links are written by the jobs until the meshes are uploaded
+		std::shared_ptr<SDKMesh> LoadSDKMesh(const std::wstring &meshFileName, bool isStaticMesh = false);
+		std::shared_ptr<SDKMesh> LoadCharacterSDKMesh(const std::wstring &meshFileName,
+			const std::wstring &animFileName, const std::shared_ptr<std::vector<Character::MeshLink>> &meshLinks = nullptr,
+			std::vector<SDKMesh> *pLinkedMeshes = nullptr);
+
+		bool Update();	// Uploads the meshes prepared so far, and submits them
+		bool Flush();	// Joins the jobs until all the queued meshes are prepared, then uploads them
+
+		uint32_t GetNumPending() const;	// Queued meshes not uploaded yet
+
+	protected:
+		struct PreparedMesh
+		{
+			SDKMesh						*pMesh;
+			std::shared_ptr<SDKMesh>	Owner;		// Keeps the mesh alive, if shared
+			bool						Succeeded;
+		};
+
+		// Shared by the jobs loading a character mesh
+		struct CharacterLoad
+		{
+			std::shared_ptr<SDKMesh>							Mesh;
+			std::shared_ptr<const AnimationClip>				Clip;
+			std::shared_ptr<std::vector<Character::MeshLink>>	MeshLinks;
+			std::atomic<bool>		Succeeded;
+			std::atomic<uint32_t>	NumDependencies;	// Jobs the binding waits for
+		};
+
+		void bindCharacter(const std::shared_ptr<CharacterLoad> &load);
+		void setPrepared(SDKMesh *pMesh, const std::shared_ptr<SDKMesh> &owner, bool succeeded);
+
+		Device			m_device;
+		JobSystem		*m_pJobSystem;
+		std::shared_ptr<UploadManager> m_uploadManager;
+		TextureCache	m_textureCache;
+
+		std::mutex		m_mutex;
+		std::vector<PreparedMesh> m_preparedMeshes;	// Waiting for Update()
+		uint32_t		m_numPending;
+		JobSystem::Counter m_numJobs;				// Load jobs not finished yet
+	};
+}
@@ -13,13 +13,15 @@ Model::Model(const Device &device, const CommandList &commandList, const wchar_t
 	m_device(device),
 	m_commandList(commandList),
 	m_currentFrame(0),
+	m_vertexFormat(VERTEX_FORMAT_HALF),
 	m_mesh(nullptr),
 	m_shaderPool(nullptr),
 	m_pipelineCache(nullptr),
 	m_descriptorTableCache(nullptr),
+	m_ringBuffer(nullptr),
+	m_cbOffsets(),
 	m_pipelineLayouts(),
 	m_pipelines(),
-	m_cbvTables(),
 	m_samplerTable(nullptr),
 	m_srvTables(0)
 {
@@ -34,19 +36,20 @@ Model::~Model()
 bool Model::Init(const InputLayout &inputLayout, const shared_ptr<SDKMesh> &mesh,
 	const shared_ptr<ShaderPool> &shaderPool, const shared_ptr<PipelineCache> &pipelineCache,
 	const shared_ptr<PipelineLayoutCache> &pipelineLayoutCache,
-	const shared_ptr <DescriptorTableCache> &descriptorTableCache)
+	const shared_ptr <DescriptorTableCache> &descriptorTableCache,
+	const shared_ptr<RingBuffer> &ringBuffer)
 {
 	// Set shader pool and states
 	m_shaderPool = shaderPool;
 	m_pipelineCache = pipelineCache;
 	m_pipelineLayoutCache = pipelineLayoutCache;
 	m_descriptorTableCache = descriptorTableCache;
+	m_ringBuffer = ringBuffer;
 
 	// Get SDKMesh
 	m_mesh = mesh;
 
-	// Create buffers and descriptor tables
-	N_RETURN(createConstantBuffers(), false);
+	// Create descriptor tables
 	N_RETURN(createDescriptorTables(), false);
 
 	return true;
@@ -64,8 +67,16 @@ void Model::SetMatrices(CXMMATRIX viewProj, CXMMATRIX world, FXMMATRIX *pShadowV
 	// Set World-View-Proj matrix
 	const auto worldViewProj = XMMatrixMultiply(world, viewProj);
 
-	// Update constant buffers
-	const auto pCBData = reinterpret_cast<CBMatrices*>(m_cbMatrices.Map(m_currentFrame));
+	// The draws without their matrices in this frame are skipped, as the offsets of the
+	// earlier frames may be reclaimed
+	for (auto &cbOffset : m_cbOffsets) cbOffset = UINT32_MAX;
+
+	// Update constant buffers, suballocated from the ring buffer for this frame
+	const auto cbAlignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+	const auto pCBData = reinterpret_cast<CBMatrices*>(m_ringBuffer->Allocate(sizeof(CBMatrices),
+		cbAlignment, &m_cbOffsets[CBV_MATRICES]));
+	if (!pCBData) return;
+
 	pCBData->WorldViewProj = XMMatrixTranspose(worldViewProj);
 	pCBData->World = XMMatrixTranspose(world);
 	pCBData->Normal = XMMatrixInverse(nullptr, world);
@@ -83,8 +94,10 @@ void Model::SetMatrices(CXMMATRIX viewProj, CXMMATRIX world, FXMMATRIX *pShadowV
 		for (auto i = 0ui8; i < numShadows; ++i)
 		{
 			const auto shadow = XMMatrixMultiply(world, pShadows[i]);
-			auto &cbData = *reinterpret_cast<XMMATRIX*>(m_cbShadowMatrices.Map(m_currentFrame * MAX_SHADOW_CASCADES + i));
-			cbData = XMMatrixTranspose(shadow);
+			const auto pCBShadow = reinterpret_cast<XMMATRIX*>(m_ringBuffer->Allocate(sizeof(XMMATRIX),
+				cbAlignment, &m_cbOffsets[CBV_SHADOW_MATRIX + i]));
+			if (!pCBShadow) return;
+			*pCBShadow = XMMatrixTranspose(shadow);
 		}
 	}
 
@@ -132,6 +145,9 @@ void Model::SetPipelineState(SubsetFlags subsetFlags, PipelineLayoutIndex layout
 void Model::Render(SubsetFlags subsetFlags, uint8_t matrixTableIndex,
 	PipelineLayoutIndex layout, uint32_t numInstances)
 {
+	// No matrices in the ring buffer for this frame
+	if (m_cbOffsets[matrixTableIndex] == UINT32_MAX) return;
+
 	const DescriptorPool descriptorPools[] =
 	{
 		m_descriptorTableCache->GetDescriptorPool(CBV_SRV_UAV_POOL),
@@ -139,7 +155,8 @@ void Model::Render(SubsetFlags subsetFlags, uint8_t matrixTableIndex,
 	};
 	m_commandList.SetDescriptorPools(static_cast<uint32_t>(size(descriptorPools)), descriptorPools);
 	m_commandList.SetGraphicsPipelineLayout(m_pipelineLayouts[layout]);
-	m_commandList.SetGraphicsDescriptorTable(MATRICES, m_cbvTables[m_currentFrame][matrixTableIndex]);
+	m_commandList.SetGraphicsRootConstantBufferView(MATRICES, m_ringBuffer->GetResource(),
+		m_cbOffsets[matrixTableIndex]);
 	m_commandList.SetGraphicsDescriptorTable(SAMPLERS, m_samplerTable);
 
 	const auto numMeshes = m_mesh->GetNumMeshes();
@@ -156,43 +173,68 @@ void Model::Render(SubsetFlags subsetFlags, uint8_t matrixTableIndex,
 	if (layout != NUM_PIPE_LAYOUT) m_commandList.IASetVertexBuffers(0, 1, nullptr);
 }
 
-InputLayout Model::CreateInputLayout(PipelineCache &pipelineCache)
+InputLayout Model::CreateInputLayout(PipelineCache &pipelineCache, VertexFormat vertexFormat)
 {
 	// Define vertex data layout for post-transformed objects
 	const auto offset = 0xffffffff;
-	InputElementTable inputElementDescs =
+	switch (vertexFormat)
 	{
-		{ "POSITION",	0, DXGI_FORMAT_R32G32B32_FLOAT,		0, 0,		D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "NORMAL",		0, DXGI_FORMAT_R16G16B16A16_FLOAT,	0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD",	0, DXGI_FORMAT_R16G16_FLOAT,		0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TANGENT",	0, DXGI_FORMAT_R16G16B16A16_FLOAT,	0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "BINORMAL",	0, DXGI_FORMAT_R16G16B16A16_FLOAT,	0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-	};
+	case VERTEX_FORMAT_OCT:
+	case VERTEX_FORMAT_OCT_QUANTIZED:
+	{
+		// The binormal is reconstructed from the normal, the tangent, and the sign bit of the tangent
+		const auto posFormat = vertexFormat == VERTEX_FORMAT_OCT_QUANTIZED ?
+			DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+		InputElementTable inputElementDescs =
+		{
+			{ "POSITION",	0, posFormat,						0, 0,		D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "NORMAL",		0, DXGI_FORMAT_R16G16_SNORM,		0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD",	0, DXGI_FORMAT_R16G16_FLOAT,		0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "TANGENT",	0, DXGI_FORMAT_R32_UINT,			0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		};
 
-	return pipelineCache.CreateInputLayout(inputElementDescs);
+		return pipelineCache.CreateInputLayout(inputElementDescs);
+	}
+	default:
+	{
+		InputElementTable inputElementDescs =
+		{
+			{ "POSITION",	0, DXGI_FORMAT_R32G32B32_FLOAT,		0, 0,		D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "NORMAL",		0, DXGI_FORMAT_R16G16B16A16_FLOAT,	0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "TEXCOORD",	0, DXGI_FORMAT_R16G16_FLOAT,		0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "TANGENT",	0, DXGI_FORMAT_R16G16B16A16_FLOAT,	0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "BINORMAL",	0, DXGI_FORMAT_R16G16B16A16_FLOAT,	0, offset,	D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		};
+
+		return pipelineCache.CreateInputLayout(inputElementDescs);
+	}
+	}
+}
+
+uint32_t Model::GetVertexStride(VertexFormat vertexFormat)
+{
+	switch (vertexFormat)
+	{
+	case VERTEX_FORMAT_OCT:
+		return 24;
+	case VERTEX_FORMAT_OCT_QUANTIZED:
+		return 20;
+	default:
+		return 40;
+	}
 }
 
 shared_ptr<SDKMesh> Model::LoadSDKMesh(const Device &device, const wstring &meshFileName,
-	const TextureCache &textureCache, bool isStaticMesh)
+	const TextureCache &textureCache, bool isStaticMesh,
+	const shared_ptr<UploadManager> &uploadManager)
 {
 	// Load the mesh
 	const auto mesh = make_shared<SDKMesh>();
-	N_RETURN(mesh->Create(device, meshFileName.c_str(), textureCache, isStaticMesh), nullptr);
+	N_RETURN(mesh->Create(device, meshFileName.c_str(), textureCache, isStaticMesh, uploadManager), nullptr);
 
 	return mesh;
 }
 
-bool Model::createConstantBuffers()
-{
-	N_RETURN(m_cbMatrices.Create(m_device, sizeof(CBMatrices[FrameCount]), FrameCount,
-		nullptr, m_name.empty() ? nullptr : (m_name + L".CBMatrices").c_str()), false);
-	N_RETURN(m_cbShadowMatrices.Create(m_device, sizeof(XMMATRIX[FrameCount][MAX_SHADOW_CASCADES]),
-		MAX_SHADOW_CASCADES * FrameCount, nullptr, m_name.empty() ? nullptr :
-		(m_name + L".CBShadowMatrices").c_str()), false);
-
-	return true;
-}
-
 bool Model::createPipelines(bool isStatic, const InputLayout &inputLayout, const Format *rtvFormats,
 	uint32_t numRTVs, Format dsvFormat, Format shadowFormat)
 {
@@ -206,7 +248,7 @@ bool Model::createPipelines(bool isStatic, const InputLayout &inputLayout, const
 
 	// Base pass
 	{
-		const auto vsBasePass = isStatic ? VS_BASE_PASS_STATIC : VS_BASE_PASS;
+		const auto vsBasePass = isStatic ? VS_BASE_PASS_STATIC : getBasePassVS();
 		const auto psBasePass = isStatic ? PS_BASE_PASS_STATIC : PS_BASE_PASS;
 		const auto psAlphaTest = isStatic ? PS_ALPHA_TEST_STATIC : PS_ALPHA_TEST;
 
@@ -245,7 +287,7 @@ bool Model::createPipelines(bool isStatic, const InputLayout &inputLayout, const
 	}
 
 	// Depth and shadow passes
-	const auto vsDepthPass = isStatic ? VS_DEPTH_STATIC : VS_DEPTH;
+	const auto vsDepthPass = isStatic ? VS_DEPTH_STATIC : getDepthVS();
 	const auto vsShadowPass = isStatic ? VS_SHADOW_STATIC : VS_SHADOW;
 	const auto vsDepth = m_shaderPool->GetShader(Shader::Stage::VS, vsDepthPass);
 	const auto vsShadow = m_shaderPool->GetShader(Shader::Stage::VS, vsShadowPass);
@@ -303,20 +345,6 @@ bool Model::createPipelines(bool isStatic, const InputLayout &inputLayout, const
 
 bool Model::createDescriptorTables()
 {
-	for (auto i = 0ui8; i < FrameCount; ++i)
-	{
-		Util::DescriptorTable cbMatricesTable;
-		cbMatricesTable.SetDescriptors(0, 1, &m_cbMatrices.GetCBV(i));
-		m_cbvTables[i][CBV_MATRICES] = cbMatricesTable.GetCbvSrvUavTable(*m_descriptorTableCache);
-
-		for (auto j = 0ui8; j < MAX_SHADOW_CASCADES; ++j)
-		{
-			Util::DescriptorTable cbShadowTable;
-			cbShadowTable.SetDescriptors(0, 1, &m_cbShadowMatrices.GetCBV(i * MAX_SHADOW_CASCADES + j));
-			m_cbvTables[i][CBV_SHADOW_MATRIX + j] = cbShadowTable.GetCbvSrvUavTable(*m_descriptorTableCache);
-		}
-	}
-
 	Util::DescriptorTable samplerTable;
 	const SamplerPreset samplers[] = { ANISOTROPIC_WRAP, POINT_WRAP, LINEAR_LESS_EQUAL };
 	samplerTable.SetSamplers(0, static_cast<uint32_t>(size(samplers)), samplers, *m_descriptorTableCache);
@@ -436,9 +464,8 @@ Util::PipelineLayout Model::initPipelineLayout(VertexShader vs, PixelShader ps)
 	Util::PipelineLayout utilPipelineLayout;
 
 	// Constant buffers
-	utilPipelineLayout.SetRange(MATRICES, DescriptorType::CBV, 1, cbMatrices,
-		0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
-	utilPipelineLayout.SetShaderStage(MATRICES, Shader::Stage::VS);
+	utilPipelineLayout.SetRootCBV(MATRICES, cbMatrices, 0,
+		D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, Shader::Stage::VS);
 
 	if (ps != PS_DEPTH && cbImmutable != UINT32_MAX)
 	{
@@ -474,3 +501,21 @@ Util::PipelineLayout Model::initPipelineLayout(VertexShader vs, PixelShader ps)
 
 	return utilPipelineLayout;
 }
+
+VertexShader Model::getBasePassVS() const
+{
+	switch (m_vertexFormat)
+	{
+	case VERTEX_FORMAT_OCT:
+		return VS_BASE_PASS_OCT;
+	case VERTEX_FORMAT_OCT_QUANTIZED:
+		return VS_BASE_PASS_OCT_QUANTIZED;
+	default:
+		return VS_BASE_PASS;
+	}
+}
+
+VertexShader Model::getDepthVS() const
+{
+	return VS_DEPTH;
+}
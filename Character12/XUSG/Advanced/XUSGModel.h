@@ -7,6 +7,7 @@
 #include "Core/XUSGPipelineLayout.h"
 #include "Core/XUSGGraphicsState.h"
 #include "Core/XUSGDescriptor.h"
+#include "Core/XUSGRingBuffer.h"
 #include "XUSGShaderCommon.h"
 #include "XUSGSDKMesh.h"
 #include "XUSGSharedConst.h"
@@ -66,6 +67,14 @@ namespace XUSG
 			NUM_CBV_TABLE = CBV_SHADOW_MATRIX + MAX_SHADOW_CASCADES
 		};
 
+		// Vertex formats of the post-transformed objects
+		enum VertexFormat : uint8_t
+		{
+			VERTEX_FORMAT_HALF,				// 40 bytes: float3 position, half normal, tangent, and binormal
+			VERTEX_FORMAT_OCT,				// 24 bytes: float3 position, octahedral normal and tangent, binormal sign
+			VERTEX_FORMAT_OCT_QUANTIZED		// 20 bytes: as above, with 16-bit positions in the bounding box
+		};
+
 		Model(const Device &device, const CommandList &commandList, const wchar_t *name);
 		virtual ~Model();
 
@@ -73,7 +82,8 @@ namespace XUSG
 			const std::shared_ptr<ShaderPool> &shaderPool,
 			const std::shared_ptr<Graphics::PipelineCache> &pipelineCache,
 			const std::shared_ptr<PipelineLayoutCache> &pipelineLayoutCache,
-			const std::shared_ptr<DescriptorTableCache> &descriptorTableCache);
+			const std::shared_ptr<DescriptorTableCache> &descriptorTableCache,
+			const std::shared_ptr<RingBuffer> &ringBuffer);
 		void Update(uint8_t frameIndex);
 		void SetMatrices(DirectX::CXMMATRIX viewProj, DirectX::CXMMATRIX world, DirectX::FXMMATRIX *pShadowView = nullptr,
 			DirectX::FXMMATRIX *pShadows = nullptr, uint8_t numShadows = 0, bool isTemporal = true);
@@ -83,10 +93,13 @@ namespace XUSG
 		void Render(SubsetFlags subsetFlags, uint8_t matrixTableIndex,
 			PipelineLayoutIndex layout = NUM_PIPE_LAYOUT, uint32_t numInstances = 1);
 
-		static InputLayout CreateInputLayout(Graphics::PipelineCache &pipelineCache);
+		static InputLayout CreateInputLayout(Graphics::PipelineCache &pipelineCache,
+			VertexFormat vertexFormat = VERTEX_FORMAT_HALF);
 		static std::shared_ptr<SDKMesh> LoadSDKMesh(const Device &device, const std::wstring &meshFileName,
-			const TextureCache &textureCache, bool isStaticMesh);
+			const TextureCache &textureCache, bool isStaticMesh,
+			const std::shared_ptr<UploadManager> &uploadManager = nullptr);
 
+		static uint32_t GetVertexStride(VertexFormat vertexFormat);
 		static constexpr uint32_t GetFrameCount() { return FrameCount; }
 
 	protected:
@@ -101,7 +114,6 @@ namespace XUSG
 #endif
 		};
 
-		bool createConstantBuffers();
 		bool createPipelines(bool isStatic, const InputLayout &inputLayout, const Format *rtvFormats,
 			uint32_t numRTVs, Format dsvFormat, Format shadowFormat);
 		bool createDescriptorTables();
@@ -109,33 +121,37 @@ namespace XUSG
 			uint32_t numInstances);
 
 		Util::PipelineLayout initPipelineLayout(VertexShader vs, PixelShader ps);
+		virtual VertexShader getBasePassVS() const;
+		virtual VertexShader getDepthVS() const;
 
 		static const uint32_t FrameCount = FRAME_COUNT;
 
 		Device		m_device;
-		CommandList	m_commandList;
+		const CommandList &m_commandList;	// Of the owner, recorded into by reference
 
 		std::wstring m_name;
 
 		uint8_t		m_currentFrame;
 		uint8_t		m_previousFrame;
 
+		VertexFormat m_vertexFormat;
+
 		std::shared_ptr<SDKMesh>					m_mesh;
 		std::shared_ptr<ShaderPool>					m_shaderPool;
 		std::shared_ptr<Graphics::PipelineCache>	m_pipelineCache;
 		std::shared_ptr<PipelineLayoutCache>		m_pipelineLayoutCache;
 		std::shared_ptr<DescriptorTableCache>		m_descriptorTableCache;
+		std::shared_ptr<RingBuffer>					m_ringBuffer;
 
 #if TEMPORAL
 		DirectX::XMFLOAT4X4	m_worldViewProjs[FrameCount];
 #endif
 
-		ConstantBuffer		m_cbMatrices;
-		ConstantBuffer		m_cbShadowMatrices;
+		// Ring buffer offsets of the constant buffers of the current frame, by CBVTableIndex
+		uint32_t			m_cbOffsets[NUM_CBV_TABLE];
 
 		PipelineLayout		m_pipelineLayouts[NUM_PIPE_LAYOUT];
 		Pipeline			m_pipelines[NUM_PIPELINE];
-		DescriptorTable		m_cbvTables[FrameCount][NUM_CBV_TABLE];
 		DescriptorTable		m_samplerTable;
 		std::vector<DescriptorTable> m_srvTables;
 	};
@@ -4,7 +4,6 @@
 
 #include "DXFrameworkHelper.h"
 #include "XUSGSDKMesh.h"
-#include "XUSGDDSLoader.h"
 
 using namespace std;
 using namespace DirectX;
@@ -14,13 +13,16 @@ using namespace XUSG;
 //--------------------------------------------------------------------------------------
 SDKMesh::SDKMesh() :
 	m_device(nullptr),
+	m_uploadManager(nullptr),
+	m_uploadFenceValue(0),
 	m_numOutstandingResources(0),
 	m_isLoading(false),
 	m_pStaticMeshData(nullptr),
 	m_heapData(0),
-	m_animation(0),
+	m_mappedFile(nullptr),
 	m_vertices(0),
 	m_indices(0),
+	m_staticVertices(0),
 	m_name(),
 	m_filePathW(),
 	m_filePath(),
@@ -31,12 +33,30 @@ SDKMesh::SDKMesh() :
 	m_pSubsetArray(nullptr),
 	m_pFrameArray(nullptr),
 	m_pMaterialArray(nullptr),
+	m_frameOrder(0),
+	m_frameParents(0),
+	m_frameHeights(0),
+	m_trackGroupHeights(0),
+	m_influenceRanges(0),
+	m_vertexStreams(0),
+	m_indexStreamVBs(0),
+	m_paletteFrames(0),
+	m_firstPaletteBones(0),
+	m_boneRemaps(0),
+	m_firstBoneRemaps(0),
 	m_pAdjIndexBufferArray(nullptr),
 	m_pAnimationHeader(nullptr),
-	m_pAnimationFrameData(nullptr),
+	m_animationSampling(SAMPLE_NLERP),
+	m_animationClip(nullptr),
 	m_bindPoseFrameMatrices(0),
-	m_transformedFrameMatrices(0),
-	m_worldPoseFrameMatrices(0)
+	m_invBindPoseFrameMatrices(0),
+	m_invBindPoseTransforms(0),
+	m_frameTransforms(0),
+	m_isBindPoseUniform(false),
+	m_hasAnimatedBounds(false),
+	m_animatedBBoxCenter(0.0f, 0.0f, 0.0f),
+	m_animatedBBoxExtents(0.0f, 0.0f, 0.0f),
+	m_pose()
 {
 }
 
@@ -47,66 +67,121 @@ SDKMesh::~SDKMesh()
 
 //--------------------------------------------------------------------------------------
 bool SDKMesh::Create(const Device &device, const wchar_t *fileName,
-	const TextureCache &textureCache, bool isStaticMesh)
+	const TextureCache &textureCache, bool isStaticMesh,
+	const shared_ptr<UploadManager> &uploadManager)
 {
-	return createFromFile(device, fileName, textureCache, isStaticMesh);
+	return createFromFile(device, fileName, textureCache, isStaticMesh, uploadManager);
 }
 
 bool SDKMesh::Create(const Device &device, uint8_t *pData,
 	const TextureCache &textureCache, size_t dataBytes,
-	bool isStaticMesh, bool copyStatic)
+	bool isStaticMesh, bool copyStatic,
+	const shared_ptr<UploadManager> &uploadManager)
 {
-	return createFromMemory(device, pData, textureCache, dataBytes, isStaticMesh, copyStatic);
+	return createFromMemory(device, pData, textureCache, dataBytes, isStaticMesh, copyStatic, uploadManager);
 }
 
-bool SDKMesh::LoadAnimation(const wchar_t *fileName)
+bool SDKMesh::Prepare(const wchar_t *fileName, const TextureCache &textureCache, bool isStaticMesh)
 {
-	wchar_t filePath[MAX_PATH];
-
-	// Find the path for the file
-	wcsncpy_s(filePath, MAX_PATH, fileName, wcslen(fileName));
-	//V_RETURN(DXUTFindDXSDKMediaFileCch(filePath, MAX_PATH, fileName));
+	N_RETURN(prepareFromFile(fileName, textureCache, isStaticMesh), false);
 
-	// Open the file
-	ifstream fileStream(filePath, ios::in | ios::binary);
-	F_RETURN(!fileStream, cerr, MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x0903), false);
+	// Read the textures ahead, so that only the GPU work is left to Upload()
+	readTextureFiles();
 
-	// Read header
-	SDKAnimationFileHeader fileheader;
-	F_RETURN(!fileStream.read(reinterpret_cast<char*>(&fileheader), sizeof(SDKAnimationFileHeader)),
-		fileStream.close(); cerr, GetLastError(), false);
-
-	// Allocate
-	m_animation.resize(static_cast<size_t>(sizeof(SDKAnimationFileHeader) + fileheader.AnimationDataSize));
-	
-	// Read it all in
-	F_RETURN(!fileStream.seekg(0), fileStream.close(); cerr, GetLastError(), false);
+	return true;
+}
 
-	const auto cBytes = static_cast<streamsize>(sizeof(SDKAnimationFileHeader) + fileheader.AnimationDataSize);
-	F_RETURN(!fileStream.read(reinterpret_cast<char*>(m_animation.data()), cBytes),
-		fileStream.close(); cerr, GetLastError(), false);
+bool SDKMesh::Upload(const Device &device, const shared_ptr<UploadManager> &uploadManager)
+{
+	return upload(device, uploadManager);
+}
 
-	fileStream.close();
+bool SDKMesh::LoadAnimation(const wchar_t *fileName)
+{
+	// Clips are shared by all the meshes playing them
+	const auto clip = AnimationClipRegistry::GetClip(fileName);
+	N_RETURN(clip, false);
 
-	// pointer fixup
-	m_pAnimationHeader = reinterpret_cast<SDKAnimationFileHeader*>(m_animation.data());
-	m_pAnimationFrameData = reinterpret_cast<SDKAnimationFrameData*>(m_animation.data() + m_pAnimationHeader->AnimationDataOffset);
+	SetAnimationClip(clip);
 
-	const auto BaseOffset = sizeof(SDKAnimationFileHeader);
+	return true;
+}
 
-	for (auto i = 0u; i < m_pAnimationHeader->NumFrames; ++i)
+//--------------------------------------------------------------------------------------
+// Offline resampler: re-bake the loaded clip at a new key rate by sampling the
+// current clip with the current sampling mode. Key 0 (the reference key) is kept.
+//--------------------------------------------------------------------------------------
+bool SDKMesh::ResampleAnimation(uint32_t animationFPS)
+{
+	M_RETURN(!m_pAnimationHeader, cerr, "No animation is loaded.", false);
+	M_RETURN(animationFPS == 0, cerr, "Invalid animation key rate.", false);
+	M_RETURN(m_animationClip->IsCompressed(), cerr, "Compressed animations cannot be resampled.", false);
+
+	const auto &srcHeader = *m_pAnimationHeader;
+	C_RETURN(srcHeader.NumAnimationKeys < 2 || srcHeader.AnimationFPS == animationFPS, true);
+
+	// The looping keys 1..N-1 cover (N - 1) / fps seconds
+	const auto numLoopKeys = srcHeader.NumAnimationKeys - 1;
+	const auto duration = static_cast<double>(numLoopKeys) / srcHeader.AnimationFPS;
+	const auto numKeys = (max)(static_cast<uint32_t>(duration * animationFPS + 0.5), 1u) + 1;
+
+	// Layout: header, frame data, then the keys of each frame
+	const auto numFrames = srcHeader.NumFrames;
+	const auto frameDataSize = sizeof(SDKAnimationFrameData) * numFrames;
+	const auto keyDataSize = sizeof(SDKAnimationData) * numKeys;
+
+	vector<uint8_t> animation(sizeof(SDKAnimationFileHeader) + frameDataSize + keyDataSize * numFrames);
+	const auto pHeader = reinterpret_cast<SDKAnimationFileHeader*>(animation.data());
+	*pHeader = srcHeader;
+	pHeader->NumAnimationKeys = numKeys;
+	pHeader->AnimationFPS = animationFPS;
+	pHeader->AnimationDataSize = frameDataSize + keyDataSize * numFrames;
+	pHeader->AnimationDataOffset = sizeof(SDKAnimationFileHeader);
+
+	const auto &srcTracks = m_animationClip->GetTracks();
+	const auto pFrameData = reinterpret_cast<SDKAnimationFrameData*>(animation.data() + pHeader->AnimationDataOffset);
+	for (auto i = 0u; i < numFrames; ++i)
 	{
-		m_pAnimationFrameData[i].pAnimationData = reinterpret_cast<SDKAnimationData*>
-			(m_animation.data() + m_pAnimationFrameData[i].DataOffset + BaseOffset);
+		auto &frameData = pFrameData[i];
+		memcpy(frameData.FrameName, m_animationClip->GetFrameName(i), sizeof(frameData.FrameName));
+		frameData.DataOffset = frameDataSize + keyDataSize * i;
 
-		const auto pFrame = FindFrame(m_pAnimationFrameData[i].FrameName);
+		const auto pData = reinterpret_cast<SDKAnimationData*>(animation.data() +
+			sizeof(SDKAnimationFileHeader) + frameData.DataOffset);
+		pData[0] = srcTracks.GetKey(i, 0);
 
-		if (pFrame) pFrame->AnimationDataIndex = i;
+		for (auto k = 1u; k < numKeys; ++k)
+		{
+			// Sample the source clip at the time of the new key
+			const auto time = static_cast<double>(k - 1) / animationFPS;
+			uint32_t nextKey;
+			float blend;
+			const auto key = GetAnimationKeysFromTime(time, nextKey, blend);
+
+			XMVECTOR translation, quat, scaling;
+			sampleAnimationData(translation, quat, scaling, srcTracks.GetKey(i, key),
+				srcTracks.GetKey(i, nextKey), blend);
+			XMStoreFloat3(&pData[k].Translation, translation);
+			XMStoreFloat4(&pData[k].Orientation, quat);
+			XMStoreFloat3(&pData[k].Scaling, scaling);
+		}
 	}
 
+	// The resampled clip is private to this mesh
+	const auto clip = make_shared<AnimationClip>();
+	N_RETURN(clip->Create(move(animation)), false);
+	SetAnimationClip(clip);
+
 	return true;
 }
 
+bool SDKMesh::SaveAnimation(const wchar_t *fileName) const
+{
+	M_RETURN(!m_animationClip, cerr, "No animation is loaded.", false);
+
+	return m_animationClip->Save(fileName);
+}
+
 void SDKMesh::Destroy()
 {
 	if (!CheckLoadDone()) return;
@@ -133,13 +208,25 @@ void SDKMesh::Destroy()
 
 	m_pStaticMeshData = nullptr;
 	m_heapData.clear();
-	m_animation.clear();
+	m_mappedFile.reset();
+	m_staticVertices.clear();
+	m_vertexStreams.clear();
+	m_indexStreamVBs.clear();
+	m_animationClip.reset();
 	m_bindPoseFrameMatrices.clear();
-	m_transformedFrameMatrices.clear();
-	m_worldPoseFrameMatrices.clear();
+	m_invBindPoseFrameMatrices.clear();
+	m_invBindPoseTransforms.clear();
+	m_frameTransforms.clear();
+	m_isBindPoseUniform = false;
+	m_pose = AnimationPose();
 
 	m_vertices.clear();
 	m_indices.clear();
+	m_influenceRanges.clear();
+	m_paletteFrames.clear();
+	m_firstPaletteBones.clear();
+	m_boneRemaps.clear();
+	m_firstBoneRemaps.clear();
 
 	m_pMeshHeader = nullptr;
 	m_pVertexBufferArray = nullptr;
@@ -150,8 +237,12 @@ void SDKMesh::Destroy()
 	m_pMaterialArray = nullptr;
 	m_pAdjIndexBufferArray = nullptr;
 
+	m_frameOrder.clear();
+	m_frameParents.clear();
+	m_frameHeights.clear();
+	m_trackGroupHeights.clear();
+
 	m_pAnimationHeader = nullptr;
-	m_pAnimationFrameData = nullptr;
 }
 
 //--------------------------------------------------------------------------------------
@@ -159,7 +250,7 @@ void SDKMesh::Destroy()
 //--------------------------------------------------------------------------------------
 void SDKMesh::TransformBindPose(CXMMATRIX world)
 {
-	transformBindPoseFrame(0, world);
+	transformBindPoseFrames(world);
 }
 
 //--------------------------------------------------------------------------------------
@@ -167,22 +258,166 @@ void SDKMesh::TransformBindPose(CXMMATRIX world)
 //--------------------------------------------------------------------------------------
 void SDKMesh::TransformMesh(CXMMATRIX world, double time)
 {
+	TransformMesh(m_pose, world, time);
+}
+
+void SDKMesh::TransformMesh(AnimationPose &pose, CXMMATRIX world, double time, uint8_t minBoneHeight) const
+{
+	InitPose(pose);
+	pose.Time = time;
+	pose.NumEvaluatedBones = 0;
+	pose.NumSkippedBones = 0;
+
 	if (!m_pAnimationHeader || FTT_RELATIVE == m_pAnimationHeader->FrameTransformType)
 	{
-		transformFrame(0, world, time);
+		transformFrames(pose, world, time, minBoneHeight);
 
 		// For each frame, move the transform to the bind pose, then
 		// move it to the final position
 		for (auto i = 0u; i < m_pMeshHeader->NumFrames; ++i)
 		{
-			const auto invBindPose = XMMatrixInverse(nullptr, XMLoadFloat4x4(&m_bindPoseFrameMatrices[i]));
-			const auto final = invBindPose * XMLoadFloat4x4(&m_transformedFrameMatrices[i]);
-			XMStoreFloat4x4(&m_transformedFrameMatrices[i], final);
+			if (pose.HasTransforms)
+			{
+				auto &transform = pose.TransformedFrameTransforms[i];
+				transform = BoneTransform::Compose(m_invBindPoseTransforms[i], pose.WorldPoseFrameTransforms[i]);
+				XMStoreFloat4x4(&pose.TransformedFrameMatrices[i], transform.ToMatrix());
+			}
+			else
+			{
+				const auto invBindPose = XMLoadFloat4x4(&m_invBindPoseFrameMatrices[i]);
+				const auto final = invBindPose * XMLoadFloat4x4(&pose.WorldPoseFrameMatrices[i]);
+				XMStoreFloat4x4(&pose.TransformedFrameMatrices[i], final);
+			}
 		}
 	}
 	else if (FTT_ABSOLUTE == m_pAnimationHeader->FrameTransformType)
+	{
+		pose.HasTransforms = !pose.TransformedFrameTransforms.empty();
 		for (auto i = 0u; i < m_pAnimationHeader->NumFrames; ++i)
-			transformFrameAbsolute(i, time);
+			transformFrameAbsolute(pose, i, time);
+		pose.NumEvaluatedBones = m_pAnimationHeader->NumFrames;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// size the per-instance pose state for this mesh and its animation clip
+//--------------------------------------------------------------------------------------
+void SDKMesh::InitPose(AnimationPose &pose) const
+{
+	const auto numFrames = m_pMeshHeader ? m_pMeshHeader->NumFrames : 0;
+	const auto numTracks = m_pAnimationHeader ? m_pAnimationHeader->NumFrames : 0;
+	const auto isCompressed = m_animationClip && m_animationClip->IsCompressed();
+
+	pose.TransformedFrameMatrices.resize(numFrames);
+	pose.WorldPoseFrameMatrices.resize(numFrames);
+	pose.TransformedFrameTransforms.resize(isUniformScaling() ? numFrames : 0, BoneTransform::Identity());
+	pose.WorldPoseFrameTransforms.resize(isUniformScaling() ? numFrames : 0, BoneTransform::Identity());
+	pose.LocalFrameTransforms.resize(isCompressed ? 0 : numTracks);
+	pose.DecodedKeys.resize(numTracks * 2);
+}
+
+void SDKMesh::SetAnimationClip(const shared_ptr<const AnimationClip> &clip)
+{
+	m_animationClip = clip;
+	bindAnimation();
+}
+
+//--------------------------------------------------------------------------------------
+// bound the skinned vertices at every key of the clip and halfway between: the bind-pose
+// box of the vertices of each palette bone is transformed by the bone, and the blends of
+// the bones stay within the union of their boxes, up to the bulging of the DQS blends
+//--------------------------------------------------------------------------------------
+void SDKMesh::ComputeAnimatedBounds()
+{
+	// Vertex element usages and types of the packed bone weights (D3DDECLUSAGE, D3DDECLTYPE)
+	enum DeclValue : uint8_t
+	{
+		DECLUSAGE_BLENDWEIGHT = 1,
+		DECLUSAGE_BLENDINDICES = 2,
+		DECLTYPE_UBYTE4 = 5,
+		DECLTYPE_UBYTE4N = 8,
+		DECL_END = 0xff
+	};
+
+	m_hasAnimatedBounds = false;
+	uint32_t numKeys;
+	float frameTime;
+	if (!GetAnimationProperties(&numKeys, &frameTime)) return;
+
+	// Bind-pose bounds of the vertices of each palette bone, over each skinned VB once
+	const auto numBones = GetNumPaletteBones();
+	vector<XMFLOAT3> boneMins(numBones, XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX));
+	vector<XMFLOAT3> boneMaxs(numBones, XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+	vector<uint8_t> isVisited(m_pMeshHeader->NumVertexBuffers);
+	for (auto m = 0u; m < m_pMeshHeader->NumMeshes; ++m)
+	{
+		const auto vb = m_pMeshArray[m].VertexBuffers[0];
+		if (m_pMeshArray[m].NumFrameInfluences == 0 || isVisited[vb]) continue;
+		isVisited[vb] = 1;
+
+		const auto &header = m_pVertexBufferArray[vb];
+		auto weightOffset = UINT32_MAX;
+		auto boneOffset = UINT32_MAX;
+		for (const auto &element : header.Decl)
+		{
+			if (element.Stream == DECL_END) break;
+			if (element.Usage == DECLUSAGE_BLENDWEIGHT && element.Type == DECLTYPE_UBYTE4N) weightOffset = element.Offset;
+			if (element.Usage == DECLUSAGE_BLENDINDICES && element.Type == DECLTYPE_UBYTE4) boneOffset = element.Offset;
+		}
+		if (weightOffset == UINT32_MAX || boneOffset == UINT32_MAX) return;
+
+		// The bone indices of the file are remapped to the palette as they are uploaded
+		const auto &stream = m_vertexStreams[vb];
+		const auto pRemap = stream.RemapMesh != UINT32_MAX ? GetBoneRemap(stream.RemapMesh) : nullptr;
+		const auto numRemaps = pRemap ? m_pMeshArray[stream.RemapMesh].NumFrameInfluences : 0;
+		const auto firstBone = GetFirstPaletteBone(m);
+		const auto numVertices = static_cast<uint32_t>(header.NumVertices);
+		const auto stride = static_cast<uint32_t>(header.StrideBytes);
+		const auto pVertices = m_vertices[vb];
+		for (auto i = 0u; i < numVertices; ++i)
+		{
+			const auto pos = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(&pVertices[stride * i]));
+			const auto pWeights = &pVertices[stride * i + weightOffset];
+			const auto pBones = &pVertices[stride * i + boneOffset];
+			for (auto j = 0u; j < MAX_INFLUENCES; ++j)
+			{
+				const auto bone = pRemap ? pRemap[pBones[j] < numRemaps ? pBones[j] : 0] : firstBone + pBones[j];
+				if (pWeights[j] == 0 || bone >= numBones) continue;
+				XMStoreFloat3(&boneMins[bone], XMVectorMin(pos, XMLoadFloat3(&boneMins[bone])));
+				XMStoreFloat3(&boneMaxs[bone], XMVectorMax(pos, XMLoadFloat3(&boneMaxs[bone])));
+			}
+		}
+	}
+
+	// Transform the boxes of the bones by the absolute values of the bone matrices
+	auto lower = XMVectorReplicate(FLT_MAX);
+	auto upper = XMVectorReplicate(-FLT_MAX);
+	AnimationPose pose;
+	InitPose(pose);
+	for (auto k = 0u; k < 2 * numKeys; ++k)
+	{
+		TransformMesh(pose, XMMatrixIdentity(), 0.5 * frameTime * k);
+		for (auto i = 0u; i < numBones; ++i)
+		{
+			const auto bMin = XMLoadFloat3(&boneMins[i]);
+			const auto bMax = XMLoadFloat3(&boneMaxs[i]);
+			if (XMVector3Greater(bMin, bMax)) continue;
+
+			const auto m = XMLoadFloat4x4(&pose.TransformedFrameMatrices[GetPaletteFrame(i)]);
+			const auto halfExtents = (bMax - bMin) * 0.5f;
+			const auto center = XMVector3Transform(bMin + halfExtents, m);
+			const auto extents = XMVectorAbs(m.r[0]) * XMVectorSplatX(halfExtents) +
+				XMVectorAbs(m.r[1]) * XMVectorSplatY(halfExtents) + XMVectorAbs(m.r[2]) * XMVectorSplatZ(halfExtents);
+			lower = XMVectorMin(center - extents, lower);
+			upper = XMVectorMax(center + extents, upper);
+		}
+	}
+	if (XMVector3Greater(lower, upper)) return;
+
+	const auto half = (upper - lower) * 0.5f;
+	XMStoreFloat3(&m_animatedBBoxCenter, lower + half);
+	XMStoreFloat3(&m_animatedBBoxExtents, half);
+	m_hasAnimatedBounds = true;
 }
 
 //--------------------------------------------------------------------------------------
@@ -318,6 +553,81 @@ uint8_t *SDKMesh::GetRawIndicesAt(uint32_t ib) const
 	return m_indices[ib];
 }
 
+void SDKMesh::WriteVerticesAt(uint32_t vb, uint8_t *pDst) const
+{
+	const auto &header = m_pVertexBufferArray[vb];
+	const auto &stream = m_vertexStreams[vb];
+	const auto pVertices = m_vertices[vb];
+	const auto numVertices = static_cast<uint32_t>(header.NumVertices);
+	const auto stride = static_cast<uint32_t>(header.StrideBytes);
+	const auto isSorted = stream.WeightOffset != UINT32_MAX;
+	const auto pRemap = stream.RemapMesh != UINT32_MAX ? GetBoneRemap(stream.RemapMesh) : nullptr;
+	const auto numRemaps = pRemap ? m_pMeshArray[stream.RemapMesh].NumFrameInfluences : 0;
+	if (stream.Order.empty() && !isSorted && !pRemap)
+	{
+		memcpy(pDst, pVertices, static_cast<size_t>(header.SizeBytes));
+		return;
+	}
+
+	// The destination may be write-combined, so each vertex is written once, in order,
+	// with its influences sorted heaviest first and its bone indices remapped on the side
+	for (auto i = 0u; i < numVertices; ++i, pDst += stride)
+	{
+		const auto pVertex = &pVertices[stride * (stream.Order.empty() ? i : stream.Order[i])];
+		memcpy(pDst, pVertex, stride);
+
+		uint8_t weights[MAX_INFLUENCES], bones[MAX_INFLUENCES];
+		memcpy(bones, &pVertex[stream.BoneOffset], MAX_INFLUENCES);
+		if (isSorted)
+		{
+			memcpy(weights, &pVertex[stream.WeightOffset], MAX_INFLUENCES);
+			for (auto j = 0u; j < MAX_INFLUENCES; ++j)
+				for (auto k = j + 1; k < MAX_INFLUENCES; ++k)
+					if (weights[k] > weights[j])
+					{
+						swap(weights[j], weights[k]);
+						swap(bones[j], bones[k]);
+					}
+			memcpy(&pDst[stream.WeightOffset], weights, MAX_INFLUENCES);
+		}
+
+		// The indices out of the influences have no weights
+		if (pRemap) for (auto j = 0u; j < MAX_INFLUENCES; ++j)
+			bones[j] = static_cast<uint8_t>(pRemap[bones[j] < numRemaps ? bones[j] : 0]);
+		memcpy(&pDst[stream.BoneOffset], bones, MAX_INFLUENCES);
+	}
+}
+
+void SDKMesh::WriteIndicesAt(uint32_t ib, uint8_t *pDst) const
+{
+	const auto &header = m_pIndexBufferArray[ib];
+	const auto vb = m_indexStreamVBs[ib];
+	if (vb == UINT32_MAX || m_vertexStreams[vb].Order.empty())
+	{
+		memcpy(pDst, m_indices[ib], static_cast<size_t>(header.SizeBytes));
+		return;
+	}
+
+	// Invert the vertex order into the new index of each file vertex
+	const auto &order = m_vertexStreams[vb].Order;
+	vector<uint32_t> remap(order.size());
+	for (auto i = 0u; i < order.size(); ++i) remap[order[i]] = i;
+
+	const auto numIndices = static_cast<uint32_t>(header.NumIndices);
+	if (header.IndexType == IT_32BIT)
+	{
+		const auto pIndices = reinterpret_cast<const uint32_t*>(m_indices[ib]);
+		const auto pDstIndices = reinterpret_cast<uint32_t*>(pDst);
+		for (auto i = 0u; i < numIndices; ++i) pDstIndices[i] = remap[pIndices[i]];
+	}
+	else
+	{
+		const auto pIndices = reinterpret_cast<const uint16_t*>(m_indices[ib]);
+		const auto pDstIndices = reinterpret_cast<uint16_t*>(pDst);
+		for (auto i = 0u; i < numIndices; ++i) pDstIndices[i] = static_cast<uint16_t>(remap[pIndices[i]]);
+	}
+}
+
 SDKMeshMaterial *SDKMesh::GetMaterial(uint32_t material) const
 {
 	return &m_pMaterialArray[material];
@@ -342,7 +652,7 @@ uint32_t SDKMesh::GetNumSubsets(uint32_t mesh, SubsetFlags materialType) const
 
 SDKMeshSubset *SDKMesh::GetSubset(uint32_t mesh, uint32_t subset) const
 {
-	return &m_pSubsetArray[m_pMeshArray[mesh].pSubsets[subset]];
+	return &m_pSubsetArray[getView<uint32_t>(m_pMeshArray[mesh].SubsetOffset)[subset]];
 }
 
 SDKMeshSubset *SDKMesh::GetSubset(uint32_t mesh, uint32_t subset, SubsetFlags materialType) const
@@ -395,6 +705,36 @@ uint64_t SDKMesh::GetNumIndices(uint32_t mesh) const
 	return m_pIndexBufferArray[m_pMeshArray[mesh].IndexBuffer].NumIndices;
 }
 
+const InfluenceRanges &SDKMesh::GetInfluenceRanges(uint32_t mesh) const
+{
+	return m_influenceRanges[m_pMeshArray[mesh].VertexBuffers[0]];
+}
+
+const uint32_t *SDKMesh::GetFrameInfluences(uint32_t mesh) const
+{
+	return getView<uint32_t>(m_pMeshArray[mesh].FrameInfluenceOffset);
+}
+
+uint32_t SDKMesh::GetNumPaletteBones() const
+{
+	return static_cast<uint32_t>(m_paletteFrames.size());
+}
+
+uint32_t SDKMesh::GetPaletteFrame(uint32_t bone) const
+{
+	return m_paletteFrames[bone];
+}
+
+uint32_t SDKMesh::GetFirstPaletteBone(uint32_t mesh) const
+{
+	return m_firstPaletteBones[mesh];
+}
+
+const uint32_t *SDKMesh::GetBoneRemap(uint32_t mesh) const
+{
+	return m_boneRemaps.data() + m_firstBoneRemaps[mesh];
+}
+
 XMVECTOR SDKMesh::GetMeshBBoxCenter(uint32_t mesh) const
 {
 	return XMLoadFloat3(&m_pMeshArray[mesh].BoundingBoxCenter);
@@ -407,6 +747,9 @@ XMVECTOR SDKMesh::GetMeshBBoxExtents(uint32_t mesh) const
 
 uint32_t SDKMesh::GetOutstandingResources() const
 {
+	// Still being prepared by a load pipeline, whose mesh data must not be raced
+	C_RETURN(m_isLoading && !m_uploadManager, 1);
+
 	auto outstandingResources = 0u;
 	if (!m_pMeshHeader) return 1;
 
@@ -438,6 +781,10 @@ uint32_t SDKMesh::GetOutstandingBufferResources() const
 	uint32_t outstandingResources = 0;
 	if (!m_pMeshHeader) return 1;
 
+	// The vertex and index buffers, until their upload batch completes
+	if (m_uploadManager && !m_uploadManager->IsComplete(m_uploadFenceValue))
+		outstandingResources += 2;
+
 	return outstandingResources;
 }
 
@@ -486,19 +833,39 @@ uint32_t SDKMesh::GetNumInfluences(uint32_t mesh) const
 
 XMMATRIX SDKMesh::GetMeshInfluenceMatrix(uint32_t mesh, uint32_t influence) const
 {
-	const auto frame = m_pMeshArray[mesh].pFrameInfluences[influence];
+	return GetMeshInfluenceMatrix(mesh, influence, m_pose);
+}
+
+XMMATRIX SDKMesh::GetMeshInfluenceMatrix(uint32_t mesh, uint32_t influence, const AnimationPose &pose) const
+{
+	const auto frame = GetFrameInfluences(mesh)[influence];
 
-	return XMLoadFloat4x4(&m_transformedFrameMatrices[frame]);
+	return XMLoadFloat4x4(&pose.TransformedFrameMatrices[frame]);
 }
 
 XMMATRIX SDKMesh::GetWorldMatrix(uint32_t frameIndex) const
 {
-	return XMLoadFloat4x4(&m_worldPoseFrameMatrices[frameIndex]);
+	return GetWorldMatrix(frameIndex, m_pose);
+}
+
+XMMATRIX SDKMesh::GetWorldMatrix(uint32_t frameIndex, const AnimationPose &pose) const
+{
+	return XMLoadFloat4x4(&pose.WorldPoseFrameMatrices[frameIndex]);
 }
 
 XMMATRIX SDKMesh::GetInfluenceMatrix(uint32_t frameIndex) const
 {
-	return XMLoadFloat4x4(&m_transformedFrameMatrices[frameIndex]);
+	return GetInfluenceMatrix(frameIndex, m_pose);
+}
+
+XMMATRIX SDKMesh::GetInfluenceMatrix(uint32_t frameIndex, const AnimationPose &pose) const
+{
+	return XMLoadFloat4x4(&pose.TransformedFrameMatrices[frameIndex]);
+}
+
+const shared_ptr<const AnimationClip> &SDKMesh::GetAnimationClip() const
+{
+	return m_animationClip;
 }
 
 XMMATRIX SDKMesh::GetBindMatrix(uint32_t frameIndex) const
@@ -506,9 +873,14 @@ XMMATRIX SDKMesh::GetBindMatrix(uint32_t frameIndex) const
 	return XMLoadFloat4x4(&m_bindPoseFrameMatrices[frameIndex]);
 }
 
+XMMATRIX SDKMesh::GetInvBindMatrix(uint32_t frameIndex) const
+{
+	return XMLoadFloat4x4(&m_invBindPoseFrameMatrices[frameIndex]);
+}
+
 uint32_t SDKMesh::GetAnimationKeyFromTime(double time) const
 {
-	if (!m_pAnimationHeader) return 0;
+	if (!m_pAnimationHeader || m_pAnimationHeader->NumAnimationKeys < 2) return 0;
 
 	auto tick = static_cast<uint32_t>(m_pAnimationHeader->AnimationFPS * time);
 
@@ -517,6 +889,35 @@ uint32_t SDKMesh::GetAnimationKeyFromTime(double time) const
 	return ++tick;
 }
 
+// Get the pair of neighbouring keys around the time, and the blend factor between them
+uint32_t SDKMesh::GetAnimationKeysFromTime(double time, uint32_t &nextKey, float &blend) const
+{
+	blend = 0.0f;
+	nextKey = GetAnimationKeyFromTime(time);
+	if (m_animationSampling == SAMPLE_NEAREST || nextKey == 0) return nextKey;
+
+	// Keys 1..N-1 form the loop, so the last key blends into the first
+	const auto numLoopKeys = m_pAnimationHeader->NumAnimationKeys - 1;
+	auto tick = fmod(m_pAnimationHeader->AnimationFPS * time, static_cast<double>(numLoopKeys));
+	tick = tick < 0.0 ? tick + numLoopKeys : tick;
+
+	const auto key = (min)(static_cast<uint32_t>(tick), numLoopKeys - 1);
+	blend = static_cast<float>(tick - key);
+	nextKey = (key + 1) % numLoopKeys + 1;
+
+	return key + 1;
+}
+
+AnimationSampling SDKMesh::GetAnimationSampling() const
+{
+	return m_animationSampling;
+}
+
+void SDKMesh::SetAnimationSampling(AnimationSampling sampling)
+{
+	m_animationSampling = sampling;
+}
+
 bool SDKMesh::GetAnimationProperties(uint32_t *pNumKeys, float *pFrameTime) const
 {
 	if (!m_pAnimationHeader)
@@ -533,15 +934,25 @@ bool SDKMesh::GetAnimationProperties(uint32_t *pNumKeys, float *pFrameTime) cons
 	return true;
 }
 
+bool SDKMesh::GetAnimatedBounds(XMFLOAT3 &center, XMFLOAT3 &extents) const
+{
+	center = m_animatedBBoxCenter;
+	extents = m_animatedBBoxExtents;
+
+	return m_hasAnimatedBounds;
+}
+
 //--------------------------------------------------------------------------------------
 void SDKMesh::loadMaterials(const CommandList &commandList, SDKMeshMaterial *pMaterials,
 	uint32_t numMaterials, vector<Resource> &uploaders)
 {
 	string filePath;
-	wstring filePathW;
 	DDS::Loader textureLoader;
 	DDS::AlphaMode alphaMode;
 
+	// Textures uploaded on the copy queue are left in the common state
+	const auto dstState = m_uploadManager ? D3D12_RESOURCE_STATE_COMMON : DDS::Loader::ShaderResourceState;
+
 	for (auto m = 0u; m < numMaterials; ++m)
 	{
 		pMaterials[m].pAlbedo = nullptr;
@@ -567,9 +978,8 @@ void SDKMesh::loadMaterials(const CommandList &commandList, SDKMeshMaterial *pMa
 				shared_ptr<ResourceBase> texture;
 				uploaders.push_back(Resource());
 
-				filePathW.assign(filePath.cbegin(), filePath.cend());
-				if (!textureLoader.CreateTextureFromFile(m_device, commandList, filePathW.c_str(),
-					8192, true, texture, uploaders.back(), &alphaMode))
+				if (!loadTexture(textureLoader, commandList, filePath, true, texture,
+					uploaders.back(), &alphaMode, dstState))
 					pMaterials[m].Albedo64 = ERROR_RESOURCE_VALUE;
 				else
 				{
@@ -594,9 +1004,8 @@ void SDKMesh::loadMaterials(const CommandList &commandList, SDKMeshMaterial *pMa
 				shared_ptr<ResourceBase> texture;
 				uploaders.push_back(Resource());
 
-				filePathW.assign(filePath.cbegin(), filePath.cend());
-				if (!textureLoader.CreateTextureFromFile(m_device, commandList, filePathW.c_str(),
-					8192, false, texture, uploaders.back(), &alphaMode))
+				if (!loadTexture(textureLoader, commandList, filePath, false, texture,
+					uploaders.back(), &alphaMode, dstState))
 					pMaterials[m].Normal64 = ERROR_RESOURCE_VALUE;
 				else
 				{
@@ -621,9 +1030,8 @@ void SDKMesh::loadMaterials(const CommandList &commandList, SDKMeshMaterial *pMa
 				shared_ptr<ResourceBase> texture;
 				uploaders.push_back(Resource());
 
-				filePathW.assign(filePath.cbegin(), filePath.cend());
-				if (!textureLoader.CreateTextureFromFile(m_device, commandList, filePathW.c_str(),
-					8192, false, texture, uploaders.back()))
+				if (!loadTexture(textureLoader, commandList, filePath, false, texture,
+					uploaders.back(), nullptr, dstState))
 					pMaterials[m].Specular64 = ERROR_RESOURCE_VALUE;
 				else
 				{
@@ -636,42 +1044,74 @@ void SDKMesh::loadMaterials(const CommandList &commandList, SDKMeshMaterial *pMa
 	}
 }
 
+void SDKMesh::readTextureFiles()
+{
+	for (auto m = 0u; m < m_pMeshHeader->NumMaterials; ++m)
+	{
+		const char *const textures[] =
+		{
+			m_pMaterialArray[m].AlbedoTexture,
+			m_pMaterialArray[m].NormalTexture,
+			m_pMaterialArray[m].SpecularTexture
+		};
+
+		// A file failing to be read is left to loadTexture(), which retries it
+		for (const auto &texture : textures)
+		{
+			if (texture[0] == 0) continue;
+
+			const auto filePath = m_filePath + texture;
+			if (m_textureFiles.find(filePath) != m_textureFiles.end()) continue;
+
+			const wstring filePathW(filePath.cbegin(), filePath.cend());
+			auto &ddsData = m_textureFiles[filePath];
+			if (!DDS::Loader::ReadTextureFile(filePathW.c_str(), ddsData)) m_textureFiles.erase(filePath);
+		}
+	}
+}
+
+bool SDKMesh::loadTexture(DDS::Loader &textureLoader, const CommandList &commandList, const string &filePath,
+	bool forceSRGB, shared_ptr<ResourceBase> &texture, Resource &uploader,
+	DDS::AlphaMode *pAlphaMode, ResourceState dstState)
+{
+	// Create from the file read ahead by Prepare() if any
+	const auto fileIter = m_textureFiles.find(filePath);
+	if (fileIter != m_textureFiles.end())
+		return textureLoader.CreateTextureFromMemory(m_device, commandList, fileIter->second.data(),
+			fileIter->second.size(), 8192, forceSRGB, texture, uploader, pAlphaMode, dstState);
+
+	const wstring filePathW(filePath.cbegin(), filePath.cend());
+
+	return textureLoader.CreateTextureFromFile(m_device, commandList, filePathW.c_str(),
+		8192, forceSRGB, texture, uploader, pAlphaMode, dstState);
+}
+
 bool SDKMesh::createVertexBuffer(const CommandList &commandList, std::vector<Resource> &uploaders)
 {
 	// Vertex buffer info
 	auto numVertices = 0u;
 	const auto stride = static_cast<uint32_t>(m_pVertexBufferArray->StrideBytes);
 	vector<uint32_t> firstVertices(m_pMeshHeader->NumVertexBuffers);
+	vector<uint32_t> sizes(m_pMeshHeader->NumVertexBuffers);
 
 	for (auto i = 0u; i < m_pMeshHeader->NumVertexBuffers; ++i)
 	{
 		firstVertices[i] = numVertices;
-		numVertices += static_cast<uint32_t>(m_pVertexBufferArray[i].SizeBytes) / stride;
+		sizes[i] = static_cast<uint32_t>(m_pVertexBufferArray[i].SizeBytes);
+		numVertices += sizes[i] / stride;
 	}
 
-	// Create a vertex Buffer
-	N_RETURN(m_vertexBuffer.Create(m_device, numVertices, stride, D3D12_RESOURCE_FLAG_NONE,
-		D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST,
+	// Create a vertex Buffer; uploaded on the copy queue, it stays in the common state,
+	// and is promoted implicitly on its first use
+	N_RETURN(m_vertexBuffer.Create(m_device, numVertices, stride, D3D12_RESOURCE_FLAG_NONE, D3D12_HEAP_TYPE_DEFAULT,
+		m_uploadManager ? D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_COPY_DEST,
 		m_pMeshHeader->NumVertexBuffers, firstVertices.data(),
 		m_pMeshHeader->NumVertexBuffers, firstVertices.data(),
 		1, nullptr, m_name.empty() ? nullptr : (m_name + L".VertexBuffer").c_str()), false);
 
-	// Copy vertices into one buffer
-	auto offset = 0u;
-	vector<uint8_t> bufferData(stride * numVertices);
-
-	for (auto i = 0u; i < m_pMeshHeader->NumVertexBuffers; ++i)
-	{
-		const auto sizeBytes = static_cast<uint32_t>(m_pVertexBufferArray[i].SizeBytes);
-		memcpy(&bufferData[offset], m_vertices[i], sizeBytes);
-		offset += sizeBytes;
-	}
-
 	// Upload vertices
-	uploaders.push_back(Resource());
-	
-	return m_vertexBuffer.Upload(commandList, uploaders.back(), bufferData.data(),
-		D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+	return uploadStreams(commandList, m_vertexBuffer, sizes, [this](uint32_t i, uint8_t *pDst)
+	{ WriteVerticesAt(i, pDst); }, uploaders, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
 }
 
 bool SDKMesh::createIndexBuffer(const CommandList &commandList, std::vector<Resource> &uploaders)
@@ -679,49 +1119,83 @@ bool SDKMesh::createIndexBuffer(const CommandList &commandList, std::vector<Reso
 	// Index buffer info
 	auto byteWidth = 0u;
 	vector<uint32_t> offsets(m_pMeshHeader->NumIndexBuffers);
+	vector<uint32_t> sizes(m_pMeshHeader->NumIndexBuffers);
 
 	for (auto i = 0u; i < m_pMeshHeader->NumIndexBuffers; ++i)
 	{
 		offsets[i] = byteWidth;
-		byteWidth += static_cast<uint32_t>(m_pIndexBufferArray[i].SizeBytes);
+		sizes[i] = static_cast<uint32_t>(m_pIndexBufferArray[i].SizeBytes);
+		byteWidth += sizes[i];
 	}
 
 	// Create a vertex Buffer
 	N_RETURN(m_indexBuffer.Create(m_device, byteWidth, m_pIndexBufferArray->IndexType == IT_32BIT ?
-		DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT, D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE,
-		D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST,
+		DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT, D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE, D3D12_HEAP_TYPE_DEFAULT,
+		m_uploadManager ? D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_COPY_DEST,
 		m_pMeshHeader->NumIndexBuffers, offsets.data(), 1, nullptr, 1, nullptr,
 		m_name.empty() ? nullptr : (m_name + L".IndexBuffer").c_str()), false);
-	
-	// Copy indices into one buffer
-	auto offset = 0u;
-	vector<uint8_t> bufferData(byteWidth);
 
-	for (auto i = 0u; i < m_pMeshHeader->NumVertexBuffers; ++i)
+	// Upload indices
+	return uploadStreams(commandList, m_indexBuffer, sizes, [this](uint32_t i, uint8_t *pDst)
+	{ WriteIndicesAt(i, pDst); }, uploaders, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+}
+
+bool SDKMesh::uploadStreams(const CommandList &commandList, RawBuffer &buffer, const vector<uint32_t> &sizes,
+	const function<void(uint32_t, uint8_t*)> &writeStream, vector<Resource> &uploaders, ResourceState dstState)
+{
+	const auto numStreams = static_cast<uint32_t>(sizes.size());
+	auto size = 0u;
+	for (const auto &streamSize : sizes) size += streamSize;
+
+	// The streams are written from the mapped mesh file straight into the upload memory,
+	// reordered and remapped on the way, in a single copy
+	const auto writeStreams = [&](uint8_t *pDst)
 	{
-		const auto sizeBytes = static_cast<uint32_t>(m_pIndexBufferArray[i].SizeBytes);
-		memcpy(&bufferData[offset], m_indices[i], sizeBytes);
-		offset += sizeBytes;
-	}
+		for (auto i = 0u; i < numStreams; ++i)
+		{
+			writeStream(i, pDst);
+			pDst += sizes[i];
+		}
+	};
 
-	// Upload indices
+	if (m_uploadManager) return m_uploadManager->Upload(buffer, writeStreams, size);
+
+	// Without an upload manager, into an upload resource of the buffer's own
 	uploaders.push_back(Resource());
 
-	return m_indexBuffer.Upload(commandList, uploaders.back(), bufferData.data(),
-		D3D12_RESOURCE_STATE_INDEX_BUFFER);
+	return buffer.Upload(commandList, uploaders.back(), writeStreams, size, dstState);
 }
 
 //--------------------------------------------------------------------------------------
 bool SDKMesh::createFromFile(const Device &device, const wchar_t *fileName,
-	const TextureCache &textureCache, bool isStaticMesh)
+	const TextureCache &textureCache, bool isStaticMesh,
+	const shared_ptr<UploadManager> &uploadManager)
+{
+	N_RETURN(prepareFromFile(fileName, textureCache, isStaticMesh), false);
+
+	return upload(device, uploadManager);
+}
+
+bool SDKMesh::createFromMemory(const Device &device, uint8_t *pData,
+	const TextureCache &textureCache, size_t dataBytes,
+	bool isStaticMesh, bool copyStatic,
+	const shared_ptr<UploadManager> &uploadManager)
+{
+	N_RETURN(prepareFromMemory(pData, textureCache, dataBytes, isStaticMesh, copyStatic), false);
+
+	return upload(device, uploadManager);
+}
+
+bool SDKMesh::prepareFromFile(const wchar_t *fileName, const TextureCache &textureCache, bool isStaticMesh)
 {
 	// Find the path for the file
 	m_filePathW = fileName;
 	//V_RETURN(DXUTFindDXSDKMediaFileCch(m_filePathW, sizeof(m_strPathW) / sizeof(WCHAR), fileName));
 
 	// Open the file
-	ifstream fileStream(m_filePathW, ios::in | ios::binary);
-	F_RETURN(!fileStream, cerr, MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x0903), false);
+	const auto hFile = CreateFileW(m_filePathW.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	F_RETURN(hFile == INVALID_HANDLE_VALUE, cerr, MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x0903), false);
 
 	// Change the path to just the directory
 	const auto found = m_filePathW.find_last_of(L"/\\");
@@ -730,40 +1204,32 @@ bool SDKMesh::createFromFile(const Device &device, const wchar_t *fileName,
 	m_filePath.assign(m_filePathW.cbegin(), m_filePathW.cend());
 
 	// Get the file size
-	F_RETURN(!fileStream.seekg(0, fileStream.end), fileStream.close(); cerr, E_FAIL, false);
-	const auto cBytes = static_cast<uint32_t>(fileStream.tellg());
-	F_RETURN(!fileStream.seekg(0), fileStream.close(); cerr, E_FAIL, false);
+	LARGE_INTEGER fileSize;
+	const auto hasSize = GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart > 0;
+	F_RETURN(!hasSize, CloseHandle(hFile); cerr, E_FAIL, false);
 
-	// Allocate memory
-	m_heapData.resize(cBytes);
-	m_pStaticMeshData = m_heapData.data();
+	// Map the file read-only instead of reading it into memory: the vertex and index pages
+	// are read from the page cache on demand and stay shared with it. Only the header and
+	// the arrays, which are written at load time, e.g. the material bindings, are copied.
+	const auto hFileMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const auto mappingError = GetLastError();
+	CloseHandle(hFile);
+	F_RETURN(!hFileMapping, cerr, mappingError, false);
 
-	// Read in the file
-	F_RETURN(!fileStream.read(reinterpret_cast<char*>(m_pStaticMeshData), cBytes), cerr, E_FAIL, false);
+	// The view keeps the mapping alive
+	const auto pView = reinterpret_cast<uint8_t*>(MapViewOfFile(hFileMapping, FILE_MAP_READ, 0, 0, 0));
+	const auto viewError = GetLastError();
+	CloseHandle(hFileMapping);
+	F_RETURN(!pView, cerr, viewError, false);
 
-	fileStream.close();
+	m_mappedFile.reset(pView, UnmapViewOfFile);
 
-	return createFromMemory(device, m_pStaticMeshData, textureCache, cBytes, isStaticMesh, false);
+	return prepareFromMemory(pView, textureCache, static_cast<size_t>(fileSize.QuadPart), isStaticMesh, true);
 }
 
-bool SDKMesh::createFromMemory(const Device &device, uint8_t *pData,
-	const TextureCache &textureCache, size_t dataBytes,
-	bool isStaticMesh, bool copyStatic)
+bool SDKMesh::prepareFromMemory(uint8_t *pData, const TextureCache &textureCache,
+	size_t dataBytes, bool isStaticMesh, bool copyStatic)
 {
-	XMFLOAT3 lower; 
-	XMFLOAT3 upper; 
-	
-	m_device = device;
-	CommandAllocator commandAllocator = nullptr;
-	CommandList commandList;
-	if (device)
-	{
-		V_RETURN(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
-			IID_PPV_ARGS(&commandAllocator)), cerr, false);
-		V_RETURN(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocator.get(),
-			nullptr, IID_PPV_ARGS(&commandList.GetCommandList())), cerr, false);
-	}
-
 	F_RETURN(dataBytes < sizeof(SDKMeshHeader), cerr, E_FAIL, false);
 
 	// Set outstanding resources to zero
@@ -782,26 +1248,23 @@ bool SDKMesh::createFromMemory(const Device &device, uint8_t *pData,
 	}
 	else m_pStaticMeshData = pData;
 
-	// Pointer fixup
-	m_pMeshHeader = reinterpret_cast<SDKMeshHeader*>(m_pStaticMeshData);
-
-	m_pVertexBufferArray = reinterpret_cast<SDKMeshVertexBufferHeader*>(m_pStaticMeshData + m_pMeshHeader->VertexStreamHeadersOffset);
-	m_pIndexBufferArray = reinterpret_cast<SDKMeshIndexBufferHeader*>(m_pStaticMeshData + m_pMeshHeader->IndexStreamHeadersOffset);
-	m_pMeshArray = reinterpret_cast<SDKMeshData*>(m_pStaticMeshData + m_pMeshHeader->MeshDataOffset);
-	m_pSubsetArray = reinterpret_cast<SDKMeshSubset*>(m_pStaticMeshData + m_pMeshHeader->SubsetDataOffset);
-	m_pFrameArray = reinterpret_cast<SDKMeshFrame*>(m_pStaticMeshData + m_pMeshHeader->FrameDataOffset);
-	m_pMaterialArray = reinterpret_cast<SDKMeshMaterial*>(m_pStaticMeshData + m_pMeshHeader->MaterialDataOffset);
+	// Views of the arrays at their offsets; the subset and frame influence lists of the
+	// meshes are viewed at their offsets on access, so the mesh data is not fixed up
+	m_pMeshHeader = getView<SDKMeshHeader>(0);
 
-	// Setup subsets
-	for(auto i = 0u; i < m_pMeshHeader->NumMeshes; ++i)
-	{
-		m_pMeshArray[i].pSubsets = reinterpret_cast<uint32_t*>(m_pStaticMeshData + m_pMeshArray[i].SubsetOffset);
-		m_pMeshArray[i].pFrameInfluences = reinterpret_cast<uint32_t*>(m_pStaticMeshData + m_pMeshArray[i].FrameInfluenceOffset);
-	}
+	m_pVertexBufferArray = getView<SDKMeshVertexBufferHeader>(m_pMeshHeader->VertexStreamHeadersOffset);
+	m_pIndexBufferArray = getView<SDKMeshIndexBufferHeader>(m_pMeshHeader->IndexStreamHeadersOffset);
+	m_pMeshArray = getView<SDKMeshData>(m_pMeshHeader->MeshDataOffset);
+	m_pSubsetArray = getView<SDKMeshSubset>(m_pMeshHeader->SubsetDataOffset);
+	m_pFrameArray = getView<SDKMeshFrame>(m_pMeshHeader->FrameDataOffset);
+	m_pMaterialArray = getView<SDKMeshMaterial>(m_pMeshHeader->MaterialDataOffset);
 
 	// error condition
 	F_RETURN(m_pMeshHeader->Version != SDKMESH_FILE_VERSION, cerr, E_NOINTERFACE, false);
 
+	// Flatten the frame hierarchy for the iterative frame transforms
+	compileFrameHierarchy();
+
 	// Create VBs
 	m_vertices.resize(m_pMeshHeader->NumVertexBuffers);
 	for(auto i = 0u; i < m_pMeshHeader->NumVertexBuffers; ++i)
@@ -812,110 +1275,327 @@ bool SDKMesh::createFromMemory(const Device &device, uint8_t *pData,
 	for (auto i = 0u; i < m_pMeshHeader->NumIndexBuffers; ++i)
 		m_indices[i] = reinterpret_cast<uint8_t*>(pData + m_pIndexBufferArray[i].DataOffset);
 
-	// Uploader buffers
-	vector<Resource> uploaders;
+	// Partition the skinned vertices by influence count and remap their bones to the palette,
+	// as they are written for the upload
+	partitionInfluences(isStaticMesh);
+	buildBonePalette(isStaticMesh);
 
-	// Load Materials
+	// Materials are loaded by upload()
 	m_textureCache = textureCache;
-	if (commandList.GetCommandList()) loadMaterials(commandList, m_pMaterialArray, m_pMeshHeader->NumMaterials, uploaders);
 
-	// Create a place to store our bind pose frame matrices
+	// Create a place to store our bind pose frame matrices and their inverses
 	m_bindPoseFrameMatrices.resize(m_pMeshHeader->NumFrames);
+	m_invBindPoseFrameMatrices.resize(m_pMeshHeader->NumFrames);
 
 	// Create a place to store our transformed frame matrices
-	m_transformedFrameMatrices.resize(m_pMeshHeader->NumFrames);
-	m_worldPoseFrameMatrices.resize(m_pMeshHeader->NumFrames);
+	InitPose(m_pose);
 
 	// Process as a static mesh
 	if (isStaticMesh) createAsStaticMesh();
 
-	SDKMeshSubset* pSubset = nullptr;
-	PrimitiveTopology primType;
+	// Update the bounding volumes, which are independent per mesh
+	for (auto m = 0u; m < m_pMeshHeader->NumMeshes; ++m) computeBounds(m);
+
+	return true;
+}
 
-	// update bounding volume
-	SDKMeshData *currentMesh = m_pMeshArray;
-	auto tris = 0;
+bool SDKMesh::upload(const Device &device, const shared_ptr<UploadManager> &uploadManager)
+{
+	m_device = device;
+	m_uploadManager = uploadManager;
+	CommandAllocator commandAllocator = nullptr;
+	CommandList commandList;
+	if (m_uploadManager) commandList = m_uploadManager->GetCommandList();
+	else if (device)
+	{
+		V_RETURN(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+			IID_PPV_ARGS(&commandAllocator)), cerr, false);
+		V_RETURN(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocator.get(),
+			nullptr, IID_PPV_ARGS(&commandList.GetCommandList())), cerr, false);
+	}
+
+	// Uploader buffers, kept alive by the upload manager until its batch completes
+	vector<Resource> meshUploaders;
+	auto &uploaders = m_uploadManager ? m_uploadManager->GetUploaders() : meshUploaders;
+
+	// Load Materials
+	if (commandList.GetCommandList()) loadMaterials(commandList, m_pMaterialArray, m_pMeshHeader->NumMaterials, uploaders);
+	m_textureFiles.clear();
+
+	// Classify material type for each subset
+	classifyMaterialType();
+
+	//Create vertex Buffer and index buffer
+	N_RETURN(createVertexBuffer(commandList, uploaders), false);
+	N_RETURN(createIndexBuffer(commandList, uploaders), false);
+
+	// Leave the commands to the upload manager without blocking
+	if (m_uploadManager)
+	{
+		m_uploadFenceValue = m_uploadManager->GetFenceValue();
+		m_isLoading = true;
+
+		return true;
+	}
+
+	// Execute commands
+	N_RETURN(executeCommandList(commandList), false);
+	m_isLoading = false;
+
+	return true;
+}
 
+void SDKMesh::partitionInfluences(bool isStaticMesh)
+{
+	// Vertex element usages and types of the packed bone weights (D3DDECLUSAGE, D3DDECLTYPE)
+	enum DeclValue : uint8_t
+	{
+		DECLUSAGE_BLENDWEIGHT = 1,
+		DECLUSAGE_BLENDINDICES = 2,
+		DECLTYPE_UBYTE4 = 5,
+		DECLTYPE_UBYTE4N = 8,
+		DECL_END = 0xff
+	};
+
+	// A single range of MAX_INFLUENCES by default, written in the file order
+	const auto numVBs = m_pMeshHeader->NumVertexBuffers;
+	m_influenceRanges.resize(numVBs);
+	m_vertexStreams.assign(numVBs, VertexStream{ vector<uint32_t>(), UINT32_MAX, UINT32_MAX, UINT32_MAX });
+	m_indexStreamVBs.assign(m_pMeshHeader->NumIndexBuffers, UINT32_MAX);
+	for (auto vb = 0u; vb < numVBs; ++vb)
+	{
+		auto &ranges = m_influenceRanges[vb];
+		for (auto i = 0u; i < MAX_INFLUENCES; ++i) ranges.FirstVertices[i] = 0;
+		ranges.FirstVertices[MAX_INFLUENCES] = static_cast<uint32_t>(m_pVertexBufferArray[vb].NumVertices);
+	}
+	if (isStaticMesh) return;
+
+	// The vertices can be reordered only if each of their index buffers indexes them alone,
+	// from the first vertex
+	vector<uint32_t> ibVBs(m_pMeshHeader->NumIndexBuffers, UINT32_MAX);
+	vector<uint8_t> isReorderable(numVBs, 1);
 	for (auto m = 0u; m < m_pMeshHeader->NumMeshes; ++m)
 	{
-		lower.x = FLT_MAX; lower.y = FLT_MAX; lower.z = FLT_MAX;
-		upper.x = -FLT_MAX; upper.y = -FLT_MAX; upper.z = -FLT_MAX;
-		currentMesh = GetMesh(m);
-		const auto indSize = m_pIndexBufferArray[currentMesh->IndexBuffer].IndexType == IT_16BIT ? 2 : 4;
+		const auto &mesh = m_pMeshArray[m];
+		const auto vb = mesh.VertexBuffers[0];
+		auto &ibVB = ibVBs[mesh.IndexBuffer];
+		if (ibVB != UINT32_MAX && ibVB != vb) isReorderable[vb] = isReorderable[ibVB] = 0;
+		ibVB = vb;
+
+		for (auto subset = 0u; subset < mesh.NumSubsets; ++subset)
+			if (GetSubset(m, subset)->VertexStart > 0) isReorderable[vb] = 0;
+	}
+
+	// The file stays untouched: only the order of the vertices is recorded here, and the
+	// vertices are sorted and the indices remapped as they are written for the upload
+	vector<uint8_t> numInfluences;
+	for (auto vb = 0u; vb < numVBs; ++vb)
+	{
+		const auto &header = m_pVertexBufferArray[vb];
+		if (!isReorderable[vb]) continue;
+
+		// Find the packed bone weights and indices
+		auto weightOffset = UINT32_MAX;
+		auto boneOffset = UINT32_MAX;
+		for (const auto &element : header.Decl)
+		{
+			if (element.Stream == DECL_END) break;
+			if (element.Usage == DECLUSAGE_BLENDWEIGHT && element.Type == DECLTYPE_UBYTE4N) weightOffset = element.Offset;
+			if (element.Usage == DECLUSAGE_BLENDINDICES && element.Type == DECLTYPE_UBYTE4) boneOffset = element.Offset;
+		}
+		if (weightOffset == UINT32_MAX || boneOffset == UINT32_MAX) continue;
+
+		// Count the nonzero weights of each vertex; the vertices without weights go with the
+		// single influences
+		const auto numVertices = static_cast<uint32_t>(header.NumVertices);
+		const auto stride = static_cast<uint32_t>(header.StrideBytes);
+		const auto pVertices = m_vertices[vb];
+		uint32_t counts[MAX_INFLUENCES] = {};
+		numInfluences.resize(numVertices);
+		for (auto i = 0u; i < numVertices; ++i)
+		{
+			const auto pWeights = &pVertices[stride * i + weightOffset];
+			auto n = 0u;
+			for (auto j = 0u; j < MAX_INFLUENCES; ++j) n += pWeights[j] > 0 ? 1 : 0;
+			n = (max)(n, 1u);
+			numInfluences[i] = static_cast<uint8_t>(n);
+			++counts[n - 1];
+		}
 
-		for (auto subset = 0u; subset < currentMesh->NumSubsets; ++subset)
+		// Stable counting sort by the influence count
+		auto &ranges = m_influenceRanges[vb];
+		uint32_t next[MAX_INFLUENCES];
+		for (auto i = 0u; i < MAX_INFLUENCES; ++i)
 		{
-			pSubset = GetSubset(m, subset);	//&m_pSubsetArray[currentMesh->pSubsets[subset]];
+			ranges.FirstVertices[i + 1] = ranges.FirstVertices[i] + counts[i];
+			next[i] = ranges.FirstVertices[i];
+		}
 
-			primType = GetPrimitiveType(static_cast<SDKMeshPrimitiveType>(pSubset->PrimitiveType));
-			assert(primType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);	// only triangle lists are handled.
+		auto &stream = m_vertexStreams[vb];
+		stream.Order.resize(numVertices);
+		for (auto i = 0u; i < numVertices; ++i) stream.Order[next[numInfluences[i] - 1]++] = i;
+		stream.WeightOffset = weightOffset;
+		stream.BoneOffset = boneOffset;
 
-			const auto indexCount = static_cast<uint32_t>(pSubset->IndexCount);
-			const auto indexStart = static_cast<uint32_t>(pSubset->IndexStart);
+		for (auto ib = 0u; ib < m_pMeshHeader->NumIndexBuffers; ++ib)
+			if (ibVBs[ib] == vb) m_indexStreamVBs[ib] = vb;
+	}
+}
+
+void SDKMesh::buildBonePalette(bool isStaticMesh)
+{
+	// Vertex element usage and type of the packed bone indices (D3DDECLUSAGE, D3DDECLTYPE)
+	enum DeclValue : uint8_t
+	{
+		DECLUSAGE_BLENDINDICES = 2,
+		DECLTYPE_UBYTE4 = 5,
+		DECL_END = 0xff
+	};
 
-			//if (bAdjacent)
-			//{
-			//	IndexCount *= 2;
-			//	IndexStart *= 2;
-			//}
-
-			//uint8_t* pIndices = nullptr;
-			//m_ppIndices[i]
-			const auto indices = reinterpret_cast<uint32_t*>(m_indices[currentMesh->IndexBuffer]);
-			const auto vertices = reinterpret_cast<float*>(m_vertices[currentMesh->VertexBuffers[0]]);
-			auto stride = static_cast<uint32_t>(m_pVertexBufferArray[currentMesh->VertexBuffers[0]].StrideBytes);
-			assert (stride % 4 == 0);
-			stride /= 4;
-
-			for (auto vertIdx = indexStart; vertIdx < indexStart + indexCount; ++vertIdx)
+	// Each influencing frame once, in the order of the first mesh it influences
+	const auto numMeshes = m_pMeshHeader->NumMeshes;
+	vector<uint32_t> frameBones(m_pMeshHeader->NumFrames, UINT32_MAX);
+	m_paletteFrames.clear();
+	m_boneRemaps.clear();
+	m_firstBoneRemaps.resize(numMeshes);
+	for (auto m = 0u; m < numMeshes; ++m)
+	{
+		const auto pFrameInfluences = GetFrameInfluences(m);
+		m_firstBoneRemaps[m] = static_cast<uint32_t>(m_boneRemaps.size());
+		for (auto i = 0u; i < m_pMeshArray[m].NumFrameInfluences; ++i)
+		{
+			auto &bone = frameBones[pFrameInfluences[i]];
+			if (bone == UINT32_MAX)
 			{
-				auto currentIndex = 0u;
-				if (indSize == 2)
-				{
-					const auto ind_div2 = vertIdx / 2;
-					currentIndex = indices[ind_div2];
-					if (vertIdx % 2 == 0)
-					{
-						currentIndex = currentIndex << 16;
-						currentIndex = currentIndex >> 16;
-					}else
-					{
-						currentIndex = currentIndex >> 16;
-					}
-				}
-				else currentIndex = indices[vertIdx];
-				++tris;
-				const auto pt = reinterpret_cast<XMFLOAT3*>(&vertices[stride * currentIndex]);
-				if (pt->x < lower.x) lower.x = pt->x;
-				if (pt->y < lower.y) lower.y = pt->y;
-				if (pt->z < lower.z) lower.z = pt->z;
-				if (pt->x > upper.x) upper.x = pt->x;
-				if (pt->y > upper.y) upper.y = pt->y;
-				if (pt->z > upper.z) upper.z = pt->z;
-				//uint8_t** m_ppVertices;
-				//uint8_t** m_ppIndices;
+				bone = static_cast<uint32_t>(m_paletteFrames.size());
+				m_paletteFrames.push_back(pFrameInfluences[i]);
 			}
-			//pd3dDeviceContext->DrawIndexed(IndexCount, IndexStart, VertexStart);
+			m_boneRemaps.push_back(bone);
 		}
+	}
 
-		XMFLOAT3 half((upper.x - lower.x) * 0.5f, (upper.y - lower.y) * 0.5f, (upper.z - lower.z) * 0.5f);
+	// The packed bone indices of the vertices can address the shared palette only if it
+	// fits in a byte, and all the meshes of each skinned vertex buffer remap it alike
+	const auto numVBs = m_pMeshHeader->NumVertexBuffers;
+	vector<uint32_t> vbMeshes(numVBs, UINT32_MAX);
+	auto isRemappable = !isStaticMesh && m_paletteFrames.size() <= UINT8_MAX + 1;
+	for (auto m = 0u; m < numMeshes && isRemappable; ++m)
+	{
+		const auto &mesh = m_pMeshArray[m];
+		if (mesh.NumFrameInfluences == 0) continue;
 
-		currentMesh->BoundingBoxCenter.x = lower.x + half.x;
-		currentMesh->BoundingBoxCenter.y = lower.y + half.y;
-		currentMesh->BoundingBoxCenter.z = lower.z + half.z;
-		currentMesh->BoundingBoxExtents = half;
+		auto &vbMesh = vbMeshes[mesh.VertexBuffers[0]];
+		if (vbMesh == UINT32_MAX) vbMesh = m;
+		else isRemappable = m_pMeshArray[vbMesh].NumFrameInfluences == mesh.NumFrameInfluences &&
+			equal(GetBoneRemap(m), GetBoneRemap(m) + mesh.NumFrameInfluences, GetBoneRemap(vbMesh));
 	}
-	// Update 
 
-	// Classify material type for each subset
-	classifyMaterialType();
+	vector<uint32_t> boneOffsets(numVBs, UINT32_MAX);
+	for (auto vb = 0u; vb < numVBs && isRemappable; ++vb)
+	{
+		if (vbMeshes[vb] == UINT32_MAX) continue;
 
-	//Create vertex Buffer and index buffer
-	N_RETURN(createVertexBuffer(commandList, uploaders), false);
-	N_RETURN(createIndexBuffer(commandList, uploaders), false);
+		for (const auto &element : m_pVertexBufferArray[vb].Decl)
+		{
+			if (element.Stream == DECL_END) break;
+			if (element.Usage == DECLUSAGE_BLENDINDICES && element.Type == DECLTYPE_UBYTE4) boneOffsets[vb] = element.Offset;
+		}
+		isRemappable = boneOffsets[vb] != UINT32_MAX;
+	}
 
-	// Execute commands
-	return executeCommandList(commandList);
+	if (isRemappable)
+	{
+		// The bone indices of the vertices are rewritten from the mesh influences to the
+		// palette as they are written for the upload
+		for (auto vb = 0u; vb < numVBs; ++vb)
+		{
+			if (vbMeshes[vb] == UINT32_MAX) continue;
+
+			m_vertexStreams[vb].BoneOffset = boneOffsets[vb];
+			m_vertexStreams[vb].RemapMesh = vbMeshes[vb];
+		}
+		m_firstPaletteBones.assign(numMeshes, 0);
+	}
+	else
+	{
+		// Fall back to a palette range per mesh, indexed by the mesh influences
+		m_paletteFrames.clear();
+		m_firstPaletteBones.resize(numMeshes);
+		for (auto m = 0u; m < numMeshes; ++m)
+		{
+			const auto pFrameInfluences = GetFrameInfluences(m);
+			m_firstPaletteBones[m] = m_firstBoneRemaps[m];
+			m_paletteFrames.insert(m_paletteFrames.end(), pFrameInfluences,
+				pFrameInfluences + m_pMeshArray[m].NumFrameInfluences);
+		}
+		for (auto i = 0u; i < m_boneRemaps.size(); ++i) m_boneRemaps[i] = i;
+	}
+}
+
+void SDKMesh::computeBounds(uint32_t mesh)
+{
+	const auto pMesh = GetMesh(mesh);
+	const auto &vbHeader = m_pVertexBufferArray[pMesh->VertexBuffers[0]];
+	const auto pVertices = m_vertices[pMesh->VertexBuffers[0]];
+	const auto stride = static_cast<uint32_t>(vbHeader.StrideBytes);
+	assert(stride % 4 == 0);
+
+	// The vertices of a mesh need not be contiguous in a VB shared with other meshes, so the
+	// vertices referenced by the subsets are marked, and only the marked ones in the range of
+	// the mesh are visited. The indices are read at their native width, once for the range,
+	// which bounds the marks, and once for the marks.
+	const auto pIndices = m_indices[pMesh->IndexBuffer];
+	const auto is32Bit = m_pIndexBufferArray[pMesh->IndexBuffer].IndexType == IT_32BIT;
+	const auto forEachSubset = [&](const auto &visit)
+	{
+		for (auto s = 0u; s < pMesh->NumSubsets; ++s)
+		{
+			const auto pSubset = GetSubset(mesh, s);
+			assert(GetPrimitiveType(static_cast<SDKMeshPrimitiveType>(pSubset->PrimitiveType)) ==
+				D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);	// only triangle lists are handled.
+
+			const auto indexStart = static_cast<uint32_t>(pSubset->IndexStart);
+			const auto indexCount = static_cast<uint32_t>(pSubset->IndexCount);
+			if (is32Bit) visit(reinterpret_cast<const uint32_t*>(pIndices) + indexStart, indexCount);
+			else visit(reinterpret_cast<const uint16_t*>(pIndices) + indexStart, indexCount);
+		}
+	};
+
+	auto firstVertex = UINT32_MAX;
+	auto lastVertex = 0u;
+	forEachSubset([&](const auto *pSubsetIndices, uint32_t numIndices)
+	{
+		for (auto i = 0u; i < numIndices; ++i)
+		{
+			const uint32_t vertex = pSubsetIndices[i];
+			firstVertex = (min)(vertex, firstVertex);
+			lastVertex = (max)(vertex, lastVertex);
+		}
+	});
+	if (firstVertex > lastVertex) return;	// No indices; the box of the file stays
+
+	vector<uint8_t> isReferenced(lastVertex - firstVertex + 1);
+	forEachSubset([&](const auto *pSubsetIndices, uint32_t numIndices)
+	{
+		for (auto i = 0u; i < numIndices; ++i) isReferenced[pSubsetIndices[i] - firstVertex] = 1;
+	});
+
+	// Each referenced vertex is read once, with the min/max of all the 3 components at a time
+	auto lower = XMVectorReplicate(FLT_MAX);
+	auto upper = XMVectorReplicate(-FLT_MAX);
+	const auto numVertices = static_cast<uint32_t>(isReferenced.size());
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		if (!isReferenced[i]) continue;
+
+		const auto pos = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(&pVertices[stride * (firstVertex + i)]));
+		lower = XMVectorMin(pos, lower);
+		upper = XMVectorMax(pos, upper);
+	}
+
+	const auto half = (upper - lower) * 0.5f;
+	XMStoreFloat3(&pMesh->BoundingBoxCenter, lower + half);
+	XMStoreFloat3(&pMesh->BoundingBoxExtents, half);
 }
 
 void SDKMesh::createAsStaticMesh()
@@ -940,7 +1620,16 @@ void SDKMesh::createAsStaticMesh()
 		}
 	}
 	TransformBindPose(XMMatrixIdentity());
-	
+
+	// The vertices may be a read-only view of the file, so they are transformed in copies
+	m_staticVertices.resize(m_pMeshHeader->NumVertexBuffers);
+	for (auto vb = 0u; vb < m_pMeshHeader->NumVertexBuffers; ++vb)
+	{
+		const auto pVertices = m_vertices[vb];
+		m_staticVertices[vb].assign(pVertices, pVertices + m_pVertexBufferArray[vb].SizeBytes);
+		m_vertices[vb] = m_staticVertices[vb].data();
+	}
+
 	// Recompute vertex buffers
 	for (auto i = 0u; i < m_pMeshHeader->NumFrames; ++i)
 	{
@@ -952,7 +1641,7 @@ void SDKMesh::createAsStaticMesh()
 			const auto local = GetBindMatrix(i);
 			const auto verts = m_vertices[vb];
 			const auto stride = GetVertexStride(m, 0);
-			const auto localIT = XMMatrixTranspose(XMMatrixInverse(nullptr, local));
+			const auto localIT = XMMatrixTranspose(GetInvBindMatrix(i));
 
 			for (auto i = 0u; i < numVerts; ++i)
 			{
@@ -988,7 +1677,7 @@ void SDKMesh::classifyMaterialType()
 		const auto &numSubsets = m_pMeshArray[m].NumSubsets;
 		for (auto s = 0u; s < numSubsets; ++s)
 		{
-			const auto &subsetIdx = m_pMeshArray[m].pSubsets[s];
+			const auto &subsetIdx = getView<uint32_t>(m_pMeshArray[m].SubsetOffset)[s];
 			const auto &pSubset = m_pSubsetArray[subsetIdx];
 			const auto pMaterial = GetMaterial(pSubset.MaterialID);
 			
@@ -1027,6 +1716,38 @@ void SDKMesh::classifyMaterialType()
 	}
 }
 
+void SDKMesh::bindAnimation()
+{
+	m_pAnimationHeader = m_animationClip ? m_animationClip->GetHeader() : nullptr;
+	if (!m_pMeshHeader) return;
+
+	for (auto i = 0u; i < m_pMeshHeader->NumFrames; ++i)
+		m_pFrameArray[i].AnimationDataIndex = INVALID_ANIMATION_DATA;
+
+	// Bind the frames to the animation tracks by name
+	const auto numTracks = m_pAnimationHeader ? m_pAnimationHeader->NumFrames : 0;
+	for (auto i = 0u; i < numTracks; ++i)
+	{
+		const auto pFrame = FindFrame(m_animationClip->GetFrameName(i));
+
+		if (pFrame) pFrame->AnimationDataIndex = i;
+	}
+
+	// Track group heights let the animation LOD skip whole SIMD groups of leaf bones
+	const auto numTrackGroups = m_animationClip ? m_animationClip->GetTracks().GetNumGroups() : 0;
+	const auto numSoATracks = m_animationClip ? m_animationClip->GetTracks().GetNumTracks() : 0;
+	m_trackGroupHeights.assign(numTrackGroups, 0);
+	for (auto i = 0u; i < m_pMeshHeader->NumFrames; ++i)
+	{
+		const auto &index = m_pFrameArray[i].AnimationDataIndex;
+		if (index == INVALID_ANIMATION_DATA || index >= numSoATracks) continue;
+		auto &groupHeight = m_trackGroupHeights[index / AnimationTracks::GroupWidth];
+		groupHeight = (max)(groupHeight, m_frameHeights[i]);
+	}
+
+	InitPose(m_pose);
+}
+
 bool SDKMesh::executeCommandList(CommandList &commandList)
 {
 	if (commandList.GetCommandList())
@@ -1073,79 +1794,182 @@ bool SDKMesh::executeCommandList(CommandList &commandList)
 }
 
 //--------------------------------------------------------------------------------------
-// transform bind pose frame using a recursive traversal
+// compile the sibling/child linked frame lists into a parent-index array in
+// topological order, so that the frames can be transformed in one linear loop
+//--------------------------------------------------------------------------------------
+void SDKMesh::compileFrameHierarchy()
+{
+	const auto numFrames = m_pMeshHeader->NumFrames;
+	m_frameOrder.clear();
+	m_frameOrder.reserve(numFrames);
+	m_frameParents.assign(numFrames, INVALID_FRAME);
+	if (numFrames == 0) return;
+
+	// Iterative depth-first traversal, starting from the root frame
+	vector<uint32_t> stack(1, 0);
+	while (!stack.empty() && m_frameOrder.size() < numFrames)
+	{
+		const auto frame = stack.back();
+		stack.pop_back();
+		m_frameOrder.push_back(frame);
+
+		// Siblings share our parent
+		const auto &sibling = m_pFrameArray[frame].SiblingFrame;
+		if (sibling != INVALID_FRAME)
+		{
+			m_frameParents[sibling] = m_frameParents[frame];
+			stack.push_back(sibling);
+		}
+
+		// Children are parented to us
+		const auto &child = m_pFrameArray[frame].ChildFrame;
+		if (child != INVALID_FRAME)
+		{
+			m_frameParents[child] = frame;
+			stack.push_back(child);
+		}
+	}
+
+	// Accumulate the heights from the leaves up
+	m_frameHeights.assign(numFrames, 0);
+	for (auto i = m_frameOrder.size(); i > 0; --i)
+	{
+		const auto &frame = m_frameOrder[i - 1];
+		const auto &parent = m_frameParents[frame];
+		const auto height = (min)(m_frameHeights[frame] + 1u, 0xffu);
+		if (parent != INVALID_FRAME && height > m_frameHeights[parent])
+			m_frameHeights[parent] = static_cast<uint8_t>(height);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// transform bind pose frames using the flattened hierarchy, and refresh the
+// inverse bind pose cache consumed by TransformMesh; the QTS forms are kept only
+// if every frame is uniformly scaled
 //--------------------------------------------------------------------------------------
-void SDKMesh::transformBindPoseFrame(uint32_t frame, CXMMATRIX parentWorld)
+void SDKMesh::transformBindPoseFrames(CXMMATRIX world)
 {
 	if (m_bindPoseFrameMatrices.empty()) return;
 
-	// Transform ourselves
-	const auto m = XMLoadFloat4x4(&m_pFrameArray[frame].Matrix);
-	const auto mLocalWorld = XMMatrixMultiply(m, parentWorld);
-	DirectX::XMStoreFloat4x4(&m_bindPoseFrameMatrices[frame], mLocalWorld);
+	const auto numFrames = m_pMeshHeader->NumFrames;
+	m_invBindPoseTransforms.resize(numFrames);
+	m_frameTransforms.resize(numFrames);
+	m_isBindPoseUniform = true;
 
-	// Transform our siblings
-	if (m_pFrameArray[frame].SiblingFrame != INVALID_FRAME)
-		transformBindPoseFrame(m_pFrameArray[frame].SiblingFrame, parentWorld);
+	for (const auto &frame : m_frameOrder)
+	{
+		const auto &parent = m_frameParents[frame];
+		const auto parentWorld = parent != INVALID_FRAME ?
+			XMLoadFloat4x4(&m_bindPoseFrameMatrices[parent]) : world;
+
+		// Transform ourselves
+		const auto m = XMLoadFloat4x4(&m_pFrameArray[frame].Matrix);
+		const auto mLocalWorld = XMMatrixMultiply(m, parentWorld);
+		const auto mInvLocalWorld = XMMatrixInverse(nullptr, mLocalWorld);
+		XMStoreFloat4x4(&m_bindPoseFrameMatrices[frame], mLocalWorld);
+		XMStoreFloat4x4(&m_invBindPoseFrameMatrices[frame], mInvLocalWorld);
+		if (m_isBindPoseUniform) m_isBindPoseUniform =
+			BoneTransform::FromUniformMatrix(m_invBindPoseTransforms[frame], mInvLocalWorld) &&
+			BoneTransform::FromUniformMatrix(m_frameTransforms[frame], m);
+	}
 
-	// Transform our children
-	if( m_pFrameArray[frame].ChildFrame != INVALID_FRAME)
-		transformBindPoseFrame(m_pFrameArray[frame].ChildFrame, mLocalWorld);
+	if (!m_isBindPoseUniform)
+	{
+		m_invBindPoseTransforms.clear();
+		m_frameTransforms.clear();
+	}
 }
 
 //--------------------------------------------------------------------------------------
-// transform frame using a recursive traversal
+// transform frames using the flattened hierarchy
 //--------------------------------------------------------------------------------------
-void SDKMesh::transformFrame(uint32_t frame, CXMMATRIX parentWorld, double time)
+void SDKMesh::transformFrames(AnimationPose &pose, CXMMATRIX world, double time, uint8_t minBoneHeight) const
 {
 	// Get the tick data
-	XMMATRIX localTransform;
-	const auto tick = GetAnimationKeyFromTime(time);
-
-	if (INVALID_ANIMATION_DATA != m_pFrameArray[frame].AnimationDataIndex)
+	uint32_t nextTick;
+	float blend;
+	const auto tick = GetAnimationKeysFromTime(time, nextTick, blend);
+
+	// Evaluate the local transforms of all tracks in SIMD groups (slerp takes the per-frame path)
+	const auto isCompressed = m_animationClip && m_animationClip->IsCompressed();
+	const auto numTracks = m_pAnimationHeader ? m_pAnimationHeader->NumFrames : 0;
+	const auto useTracks = m_animationSampling != SAMPLE_SLERP && !isCompressed &&
+		m_animationClip && m_animationClip->GetTracks().GetNumTracks() > 0;
+	if (useTracks) m_animationClip->GetTracks().Evaluate(pose.LocalFrameTransforms.data(), tick, nextTick,
+		blend, m_trackGroupHeights.data(), minBoneHeight);
+	else if (m_animationClip)
 	{
-		const auto frameData = &m_pAnimationFrameData[m_pFrameArray[frame].AnimationDataIndex];
-		const auto data = &frameData->pAnimationData[tick];
+		// Decode the 2 keys of all tracks for the per-frame path
+		m_animationClip->DecodeKey(pose.DecodedKeys.data(), tick);
+		if (blend > 0.0f) m_animationClip->DecodeKey(&pose.DecodedKeys[numTracks], nextTick);
+	}
 
-		// Turn it into a matrix
-		const auto translate = XMMatrixTranslation(data->Translation.x, data->Translation.y, data->Translation.z);
-		const auto scaling = XMMatrixScaling(data->Scaling.x, data->Scaling.y, data->Scaling.z); // BY STARS----Scaling
-		auto quat = XMLoadFloat4(&data->Orientation);
+	// Compose the bones in quaternion-translation-scale form if the skeleton and the world
+	// are uniformly scaled, or else chain the matrices
+	auto rootTransform = BoneTransform::Identity();
+	pose.HasTransforms = isUniformScaling() && (XMMatrixIsIdentity(world) ||
+		BoneTransform::FromUniformMatrix(rootTransform, world));
+	for (const auto &frame : m_frameOrder)
+	{
+		const auto &index = m_pFrameArray[frame].AnimationDataIndex;
 
-		if (XMVector4Equal(quat, g_XMZero)) quat = XMQuaternionIdentity();
+		// Leaf bones below the LOD height are held at the bind pose
+		const auto isSkipped = INVALID_ANIMATION_DATA != index && m_frameHeights[frame] < minBoneHeight;
+		if (isSkipped) ++pose.NumSkippedBones;
+		else if (INVALID_ANIMATION_DATA != index) ++pose.NumEvaluatedBones;
 
-		quat = XMQuaternionNormalize(quat);
-		const auto quatMatrix = XMMatrixRotationQuaternion(quat);
-		localTransform = scaling * quatMatrix * translate;
-	}
-	else localTransform = XMLoadFloat4x4(&m_pFrameArray[frame].Matrix);
+		const auto isAnimated = INVALID_ANIMATION_DATA != index && !isSkipped;
+		BoneTransform localTransform;
+		if (isAnimated && useTracks) localTransform = pose.LocalFrameTransforms[index];
+		else if (isAnimated)
+		{
+			const auto pData = &pose.DecodedKeys[index];
+			const auto pNextData = &pose.DecodedKeys[numTracks + index];
+
+			// Sample the keys
+			XMVECTOR translation, quat, scaling;
+			sampleAnimationData(translation, quat, scaling, *pData, *pNextData, blend);
+			XMStoreFloat4(&localTransform.Rotation, quat);
+			XMStoreFloat3(&localTransform.Translation, translation);
+			XMStoreFloat3(&localTransform.Scaling, scaling); // BY STARS----Scaling
+		}
 
-	// Transform ourselves
-	auto localWorld = XMMatrixMultiply(localTransform, parentWorld);
-	XMStoreFloat4x4(&m_transformedFrameMatrices[frame], localWorld);
-	XMStoreFloat4x4(&m_worldPoseFrameMatrices[frame], localWorld);
+		const auto &parent = m_frameParents[frame];
+		if (pose.HasTransforms)
+		{
+			const auto &parentWorld = parent != INVALID_FRAME ? pose.WorldPoseFrameTransforms[parent] : rootTransform;
 
-	// Transform our siblings
-	if (m_pFrameArray[frame].SiblingFrame != INVALID_FRAME)
-		transformFrame(m_pFrameArray[frame].SiblingFrame, parentWorld, time);
+			// Transform ourselves
+			auto &localWorld = pose.WorldPoseFrameTransforms[frame];
+			localWorld = BoneTransform::Compose(isAnimated ? localTransform : m_frameTransforms[frame], parentWorld);
+			XMStoreFloat4x4(&pose.WorldPoseFrameMatrices[frame], localWorld.ToMatrix());
+		}
+		else
+		{
+			const auto mLocal = isAnimated ? localTransform.ToMatrix() : XMLoadFloat4x4(&m_pFrameArray[frame].Matrix);
+			const auto parentWorld = parent != INVALID_FRAME ?
+				XMLoadFloat4x4(&pose.WorldPoseFrameMatrices[parent]) : world;
 
-	// Transform our children
-	if (m_pFrameArray[frame].ChildFrame != INVALID_FRAME)
-		transformFrame(m_pFrameArray[frame].ChildFrame, localWorld, time);
+			// Transform ourselves
+			XMStoreFloat4x4(&pose.WorldPoseFrameMatrices[frame], XMMatrixMultiply(mLocal, parentWorld));
+		}
+	}
 }
 
 //--------------------------------------------------------------------------------------
 // transform frame assuming that it is an absolute transformation
 //--------------------------------------------------------------------------------------
-void SDKMesh::transformFrameAbsolute(uint32_t frame, double time)
+void SDKMesh::transformFrameAbsolute(AnimationPose &pose, uint32_t frame, double time) const
 {
 	const auto iTick = GetAnimationKeyFromTime(time);
 
 	if (INVALID_ANIMATION_DATA != m_pFrameArray[frame].AnimationDataIndex)
 	{
-		const auto pFrameData = &m_pAnimationFrameData[m_pFrameArray[frame].AnimationDataIndex];
-		const auto pData = &pFrameData->pAnimationData[iTick];
-		const auto pDataOrig = &pFrameData->pAnimationData[0];
+		const auto &tracks = m_animationClip->GetTracks();
+		const auto data = tracks.GetKey(m_pFrameArray[frame].AnimationDataIndex, iTick);
+		const auto dataOrig = tracks.GetKey(m_pFrameArray[frame].AnimationDataIndex, 0);
+		const auto pData = &data;
+		const auto pDataOrig = &dataOrig;
 
 		const auto mTrans1 = XMMatrixTranslation(-pDataOrig->Translation.x, -pDataOrig->Translation.y, -pDataOrig->Translation.z);
 		const auto mTrans2 = XMMatrixTranslation(pData->Translation.x, pData->Translation.y, pData->Translation.z);
@@ -1160,6 +1984,56 @@ void SDKMesh::transformFrameAbsolute(uint32_t frame, double time)
 		const auto mFrom = mRot2 * mTrans2;
 
 		const auto mOutput = mInvTo * mFrom;
-		XMStoreFloat4x4(&m_transformedFrameMatrices[frame], mOutput);
+		XMStoreFloat4x4(&pose.TransformedFrameMatrices[frame], mOutput);
+
+		// The same transform in quaternion-translation-scale form
+		if (!pose.HasTransforms) return;
+		BoneTransform invTo, from;
+		XMStoreFloat4(&invTo.Rotation, quat1);
+		XMStoreFloat3(&invTo.Translation, XMVector3Rotate(XMVectorNegate(XMLoadFloat3(&pDataOrig->Translation)), quat1));
+		invTo.Scaling = XMFLOAT3(1.0f, 1.0f, 1.0f);
+		XMStoreFloat4(&from.Rotation, quat2);
+		from.Translation = pData->Translation;
+		from.Scaling = XMFLOAT3(1.0f, 1.0f, 1.0f);
+		pose.TransformedFrameTransforms[frame] = BoneTransform::Compose(invTo, from);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// whether the bones compose exactly in quaternion-translation-scale form
+//--------------------------------------------------------------------------------------
+bool SDKMesh::isUniformScaling() const
+{
+	return m_isBindPoseUniform && (!m_animationClip || m_animationClip->IsUniformScaling());
+}
+
+//--------------------------------------------------------------------------------------
+// sample the keys of a frame: translation and scale lerp, rotation nlerp/slerp
+//--------------------------------------------------------------------------------------
+void SDKMesh::sampleAnimationData(XMVECTOR &translation, XMVECTOR &quat, XMVECTOR &scaling,
+	const SDKAnimationData &data, const SDKAnimationData &nextData, float blend) const
+{
+	translation = XMLoadFloat3(&data.Translation);
+	scaling = XMLoadFloat3(&data.Scaling);
+	quat = XMLoadFloat4(&data.Orientation);
+	if (XMVector4Equal(quat, g_XMZero)) quat = XMQuaternionIdentity();
+
+	if (blend > 0.0f && m_animationSampling != SAMPLE_NEAREST)
+	{
+		auto nextQuat = XMLoadFloat4(&nextData.Orientation);
+		if (XMVector4Equal(nextQuat, g_XMZero)) nextQuat = XMQuaternionIdentity();
+
+		translation = XMVectorLerp(translation, XMLoadFloat3(&nextData.Translation), blend);
+		scaling = XMVectorLerp(scaling, XMLoadFloat3(&nextData.Scaling), blend);
+
+		if (m_animationSampling == SAMPLE_SLERP) quat = XMQuaternionSlerp(quat, nextQuat, blend);
+		else
+		{
+			// Take the shortest arc
+			if (XMVectorGetX(XMVector4Dot(quat, nextQuat)) < 0.0f) nextQuat = XMVectorNegate(nextQuat);
+			quat = XMVectorLerp(quat, nextQuat, blend);
+		}
 	}
+
+	quat = XMQuaternionNormalize(quat);
 }
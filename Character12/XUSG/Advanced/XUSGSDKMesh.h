@@ -5,6 +5,9 @@
 #pragma once
 
 #include "Core/XUSGResource.h"
+#include "Core/XUSGUploadManager.h"
+#include "XUSGAnimation.h"
+#include "XUSGDDSLoader.h"
 
 //--------------------------------------------------------------------------------------
 // Hard Defines for the various structures
@@ -12,12 +15,12 @@
 #define SDKMESH_FILE_VERSION	101
 #define MAX_VERTEX_ELEMENTS		32
 #define MAX_VERTEX_STREAMS		16
-#define MAX_FRAME_NAME			100
 #define MAX_MESH_NAME			100
 #define MAX_SUBSET_NAME			100
 #define MAX_MATERIAL_NAME		100
 #define MAX_TEXTURE_NAME		MAX_PATH
 #define MAX_MATERIAL_PATH		MAX_PATH
+#define MAX_INFLUENCES			4
 #define INVALID_FRAME			((uint32_t)-1)
 #define INVALID_MESH			((uint32_t)-1)
 #define INVALID_MATERIAL		((uint32_t)-1)
@@ -75,10 +78,11 @@ namespace XUSG
 		IT_32BIT
 	};
 
-	enum FrameTransformType
+	enum AnimationSampling : uint8_t
 	{
-		FTT_RELATIVE = 0,
-		FTT_ABSOLUTE		// This is not currently used but is here to support absolute transformations in the future
+		SAMPLE_NEAREST,		// Truncate to the nearest key
+		SAMPLE_NLERP,		// Lerp translation and scale, nlerp rotation between neighbouring keys
+		SAMPLE_SLERP		// Lerp translation and scale, slerp rotation between neighbouring keys
 	};
 
 	//--------------------------------------------------------------------------------------
@@ -154,12 +158,12 @@ namespace XUSG
 		union
 		{
 			uint64_t SubsetOffset;			// Offset to list of subsets (This also forces the union to 64bits)
-			uint32_t *pSubsets;				// Pointer to list of subsets
+			uint32_t *pSubsets;				// Unused; the list is viewed at SubsetOffset
 		};
 		union
 		{
 			uint64_t FrameInfluenceOffset;	// Offset to list of frame influences (This also forces the union to 64bits)
-			uint32_t *pFrameInfluences;		// Pointer to list of frame influences
+			uint32_t *pFrameInfluences;		// Unused; the list is viewed at FrameInfluenceOffset
 		};
 	};
 
@@ -223,37 +227,19 @@ namespace XUSG
 		uint64_t AlphaModeSpecular;		// Force the union to 64bits
 	};
 
-	struct SDKAnimationFileHeader
-	{
-		uint32_t	Version;
-		uint8_t		IsBigEndian;
-		uint32_t	FrameTransformType;
-		uint32_t	NumFrames;
-		uint32_t	NumAnimationKeys;
-		uint32_t	AnimationFPS;
-		uint64_t	AnimationDataSize;
-		uint64_t	AnimationDataOffset;
-	};
-
-	struct SDKAnimationData
-	{
-		DirectX::XMFLOAT3 Translation;
-		DirectX::XMFLOAT4 Orientation;
-		DirectX::XMFLOAT3 Scaling;
-	};
+#pragma pack(pop)
 
-	struct SDKAnimationFrameData
+	//--------------------------------------------------------------------------------------
+	// Vertices of a skinned vertex buffer partitioned on upload by the number of nonzero
+	// bone weights, with the weights sorted heaviest first; the vertices with i + 1
+	// influences are [FirstVertices[i], FirstVertices[i + 1]). A vertex buffer without
+	// packed bone weights is a single range of MAX_INFLUENCES.
+	//--------------------------------------------------------------------------------------
+	struct InfluenceRanges
 	{
-		char FrameName[MAX_FRAME_NAME];
-		union
-		{
-			uint64_t DataOffset;
-			SDKAnimationData* pAnimationData;
-		};
+		uint32_t FirstVertices[MAX_INFLUENCES + 1];
 	};
 
-#pragma pack(pop)
-
 	static_assert(sizeof(SDKMeshVertexBufferHeader::VertexElement) == 8, "Vertex element structure size incorrect");
 	static_assert(sizeof(SDKMeshHeader) == 104, "SDK Mesh structure size incorrect");
 	static_assert(sizeof(SDKMeshVertexBufferHeader) == 288, "SDK Mesh structure size incorrect");
@@ -262,9 +248,23 @@ namespace XUSG
 	static_assert(sizeof(SDKMeshSubset) == 144, "SDK Mesh structure size incorrect");
 	static_assert(sizeof(SDKMeshFrame) == 184, "SDK Mesh structure size incorrect");
 	static_assert(sizeof(SDKMeshMaterial) == 1256, "SDK Mesh structure size incorrect");
-	static_assert(sizeof(SDKAnimationFileHeader) == 40, "SDK Mesh structure size incorrect");
-	static_assert(sizeof(SDKAnimationData) == 40, "SDK Mesh structure size incorrect");
-	static_assert(sizeof(SDKAnimationFrameData) == 112, "SDK Mesh structure size incorrect");
+
+	//--------------------------------------------------------------------------------------
+	// Per-instance animation state; the clip and the mesh are shared
+	//--------------------------------------------------------------------------------------
+	struct AnimationPose
+	{
+		double Time = -1.0;
+		std::vector<DirectX::XMFLOAT4X4> TransformedFrameMatrices;
+		std::vector<DirectX::XMFLOAT4X4> WorldPoseFrameMatrices;
+		std::vector<BoneTransform> TransformedFrameTransforms;	// Uniformly scaled skeletons only
+		std::vector<BoneTransform> WorldPoseFrameTransforms;	// Uniformly scaled skeletons only
+		std::vector<BoneTransform> LocalFrameTransforms;	// Per animation track
+		std::vector<SDKAnimationData> DecodedKeys;			// 2 keys of all tracks, off the SIMD path
+		uint32_t NumEvaluatedBones = 0;						// Animated bones sampled by the last evaluation
+		uint32_t NumSkippedBones = 0;						// Animated bones held at the bind pose by LOD
+		bool HasTransforms = false;							// Whether the frame transforms are composed
+	};
 
 	struct TextureCacheEntry
 	{
@@ -282,16 +282,36 @@ namespace XUSG
 		SDKMesh();
 		virtual ~SDKMesh();
 
+		// With an upload manager, the uploads are recorded into its batch, and the mesh is
+		// loading until the batch completes on the copy queue; otherwise they are blocking
 		virtual bool Create(const Device &device, const wchar_t *fileName,
-			const TextureCache &textureCache, bool isStaticMesh = false);
+			const TextureCache &textureCache, bool isStaticMesh = false,
+			const std::shared_ptr<UploadManager> &uploadManager = nullptr);
 		virtual bool Create(const Device &device, uint8_t *pData, const TextureCache &textureCache,
-			size_t dataBytes, bool isStaticMesh = false, bool copyStatic = false);
+			size_t dataBytes, bool isStaticMesh = false, bool copyStatic = false,
+			const std::shared_ptr<UploadManager> &uploadManager = nullptr);
+
+		// Staged creation for the load pipelines: Prepare() maps, parses and preprocesses the
+		// mesh and reads its textures on any thread, and Upload() creates the GPU resources on
+		// the thread recording the uploads
+		virtual bool Prepare(const wchar_t *fileName, const TextureCache &textureCache, bool isStaticMesh = false);
+		virtual bool Upload(const Device &device, const std::shared_ptr<UploadManager> &uploadManager = nullptr);
+
 		virtual bool LoadAnimation(const wchar_t *fileName);
+		virtual bool ResampleAnimation(uint32_t animationFPS);
+		virtual bool SaveAnimation(const wchar_t *fileName) const;
 		virtual void Destroy();
 
 		//Frame manipulation
 		void TransformBindPose(DirectX::CXMMATRIX world);
 		void TransformMesh(DirectX::CXMMATRIX world, double time);
+		// Bones with fewer than minBoneHeight levels of descendants (e.g. fingers) are not animated
+		void TransformMesh(AnimationPose &pose, DirectX::CXMMATRIX world, double time,
+			uint8_t minBoneHeight = 0) const;
+		void InitPose(AnimationPose &pose) const;
+		void SetAnimationClip(const std::shared_ptr<const AnimationClip> &clip);
+		// Bounds of the skinned vertices over the animation clip, after the clip and the bind pose
+		void ComputeAnimatedBounds();
 
 		// Helpers (Graphics API specific)
 		static PrimitiveTopology GetPrimitiveType(SDKMeshPrimitiveType primType);
@@ -316,8 +336,13 @@ namespace XUSG
 		uint32_t			GetNumVertexBuffers() const;
 		uint32_t			GetNumIndexBuffers() const;
 
+		// The raw streams are read-only views of the file, in its order; the streams as
+		// uploaded, i.e. partitioned by influence count with the bone indices of the palette,
+		// are written to pDst at the sizes of their headers
 		uint8_t				*GetRawVerticesAt(uint32_t vb) const;
 		uint8_t				*GetRawIndicesAt(uint32_t ib) const;
+		void				WriteVerticesAt(uint32_t vb, uint8_t *pDst) const;
+		void				WriteIndicesAt(uint32_t ib, uint8_t *pDst) const;
 
 		SDKMeshMaterial		*GetMaterial(uint32_t material) const;
 		SDKMeshData			*GetMesh(uint32_t mesh) const;
@@ -332,6 +357,11 @@ namespace XUSG
 		uint32_t			FindFrameIndex(const char *name) const;
 		uint64_t			GetNumVertices(uint32_t mesh, uint32_t i) const;
 		uint64_t			GetNumIndices(uint32_t mesh) const;
+		const InfluenceRanges &GetInfluenceRanges(uint32_t mesh) const;
+		uint32_t			GetNumPaletteBones() const;
+		uint32_t			GetPaletteFrame(uint32_t bone) const;
+		uint32_t			GetFirstPaletteBone(uint32_t mesh) const;	// Added to the bone indices of the vertices
+		const uint32_t		*GetBoneRemap(uint32_t mesh) const;			// Palette bone of each mesh influence
 		DirectX::XMVECTOR	GetMeshBBoxCenter(uint32_t mesh) const;
 		DirectX::XMVECTOR	GetMeshBBoxExtents(uint32_t mesh) const;
 		uint32_t			GetOutstandingResources() const;
@@ -344,40 +374,78 @@ namespace XUSG
 
 		// Animation
 		uint32_t			GetNumInfluences(uint32_t mesh) const;
+		const uint32_t		*GetFrameInfluences(uint32_t mesh) const;
 		DirectX::XMMATRIX	GetMeshInfluenceMatrix(uint32_t mesh, uint32_t influence) const;
+		DirectX::XMMATRIX	GetMeshInfluenceMatrix(uint32_t mesh, uint32_t influence, const AnimationPose &pose) const;
 		uint32_t			GetAnimationKeyFromTime(double time) const;
+		uint32_t			GetAnimationKeysFromTime(double time, uint32_t &nextKey, float &blend) const;
+		AnimationSampling	GetAnimationSampling() const;
+		void				SetAnimationSampling(AnimationSampling sampling);
 		DirectX::XMMATRIX	GetWorldMatrix(uint32_t frameIndex) const;
+		DirectX::XMMATRIX	GetWorldMatrix(uint32_t frameIndex, const AnimationPose &pose) const;
 		DirectX::XMMATRIX	GetInfluenceMatrix(uint32_t frameIndex) const;
+		DirectX::XMMATRIX	GetInfluenceMatrix(uint32_t frameIndex, const AnimationPose &pose) const;
 		DirectX::XMMATRIX	GetBindMatrix(uint32_t frameIndex) const;
+		DirectX::XMMATRIX	GetInvBindMatrix(uint32_t frameIndex) const;
 		bool				GetAnimationProperties(uint32_t *pNumKeys, float *pFrameTime) const;
+		// False unless ComputeAnimatedBounds() found the packed bone weights of the vertices
+		bool				GetAnimatedBounds(DirectX::XMFLOAT3 &center, DirectX::XMFLOAT3 &extents) const;
+		const std::shared_ptr<const AnimationClip> &GetAnimationClip() const;
 
 	protected:
 		void loadMaterials(const CommandList &commandList, SDKMeshMaterial *pMaterials,
 			uint32_t NumMaterials, std::vector<Resource> &uploaders);
+		void readTextureFiles();
+		bool loadTexture(DDS::Loader &textureLoader, const CommandList &commandList, const std::string &filePath,
+			bool forceSRGB, std::shared_ptr<ResourceBase> &texture, Resource &uploader,
+			DDS::AlphaMode *pAlphaMode, ResourceState dstState);
 
 		bool createVertexBuffer(const CommandList &commandList, std::vector<Resource> &uploaders);
 		bool createIndexBuffer(const CommandList &commandList, std::vector<Resource> &uploaders);
+		bool uploadStreams(const CommandList &commandList, RawBuffer &buffer, const std::vector<uint32_t> &sizes,
+			const std::function<void(uint32_t, uint8_t*)> &writeStream, std::vector<Resource> &uploaders,
+			ResourceState dstState);
 
 		virtual bool createFromFile(const Device &device, const wchar_t *fileName,
-			const TextureCache &textureCache, bool isStaticMesh);
+			const TextureCache &textureCache, bool isStaticMesh,
+			const std::shared_ptr<UploadManager> &uploadManager);
 		virtual bool createFromMemory(const Device &device, uint8_t *pData, const TextureCache &textureCache,
-			size_t dataBytes, bool isStaticMesh, bool copyStatic);
+			size_t dataBytes, bool isStaticMesh, bool copyStatic,
+			const std::shared_ptr<UploadManager> &uploadManager);
+		bool prepareFromFile(const wchar_t *fileName, const TextureCache &textureCache, bool isStaticMesh);
+		bool prepareFromMemory(uint8_t *pData, const TextureCache &textureCache, size_t dataBytes,
+			bool isStaticMesh, bool copyStatic);
+		bool upload(const Device &device, const std::shared_ptr<UploadManager> &uploadManager);
 
 		void createAsStaticMesh();
+		void partitionInfluences(bool isStaticMesh);
+		void buildBonePalette(bool isStaticMesh);
+		void computeBounds(uint32_t mesh);	// Thread safe across the meshes
+
+		template<typename T>
+		T *getView(uint64_t offset) const { return reinterpret_cast<T*>(m_pStaticMeshData + offset); }
 		void classifyMaterialType();
 		bool executeCommandList(CommandList &commandList);
+		void bindAnimation();
 
 		// Frame manipulation
-		void transformBindPoseFrame(uint32_t frame, DirectX::CXMMATRIX parentWorld);
-		void transformFrame(uint32_t frame, DirectX::CXMMATRIX parentWorld, double time);
-		void transformFrameAbsolute(uint32_t frame, double time);
+		void compileFrameHierarchy();
+		void transformBindPoseFrames(DirectX::CXMMATRIX world);
+		void transformFrames(AnimationPose &pose, DirectX::CXMMATRIX world, double time,
+			uint8_t minBoneHeight) const;
+		void transformFrameAbsolute(AnimationPose &pose, uint32_t frame, double time) const;
+		bool isUniformScaling() const;
+		void sampleAnimationData(DirectX::XMVECTOR &translation, DirectX::XMVECTOR &quat,
+			DirectX::XMVECTOR &scaling, const SDKAnimationData &data,
+			const SDKAnimationData &nextData, float blend) const;
 
 		// These are the pointers to the two chunks of data loaded in from the mesh file
 		uint8_t							*m_pStaticMeshData;
 		std::vector<uint8_t>			m_heapData;
-		std::vector<uint8_t>			m_animation;
+		std::shared_ptr<uint8_t>		m_mappedFile;		// Read-only view of the mesh file
 		std::vector<uint8_t*>			m_vertices;
 		std::vector<uint8_t*>			m_indices;
+		std::vector<std::vector<uint8_t>> m_staticVertices;	// Transformed by createAsStaticMesh()
 
 		// Keep track of the path
 		std::wstring					m_name;
@@ -393,28 +461,65 @@ namespace XUSG
 		SDKMeshFrame					*m_pFrameArray;
 		SDKMeshMaterial					*m_pMaterialArray;
 
+		// Flattened frame hierarchy (parents always precede their children)
+		std::vector<uint32_t>			m_frameOrder;
+		std::vector<uint32_t>			m_frameParents;
+		std::vector<uint8_t>			m_frameHeights;		// Levels of descendants, 0 for leaves
+		std::vector<uint8_t>			m_trackGroupHeights;	// Max frame height per SIMD track group
+
 		VertexBuffer					m_vertexBuffer;
 		IndexBuffer						m_indexBuffer;
 		IndexBuffer						m_adjIndexBuffer;
 
+		// Influence ranges per vertex buffer
+		std::vector<InfluenceRanges>	m_influenceRanges;
+
+		// How the vertices of each VB are written from the file into the upload memory
+		struct VertexStream
+		{
+			std::vector<uint32_t> Order;	// File vertex of each vertex, empty in the file order
+			uint32_t WeightOffset;			// Of the packed bone weights, if their influences are sorted
+			uint32_t BoneOffset;			// Of the packed bone indices, if sorted or remapped
+			uint32_t RemapMesh;				// Whose bone remap rewrites the bone indices, if any
+		};
+		std::vector<VertexStream>		m_vertexStreams;
+		std::vector<uint32_t>			m_indexStreamVBs;		// Reordered VB indexed by each IB, if any
+
+		// Bone palette shared by all the meshes, each influencing frame once if the bone
+		// indices of the vertices are remapped to it, or else a range per mesh
+		std::vector<uint32_t>			m_paletteFrames;		// Frame of each palette bone
+		std::vector<uint32_t>			m_firstPaletteBones;	// Of each mesh, 0 if remapped
+		std::vector<uint32_t>			m_boneRemaps;			// Palette bone of each mesh influence
+		std::vector<uint32_t>			m_firstBoneRemaps;		// Of each mesh in m_boneRemaps
+
 		// Classified subsets
 		std::vector<std::vector<uint32_t>> m_classifiedSubsets[NUM_SUBSET_TYPE];
 
 		// Texture cache
 		TextureCache					m_textureCache;
+		std::unordered_map<std::string, std::vector<uint8_t>> m_textureFiles;	// Read by Prepare() for Upload()
 
 		// Adjacency information (not part of the m_pStaticMeshData, so it must be created and destroyed separately )
 		SDKMeshIndexBufferHeader		*m_pAdjIndexBufferArray;
 
 		// Animation
-		SDKAnimationFileHeader			*m_pAnimationHeader;
-		SDKAnimationFrameData			*m_pAnimationFrameData;
+		const SDKAnimationFileHeader	*m_pAnimationHeader;
+		AnimationSampling				m_animationSampling;
+		std::shared_ptr<const AnimationClip> m_animationClip;
 		std::vector<DirectX::XMFLOAT4X4> m_bindPoseFrameMatrices;
-		std::vector<DirectX::XMFLOAT4X4> m_transformedFrameMatrices;
-		std::vector<DirectX::XMFLOAT4X4> m_worldPoseFrameMatrices;
+		std::vector<DirectX::XMFLOAT4X4> m_invBindPoseFrameMatrices;
+		std::vector<BoneTransform>		m_invBindPoseTransforms;	// If the bind pose is uniformly scaled
+		std::vector<BoneTransform>		m_frameTransforms;			// If the bind pose is uniformly scaled
+		bool							m_isBindPoseUniform;
+		bool							m_hasAnimatedBounds;
+		DirectX::XMFLOAT3				m_animatedBBoxCenter;
+		DirectX::XMFLOAT3				m_animatedBBoxExtents;
+		AnimationPose					m_pose;	// Pose of the legacy TransformMesh(world, time)
 
 	private:
 		Device m_device;
+		std::shared_ptr<UploadManager> m_uploadManager;
+		uint64_t m_uploadFenceValue;	// Completing the uploads of the mesh
 		uint32_t m_numOutstandingResources;
 		bool m_isLoading;
 	};
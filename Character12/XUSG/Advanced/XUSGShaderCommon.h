@@ -14,10 +14,16 @@ enum VertexShader : uint8_t
 
 	VS_BASE_PASS,
 	VS_BASE_PASS_STATIC,
+	VS_BASE_PASS_OCT,
+	VS_BASE_PASS_OCT_QUANTIZED,
+	VS_BASE_PASS_SKINNING,
+	VS_BASE_PASS_SKINNING_COMPACT,
 	VS_DEPTH,
 	VS_DEPTH_STATIC,
 	VS_SHADOW,
 	VS_SHADOW_STATIC,
+	VS_DEPTH_SKINNING,
+	VS_DEPTH_SKINNING_COMPACT,
 	VS_SKINNING,
 
 	VS_WATER
@@ -51,6 +57,21 @@ enum PixelShader : uint8_t
 enum ComputeShader : uint8_t
 {
 	CS_SKINNING,
+	CS_SKINNING_BATCH,
+	CS_SKINNING_COMPACT,
+	CS_SKINNING_BATCH_COMPACT,
+	CS_SKINNING_LBS4,
+	CS_SKINNING_LBS2,
+	CS_SKINNING_RIGID,
+	CS_SKINNING_RIGID_COMPACT,
+	CS_SKINNING_OCT,
+	CS_SKINNING_OCT_QUANTIZED,
+	CS_SKINNING_COMPACT_OCT,
+	CS_SKINNING_COMPACT_OCT_QUANTIZED,
+	CS_SKINNING_BATCH_OCT,
+	CS_SKINNING_BATCH_OCT_QUANTIZED,
+	CS_SKINNING_BATCH_COMPACT_OCT,
+	CS_SKINNING_BATCH_COMPACT_OCT_QUANTIZED,
 	CS_RESAMPLE,
 	CS_LUM_ADAPT
 };
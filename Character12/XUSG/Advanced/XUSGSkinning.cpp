@@ -0,0 +1,586 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "XUSGSkinning.h"
+#include <DirectXPackedVector.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+using namespace XUSG;
+
+static_assert(sizeof(CPUSkinning::InputVertex) == 48, "InputVertex must match CS_Input");
+static_assert(sizeof(CPUSkinning::OutputVertex) == 40, "OutputVertex must match CS_Output");
+static_assert(sizeof(CPUSkinning::CompactBone) == 32, "CompactBone must match CSSkinning.hlsli");
+
+// Scales closer to 1 than this are dropped from the sparse scaling stream
+static const float g_scaleEpsilon = 1e-5f;
+
+//--------------------------------------------------------------------------------------
+// Scalar SkinVert of CSSkinning.hlsli
+//--------------------------------------------------------------------------------------
+static void decodeRGB16f(float v[3], const XMUINT2 &u)
+{
+	v[0] = XMConvertHalfToFloat(static_cast<HALF>(u.x & 0xffff));
+	v[1] = XMConvertHalfToFloat(static_cast<HALF>(u.x >> 16));
+	v[2] = XMConvertHalfToFloat(static_cast<HALF>(u.y & 0xffff));
+}
+
+static XMUINT2 encodeRGB16f(const float v[3])
+{
+	return XMUINT2(XMConvertFloatToHalf(v[0]) | (XMConvertFloatToHalf(v[1]) << 16), XMConvertFloatToHalf(v[2]));
+}
+
+static void cross(float r[3], const float a[3], const float b[3])
+{
+	r[0] = a[1] * b[2] - a[2] * b[1];
+	r[1] = a[2] * b[0] - a[0] * b[2];
+	r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// RotateWithDQ
+static void rotateWithDQ(float v[3], const float q[4])
+{
+	float t[3], disp[3];
+	cross(t, q, v);
+	for (auto i = 0u; i < 3; ++i) t[i] = t[i] + q[3] * v[i];
+	cross(disp, q, t);
+	for (auto i = 0u; i < 3; ++i) v[i] = disp[i] * 2.0f + v[i];
+}
+
+// TranslateWithDQ
+static void translateWithDQ(float v[3], const float q[4], const float d[4])
+{
+	float disp[3];
+	cross(disp, q, d);
+	for (auto i = 0u; i < 3; ++i)
+	{
+		disp[i] = disp[i] + q[3] * d[i];
+		disp[i] = disp[i] - d[3] * q[i];
+		v[i] = disp[i] * 2.0f + v[i];
+	}
+}
+
+// SortInfluences: move the heaviest influence to the front, and the second heaviest next
+// to it for the linear blend with 2 influences
+static void sortInfluences(uint32_t bones[4], float weights[4], uint32_t numSorted)
+{
+	for (auto i = 0u; i < numSorted; ++i)
+		for (auto j = i + 1; j < 4; ++j)
+			if (weights[j] > weights[i])
+			{
+				swap(weights[i], weights[j]);
+				swap(bones[i], bones[j]);
+			}
+}
+
+// The loops run over the influences of the mode, clamped to the nonzero weights of the range
+template<SkinningMode mode, uint8_t numWeights>
+void CPUSkinning::skinReference(const Batch &batch, uint32_t first, uint32_t count)
+{
+	const auto isLinear = mode == SKINNING_LBS4 || mode == SKINNING_LBS2;
+	const auto isSorted = numWeights < 4;
+	const auto numModeInfluences = mode == SKINNING_RIGID ? 1u : (mode == SKINNING_LBS2 ? 2u : 4u);
+	const auto numInfluences = (min)(numModeInfluences, static_cast<uint32_t>(numWeights));
+
+	for (auto i = first; i < first + count; ++i)
+	{
+		const auto &input = batch.pInput[i];
+		auto &output = batch.pOutput[i];
+
+		uint32_t bones[4];
+		float weights[4];
+		for (auto j = 0u; j < 4; ++j)
+		{
+			bones[j] = (input.Bones >> (8 * j)) & 0xff;
+			weights[j] = ((input.Weights >> (8 * j)) & 0xff) / 255.0f;
+		}
+		if (!isSorted && numInfluences < 4) sortInfluences(bones, weights, numInfluences);
+
+		float pos[3] = { input.Pos.x, input.Pos.y, input.Pos.z }, norm[3], tan[3], biNorm[3];
+		decodeRGB16f(norm, input.Norm);
+		decodeRGB16f(tan, input.Tan);
+		decodeRGB16f(biNorm, input.BiNorm);
+
+		if (isLinear)
+		{
+			// Blend the bone matrices, renormalizing the weights of the influences used
+			auto weightSum = 0.0f;
+			for (auto j = 0u; j < numInfluences; ++j) weightSum = weightSum + weights[j];
+
+			float m[4][3] = {};
+			for (auto j = 0u; j < numInfluences; ++j)
+			{
+				const auto &b = batch.pPalette[bones[j]];
+				const auto weight = weights[j] / weightSum;
+				for (auto r = 0u; r < 4; ++r)
+					for (auto c = 0u; c < 3; ++c)
+						m[r][c] = m[r][c] + weight * b.m[r][c];
+			}
+
+			// The normal by the inverse transpose of the blended matrix, as its cofactors over
+			// its determinant
+			float cofactors[3][3];
+			cross(cofactors[0], m[1], m[2]);
+			cross(cofactors[1], m[2], m[0]);
+			cross(cofactors[2], m[0], m[1]);
+			const auto det = m[0][0] * cofactors[0][0] + m[0][1] * cofactors[0][1] + m[0][2] * cofactors[0][2];
+
+			float v[4][3];
+			for (auto c = 0u; c < 3; ++c)
+			{
+				v[0][c] = pos[0] * m[0][c] + pos[1] * m[1][c] + pos[2] * m[2][c] + m[3][c];
+				v[1][c] = (norm[0] * cofactors[0][c] + norm[1] * cofactors[1][c] + norm[2] * cofactors[2][c]) / det;
+				v[2][c] = tan[0] * m[0][c] + tan[1] * m[1][c] + tan[2] * m[2][c];
+				v[3][c] = biNorm[0] * m[0][c] + biNorm[1] * m[1][c] + biNorm[2] * m[2][c];
+			}
+
+			for (auto c = 0u; c < 3; ++c)
+			{
+				pos[c] = v[0][c];
+				norm[c] = v[1][c];
+				tan[c] = v[2][c];
+				biNorm[c] = v[3][c];
+			}
+		}
+		else
+		{
+			// Blend the dual quaternions, flipping the ones in the opposite hemisphere to the first
+			const auto &b0 = batch.pPalette[bones[0]];
+			float q[4] = {}, d[4] = {}, scale[3] = {};
+			for (auto j = 0u; j < numInfluences; ++j)
+			{
+				const auto &b = batch.pPalette[bones[j]];
+				const auto weight = mode == SKINNING_RIGID ? 1.0f : weights[j];
+				const auto dot = b0.m[0][0] * b.m[0][0] + b0.m[1][0] * b.m[1][0] + b0.m[2][0] * b.m[2][0] + b0.m[3][0] * b.m[3][0];
+				const auto signedWeight = dot < 0.0f ? -weight : weight;
+				for (auto c = 0u; c < 4; ++c)
+				{
+					q[c] = q[c] + signedWeight * b.m[c][0];
+					d[c] = d[c] + signedWeight * b.m[c][1];
+				}
+				for (auto c = 0u; c < 3; ++c) scale[c] = scale[c] + weight * b.m[c][2];
+			}
+
+			// Fast DQS; a single bone is normalized already
+			if (mode != SKINNING_RIGID)
+			{
+				const auto len = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+				for (auto c = 0u; c < 4; ++c)
+				{
+					q[c] = q[c] / len;
+					d[c] = d[c] / len;
+				}
+			}
+
+			for (auto c = 0u; c < 3; ++c)
+			{
+				pos[c] = pos[c] * scale[c];
+				norm[c] = norm[c] / scale[c];
+				tan[c] = tan[c] * scale[c];
+				biNorm[c] = biNorm[c] * scale[c];
+			}
+
+			rotateWithDQ(pos, q);
+			translateWithDQ(pos, q, d);
+			rotateWithDQ(norm, q);
+			rotateWithDQ(tan, q);
+			rotateWithDQ(biNorm, q);
+		}
+
+		output.Pos = XMFLOAT3(pos);
+		output.Norm = encodeRGB16f(norm);
+		output.Tex = input.Tex;
+		output.Tan = encodeRGB16f(tan);
+		output.BiNorm = encodeRGB16f(biNorm);
+	}
+}
+
+template<SkinningMode mode>
+void CPUSkinning::skinReference(const Batch &batch, uint32_t first, uint32_t count)
+{
+	switch (batch.NumInfluences)
+	{
+	case 1:
+		skinReference<mode, 1>(batch, first, count);
+		break;
+	case 2:
+		skinReference<mode, 2>(batch, first, count);
+		break;
+	case 3:
+		skinReference<mode, 3>(batch, first, count);
+		break;
+	default:
+		skinReference<mode, 4>(batch, first, count);
+	}
+}
+
+void CPUSkinning::skinReference(const Batch &batch, uint32_t first, uint32_t count)
+{
+	switch (batch.Mode)
+	{
+	case SKINNING_LBS4:
+		skinReference<SKINNING_LBS4>(batch, first, count);
+		break;
+	case SKINNING_LBS2:
+		skinReference<SKINNING_LBS2>(batch, first, count);
+		break;
+	case SKINNING_RIGID:
+		skinReference<SKINNING_RIGID>(batch, first, count);
+		break;
+	default:
+		skinReference<SKINNING_DQS4>(batch, first, count);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// AVX2 SkinVert: 8 vertices at once in structure-of-arrays form, with the same operation
+// order as the scalar path; under /fp:fast the compiler may contract either into FMAs, so
+// both agree to rounding rather than bit for bit
+//--------------------------------------------------------------------------------------
+#if defined(__AVX2__)
+struct SkinningV3
+{
+	__m256 x, y, z;
+};
+
+static SkinningV3 cross(const SkinningV3 &a, const SkinningV3 &b)
+{
+	return SkinningV3
+	{
+		_mm256_sub_ps(_mm256_mul_ps(a.y, b.z), _mm256_mul_ps(a.z, b.y)),
+		_mm256_sub_ps(_mm256_mul_ps(a.z, b.x), _mm256_mul_ps(a.x, b.z)),
+		_mm256_sub_ps(_mm256_mul_ps(a.x, b.y), _mm256_mul_ps(a.y, b.x))
+	};
+}
+
+static SkinningV3 rotateWithDQ(const SkinningV3 &v, const SkinningV3 &q, __m256 qw)
+{
+	auto t = cross(q, v);
+	t.x = _mm256_add_ps(t.x, _mm256_mul_ps(qw, v.x));
+	t.y = _mm256_add_ps(t.y, _mm256_mul_ps(qw, v.y));
+	t.z = _mm256_add_ps(t.z, _mm256_mul_ps(qw, v.z));
+
+	const auto two = _mm256_set1_ps(2.0f);
+	const auto disp = cross(q, t);
+
+	return SkinningV3
+	{
+		_mm256_add_ps(_mm256_mul_ps(disp.x, two), v.x),
+		_mm256_add_ps(_mm256_mul_ps(disp.y, two), v.y),
+		_mm256_add_ps(_mm256_mul_ps(disp.z, two), v.z)
+	};
+}
+
+static SkinningV3 translateWithDQ(const SkinningV3 &v, const SkinningV3 &q, __m256 qw,
+	const SkinningV3 &d, __m256 dw)
+{
+	auto disp = cross(q, d);
+	disp.x = _mm256_sub_ps(_mm256_add_ps(disp.x, _mm256_mul_ps(qw, d.x)), _mm256_mul_ps(dw, q.x));
+	disp.y = _mm256_sub_ps(_mm256_add_ps(disp.y, _mm256_mul_ps(qw, d.y)), _mm256_mul_ps(dw, q.y));
+	disp.z = _mm256_sub_ps(_mm256_add_ps(disp.z, _mm256_mul_ps(qw, d.z)), _mm256_mul_ps(dw, q.z));
+
+	const auto two = _mm256_set1_ps(2.0f);
+
+	return SkinningV3
+	{
+		_mm256_add_ps(_mm256_mul_ps(disp.x, two), v.x),
+		_mm256_add_ps(_mm256_mul_ps(disp.y, two), v.y),
+		_mm256_add_ps(_mm256_mul_ps(disp.z, two), v.z)
+	};
+}
+
+// Convert the low 16 bits of each lane from half to float
+static __m256 halfToFloat(__m256i u)
+{
+	const auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(u, u), _MM_SHUFFLE(3, 1, 2, 0));
+
+	return _mm256_cvtph_ps(_mm256_castsi256_si128(packed));
+}
+
+static SkinningV3 decodeRGB16f(const int *pBase, __m256i vertexOffsets, uint32_t offset)
+{
+	const auto mask = _mm256_set1_epi32(0xffff);
+	const auto xy = _mm256_i32gather_epi32(pBase + offset, vertexOffsets, 4);
+	const auto z = _mm256_i32gather_epi32(pBase + offset + 1, vertexOffsets, 4);
+
+	return SkinningV3
+	{
+		halfToFloat(_mm256_and_si256(xy, mask)),
+		halfToFloat(_mm256_srli_epi32(xy, 16)),
+		halfToFloat(_mm256_and_si256(z, mask))
+	};
+}
+
+static void encodeRGB16f(XMUINT2 encoded[8], const SkinningV3 &v)
+{
+	const auto x = _mm256_cvtps_ph(v.x, _MM_FROUND_TO_NEAREST_INT);
+	const auto y = _mm256_cvtps_ph(v.y, _MM_FROUND_TO_NEAREST_INT);
+	const auto z = _mm256_cvtps_ph(v.z, _MM_FROUND_TO_NEAREST_INT);
+
+	uint32_t xy[8], zz[8];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(xy), _mm_unpacklo_epi16(x, y));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(&xy[4]), _mm_unpackhi_epi16(x, y));
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(zz), _mm256_cvtepu16_epi32(z));
+	for (auto i = 0u; i < 8; ++i) encoded[i] = XMUINT2(xy[i], zz[i]);
+}
+
+template<uint8_t numInfluences>
+void CPUSkinning::skinDQS(const Batch &batch, uint32_t first, uint32_t count)
+{
+	// Offsets in 32-bit words
+	enum InputOffset : uint32_t
+	{
+		POS = 0,
+		WEIGHTS = 3,
+		BONES = 4,
+		NORM = 5,
+		TAN = 8,
+		BI_NORM = 10,
+		INPUT_STRIDE = sizeof(InputVertex) / sizeof(uint32_t)
+	};
+
+	const auto vertexOffsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+		_mm256_set1_epi32(INPUT_STRIDE));
+	const auto byteMask = _mm256_set1_epi32(0xff);
+	const auto boneStride = _mm256_set1_epi32(sizeof(XMFLOAT4X3) / sizeof(float));
+	const auto zero = _mm256_setzero_ps();
+	const auto signMask = _mm256_set1_ps(-0.0f);
+	const auto pPalette = reinterpret_cast<const float*>(batch.pPalette);
+
+	const auto end = first + count;
+	auto i = first;
+	for (; i + 8 <= end; i += 8)
+	{
+		const auto pBase = reinterpret_cast<const int*>(&batch.pInput[i]);
+		const auto pBaseF = reinterpret_cast<const float*>(pBase);
+		const auto weights = _mm256_i32gather_epi32(pBase + WEIGHTS, vertexOffsets, 4);
+		const auto bones = _mm256_i32gather_epi32(pBase + BONES, vertexOffsets, 4);
+
+		// Blend the dual quaternions; the palette element m[c][r] is at float 3 * c + r
+		__m256 q[4], d[4], scale[3], q0[4];
+		for (auto c = 0u; c < 4; ++c) q[c] = d[c] = zero;
+		for (auto c = 0u; c < 3; ++c) scale[c] = zero;
+		for (auto j = 0u; j < numInfluences; ++j)
+		{
+			const auto bone = _mm256_and_si256(_mm256_srli_epi32(bones, 8 * j), byteMask);
+			const auto boneOffsets = _mm256_mullo_epi32(bone, boneStride);
+			const auto weight = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(
+				_mm256_srli_epi32(weights, 8 * j), byteMask)), _mm256_set1_ps(255.0f));
+
+			__m256 bq[4], bd[4], bs[3];
+			for (auto c = 0u; c < 4; ++c)
+			{
+				bq[c] = _mm256_i32gather_ps(pPalette + 3 * c, boneOffsets, 4);
+				bd[c] = _mm256_i32gather_ps(pPalette + 3 * c + 1, boneOffsets, 4);
+			}
+			for (auto c = 0u; c < 3; ++c) bs[c] = _mm256_i32gather_ps(pPalette + 3 * c + 2, boneOffsets, 4);
+			if (j == 0) for (auto c = 0u; c < 4; ++c) q0[c] = bq[c];
+
+			auto dot = _mm256_mul_ps(q0[0], bq[0]);
+			for (auto c = 1u; c < 4; ++c) dot = _mm256_add_ps(dot, _mm256_mul_ps(q0[c], bq[c]));
+			const auto flip = _mm256_and_ps(_mm256_cmp_ps(dot, zero, _CMP_LT_OQ), signMask);
+			const auto signedWeight = _mm256_xor_ps(weight, flip);
+
+			for (auto c = 0u; c < 4; ++c)
+			{
+				q[c] = _mm256_add_ps(q[c], _mm256_mul_ps(signedWeight, bq[c]));
+				d[c] = _mm256_add_ps(d[c], _mm256_mul_ps(signedWeight, bd[c]));
+			}
+			for (auto c = 0u; c < 3; ++c) scale[c] = _mm256_add_ps(scale[c], _mm256_mul_ps(weight, bs[c]));
+		}
+
+		// Fast DQS
+		auto len = _mm256_mul_ps(q[0], q[0]);
+		for (auto c = 1u; c < 4; ++c) len = _mm256_add_ps(len, _mm256_mul_ps(q[c], q[c]));
+		len = _mm256_sqrt_ps(len);
+		for (auto c = 0u; c < 4; ++c)
+		{
+			q[c] = _mm256_div_ps(q[c], len);
+			d[c] = _mm256_div_ps(d[c], len);
+		}
+
+		auto norm = decodeRGB16f(pBase, vertexOffsets, NORM);
+		auto tan = decodeRGB16f(pBase, vertexOffsets, TAN);
+		auto biNorm = decodeRGB16f(pBase, vertexOffsets, BI_NORM);
+		SkinningV3 pos =
+		{
+			_mm256_mul_ps(_mm256_i32gather_ps(pBaseF + POS, vertexOffsets, 4), scale[0]),
+			_mm256_mul_ps(_mm256_i32gather_ps(pBaseF + POS + 1, vertexOffsets, 4), scale[1]),
+			_mm256_mul_ps(_mm256_i32gather_ps(pBaseF + POS + 2, vertexOffsets, 4), scale[2])
+		};
+		norm = { _mm256_div_ps(norm.x, scale[0]), _mm256_div_ps(norm.y, scale[1]), _mm256_div_ps(norm.z, scale[2]) };
+		tan = { _mm256_mul_ps(tan.x, scale[0]), _mm256_mul_ps(tan.y, scale[1]), _mm256_mul_ps(tan.z, scale[2]) };
+		biNorm = { _mm256_mul_ps(biNorm.x, scale[0]), _mm256_mul_ps(biNorm.y, scale[1]), _mm256_mul_ps(biNorm.z, scale[2]) };
+
+		const SkinningV3 qv = { q[0], q[1], q[2] };
+		const SkinningV3 dv = { d[0], d[1], d[2] };
+		pos = translateWithDQ(rotateWithDQ(pos, qv, q[3]), qv, q[3], dv, d[3]);
+		norm = rotateWithDQ(norm, qv, q[3]);
+		tan = rotateWithDQ(tan, qv, q[3]);
+		biNorm = rotateWithDQ(biNorm, qv, q[3]);
+
+		// Scatter to CS_Output
+		float px[8], py[8], pz[8];
+		XMUINT2 n[8], t[8], b[8];
+		_mm256_storeu_ps(px, pos.x);
+		_mm256_storeu_ps(py, pos.y);
+		_mm256_storeu_ps(pz, pos.z);
+		encodeRGB16f(n, norm);
+		encodeRGB16f(t, tan);
+		encodeRGB16f(b, biNorm);
+		for (auto k = 0u; k < 8; ++k)
+		{
+			auto &output = batch.pOutput[i + k];
+			output.Pos = XMFLOAT3(px[k], py[k], pz[k]);
+			output.Norm = n[k];
+			output.Tex = batch.pInput[i + k].Tex;
+			output.Tan = t[k];
+			output.BiNorm = b[k];
+		}
+	}
+
+	// Remainder
+	if (i < end) skinReference<SKINNING_DQS4, numInfluences>(batch, i, end - i);
+}
+
+void CPUSkinning::skin(const Batch &batch, uint32_t first, uint32_t count)
+{
+	// The cheaper modes run the specialized scalar kernels
+	if (batch.Mode != SKINNING_DQS4)
+	{
+		skinReference(batch, first, count);
+
+		return;
+	}
+
+	switch (batch.NumInfluences)
+	{
+	case 1:
+		skinDQS<1>(batch, first, count);
+		break;
+	case 2:
+		skinDQS<2>(batch, first, count);
+		break;
+	case 3:
+		skinDQS<3>(batch, first, count);
+		break;
+	default:
+		skinDQS<4>(batch, first, count);
+	}
+}
+#else
+void CPUSkinning::skin(const Batch &batch, uint32_t first, uint32_t count)
+{
+	skinReference(batch, first, count);
+}
+#endif
+
+//--------------------------------------------------------------------------------------
+// Compact bone palette
+//--------------------------------------------------------------------------------------
+uint32_t CPUSkinning::EncodeCompact(CompactBone *pBones, XMFLOAT3 *pScales,
+	const XMFLOAT4X3 *pDualQuats, uint32_t numBones)
+{
+	auto numScales = 0u;
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		const auto &b = pDualQuats[i];
+		auto &bone = pBones[i];
+
+		// Translation t = 2 * dual * conjugate(rotation)
+		const float q[] = { b.m[0][0], b.m[1][0], b.m[2][0], b.m[3][0] };
+		const float d[] = { b.m[0][1], b.m[1][1], b.m[2][1], b.m[3][1] };
+		float t[3];
+		cross(t, q, d);
+		for (auto c = 0u; c < 3; ++c) t[c] = 2.0f * (q[3] * d[c] - d[3] * q[c] + t[c]);
+
+		bone.Rotation = XMFLOAT4(q);
+		bone.Translation = XMFLOAT3(t);
+
+		// Only the scaled bones go into the scaling stream
+		const XMFLOAT3 scale(b.m[0][2], b.m[1][2], b.m[2][2]);
+		const auto isScaled = fabs(scale.x - 1.0f) > g_scaleEpsilon ||
+			fabs(scale.y - 1.0f) > g_scaleEpsilon || fabs(scale.z - 1.0f) > g_scaleEpsilon;
+		if (isScaled)
+		{
+			pScales[numScales] = scale;
+			bone.ScaleIndex = numScales++;
+		}
+		else bone.ScaleIndex = NoScale;
+	}
+
+	return numScales;
+}
+
+void CPUSkinning::DecodeCompact(XMFLOAT4X3 *pDualQuats, const CompactBone *pBones,
+	const XMFLOAT3 *pScales, uint32_t numBones)
+{
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		const auto &bone = pBones[i];
+		const float q[] = { bone.Rotation.x, bone.Rotation.y, bone.Rotation.z, bone.Rotation.w };
+		const float t[] = { bone.Translation.x, bone.Translation.y, bone.Translation.z };
+		const auto scale = bone.ScaleIndex != NoScale ? pScales[bone.ScaleIndex] : XMFLOAT3(1.0f, 1.0f, 1.0f);
+
+		// Dual part = 0.5 * translation * rotation
+		float d[3];
+		cross(d, t, q);
+
+		auto &b = pDualQuats[i];
+		for (auto c = 0u; c < 4; ++c) b.m[c][0] = q[c];
+		for (auto c = 0u; c < 3; ++c) b.m[c][1] = 0.5f * (q[3] * t[c] + d[c]);
+		b.m[3][1] = -0.5f * (t[0] * q[0] + t[1] * q[1] + t[2] * q[2]);
+		b.m[0][2] = scale.x;
+		b.m[1][2] = scale.y;
+		b.m[2][2] = scale.z;
+		b.m[3][2] = 0.0f;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// CPU skinning
+//--------------------------------------------------------------------------------------
+void CPUSkinning::Skin(const Batch &batch)
+{
+	skin(batch, 0, batch.NumVertices);
+}
+
+void CPUSkinning::SkinReference(const Batch &batch)
+{
+	skinReference(batch, 0, batch.NumVertices);
+}
+
+void CPUSkinning::Skin(const Batch *pBatches, uint32_t numBatches, JobSystem *pJobSystem)
+{
+	if (!pJobSystem)
+	{
+		for (auto i = 0u; i < numBatches; ++i) Skin(pBatches[i]);
+
+		return;
+	}
+
+	// Split the meshes into chunks, so that large meshes are balanced across the workers
+	struct Chunk
+	{
+		uint32_t Batch;
+		uint32_t First;
+		uint32_t Count;
+	};
+
+	vector<Chunk> chunks;
+	for (auto i = 0u; i < numBatches; ++i)
+		for (auto first = 0u; first < pBatches[i].NumVertices; first += ChunkSize)
+			chunks.push_back({ i, first, (min)(ChunkSize, pBatches[i].NumVertices - first) });
+
+	pJobSystem->ParallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t i)
+	{
+		const auto &chunk = chunks[i];
+		skin(pBatches[chunk.Batch], chunk.First, chunk.Count);
+	});
+}
@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <DirectXMath.h>
+#include "XUSGJobSystem.h"
+
+namespace XUSG
+{
+	// Skinning modes, trading quality for throughput; SKINNING_MODE in CSSkinning.hlsli
+	enum SkinningMode : uint8_t
+	{
+		SKINNING_DQS4,		// Dual-quaternion skinning with 4 influences
+		SKINNING_LBS4,		// Linear blend skinning with 4 influences
+		SKINNING_LBS2,		// Linear blend skinning with the 2 heaviest influences
+		SKINNING_RIGID		// The heaviest influence only
+	};
+
+	//--------------------------------------------------------------------------------------
+	// CPU skinning with the same math and packed vertex layouts as CSSkinning.hlsl, for
+	// validating the GPU path and for hosts without a GPU. The bone palette is the
+	// g_roDualQuat buffer: per bone, the transposed rows of rotation, dual part, and
+	// scaling, or the bone matrix in XMFLOAT4X3 form for the linear blend modes.
+	// CSSkinningCompact.hlsl reads the compact encoding instead. Only DirectXMath and the
+	// standard library are needed, so it also builds outside Windows.
+	//--------------------------------------------------------------------------------------
+	class CPUSkinning
+	{
+	public:
+		// CS_Input
+		struct InputVertex
+		{
+			DirectX::XMFLOAT3	Pos;
+			uint32_t			Weights;	// R8G8B8A8_UNORM
+			uint32_t			Bones;		// R8G8B8A8_UINT
+			DirectX::XMUINT2	Norm;		// R16G16B16_FLOAT
+			uint32_t			Tex;
+			DirectX::XMUINT2	Tan;		// R16G16B16_FLOAT
+			DirectX::XMUINT2	BiNorm;		// R16G16B16_FLOAT
+		};
+
+		// CS_Output
+		struct OutputVertex
+		{
+			DirectX::XMFLOAT3	Pos;
+			DirectX::XMUINT2	Norm;		// R16G16B16_FLOAT
+			uint32_t			Tex;
+			DirectX::XMUINT2	Tan;		// R16G16B16_FLOAT
+			DirectX::XMUINT2	BiNorm;		// R16G16B16_FLOAT
+		};
+
+		// Vertices of a mesh and the bone palette skinning them
+		struct Batch
+		{
+			OutputVertex				*pOutput;
+			const InputVertex			*pInput;
+			uint32_t					NumVertices;
+			const DirectX::XMFLOAT4X3	*pPalette;
+			SkinningMode				Mode;
+			uint8_t						NumInfluences;	// 1-3 for the presorted influence ranges, else 4
+		};
+
+		// CompactBone in CSSkinning.hlsli: the rigid part of a bone in 8 dwords, with the
+		// scaling of the scaled bones only in a separate sparse stream
+		struct CompactBone
+		{
+			DirectX::XMFLOAT4	Rotation;
+			DirectX::XMFLOAT3	Translation;
+			uint32_t			ScaleIndex;	// Into the scaling stream, or NoScale
+		};
+
+		static const uint32_t NoScale = UINT32_MAX;
+
+		// Encode a palette into compact bones and a scaling stream with space for numBones
+		// entries; returns the number of scaled bones
+		static uint32_t EncodeCompact(CompactBone *pBones, DirectX::XMFLOAT3 *pScales,
+			const DirectX::XMFLOAT4X3 *pDualQuats, uint32_t numBones);
+		// Decode as LoadBone() of CSSkinning.hlsli, the CPU reference of the compact format
+		static void DecodeCompact(DirectX::XMFLOAT4X3 *pDualQuats, const CompactBone *pBones,
+			const DirectX::XMFLOAT3 *pScales, uint32_t numBones);
+
+		// Skin with the widest available SIMD path, for SKINNING_DQS4
+		static void Skin(const Batch &batch);
+		// Scalar reference path of Skin(), specialized per mode
+		static void SkinReference(const Batch &batch);
+		// Skin several meshes, split into chunks across the job system if any
+		static void Skin(const Batch *pBatches, uint32_t numBatches, JobSystem *pJobSystem = nullptr);
+
+	protected:
+		static const uint32_t ChunkSize = 4096;
+
+		template<SkinningMode mode, uint8_t numInfluences>
+		static void skinReference(const Batch &batch, uint32_t first, uint32_t count);
+		template<SkinningMode mode>
+		static void skinReference(const Batch &batch, uint32_t first, uint32_t count);
+		static void skinReference(const Batch &batch, uint32_t first, uint32_t count);
+		template<uint8_t numInfluences>
+		static void skinDQS(const Batch &batch, uint32_t first, uint32_t count);
+		static void skin(const Batch &batch, uint32_t first, uint32_t count);
+	};
+}
@@ -0,0 +1,388 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "XUSGSkinningBatcher.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+SkinningBatcher::SkinningBatcher(const Device &device, const CommandList &commandList, const wchar_t *name) :
+	m_device(device),
+	m_commandList(commandList),
+	m_shaderPool(nullptr),
+	m_computePipelineCache(nullptr),
+	m_pipelineLayoutCache(nullptr),
+	m_descriptorTableCache(nullptr),
+	m_ringBuffer(nullptr),
+	m_characters(0),
+	m_firstBones(0),
+	m_ranges(0),
+	m_firstRanges(0),
+	m_frameRanges(0),
+	m_numBones(0),
+	m_paletteOffset(0),
+	m_scaleOffset(0),
+	m_boneFormat(Character::BONE_FORMAT_DQ_SCALE),
+	m_pipelineLayout(nullptr),
+	m_pipeline(nullptr),
+	m_srvTable(nullptr),
+	m_uavTables(),
+	m_stats()
+{
+	if (name) m_name = name;
+	else m_name = L"";
+}
+
+SkinningBatcher::~SkinningBatcher()
+{
+	// The characters fall back to their own palettes
+	for (const auto &pCharacter : m_characters)
+	{
+		pCharacter->m_pBatchedPalette = nullptr;
+		pCharacter->m_pBatchedScales = nullptr;
+	}
+}
+
+void SkinningBatcher::Register(Character *pCharacter)
+{
+	m_characters.push_back(pCharacter);
+}
+
+bool SkinningBatcher::Init(const shared_ptr<ShaderPool> &shaderPool,
+	const shared_ptr<Compute::PipelineCache> &computePipelineCache,
+	const shared_ptr<PipelineLayoutCache> &pipelineLayoutCache,
+	const shared_ptr<DescriptorTableCache> &descriptorTableCache,
+	const shared_ptr<RingBuffer> &ringBuffer)
+{
+	m_shaderPool = shaderPool;
+	m_computePipelineCache = computePipelineCache;
+	m_pipelineLayoutCache = pipelineLayoutCache;
+	m_descriptorTableCache = descriptorTableCache;
+	m_ringBuffer = ringBuffer;
+
+	// One pipeline for all the characters
+	if (!m_characters.empty()) m_boneFormat = m_characters[0]->m_boneFormat;
+	for (const auto &pCharacter : m_characters)
+	{
+		M_RETURN(pCharacter->m_boneFormat != m_boneFormat, cerr,
+			"The batched characters must share the same bone format.", false);
+		M_RETURN(pCharacter->m_vertexFormat != m_characters[0]->m_vertexFormat, cerr,
+			"The batched characters must share the same vertex format.", false);
+		M_RETURN(pCharacter->m_isInlineSkinning, cerr,
+			"The characters with inline skinning have no skinned VBs to batch.", false);
+	}
+
+	// Create buffers, pipeline, and descriptor tables
+	N_RETURN(createBuffers(), false);
+	N_RETURN(createPipelineLayout(), false);
+	N_RETURN(createPipeline(), false);
+	N_RETURN(createDescriptorTables(), false);
+
+	return true;
+}
+
+void SkinningBatcher::Update()
+{
+	if (m_ranges.empty()) return;
+
+	// Suballocate the shared palette of the frame; the characters write their parts of it
+	// concurrently, or fall back to their own palettes if the ring buffer is full. The
+	// scaling streams of the compact bones follow, with room for every bone to scale.
+	const auto isCompact = m_boneFormat == Character::BONE_FORMAT_COMPACT;
+	const auto boneSize = static_cast<uint32_t>(isCompact ?
+		sizeof(CPUSkinning::CompactBone) : sizeof(XMFLOAT4X3));
+	const auto paletteSize = boneSize * m_numBones;
+	const auto scaleSize = isCompact ? static_cast<uint32_t>(sizeof(XMFLOAT3)) * m_numBones : 0;
+	const auto pPalette = reinterpret_cast<uint8_t*>(m_ringBuffer->Allocate(paletteSize + scaleSize,
+		D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, &m_paletteOffset));
+	m_paletteOffset = pPalette ? m_paletteOffset : UINT32_MAX;
+	m_scaleOffset = pPalette ? m_paletteOffset + paletteSize : UINT32_MAX;
+
+	for (auto i = 0u; i < m_characters.size(); ++i)
+	{
+		const auto &pCharacter = m_characters[i];
+		pCharacter->m_pBatchedPalette = pPalette ? pPalette + boneSize * m_firstBones[i] : nullptr;
+		pCharacter->m_pBatchedScales = pPalette ?
+			reinterpret_cast<XMFLOAT3*>(pPalette + paletteSize) + m_firstBones[i] : nullptr;
+		pCharacter->m_batchedPaletteOffset = m_paletteOffset + boneSize * m_firstBones[i];
+		pCharacter->m_batchedScaleOffset = m_scaleOffset + static_cast<uint32_t>(sizeof(XMFLOAT3)) * m_firstBones[i];
+	}
+}
+
+void SkinningBatcher::Skinning(bool reset)
+{
+	m_stats = Stats();
+	if (m_ranges.empty()) return;
+
+	// Range table of the frame, with space for all the ranges
+	uint32_t rangeOffset;
+	const auto pRanges = m_paletteOffset != UINT32_MAX ? m_ringBuffer->Allocate(
+		static_cast<uint32_t>(sizeof(Range) * m_ranges.size()),
+		D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, &rangeOffset) : nullptr;
+
+	// Skin the characters one by one if the shared palette or the range table is unavailable
+	if (!pRanges)
+	{
+		for (auto i = 0u; i < m_characters.size(); ++i)
+		{
+			m_characters[i]->uploadPose();
+			m_characters[i]->skinning(reset && i == 0, &m_stats);
+		}
+
+		return;
+	}
+
+	// The characters are updated for the same frame
+	const auto frame = m_characters[0]->m_currentFrame;
+
+	// Write the palettes not yet written by the updates, gather the ranges with changed palettes,
+	// and prepare the UAV states
+	auto numGroups = 0u;
+	m_frameRanges.clear();
+	vector<ResourceBarrier> barriers;
+	barriers.reserve(m_characters.size());
+	for (auto i = 0u, r = 0u; i < m_characters.size(); ++i)
+	{
+		const auto &pCharacter = m_characters[i];
+		pCharacter->uploadPose();
+
+		const auto numRanges = m_frameRanges.size();
+		const auto numMeshes = pCharacter->m_mesh->GetNumMeshes();
+		for (auto m = 0u; m < numMeshes; ++m, ++r)
+		{
+			if (!pCharacter->prepareSkinning(m))
+			{
+				++m_stats.NumSkipped;
+				continue;
+			}
+
+			for (auto k = m_firstRanges[r]; k < m_firstRanges[r + 1]; ++k)
+			{
+				auto range = m_ranges[k];
+				range.FirstGroup = numGroups;
+				m_frameRanges.push_back(range);
+				numGroups += ALIGN(range.NumVertices, GroupSize) / GroupSize;
+			}
+		}
+
+		if (m_frameRanges.size() > numRanges)
+			barriers.push_back(pCharacter->m_transformedVBs[frame].Transition(D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+	}
+	if (m_frameRanges.empty()) return;
+	memcpy(pRanges, m_frameRanges.data(), sizeof(Range) * m_frameRanges.size());
+	m_commandList.Barrier(static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	if (reset)
+	{
+		const DescriptorPool descriptorPools[] =
+		{ m_descriptorTableCache->GetDescriptorPool(CBV_SRV_UAV_POOL) };
+		m_commandList.SetDescriptorPools(static_cast<uint32_t>(size(descriptorPools)), descriptorPools);
+	}
+	m_commandList.SetComputePipelineLayout(m_pipelineLayout);
+	m_commandList.SetPipelineState(m_pipeline);
+
+	// Thread groups in rows within the dispatch limit
+	const auto numGroupsX = (min)(numGroups, MaxGroupsX);
+	const auto numGroupsY = (numGroups + numGroupsX - 1) / numGroupsX;
+	const uint32_t constants[] = { static_cast<uint32_t>(m_frameRanges.size()), numGroupsX };
+	m_commandList.SetCompute32BitConstants(CONSTANTS, static_cast<uint32_t>(size(constants)), constants);
+
+	// Skin the ranges of the frame
+	m_commandList.SetComputeRootShaderResourceView(RANGES, m_ringBuffer->GetResource(), rangeOffset);
+	m_commandList.SetComputeRootShaderResourceView(BONE_WORLDS, m_ringBuffer->GetResource(), m_paletteOffset);
+	if (m_boneFormat == Character::BONE_FORMAT_COMPACT)
+		m_commandList.SetComputeRootShaderResourceView(BONE_SCALES, m_ringBuffer->GetResource(), m_scaleOffset);
+	m_commandList.SetComputeDescriptorTable(INPUT, m_srvTable);
+	m_commandList.SetComputeDescriptorTable(OUTPUT, m_uavTables[frame]);
+	m_stats.NumDescriptorTables += 2;
+	m_commandList.Dispatch(numGroupsX, numGroupsY, 1);
+	++m_stats.NumDispatches;
+
+	m_stats.NumRanges = static_cast<uint32_t>(m_frameRanges.size());
+	m_stats.NumGroups = numGroups;
+}
+
+const SkinningBatcher::Stats &SkinningBatcher::GetStats() const
+{
+	return m_stats;
+}
+
+uint32_t SkinningBatcher::GetDynamicDataSize() const
+{
+	return ALIGN(static_cast<uint32_t>(sizeof(Range) * m_ranges.size()), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+}
+
+bool SkinningBatcher::createBuffers()
+{
+	// One range per nonempty influence range of each mesh of each character, with the
+	// palettes packed in the same order; the thread groups are assigned per frame to the
+	// ranges skinned
+	m_numBones = 0;
+	m_ranges.clear();
+	m_firstRanges.assign(1, 0);
+	m_firstBones.resize(m_characters.size());
+	for (auto i = 0u; i < m_characters.size(); ++i)
+	{
+		const auto &pCharacter = m_characters[i];
+		const auto &mesh = pCharacter->m_mesh;
+		const auto numMeshes = mesh->GetNumMeshes();
+		for (auto m = 0u; m < numMeshes; ++m)
+		{
+			const auto &influenceRanges = mesh->GetInfluenceRanges(m);
+			for (auto j = 0u; j < MAX_INFLUENCES; ++j)
+			{
+				const auto firstVertex = influenceRanges.FirstVertices[j];
+				if (influenceRanges.FirstVertices[j + 1] <= firstVertex) continue;
+
+				Range range;
+				range.FirstGroup = 0;
+				range.NumVertices = influenceRanges.FirstVertices[j + 1] - firstVertex;
+				range.FirstBone = m_numBones + pCharacter->m_firstBones[m];
+				range.FirstScale = m_numBones;	// The scale indices are per character
+				range.Slot = static_cast<uint32_t>(m_firstRanges.size() - 1);
+				range.Mode = pCharacter->m_skinningMode;
+				range.FirstVertex = firstVertex;
+				range.NumInfluences = j + 1;
+				range.PosBox = pCharacter->m_positionBox;
+				m_ranges.push_back(range);
+			}
+			m_firstRanges.push_back(static_cast<uint32_t>(m_ranges.size()));
+		}
+
+		m_firstBones[i] = m_numBones;
+		m_numBones += mesh->GetNumPaletteBones();
+	}
+	m_frameRanges.reserve(m_ranges.size());
+
+	return true;
+}
+
+bool SkinningBatcher::createPipelineLayout()
+{
+	C_RETURN(m_ranges.empty(), true);
+
+	const auto isCompact = m_boneFormat == Character::BONE_FORMAT_COMPACT;
+	auto cbBatch = 0u;
+	auto roBoneWorld = 0u;
+	auto roScales = roBoneWorld + 1;
+	auto roRanges = isCompact ? roScales + 1 : roBoneWorld + 1;
+	auto roVertices = 0u, roVerticesSpace = 1u;
+	auto rwVertices = 0u, rwVerticesSpace = 1u;
+
+	// Get compute shader slots
+	const auto reflector = m_shaderPool->GetReflector(Shader::Stage::CS, m_characters[0]->getSkinningShader(true));
+	if (reflector)
+	{
+		D3D12_SHADER_INPUT_BIND_DESC desc;
+
+		// Get constant buffer slot
+		auto hr = reflector->GetResourceBindingDescByName("cbBatch", &desc);
+		if (SUCCEEDED(hr)) cbBatch = desc.BindPoint;
+
+		// Get shader resource slots
+		hr = reflector->GetResourceBindingDescByName("g_roDualQuat", &desc);
+		if (SUCCEEDED(hr)) roBoneWorld = desc.BindPoint;
+
+		hr = reflector->GetResourceBindingDescByName("g_roScales", &desc);
+		if (SUCCEEDED(hr)) roScales = desc.BindPoint;
+
+		hr = reflector->GetResourceBindingDescByName("g_roRanges", &desc);
+		if (SUCCEEDED(hr)) roRanges = desc.BindPoint;
+
+		hr = reflector->GetResourceBindingDescByName("g_roVertices", &desc);
+		if (SUCCEEDED(hr))
+		{
+			roVertices = desc.BindPoint;
+			roVerticesSpace = desc.Space;
+		}
+
+		hr = reflector->GetResourceBindingDescByName("g_rwVertices", &desc);
+		if (SUCCEEDED(hr))
+		{
+			rwVertices = desc.BindPoint;
+			rwVerticesSpace = desc.Space;
+		}
+	}
+
+	// Pipeline layout utility
+	Util::PipelineLayout utilPipelineLayout;
+	const auto numSlots = static_cast<uint32_t>(m_firstRanges.size() - 1);
+
+	// Range count and dispatch width
+	utilPipelineLayout.SetConstants(CONSTANTS, 2, cbBatch, 0, Shader::Stage::CS);
+
+	// Bone matrices in the ring buffer
+	utilPipelineLayout.SetRootSRV(BONE_WORLDS, roBoneWorld, 0,
+		D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, Shader::Stage::CS);
+
+	// Range table of the frame in the ring buffer
+	utilPipelineLayout.SetRootSRV(RANGES, roRanges, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, Shader::Stage::CS);
+
+	// Input vertices
+	utilPipelineLayout.SetRange(INPUT, DescriptorType::SRV, numSlots, roVertices, roVerticesSpace);
+	utilPipelineLayout.SetShaderStage(INPUT, Shader::Stage::CS);
+
+	// Output vertices
+	utilPipelineLayout.SetRange(OUTPUT, DescriptorType::UAV, numSlots, rwVertices, rwVerticesSpace);
+	utilPipelineLayout.SetShaderStage(OUTPUT, Shader::Stage::CS);
+
+	// Sparse scaling streams of the compact bones
+	if (isCompact) utilPipelineLayout.SetRootSRV(BONE_SCALES, roScales, 0,
+		D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, Shader::Stage::CS);
+
+	// Get pipeline layout
+	X_RETURN(m_pipelineLayout, utilPipelineLayout.GetPipelineLayout(*m_pipelineLayoutCache,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE, m_name.empty() ? nullptr : (m_name + L".SkinningLayout").c_str()), false);
+
+	return true;
+}
+
+bool SkinningBatcher::createPipeline()
+{
+	C_RETURN(m_ranges.empty(), true);
+
+	Compute::State state;
+	state.SetPipelineLayout(m_pipelineLayout);
+	state.SetShader(m_shaderPool->GetShader(Shader::Stage::CS, m_characters[0]->getSkinningShader(true)));
+	X_RETURN(m_pipeline, state.GetPipeline(*m_computePipelineCache,
+		m_name.empty() ? nullptr : (m_name + L".SkinningPipe").c_str()), false);
+
+	return true;
+}
+
+bool SkinningBatcher::createDescriptorTables()
+{
+	C_RETURN(m_ranges.empty(), true);
+
+	// In the order of the range slots
+	vector<Descriptor> srvs;
+	srvs.reserve(m_firstRanges.size() - 1);
+	for (const auto &pCharacter : m_characters)
+	{
+		const auto numMeshes = pCharacter->m_mesh->GetNumMeshes();
+		for (auto m = 0u; m < numMeshes; ++m) srvs.push_back(pCharacter->m_mesh->GetVertexBufferSRV(m, 0));
+	}
+
+	Util::DescriptorTable srvTable;
+	srvTable.SetDescriptors(0, static_cast<uint32_t>(srvs.size()), srvs.data());
+	X_RETURN(m_srvTable, srvTable.GetCbvSrvUavTable(*m_descriptorTableCache), false);
+
+	for (auto i = 0ui8; i < FrameCount; ++i)
+	{
+		vector<Descriptor> uavs;
+		uavs.reserve(m_firstRanges.size() - 1);
+		for (const auto &pCharacter : m_characters)
+		{
+			const auto numMeshes = pCharacter->m_mesh->GetNumMeshes();
+			for (auto m = 0u; m < numMeshes; ++m) uavs.push_back(pCharacter->m_transformedVBs[i].GetUAV(m));
+		}
+
+		Util::DescriptorTable uavTable;
+		uavTable.SetDescriptors(0, static_cast<uint32_t>(uavs.size()), uavs.data());
+		X_RETURN(m_uavTables[i], uavTable.GetCbvSrvUavTable(*m_descriptorTableCache), false);
+	}
+
+	return true;
+}
@@ -0,0 +1,105 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "XUSGCharacter.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Skins every mesh of every registered character with a single dispatch. The bone
+	// palettes of the characters share one ring buffer block per frame, and each influence
+	// range of the mesh instances with changed palettes owns a range of thread groups; the
+	// thread groups look up their ranges in a per-frame range table, and index the vertex
+	// buffers in descriptor arrays by the slots of the ranges. The characters must share the
+	// same bone and vertex formats, but may use different skinning modes.
+	//--------------------------------------------------------------------------------------
+	class SkinningBatcher
+	{
+	public:
+		// Commands recorded by the last Skinning()
+		typedef Character::SkinningStats Stats;
+
+		SkinningBatcher(const Device &device, const CommandList &commandList, const wchar_t *name = nullptr);
+		virtual ~SkinningBatcher();
+
+		// Register the characters before Init(); Update() redirects their bone palettes
+		void Register(Character *pCharacter);
+		bool Init(const std::shared_ptr<ShaderPool> &shaderPool,
+			const std::shared_ptr<Compute::PipelineCache> &computePipelineCache,
+			const std::shared_ptr<PipelineLayoutCache> &pipelineLayoutCache,
+			const std::shared_ptr<DescriptorTableCache> &descriptorTableCache,
+			const std::shared_ptr<RingBuffer> &ringBuffer);
+		void Update();						// Before the characters are updated for the frame
+		void Skinning(bool reset = false);	// After the characters are updated for the frame
+
+		const Stats &GetStats() const;
+
+		// Ring buffer space written per frame in addition to the characters
+		uint32_t GetDynamicDataSize() const;
+
+	protected:
+		enum DescriptorTableSlot : uint8_t
+		{
+			CONSTANTS,
+			BONE_WORLDS,
+			RANGES,
+			INPUT,
+			OUTPUT,
+			BONE_SCALES
+		};
+
+		// SkinningRange in CSSkinningBatch.hlsl
+		struct Range
+		{
+			uint32_t	FirstGroup;
+			uint32_t	NumVertices;
+			uint32_t	FirstBone;
+			uint32_t	FirstScale;
+			uint32_t	Slot;			// Of the mesh instance in the vertex buffer descriptor arrays
+			uint32_t	Mode;			// SkinningMode of the character
+			uint32_t	FirstVertex;
+			uint32_t	NumInfluences;
+			DirectX::XMFLOAT4	PosBox;		// Quantization box of the character, if quantized
+		};
+
+		bool createBuffers();
+		bool createPipelineLayout();
+		bool createPipeline();
+		bool createDescriptorTables();
+
+		static const uint32_t FrameCount = FRAME_COUNT;
+		static const uint32_t GroupSize = 64;
+		static const uint32_t MaxGroupsX = 65535;
+
+		Device		m_device;
+		const CommandList &m_commandList;	// Of the owner, recorded into by reference
+
+		std::wstring m_name;
+
+		std::shared_ptr<ShaderPool>					m_shaderPool;
+		std::shared_ptr<Compute::PipelineCache>		m_computePipelineCache;
+		std::shared_ptr<PipelineLayoutCache>		m_pipelineLayoutCache;
+		std::shared_ptr<DescriptorTableCache>		m_descriptorTableCache;
+		std::shared_ptr<RingBuffer>					m_ringBuffer;
+
+		std::vector<Character*> m_characters;
+		std::vector<uint32_t> m_firstBones;		// Palette offset of each character
+		std::vector<Range> m_ranges;			// Of all the mesh instances, split by influence count
+		std::vector<uint32_t> m_firstRanges;	// Of each mesh instance in m_ranges, and the end
+		std::vector<Range> m_frameRanges;		// Of the mesh instances skinned in the current frame
+		uint32_t m_numBones;
+		uint32_t m_paletteOffset;				// In the ring buffer for the current frame
+		uint32_t m_scaleOffset;					// Scaling stream of the compact bones
+		Character::BoneFormat m_boneFormat;
+
+		PipelineLayout	m_pipelineLayout;
+		Pipeline		m_pipeline;
+		DescriptorTable	m_srvTable;
+		DescriptorTable	m_uavTables[FrameCount];
+
+		Stats m_stats;
+	};
+}
@@ -0,0 +1,15 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#define H_RETURN(x, o, m, r)	{ const auto hr = x; if (FAILED(hr)) { o << m << endl; return r; } }
+#define V_RETURN(x, o, r)		H_RETURN(x, o, HrToString(hr), r)
+
+#define M_RETURN(x, o, m, r)	if (x) { o << m << endl; return r; }
+#define F_RETURN(x, o, h, r)	M_RETURN(x, o, HrToString(h), r)
+
+#define C_RETURN(x, r)			if (x) return r
+#define N_RETURN(x, r)			C_RETURN(!(x), r)
+#define X_RETURN(x, f, r)		{ x = f; N_RETURN(x, r); }
@@ -1331,6 +1331,39 @@ bool RawBuffer::Upload(const CommandList &commandList, Resource &resourceUpload,
 	return true;
 }
 
+bool RawBuffer::Upload(const CommandList &commandList, Resource &resourceUpload,
+	const function<void(uint8_t*)> &writeData, uint32_t size, ResourceState dstState)
+{
+	const auto desc = m_resource->GetDesc();
+	M_RETURN(size > desc.Width, clog, "The data exceed the buffer.", false);
+
+	// Create the GPU upload buffer.
+	V_RETURN(m_device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(desc.Width),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&resourceUpload)), clog, false);
+	if (!m_name.empty()) resourceUpload->SetName((m_name + L".UploaderResource").c_str());
+
+	// Write the data into the upload heap, without an intermediate copy on the CPU.
+	void *pMapped;
+	CD3DX12_RANGE readRange(0, 0);	// We do not intend to read from this resource on the CPU.
+	V_RETURN(resourceUpload->Map(0, &readRange, &pMapped), clog, false);
+	writeData(reinterpret_cast<uint8_t*>(pMapped));
+	resourceUpload->Unmap(0, nullptr);
+
+	// Schedule a copy from the upload heap to the buffer.
+	const auto &curState = m_states[0];
+	dstState = dstState ? dstState : curState;
+	if (curState != D3D12_RESOURCE_STATE_COPY_DEST) Barrier(commandList, D3D12_RESOURCE_STATE_COPY_DEST);
+	commandList.CopyBufferRegion(m_resource, 0, resourceUpload, 0, size);
+	Barrier(commandList, dstState);
+
+	return true;
+}
+
 bool RawBuffer::CreateSRVs(uint32_t byteWidth, const uint32_t *firstElements,
 	uint32_t numDescriptors)
 {
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <functional>
 #include "XUSGCommand.h"
 
 #define BIND_PACKED_UAV	ResourceFlags(0x4 | 0x8000)
@@ -238,6 +239,10 @@ namespace XUSG
 			const wchar_t *name = nullptr);
 		bool Upload(const CommandList &commandList, Resource &resourceUpload,
 			const void *pData, ResourceState dstState = ResourceState(0));
+		// The data of the size are written by the writer straight into the upload resource
+		bool Upload(const CommandList &commandList, Resource &resourceUpload,
+			const std::function<void(uint8_t*)> &writeData, uint32_t size,
+			ResourceState dstState = ResourceState(0));
 		bool CreateSRVs(uint32_t byteWidth, const uint32_t *firstElements = nullptr,
 			uint32_t numDescriptors = 1);
 		bool CreateUAVs(uint32_t byteWidth, const uint32_t *firstElements = nullptr,
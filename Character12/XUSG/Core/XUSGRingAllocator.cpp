@@ -0,0 +1,99 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "XUSGRingAllocator.h"
+
+using namespace std;
+using namespace XUSG;
+
+RingAllocator::RingAllocator() :
+	m_byteWidth(0),
+	m_head(0),
+	m_tail(0),
+	m_usedSize(0),
+	m_frameSize(0),
+	m_frames()
+{
+}
+
+RingAllocator::~RingAllocator()
+{
+}
+
+void RingAllocator::Init(uint32_t byteWidth)
+{
+	m_byteWidth = byteWidth;
+	m_head = 0;
+	m_tail = 0;
+	m_usedSize = 0;
+	m_frameSize = 0;
+	m_frames.clear();
+}
+
+bool RingAllocator::Allocate(uint32_t size, uint32_t alignment, uint32_t *pOffset)
+{
+	uint32_t offset, allocSize;
+	if (!fits(size, alignment, offset, allocSize)) return false;
+
+	m_head = (offset + size) % m_byteWidth;
+	m_usedSize += allocSize;
+	m_frameSize += allocSize;
+	if (pOffset) *pOffset = offset;
+
+	return true;
+}
+
+bool RingAllocator::CanAllocate(uint32_t size, uint32_t alignment) const
+{
+	uint32_t offset, allocSize;
+
+	return fits(size, alignment, offset, allocSize);
+}
+
+void RingAllocator::EndFrame(uint64_t fenceValue)
+{
+	FrameAllocations frame;
+	frame.FenceValue = fenceValue;
+	frame.Size = m_frameSize;
+	m_frames.push_back(frame);
+	m_frameSize = 0;
+}
+
+void RingAllocator::Reclaim(uint64_t completedFenceValue)
+{
+	while (!m_frames.empty() && m_frames.front().FenceValue <= completedFenceValue)
+	{
+		const auto &frame = m_frames.front();
+		m_tail = (m_tail + frame.Size) % m_byteWidth;
+		m_usedSize -= frame.Size;
+		m_frames.pop_front();
+	}
+
+	// Restart from the beginning once drained, so that no wrapping is wasted
+	if (m_usedSize == 0) m_head = m_tail = 0;
+}
+
+uint32_t RingAllocator::GetByteWidth() const
+{
+	return m_byteWidth;
+}
+
+uint32_t RingAllocator::GetUsedSize() const
+{
+	return m_usedSize;
+}
+
+bool RingAllocator::fits(uint32_t size, uint32_t alignment, uint32_t &offset, uint32_t &allocSize) const
+{
+	// Wrap around if the allocation does not fit at the end, wasting the remainder
+	offset = (m_head + alignment - 1) / alignment * alignment;
+	allocSize = offset - m_head + size;
+	if (offset + size > m_byteWidth)
+	{
+		offset = 0;
+		allocSize = m_byteWidth - m_head + size;
+	}
+
+	return size <= m_byteWidth && m_usedSize + allocSize <= m_byteWidth;
+}
@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Offset bookkeeping of a ring of GPU-visible memory, without the memory: the frames or
+	// batches retire their allocations with the fence value signaled after them, and the
+	// space is reclaimed once the fence has been passed. Not thread safe.
+	//--------------------------------------------------------------------------------------
+	class RingAllocator
+	{
+	public:
+		RingAllocator();
+		virtual ~RingAllocator();
+
+		void Init(uint32_t byteWidth);
+
+		bool Allocate(uint32_t size, uint32_t alignment, uint32_t *pOffset);	// False if full
+		bool CanAllocate(uint32_t size, uint32_t alignment) const;
+
+		void EndFrame(uint64_t fenceValue);				// After the frame is submitted
+		void Reclaim(uint64_t completedFenceValue);
+
+		uint32_t GetByteWidth() const;
+		uint32_t GetUsedSize() const;
+
+	protected:
+		struct FrameAllocations
+		{
+			uint64_t	FenceValue;
+			uint32_t	Size;
+		};
+
+		bool fits(uint32_t size, uint32_t alignment, uint32_t &offset, uint32_t &allocSize) const;
+
+		uint32_t	m_byteWidth;
+		uint32_t	m_head;			// Next free byte
+		uint32_t	m_tail;			// Oldest byte in flight
+		uint32_t	m_usedSize;
+		uint32_t	m_frameSize;	// Bytes allocated since the last EndFrame()
+
+		std::deque<FrameAllocations> m_frames;
+	};
+}
@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "XUSGRingBuffer.h"
+
+using namespace std;
+using namespace XUSG;
+
+RingBuffer::RingBuffer() :
+	m_buffer(),
+	m_pDataBegin(nullptr),
+	m_allocator(),
+	m_isFullReported(false)
+{
+}
+
+RingBuffer::~RingBuffer()
+{
+}
+
+bool RingBuffer::Create(const Device &device, uint32_t byteWidth, const wchar_t *name)
+{
+	byteWidth = ALIGN(byteWidth, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	N_RETURN(m_buffer.Create(device, byteWidth, D3D12_RESOURCE_FLAG_NONE, D3D12_HEAP_TYPE_UPLOAD,
+		D3D12_RESOURCE_STATE_GENERIC_READ, 1, nullptr, 1, nullptr, name), false);
+
+	// Mapped for the lifetime of the ring
+	m_pDataBegin = reinterpret_cast<uint8_t*>(m_buffer.Map());
+	N_RETURN(m_pDataBegin, false);
+
+	m_allocator.Init(byteWidth);
+
+	return true;
+}
+
+void *RingBuffer::Allocate(uint32_t size, uint32_t alignment, uint32_t *pOffset)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	// The callers fall back or skip their commands, so a full ring is reported once per frame
+	uint32_t offset;
+	if (!m_allocator.Allocate(size, alignment, &offset))
+	{
+		if (!m_isFullReported) cerr << "Ring buffer is full; the frames in flight need more space." << endl;
+		m_isFullReported = true;
+
+		return nullptr;
+	}
+	if (pOffset) *pOffset = offset;
+
+	return &m_pDataBegin[offset];
+}
+
+bool RingBuffer::CanAllocate(uint32_t size, uint32_t alignment)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	return m_allocator.CanAllocate(size, alignment);
+}
+
+void RingBuffer::EndFrame(uint64_t fenceValue)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_allocator.EndFrame(fenceValue);
+	m_isFullReported = false;
+}
+
+void RingBuffer::Reclaim(uint64_t completedFenceValue)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_allocator.Reclaim(completedFenceValue);
+}
+
+const Resource &RingBuffer::GetResource() const
+{
+	return m_buffer.GetResource();
+}
+
+uint32_t RingBuffer::GetByteWidth() const
+{
+	return m_allocator.GetByteWidth();
+}
+
+uint32_t RingBuffer::GetUsedSize() const
+{
+	return m_allocator.GetUsedSize();
+}
@@ -0,0 +1,46 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <mutex>
+#include "XUSGResource.h"
+#include "XUSGRingAllocator.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Persistently mapped upload ring for per-frame dynamic data, e.g. constant buffers
+	// and bone palettes, bound as root descriptors at the allocation offsets. Each frame
+	// retires its allocations with the fence value signaled after its command lists, and
+	// the space is reclaimed once the GPU has passed that fence; see RingAllocator.
+	//--------------------------------------------------------------------------------------
+	class RingBuffer
+	{
+	public:
+		RingBuffer();
+		virtual ~RingBuffer();
+
+		bool Create(const Device &device, uint32_t byteWidth, const wchar_t *name = nullptr);
+
+		// Thread safe; returns nullptr if the ring is full, reported once per frame
+		void *Allocate(uint32_t size, uint32_t alignment, uint32_t *pOffset);
+		bool CanAllocate(uint32_t size, uint32_t alignment);	// Quietly
+
+		void EndFrame(uint64_t fenceValue);				// After the frame is submitted
+		void Reclaim(uint64_t completedFenceValue);
+
+		const Resource &GetResource() const;
+		uint32_t GetByteWidth() const;
+		uint32_t GetUsedSize() const;
+
+	protected:
+		RawBuffer		m_buffer;
+		uint8_t			*m_pDataBegin;
+
+		RingAllocator	m_allocator;
+		std::mutex		m_mutex;
+		bool			m_isFullReported;	// In the current frame
+	};
+}
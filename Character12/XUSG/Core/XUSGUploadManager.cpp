@@ -0,0 +1,191 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "XUSGUploadManager.h"
+
+using namespace std;
+using namespace XUSG;
+
+UploadManager::UploadManager() :
+	UploadScheduler(),
+	m_device(nullptr),
+	m_commandQueue(nullptr),
+	m_commandList(),
+	m_fence(nullptr),
+	m_fenceEvent(nullptr),
+	m_stagingBuffer(),
+	m_pStagingData(nullptr),
+	m_allocators(),
+	m_uploaders(),
+	m_batchUploaders()
+{
+}
+
+UploadManager::~UploadManager()
+{
+	// The staging ring and the upload resources must outlive the batches in flight
+	if (m_fence && !m_batches.empty() && m_fence->GetCompletedValue() < m_batches.back().FenceValue)
+		if (SUCCEEDED(m_fence->SetEventOnCompletion(m_batches.back().FenceValue, m_fenceEvent)))
+			WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
+
+	if (m_fenceEvent) CloseHandle(m_fenceEvent);
+}
+
+bool UploadManager::Create(const Device &device, uint32_t stagingSize, const wchar_t *name)
+{
+	m_device = device;
+	m_allocators.clear();
+	m_uploaders.clear();
+	m_batchUploaders.clear();
+	init(stagingSize);
+
+	return create(stagingSize, name);
+}
+
+const CommandList &UploadManager::GetCommandList()
+{
+	Open();
+
+	return m_commandList;
+}
+
+vector<Resource> &UploadManager::GetUploaders()
+{
+	return m_uploaders;
+}
+
+bool UploadManager::Upload(RawBuffer &buffer, const void *pData, uint32_t size, uint32_t dstOffset)
+{
+	return Upload(buffer, [pData, size](uint8_t *pDst) { memcpy(pDst, pData, size); }, size, dstOffset);
+}
+
+bool UploadManager::Upload(RawBuffer &buffer, const function<void(uint8_t*)> &writeData,
+	uint32_t size, uint32_t dstOffset)
+{
+	// Make room in the staging ring before opening the batch, which may be submitted for it
+	uint32_t srcOffset;
+	const auto isStaged = AllocateStaging(size, StagingAlignment, &srcOffset);
+	N_RETURN(Open(), false);
+
+	if (isStaged)
+	{
+		writeData(&m_pStagingData[srcOffset]);
+		m_commandList.CopyBufferRegion(buffer.GetResource(), dstOffset, m_stagingBuffer.GetResource(), srcOffset, size);
+
+		return true;
+	}
+
+	// Larger than the staging ring, so the data gets an upload resource of its own
+	m_uploaders.push_back(nullptr);
+	auto &uploader = m_uploaders.back();
+	V_RETURN(m_device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&uploader)), clog, false);
+
+	void *pMapped;
+	const CD3DX12_RANGE readRange(0, 0);
+	V_RETURN(uploader->Map(0, &readRange, &pMapped), clog, false);
+	writeData(reinterpret_cast<uint8_t*>(pMapped));
+	uploader->Unmap(0, nullptr);
+
+	m_commandList.CopyBufferRegion(buffer.GetResource(), dstOffset, uploader, 0, size);
+
+	return true;
+}
+
+const CommandQueue &UploadManager::GetCommandQueue() const
+{
+	return m_commandQueue;
+}
+
+const Fence &UploadManager::GetFence() const
+{
+	return m_fence;
+}
+
+bool UploadManager::create(uint32_t stagingSize, const wchar_t *name)
+{
+	// Describe and create the copy queue.
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+
+	V_RETURN(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)), cerr, false);
+	if (name) m_commandQueue->SetName((wstring(name) + L".CommandQueue").c_str());
+
+	// Create synchronization objects.
+	V_RETURN(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)), cerr, false);
+	if (m_fenceEvent) CloseHandle(m_fenceEvent);
+	m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	F_RETURN(!m_fenceEvent, cerr, GetLastError(), false);
+
+	// The staging ring, mapped for the lifetime of the manager
+	N_RETURN(m_stagingBuffer.Create(m_device, stagingSize, D3D12_RESOURCE_FLAG_NONE, D3D12_HEAP_TYPE_UPLOAD,
+		D3D12_RESOURCE_STATE_GENERIC_READ, 1, nullptr, 1, nullptr,
+		name ? (wstring(name) + L".Staging").c_str() : nullptr), false);
+	m_pStagingData = reinterpret_cast<uint8_t*>(m_stagingBuffer.Map());
+
+	return m_pStagingData != nullptr;
+}
+
+bool UploadManager::openBatch(uint32_t slot, bool isReused)
+{
+	if (isReused)
+	{
+		V_RETURN(m_allocators[slot]->Reset(), cerr, false);
+	}
+	else
+	{
+		m_allocators.resize((max)(slot + 1, static_cast<uint32_t>(m_allocators.size())));
+		m_batchUploaders.resize(m_allocators.size());
+		V_RETURN(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+			IID_PPV_ARGS(&m_allocators[slot])), cerr, false);
+	}
+
+	// The command list is created open, and reset for the later batches
+	const auto &allocator = m_allocators[slot];
+	if (m_commandList.GetCommandList()) return m_commandList.Reset(allocator, nullptr);
+	V_RETURN(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, allocator.get(),
+		nullptr, IID_PPV_ARGS(&m_commandList.GetCommandList())), cerr, false);
+
+	return true;
+}
+
+bool UploadManager::execute(uint32_t slot, uint64_t fenceValue)
+{
+	N_RETURN(m_commandList.Close(), false);
+	ID3D12CommandList *const ppCommandLists[] = { m_commandList.GetCommandList().get() };
+	m_commandQueue->ExecuteCommandLists(static_cast<uint32_t>(size(ppCommandLists)), ppCommandLists);
+
+	// Schedule a Signal command in the queue.
+	V_RETURN(m_commandQueue->Signal(m_fence.get(), fenceValue), cerr, false);
+
+	// The upload resources of the batch live until it completes
+	m_batchUploaders[slot].swap(m_uploaders);
+	m_uploaders.clear();
+
+	return true;
+}
+
+uint64_t UploadManager::getCompletedValue() const
+{
+	return m_fence->GetCompletedValue();
+}
+
+bool UploadManager::waitForValue(uint64_t fenceValue)
+{
+	V_RETURN(m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent), cerr, false);
+	WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
+
+	return true;
+}
+
+void UploadManager::retireBatch(uint32_t slot)
+{
+	m_batchUploaders[slot].clear();
+}
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <functional>
+#include "XUSGResource.h"
+#include "XUSGUploadScheduler.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Shared upload path of the assets: the uploads of many meshes and textures are recorded
+	// into one batch, with the buffer data staged in a large persistently mapped ring, and
+	// the batches are submitted on a copy queue. A batch completes at the fence value it is
+	// signaled with, which the other queues wait for on the GPU; its staging space, upload
+	// resources and command allocator are reclaimed once the copy queue has passed it.
+	// The scheduling is the one of UploadScheduler; this class holds the Direct3D 12 queue
+	// operations. Not thread safe; the uploads are recorded from one thread.
+	//--------------------------------------------------------------------------------------
+	class UploadManager :
+		public UploadScheduler
+	{
+	public:
+		UploadManager();
+		virtual ~UploadManager();
+
+		bool Create(const Device &device, uint32_t stagingSize, const wchar_t *name = nullptr);
+
+		// The batch being recorded, opened on demand; the resources uploaded on the copy queue
+		// end in the common state, and are promoted implicitly on their first use
+		const CommandList &GetCommandList();
+		std::vector<Resource> &GetUploaders();		// Kept alive until the batch completes
+		bool Upload(RawBuffer &buffer, const void *pData, uint32_t size, uint32_t dstOffset = 0);
+		// The data is written by writeData straight into the upload memory, which is write-
+		// combined, so it should be written sequentially and never read back
+		bool Upload(RawBuffer &buffer, const std::function<void(uint8_t*)> &writeData,
+			uint32_t size, uint32_t dstOffset = 0);
+
+		const CommandQueue &GetCommandQueue() const;
+		const Fence &GetFence() const;
+
+	protected:
+		virtual bool create(uint32_t stagingSize, const wchar_t *name);
+
+		// Queue operations
+		virtual bool openBatch(uint32_t slot, bool isReused);
+		virtual bool execute(uint32_t slot, uint64_t fenceValue);
+		virtual uint64_t getCompletedValue() const;
+		virtual bool waitForValue(uint64_t fenceValue);
+		virtual void retireBatch(uint32_t slot);
+
+		// Texture placement alignment, so that the ring can stage textures as well
+		static const uint32_t StagingAlignment = D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT;
+
+		Device			m_device;
+		CommandQueue	m_commandQueue;
+		CommandList		m_commandList;
+		Fence			m_fence;
+		HANDLE			m_fenceEvent;
+
+		RawBuffer		m_stagingBuffer;
+		uint8_t			*m_pStagingData;	// Mapped for the lifetime of the manager
+
+		std::vector<CommandAllocator>		m_allocators;		// Of each batch slot
+		std::vector<Resource>				m_uploaders;		// Of the batch being recorded
+		std::vector<std::vector<Resource>>	m_batchUploaders;	// Of each batch slot in flight
+	};
+}
@@ -0,0 +1,153 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "XUSGMacros.h"
+#include "XUSGUploadScheduler.h"
+
+using namespace std;
+using namespace XUSG;
+
+UploadScheduler::UploadScheduler() :
+	m_staging(),
+	m_slot(0),
+	m_isRecording(false),
+	m_fenceValue(1),
+	m_numSlots(0),
+	m_batches(),
+	m_freeSlots()
+{
+}
+
+UploadScheduler::~UploadScheduler()
+{
+}
+
+bool UploadScheduler::Open()
+{
+	if (m_isRecording) return true;
+
+	// Reuse the slot of a completed batch if any
+	if (m_freeSlots.empty()) Reclaim();
+	const auto isReused = !m_freeSlots.empty();
+	if (isReused)
+	{
+		m_slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else m_slot = m_numSlots++;
+
+	m_isRecording = openBatch(m_slot, isReused);
+	if (!m_isRecording)
+	{
+		if (isReused) m_freeSlots.push_back(m_slot);
+		else --m_numSlots;
+	}
+
+	return m_isRecording;
+}
+
+bool UploadScheduler::AllocateStaging(uint32_t size, uint32_t alignment, uint32_t *pOffset)
+{
+	C_RETURN(size > m_staging.GetByteWidth(), false);
+
+	// Retire the oldest batches until the data fits, submitting the batch being
+	// recorded first if it holds the rest of the ring
+	Reclaim();
+	while (!m_staging.CanAllocate(size, alignment))
+	{
+		if (m_batches.empty()) N_RETURN(m_isRecording && Submit(), false);
+		N_RETURN(Wait(m_batches.front().FenceValue), false);
+	}
+
+	return m_staging.Allocate(size, alignment, pOffset);
+}
+
+bool UploadScheduler::Submit()
+{
+	if (!m_isRecording) return true;
+
+	m_isRecording = false;
+	N_RETURN(execute(m_slot, m_fenceValue), false);
+
+	// The staging space of the batch retires with its fence value
+	m_staging.EndFrame(m_fenceValue);
+	Batch batch;
+	batch.Slot = m_slot;
+	batch.FenceValue = m_fenceValue++;
+	m_batches.push_back(batch);
+
+	return true;
+}
+
+bool UploadScheduler::Wait(uint64_t fenceValue)
+{
+	if (m_isRecording && fenceValue >= m_fenceValue) N_RETURN(Submit(), false);
+	if (!IsComplete(fenceValue)) N_RETURN(waitForValue(fenceValue), false);
+	Reclaim();
+
+	return true;
+}
+
+void UploadScheduler::Reclaim()
+{
+	const auto completedValue = getCompletedValue();
+	while (!m_batches.empty() && m_batches.front().FenceValue <= completedValue)
+	{
+		retireBatch(m_batches.front().Slot);
+		m_freeSlots.push_back(m_batches.front().Slot);
+		m_batches.pop_front();
+	}
+
+	m_staging.Reclaim(completedValue);
+}
+
+uint64_t UploadScheduler::GetFenceValue() const
+{
+	return m_isRecording ? m_fenceValue : m_fenceValue - 1;
+}
+
+bool UploadScheduler::IsComplete(uint64_t fenceValue) const
+{
+	return getCompletedValue() >= fenceValue;
+}
+
+bool UploadScheduler::IsRecording() const
+{
+	return m_isRecording;
+}
+
+uint32_t UploadScheduler::GetBatchSlot() const
+{
+	return m_slot;
+}
+
+uint32_t UploadScheduler::GetNumBatchSlots() const
+{
+	return m_numSlots;
+}
+
+uint32_t UploadScheduler::GetNumBatchesInFlight() const
+{
+	return static_cast<uint32_t>(m_batches.size());
+}
+
+const RingAllocator &UploadScheduler::GetStaging() const
+{
+	return m_staging;
+}
+
+void UploadScheduler::init(uint32_t stagingSize)
+{
+	m_staging.Init(stagingSize);
+	m_slot = 0;
+	m_isRecording = false;
+	m_fenceValue = 1;
+	m_numSlots = 0;
+	m_batches.clear();
+	m_freeSlots.clear();
+}
+
+void UploadScheduler::retireBatch(uint32_t)
+{
+}
@@ -0,0 +1,68 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include "XUSGRingAllocator.h"
+
+namespace XUSG
+{
+	//--------------------------------------------------------------------------------------
+	// Scheduling of the batched uploads, without the graphics API: the batch being recorded
+	// is opened on demand in a batch slot, e.g. a command allocator, reusing the slots of
+	// the completed batches; its staging space comes from a ring, and when the ring is full,
+	// the batch is submitted or the oldest batches are waited for. A batch completes at the
+	// fence value it is submitted with. The queue operations are virtual, so the scheduling
+	// runs against a fake queue as well. Not thread safe.
+	//--------------------------------------------------------------------------------------
+	class UploadScheduler
+	{
+	public:
+		UploadScheduler();
+		virtual ~UploadScheduler();
+
+		bool Open();								// The batch being recorded, opened on demand
+		// False if the ring cannot hold the size, or the batches could not make room for it;
+		// may submit the batch being recorded
+		bool AllocateStaging(uint32_t size, uint32_t alignment, uint32_t *pOffset);
+
+		bool Submit();
+		bool Wait(uint64_t fenceValue);				// Submits the batch being recorded if needed
+		void Reclaim();
+
+		uint64_t GetFenceValue() const;				// Completes everything recorded so far
+		bool IsComplete(uint64_t fenceValue) const;
+		bool IsRecording() const;
+		uint32_t GetBatchSlot() const;				// Of the batch being recorded
+		uint32_t GetNumBatchSlots() const;
+		uint32_t GetNumBatchesInFlight() const;
+		const RingAllocator &GetStaging() const;
+
+	protected:
+		struct Batch
+		{
+			uint32_t	Slot;
+			uint64_t	FenceValue;
+		};
+
+		void init(uint32_t stagingSize);
+
+		// Queue operations
+		virtual bool openBatch(uint32_t slot, bool isReused) = 0;	// Creates the slot, or resets it
+		virtual bool execute(uint32_t slot, uint64_t fenceValue) = 0;
+		virtual uint64_t getCompletedValue() const = 0;
+		virtual bool waitForValue(uint64_t fenceValue) = 0;
+		virtual void retireBatch(uint32_t slot);					// Once the queue has passed it
+
+		RingAllocator			m_staging;
+
+		uint32_t				m_slot;				// Of the batch being recorded
+		bool					m_isRecording;
+		uint64_t				m_fenceValue;		// Of the batch being recorded, or the next one
+		uint32_t				m_numSlots;
+		std::deque<Batch>		m_batches;			// Submitted, oldest first
+		std::vector<uint32_t>	m_freeSlots;		// Of the completed batches, for reuse
+	};
+}
@@ -3,28 +3,22 @@
 //--------------------------------------------------------------------------------------
 
 #include "CSSkinning.hlsli"
+#include "CSSkinningIO.hlsli"
+
+#define GROUP_SIZE 64
 
 //--------------------------------------------------------------------------------------
-// Input/Output structures
+// Constant buffer: the vertex ranges with 1-4 influences, each starting a thread group
 //--------------------------------------------------------------------------------------
-struct CS_Input
-{
-	float3	Pos;		// Position
-	uint	Weights;	// Bone weights
-	uint	Bones;		// Bone indices
-	uint2	Norm;		// Normal
-	uint	Tex;		// Texture coordinate
-	uint2	Tan;		// Normalized Tangent vector
-	uint2	BiNorm;		// Normalized BiNormal vector
-};
-
-struct CS_Output
+cbuffer cbInfluenceRanges
 {
-	float3	Pos;		// Position
-	uint2	Norm;		// Normal
-	uint	Tex;		// Texture coordinate
-	uint2	Tan;		// Normalized Tangent vector
-	uint2	BiNorm;		// Normalized BiNormal vector
+	uint4	g_firstVertices;	// Of the vertices with 1, 2, 3, and 4 influences
+	uint4	g_firstGroups;		// Of the ranges
+	uint	g_numVertices;
+#if VERTEX_QUANTIZED
+	float3	g_posMin;			// Quantization box of the output positions
+	float	g_posSize;
+#endif
 };
 
 //--------------------------------------------------------------------------------------
@@ -33,57 +27,12 @@ struct CS_Output
 RWStructuredBuffer<CS_Output>	g_rwVertices;
 StructuredBuffer<CS_Input>		g_roVertices;
 
-//--------------------------------------------------------------------------------------
-// Encode R16G16B16_FLOAT
-//--------------------------------------------------------------------------------------
-uint2 EncodeRGB16f(float3 v)
-{
-	return uint2(f32tof16(v.x) | (f32tof16(v.y) << 16), f32tof16(v.z));
-}
-
-//--------------------------------------------------------------------------------------
-// Decode R8G8B8A8_UINT
-//--------------------------------------------------------------------------------------
-uint4 DecodeRGBA8u(uint u)
-{
-	return uint4(u & 0xff, (u >> 8) & 0xff, (u >> 16) & 0xff, u >> 24);
-}
-
-//--------------------------------------------------------------------------------------
-// Decode R8G8B8A8_UNORM
-//--------------------------------------------------------------------------------------
-float4 DecodeRGBA8(uint u)
-{
-	return DecodeRGBA8u(u) / 255.0;
-}
-
-//--------------------------------------------------------------------------------------
-// Decode R16G16B16_FLOAT
-//--------------------------------------------------------------------------------------
-float3 DecodeRGB16f(uint2 u)
-{
-	const uint2 v = { u.x & 0xffff, (u.x >> 16) & 0xffff };
-
-	return float3(f16tof32(v), f16tof32(u.y));
-}
-
 //--------------------------------------------------------------------------------------
 // Load vertex data
 //--------------------------------------------------------------------------------------
 VS_Input LoadVertex(uint i)
 {
-	VS_Input vertex;
-
-	CS_Input vertexIn = g_roVertices[i];
-	vertex.Pos = vertexIn.Pos;
-	vertex.Weights = DecodeRGBA8(vertexIn.Weights);
-	vertex.Bones = DecodeRGBA8u(vertexIn.Bones);
-	vertex.Norm = DecodeRGB16f(vertexIn.Norm);
-	vertex.Tan = DecodeRGB16f(vertexIn.Tan);
-	vertex.BiNorm = DecodeRGB16f(vertexIn.BiNorm);
-	vertex.Tex = vertexIn.Tex;
-	
-	return vertex;
+	return DecodeVertex(g_roVertices[i]);
 }
 
 //--------------------------------------------------------------------------------------
@@ -91,22 +40,24 @@ VS_Input LoadVertex(uint i)
 //--------------------------------------------------------------------------------------
 void StoreVertex(SkinnedInfo skinned, uint i)
 {
-	CS_Output output;
-	output.Pos = skinned.Pos;
-	output.Norm = EncodeRGB16f(skinned.Norm);
-	output.Tex = skinned.Tex;
-	output.Tan = EncodeRGB16f(skinned.Tan);
-	output.BiNorm = EncodeRGB16f(skinned.BiNorm);
-
-	g_rwVertices[i] = output;
+#if VERTEX_QUANTIZED
+	g_rwVertices[i] = EncodeVertex(skinned, float4(g_posMin, g_posSize));
+#else
+	g_rwVertices[i] = EncodeVertex(skinned);
+#endif
 }
 
 //--------------------------------------------------------------------------------------
 // Compute shader used for skinning the mesh for stream out
 //--------------------------------------------------------------------------------------
-[numthreads(64, 1, 1)]
-void main(uint3 DTid : SV_DispatchThreadID)
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint GTid : SV_GroupThreadID, uint Gid : SV_GroupID)
 {
-	VS_Input vertex = LoadVertex(DTid.x);
-	StoreVertex(SkinVert(vertex), DTid.x);
+	// The influence range is uniform across the thread group; the empty ranges are skipped
+	const uint r = (Gid >= g_firstGroups.y) + (Gid >= g_firstGroups.z) + (Gid >= g_firstGroups.w);
+	const uint i = g_firstVertices[r] + (Gid - g_firstGroups[r]) * GROUP_SIZE + GTid;
+	if (i >= (r < 3 ? g_firstVertices[r + 1] : g_numVertices)) return;
+
+	VS_Input vertex = LoadVertex(i);
+	StoreVertex(SkinVert(vertex, 0, r + 1), i);
 }
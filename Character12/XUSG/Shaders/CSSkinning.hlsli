@@ -2,6 +2,18 @@
 // By Stars XU Tianchen
 //--------------------------------------------------------------------------------------
 
+//--------------------------------------------------------------------------------------
+// Skinning modes, SkinningMode in XUSGSkinning.h
+//--------------------------------------------------------------------------------------
+#define SKINNING_DQS4	0
+#define SKINNING_LBS4	1
+#define SKINNING_LBS2	2
+#define SKINNING_RIGID	3
+
+#ifndef SKINNING_MODE
+#define SKINNING_MODE	SKINNING_DQS4
+#endif
+
 //--------------------------------------------------------------------------------------
 // Input/Output structures
 //--------------------------------------------------------------------------------------
@@ -19,8 +31,49 @@ struct VS_Input
 //--------------------------------------------------------------------------------------
 // Buffers
 //--------------------------------------------------------------------------------------
-// Structured buffer for bone matrices
+#if COMPACT_BONES
+#define NO_SCALE 0xffffffff
+
+// 8 dwords per bone: rotation, translation, and the index into the sparse scaling
+// stream, or NO_SCALE for the bones without scaling
+struct CompactBone
+{
+	float4	Rot;
+	float3	Trans;
+	uint	ScaleIdx;
+};
+
+StructuredBuffer<CompactBone>	g_roDualQuat;
+StructuredBuffer<float3>		g_roScales;
+#else
+// Structured buffer for bone matrices: dual quaternions and scaling, or 3x4 matrices in
+// the linear blend modes
 StructuredBuffer<float3x4>	g_roDualQuat;
+#endif
+
+//--------------------------------------------------------------------------------------
+// Load the dual quaternion and scaling of a bone
+//--------------------------------------------------------------------------------------
+float3x4 LoadBone(uint i, uint firstScale)
+{
+#if COMPACT_BONES
+	const CompactBone bone = g_roDualQuat[i];
+
+	float3x4 m;
+	m[0] = bone.Rot;
+	m[1].xyz = 0.5 * (bone.Rot.w * bone.Trans + cross(bone.Trans, bone.Rot.xyz));
+	m[1].w = -0.5 * dot(bone.Trans, bone.Rot.xyz);
+	m[2] = float4(1.0.xxx, 0.0);
+
+	// The ternary operator would fetch the scaling of the rigid bones too
+	[branch]
+	if (bone.ScaleIdx != NO_SCALE) m[2].xyz = g_roScales[firstScale + bone.ScaleIdx];
+
+	return m;
+#else
+	return g_roDualQuat[i];
+#endif
+}
 
 //--------------------------------------------------------------------------------------
 // Helper struct for passing back skinned vertex information
@@ -57,30 +110,50 @@ float3 RotateWithDQ(float3 vec, float2x4 dual)
 }
 
 //--------------------------------------------------------------------------------------
-// SkinVert skins a single vertex
+// Move the heaviest influence to the front, and the second heaviest next to it
 //--------------------------------------------------------------------------------------
-SkinnedInfo SkinVert(VS_Input input)
+VS_Input SortInfluences(VS_Input input, uint numSorted)
 {
-	SkinnedInfo output;
-	
-	const float3x4 m[] =
+	[unroll]
+	for (uint i = 0; i < numSorted; ++i)
 	{
-		g_roDualQuat[input.Bones.x],
-		g_roDualQuat[input.Bones.y],
-		g_roDualQuat[input.Bones.z],
-		g_roDualQuat[input.Bones.w]
-	};
+		[unroll]
+		for (uint j = i + 1; j < 4; ++j)
+		{
+			if (input.Weights[j] > input.Weights[i])
+			{
+				const float weight = input.Weights[i];
+				const uint bone = input.Bones[i];
+				input.Weights[i] = input.Weights[j];
+				input.Bones[i] = input.Bones[j];
+				input.Weights[j] = weight;
+				input.Bones[j] = bone;
+			}
+		}
+	}
 
+	return input;
+}
+
+//--------------------------------------------------------------------------------------
+// Dual-quaternion skinning of a single vertex with the first influences
+//--------------------------------------------------------------------------------------
+SkinnedInfo SkinVertDQS(VS_Input input, uint firstScale, uint numInfluences)
+{
+	SkinnedInfo output;
+
+	const float3x4 m0 = LoadBone(input.Bones.x, firstScale);
 	float weight = input.Weights[0];
-	float4 scale = weight * m[0][2];
-	float2x4 dual = weight * (float2x4)m[0];
+	float4 scale = weight * m0[2];
+	float2x4 dual = weight * (float2x4)m0;
 
 	[unroll]
-	for (uint i = 1; i < 4; ++i)
+	for (uint i = 1; i < numInfluences; ++i)
 	{
+		const float3x4 m = LoadBone(input.Bones[i], firstScale);
 		weight = input.Weights[i];
-		scale += weight * m[i][2];
-		dual += (dot(m[0][0], m[i][0]) < 0.0 ? -weight : weight) * (float2x4)m[i];
+		scale += weight * m[2];
+		dual += (dot(m0[0], m[0]) < 0.0 ? -weight : weight) * (float2x4)m;
 	}
 
 	// fast dqs 
@@ -100,3 +173,109 @@ SkinnedInfo SkinVert(VS_Input input)
 
 	return output;
 }
+
+//--------------------------------------------------------------------------------------
+// Rigid skinning of a single vertex by its heaviest influence, no blending
+//--------------------------------------------------------------------------------------
+SkinnedInfo SkinVertRigid(VS_Input input, uint firstScale, bool isSorted)
+{
+	SkinnedInfo output;
+
+	if (!isSorted) input = SortInfluences(input, 1);
+	const float3x4 m = LoadBone(input.Bones.x, firstScale);
+	const float2x4 dual = (float2x4)m;
+	const float3 scale = m[2].xyz;
+
+	float3 pos = input.Pos * scale;
+	pos = RotateWithDQ(pos, dual);
+	pos = TranslateWithDQ(pos, dual);
+
+	output.Pos = pos;
+	output.Norm = RotateWithDQ(input.Norm / scale, dual);
+	output.Tan = RotateWithDQ(input.Tan * scale, dual);
+	output.BiNorm = RotateWithDQ(input.BiNorm * scale, dual);
+	output.Tex = input.Tex;
+
+	return output;
+}
+
+#if !COMPACT_BONES
+//--------------------------------------------------------------------------------------
+// Linear blend skinning of a single vertex with the heaviest influences
+//--------------------------------------------------------------------------------------
+SkinnedInfo SkinVertLBS(VS_Input input, uint numInfluences, bool isSorted)
+{
+	SkinnedInfo output;
+
+	if (!isSorted && numInfluences < 4) input = SortInfluences(input, numInfluences);
+
+	float weightSum = input.Weights[0];
+	[unroll]
+	for (uint i = 1; i < numInfluences; ++i) weightSum += input.Weights[i];
+
+	float3x4 m = (input.Weights[0] / weightSum) * g_roDualQuat[input.Bones[0]];
+	[unroll]
+	for (uint j = 1; j < numInfluences; ++j)
+		m += (input.Weights[j] / weightSum) * g_roDualQuat[input.Bones[j]];
+
+	// The normal by the inverse transpose of the blended matrix, as its cofactors over its
+	// determinant, which stays exact under the non-uniform scaling of the blend
+	const float3x3 cofactors = float3x3(cross(m[1].xyz, m[2].xyz), cross(m[2].xyz, m[0].xyz),
+		cross(m[0].xyz, m[1].xyz));
+	const float det = dot(m[0].xyz, cofactors[0]);
+
+	output.Pos = mul(m, float4(input.Pos, 1.0));
+	output.Norm = mul(cofactors, input.Norm) / det;
+	output.Tan = mul((float3x3)m, input.Tan);
+	output.BiNorm = mul((float3x3)m, input.BiNorm);
+	output.Tex = input.Tex;
+
+	return output;
+}
+#endif
+
+//--------------------------------------------------------------------------------------
+// Skin a single vertex in the given mode with its nonzero weights: 1-3 in the influence
+// ranges partitioned at load time, which are sorted heaviest first, or 4 in any order.
+// Specialized if the arguments are literals; otherwise the loops are unrolled per
+// influence count behind branches uniform across the thread group.
+//--------------------------------------------------------------------------------------
+SkinnedInfo SkinVertMode(VS_Input input, uint mode, uint firstScale, uint numWeights = 4)
+{
+	const bool isSorted = numWeights < 4;
+
+#if !COMPACT_BONES
+	[branch]
+	if (mode == SKINNING_LBS4 || mode == SKINNING_LBS2)
+	{
+		const uint numInfluences = mode == SKINNING_LBS2 ? min(numWeights, 2) : numWeights;
+		[branch]
+		if (numInfluences == 1) return SkinVertLBS(input, 1, true);
+		[branch]
+		if (numInfluences == 2) return SkinVertLBS(input, 2, isSorted);
+		[branch]
+		if (numInfluences == 3) return SkinVertLBS(input, 3, true);
+
+		return SkinVertLBS(input, 4, false);
+	}
+#endif
+	[branch]
+	if (mode == SKINNING_RIGID) return SkinVertRigid(input, firstScale, isSorted);
+
+	[branch]
+	if (numWeights == 1) return SkinVertDQS(input, firstScale, 1);
+	[branch]
+	if (numWeights == 2) return SkinVertDQS(input, firstScale, 2);
+	[branch]
+	if (numWeights == 3) return SkinVertDQS(input, firstScale, 3);
+
+	return SkinVertDQS(input, firstScale, 4);
+}
+
+//--------------------------------------------------------------------------------------
+// SkinVert skins a single vertex in SKINNING_MODE
+//--------------------------------------------------------------------------------------
+SkinnedInfo SkinVert(VS_Input input, uint firstScale = 0, uint numWeights = 4)
+{
+	return SkinVertMode(input, SKINNING_MODE, firstScale, numWeights);
+}
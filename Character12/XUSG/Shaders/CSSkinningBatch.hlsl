@@ -0,0 +1,87 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "CSSkinning.hlsli"
+#include "CSSkinningIO.hlsli"
+
+#define GROUP_SIZE 64
+
+//--------------------------------------------------------------------------------------
+// Influence range of a mesh instance in the batch
+//--------------------------------------------------------------------------------------
+struct SkinningRange
+{
+	uint	FirstGroup;		// First thread group of the range
+	uint	NumVertices;
+	uint	FirstBone;		// Offset of the palette in g_roDualQuat
+	uint	FirstScale;		// Offset of the scaling stream in g_roScales
+	uint	Slot;			// Index of the vertex buffers
+	uint	Mode;			// Skinning mode of the character
+	uint	FirstVertex;	// Of the influence range in the vertex buffers
+	uint	NumInfluences;	// Of the vertices in the range, 4 if not presorted
+	float4	PosBox;			// Quantization box of the output positions, if quantized
+};
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbBatch
+{
+	uint	g_numRanges;
+	uint	g_numGroupsX;	// Thread groups per row of the 2D dispatch
+};
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+StructuredBuffer<SkinningRange>	g_roRanges;
+
+// Vertex buffers of the mesh instances, in their own space for the unbounded arrays
+StructuredBuffer<CS_Input>		g_roVertices[]	: register (t0, space1);
+RWStructuredBuffer<CS_Output>	g_rwVertices[]	: register (u0, space1);
+
+//--------------------------------------------------------------------------------------
+// Find the range containing the thread group, the ranges are sorted by FirstGroup
+//--------------------------------------------------------------------------------------
+uint FindRange(uint group)
+{
+	uint first = 0;
+	uint count = g_numRanges;
+
+	while (count > 0)
+	{
+		const uint step = count / 2;
+		const uint i = first + step;
+		if (g_roRanges[i].FirstGroup <= group)
+		{
+			first = i + 1;
+			count -= step + 1;
+		}
+		else count = step;
+	}
+
+	return first - 1;
+}
+
+//--------------------------------------------------------------------------------------
+// Compute shader skinning the changed meshes of all the characters in one dispatch
+//--------------------------------------------------------------------------------------
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint GTid : SV_GroupThreadID, uint2 Gid : SV_GroupID)
+{
+	const uint group = Gid.y * g_numGroupsX + Gid.x;
+
+	// The range is uniform across the thread group
+	const uint r = FindRange(group);
+	const SkinningRange range = g_roRanges[r];
+	const uint j = (group - range.FirstGroup) * GROUP_SIZE + GTid;
+	if (j >= range.NumVertices) return;
+
+	const uint i = range.FirstVertex + j;
+	VS_Input vertex = DecodeVertex(g_roVertices[range.Slot][i]);
+	vertex.Bones += range.FirstBone;
+	// The mode and the influence count are uniform across the thread group as well
+	g_rwVertices[range.Slot][i] = EncodeVertex(SkinVertMode(vertex, range.Mode,
+		range.FirstScale, range.NumInfluences), range.PosBox);
+}
@@ -0,0 +1,8 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Bones in 8 dwords with a sparse scaling stream
+#define COMPACT_BONES 1
+
+#include "CSSkinningBatch.hlsl"
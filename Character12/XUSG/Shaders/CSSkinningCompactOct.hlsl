@@ -0,0 +1,11 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Bones in 8 dwords with a sparse scaling stream
+#define COMPACT_BONES 1
+
+// Octahedral normal and tangent, with the binormal reconstructed from a sign bit
+#define VERTEX_OCT 1
+
+#include "CSSkinning.hlsl"
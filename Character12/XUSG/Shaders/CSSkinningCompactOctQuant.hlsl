@@ -0,0 +1,12 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Bones in 8 dwords with a sparse scaling stream
+#define COMPACT_BONES 1
+
+// Octahedral normal and tangent, and 16-bit positions in the bounding box
+#define VERTEX_OCT 1
+#define VERTEX_QUANTIZED 1
+
+#include "CSSkinning.hlsl"
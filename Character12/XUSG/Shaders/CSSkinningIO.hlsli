@@ -0,0 +1,115 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#if VERTEX_OCT
+#include "VertexCompression.hlsli"
+#endif
+
+//--------------------------------------------------------------------------------------
+// Input/Output structures
+//--------------------------------------------------------------------------------------
+struct CS_Input
+{
+	float3	Pos;		// Position
+	uint	Weights;	// Bone weights
+	uint	Bones;		// Bone indices
+	uint2	Norm;		// Normal
+	uint	Tex;		// Texture coordinate
+	uint2	Tan;		// Normalized Tangent vector
+	uint2	BiNorm;		// Normalized BiNormal vector
+};
+
+struct CS_Output
+{
+#if VERTEX_QUANTIZED
+	uint2	Pos;		// Position quantized in the bounding box
+#else
+	float3	Pos;		// Position
+#endif
+#if VERTEX_OCT
+	uint	Norm;		// Octahedral normal
+	uint	Tex;		// Texture coordinate
+	uint	Tan;		// Octahedral tangent and the handedness of the binormal
+#else
+	uint2	Norm;		// Normal
+	uint	Tex;		// Texture coordinate
+	uint2	Tan;		// Normalized Tangent vector
+	uint2	BiNorm;		// Normalized BiNormal vector
+#endif
+};
+
+//--------------------------------------------------------------------------------------
+// Encode R16G16B16_FLOAT
+//--------------------------------------------------------------------------------------
+uint2 EncodeRGB16f(float3 v)
+{
+	return uint2(f32tof16(v.x) | (f32tof16(v.y) << 16), f32tof16(v.z));
+}
+
+//--------------------------------------------------------------------------------------
+// Decode R8G8B8A8_UINT
+//--------------------------------------------------------------------------------------
+uint4 DecodeRGBA8u(uint u)
+{
+	return uint4(u & 0xff, (u >> 8) & 0xff, (u >> 16) & 0xff, u >> 24);
+}
+
+//--------------------------------------------------------------------------------------
+// Decode R8G8B8A8_UNORM
+//--------------------------------------------------------------------------------------
+float4 DecodeRGBA8(uint u)
+{
+	return DecodeRGBA8u(u) / 255.0;
+}
+
+//--------------------------------------------------------------------------------------
+// Decode R16G16B16_FLOAT
+//--------------------------------------------------------------------------------------
+float3 DecodeRGB16f(uint2 u)
+{
+	const uint2 v = { u.x & 0xffff, (u.x >> 16) & 0xffff };
+
+	return float3(f16tof32(v), f16tof32(u.y));
+}
+
+//--------------------------------------------------------------------------------------
+// Decode an input vertex
+//--------------------------------------------------------------------------------------
+VS_Input DecodeVertex(CS_Input vertexIn)
+{
+	VS_Input vertex;
+	vertex.Pos = vertexIn.Pos;
+	vertex.Weights = DecodeRGBA8(vertexIn.Weights);
+	vertex.Bones = DecodeRGBA8u(vertexIn.Bones);
+	vertex.Norm = DecodeRGB16f(vertexIn.Norm);
+	vertex.Tan = DecodeRGB16f(vertexIn.Tan);
+	vertex.BiNorm = DecodeRGB16f(vertexIn.BiNorm);
+	vertex.Tex = vertexIn.Tex;
+
+	return vertex;
+}
+
+//--------------------------------------------------------------------------------------
+// Encode an output vertex, the positions are quantized in posBox (min corner and size)
+//--------------------------------------------------------------------------------------
+CS_Output EncodeVertex(SkinnedInfo skinned, float4 posBox = float4(0.0, 0.0, 0.0, 1.0))
+{
+	CS_Output output;
+#if VERTEX_QUANTIZED
+	output.Pos = EncodePosition(skinned.Pos, posBox);
+#else
+	output.Pos = skinned.Pos;
+#endif
+	output.Tex = skinned.Tex;
+#if VERTEX_OCT
+	output.Norm = EncodeNormalOct(skinned.Norm);
+	output.Tan = EncodeTangentFrame(skinned.Norm, skinned.Tan, skinned.BiNorm);
+#else
+	output.Norm = EncodeRGB16f(skinned.Norm);
+	output.Tan = EncodeRGB16f(skinned.Tan);
+	output.BiNorm = EncodeRGB16f(skinned.BiNorm);
+#endif
+
+	return output;
+}
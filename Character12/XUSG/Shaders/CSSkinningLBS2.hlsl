@@ -0,0 +1,8 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Linear blend skinning with the 2 heaviest influences
+#define SKINNING_MODE SKINNING_LBS2
+
+#include "CSSkinning.hlsl"
@@ -0,0 +1,8 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Linear blend skinning with 4 influences
+#define SKINNING_MODE SKINNING_LBS4
+
+#include "CSSkinning.hlsl"
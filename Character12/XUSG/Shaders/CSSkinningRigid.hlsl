@@ -0,0 +1,8 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Rigid skinning by the heaviest influence
+#define SKINNING_MODE SKINNING_RIGID
+
+#include "CSSkinning.hlsl"
@@ -0,0 +1,9 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+// Rigid skinning by the heaviest influence, with bones in 8 dwords
+#define SKINNING_MODE SKINNING_RIGID
+#define COMPACT_BONES 1
+
+#include "CSSkinning.hlsl"
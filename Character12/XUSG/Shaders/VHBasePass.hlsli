@@ -2,17 +2,29 @@
 // By Stars XU Tianchen
 //--------------------------------------------------------------------------------------
 
+#if !INLINE_SKINNING	// The source vertices of the inline skinning are in CSSkinning.hlsli
 //--------------------------------------------------------------------------------------
 // Input/Output structures
 //--------------------------------------------------------------------------------------
 struct VS_Input
 {
+#if VERTEX_QUANTIZED
+	float4		Pos		: POSITION;		// Position quantized in the bounding box, w = 1
+#else
 	float3		Pos		: POSITION;		// Position
+#endif
+#if VERTEX_OCT
+	float2		Norm	: NORMAL;		// Octahedral normal
+	min16float2	Tex		: TEXCOORD;		// Texture coordinate
+	uint		Tan		: TANGENT;		// Octahedral tangent and the handedness of the binormal
+#else
 	float3		Norm	: NORMAL;		// Normal
 	min16float2	Tex		: TEXCOORD;		// Texture coordinate
 	float3		Tan		: TANGENT;		// Normalized Tangent vector
 	float3		BiNorm	: BINORMAL;		// Normalized BiNormal vector
+#endif
 };
+#endif
 
 //--------------------------------------------------------------------------------------
 // Constant buffers
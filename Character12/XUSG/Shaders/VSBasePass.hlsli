@@ -2,8 +2,14 @@
 // By Stars XU Tianchen
 //--------------------------------------------------------------------------------------
 
+#if INLINE_SKINNING
+#include "CSSkinning.hlsli"
+#endif
 #include "VHBasePass.hlsli"
 #include "SHCommon.hlsli"
+#if VERTEX_OCT
+#include "VertexCompression.hlsli"
+#endif
 
 //--------------------------------------------------------------------------------------
 // Constant buffers
@@ -15,17 +21,36 @@ cbuffer cbTempBias	: register (b3)
 };
 #endif
 
-#if TEMPORAL
+#if INLINE_SKINNING
+cbuffer cbInlineSkinning
+{
+	uint	g_skinningMode;
+	uint	g_historyBones;		// Offset of the palette of the previous frame
+	uint	g_historyScales;	// Offset of the scaling stream of the previous frame
+};
+#endif
+
+#if TEMPORAL && !INLINE_SKINNING
 //--------------------------------------------------------------------------------------
 // Input/Output structures
 //--------------------------------------------------------------------------------------
 struct Vertex
 {
+#if VERTEX_QUANTIZED
+	uint2	Pos;		// Position quantized in the bounding box
+#else
 	float3	Pos;		// Position
+#endif
+#if VERTEX_OCT
+	uint	Norm;		// Octahedral normal
+	uint	Tex;		// Texture coordinate
+	uint	Tan;		// Octahedral tangent and the handedness of the binormal
+#else
 	uint2	Norm;		// Normal
 	uint	Tex;		// Texture coordinate
 	uint2	Tan;		// Normalized Tangent vector
 	uint2	BiNorm;		// Normalized BiNormal vector
+#endif
 };
 
 //--------------------------------------------------------------------------------------
@@ -41,11 +66,23 @@ StructuredBuffer<Vertex>	g_roVertices;
 VS_Output main(uint vid : SV_VERTEXID, VS_Input input)
 {
 	VS_Output output;
-	float4 pos = { input.Pos, 1.0 };
+#if INLINE_SKINNING
+	// Skin the source vertex with the bone palette, instead of reading the skinned VB
+	const SkinnedInfo skinned = SkinVertMode(input, g_skinningMode, 0);
+	float4 pos = { skinned.Pos, 1.0 };
+#else
+	float4 pos = { input.Pos.xyz, 1.0 };
+#endif
 
 #if defined(_BASEPASS_) && TEMPORAL	// Temporal tracking
 
-#ifdef _CHARACTER_
+#if defined(_CHARACTER_) && INLINE_SKINNING
+	VS_Input history = input;
+	history.Bones += g_historyBones;
+	const float4 hPos = { SkinVertMode(history, g_skinningMode, g_historyScales).Pos, 1.0 };
+#elif defined(_CHARACTER_) && VERTEX_QUANTIZED
+	const float4 hPos = { DecodePosition(g_roVertices[vid].Pos), 1.0 };
+#elif defined(_CHARACTER_)
 	const float4 hPos = { g_roVertices[vid].Pos, 1.0 };
 #elif defined(_VEGETATION_)
 	float4 hPos = pos;
@@ -80,16 +117,35 @@ VS_Output main(uint vid : SV_VERTEXID, VS_Input input)
 	output.WSPos = pos.xyz;
 #endif
 
+#if INLINE_SKINNING
+	const float3 norm = skinned.Norm;
+	const float3 tan = skinned.Tan;
+	const float3 biNorm = skinned.BiNorm;
+#elif VERTEX_OCT
+	// The binormal is reconstructed from the normal, the tangent, and the handedness
+	const float3 norm = DecodeOct(input.Norm);
+	float3 tan, biNorm;
+	DecodeTangentFrame(input.Tan, norm, tan, biNorm);
+#else
+	const float3 norm = input.Norm;
+	const float3 tan = input.Tan;
+	const float3 biNorm = input.BiNorm;
+#endif
+
 #ifdef _NORMAL_
-	output.Norm = min16float3(normalize(mul(input.Norm, (float3x3)g_normal)));
+	output.Norm = min16float3(normalize(mul(norm, (float3x3)g_normal)));
 #endif
 
 #ifdef _TANGENTS_
-	output.Tangent = min16float3(normalize(mul(input.Tan, (float3x3)g_world)));
-	output.BiNorm = min16float3(normalize(mul(input.BiNorm, (float3x3)g_world)));
+	output.Tangent = min16float3(normalize(mul(tan, (float3x3)g_world)));
+	output.BiNorm = min16float3(normalize(mul(biNorm, (float3x3)g_world)));
 #endif
 
+#if INLINE_SKINNING
+	output.Tex = f16tof32(uint2(input.Tex & 0xffff, input.Tex >> 16));
+#else
 	output.Tex = input.Tex;
+#endif
 
 #ifdef  _CLIP_
 	output.Clip = dot(pos, g_clipPlane);
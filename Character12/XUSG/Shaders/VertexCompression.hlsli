@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Encode a direction onto the octahedron unfolded into [-1, 1]^2
+//--------------------------------------------------------------------------------------
+float2 EncodeOct(float3 v)
+{
+	v /= abs(v.x) + abs(v.y) + abs(v.z);
+	const float2 s = v.xy >= 0.0 ? 1.0 : -1.0;
+
+	return v.z >= 0.0 ? v.xy : (1.0 - abs(v.yx)) * s;
+}
+
+//--------------------------------------------------------------------------------------
+// Decode an octahedral direction
+//--------------------------------------------------------------------------------------
+float3 DecodeOct(float2 e)
+{
+	float3 v = float3(e, 1.0 - abs(e.x) - abs(e.y));
+	const float t = saturate(-v.z);
+	v.xy += v.xy >= 0.0 ? -t : t;
+
+	return normalize(v);
+}
+
+//--------------------------------------------------------------------------------------
+// Encode an octahedral normal in R16G16_SNORM
+//--------------------------------------------------------------------------------------
+uint EncodeNormalOct(float3 norm)
+{
+	const int2 i = round(clamp(EncodeOct(norm), -1.0, 1.0) * 32767.0);
+
+	return (asuint(i.x) & 0xffff) | (asuint(i.y) << 16);
+}
+
+//--------------------------------------------------------------------------------------
+// Encode the tangent frame in a uint: the octahedral tangent in 2 15-bit SNORMs, and the
+// handedness of the binormal in bit 31
+//--------------------------------------------------------------------------------------
+uint EncodeTangentFrame(float3 norm, float3 tan, float3 biNorm)
+{
+	const int2 i = round(clamp(EncodeOct(tan), -1.0, 1.0) * 16383.0);
+	const uint sign = dot(cross(norm, tan), biNorm) < 0.0 ? 0x80000000 : 0;
+
+	return (asuint(i.x) & 0x7fff) | ((asuint(i.y) & 0x7fff) << 15) | sign;
+}
+
+//--------------------------------------------------------------------------------------
+// Decode the tangent frame, the binormal is reconstructed from the normal and the tangent
+//--------------------------------------------------------------------------------------
+void DecodeTangentFrame(uint u, float3 norm, out float3 tan, out float3 biNorm)
+{
+	// Sign extend the 15-bit components
+	const int2 i = asint(uint2(u << 17, u << 2)) >> 17;
+	tan = DecodeOct(i / 16383.0);
+	biNorm = cross(norm, tan);
+	if (u >> 31) biNorm = -biNorm;
+}
+
+//--------------------------------------------------------------------------------------
+// Encode a position in the quantization box (min corner and size) in R16G16B16A16_UNORM,
+// with w = 1
+//--------------------------------------------------------------------------------------
+uint2 EncodePosition(float3 pos, float4 box)
+{
+	const uint3 q = round(saturate((pos - box.xyz) / box.w) * 65535.0);
+
+	return uint2(q.x | (q.y << 16), q.z | 0xffff0000);
+}
+
+//--------------------------------------------------------------------------------------
+// Decode a quantized position, relative to the quantization box
+//--------------------------------------------------------------------------------------
+float3 DecodePosition(uint2 u)
+{
+	return float3(u.x & 0xffff, u.x >> 16, u.y & 0xffff) / 65535.0;
+}
@@ -0,0 +1,235 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "SyntheticAnimation.h"
+#include "Advanced/XUSGJobSystem.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+// Track evaluation with each kernel the CPU supports, in ns per bone
+BENCHMARK(AnimationKernels)
+{
+	static const char *kernelNames[] = { "scalar", "SSE", "AVX2" };
+
+	for (const auto numBones : { 256u, 1024u })
+	{
+		AnimationClip clip;
+		CHECK(clip.Create(Test::CreateSyntheticAnimation(numBones, 31, 30)));
+
+		auto tracks = clip.GetTracks();
+		vector<XMFLOAT4X4> matrices(numBones);
+		vector<BoneTransform> transforms(numBones);
+		const auto name = to_string(numBones) + " bones ";
+		for (auto kernel = ANIMATION_KERNEL_SCALAR; kernel <= AnimationTracks::GetBestKernel();
+			kernel = static_cast<AnimationKernel>(kernel + 1))
+		{
+			tracks.SetKernel(kernel);
+
+			auto key = 0u;
+			const auto matrixTime = Test::Measure([&]()
+			{
+				key = (key + 1) % 30;
+				tracks.Evaluate(matrices.data(), key, key + 1, 0.5f);
+			}, 1000);
+
+			const auto transformTime = Test::Measure([&]()
+			{
+				key = (key + 1) % 30;
+				tracks.Evaluate(transforms.data(), key, key + 1, 0.5f);
+			}, 1000);
+
+			Test::Report(name + kernelNames[kernel] + " matrices", matrixTime / numBones, "ns/bone");
+			Test::Report(name + kernelNames[kernel] + " transforms", transformTime / numBones, "ns/bone");
+		}
+	}
+}
+
+// Pose evaluation of 1, 100 and 10,000 characters sharing a clip, each at its own time,
+// serially and over the job system, in ns per character
+BENCHMARK(CharacterScaling)
+{
+	const auto numBones = 256u;
+	AnimationClip clip;
+	CHECK(clip.Create(Test::CreateSyntheticAnimation(numBones, 31, 30)));
+	const auto &tracks = clip.GetTracks();
+
+	JobSystem jobSystem;
+	for (const auto numCharacters : { 1u, 100u, 10000u })
+	{
+		vector<BoneTransform> poses(numCharacters * numBones);
+		const auto evaluate = [&](uint32_t i, uint32_t frame)
+		{
+			const auto key = (frame + i) % 30;
+			tracks.Evaluate(&poses[i * numBones], key, key + 1, 0.5f);
+		};
+
+		const auto numIterations = (max)(1000u / numCharacters, 1u);
+		auto frame = 0u;
+		const auto serialTime = Test::Measure([&]()
+		{
+			++frame;
+			for (auto i = 0u; i < numCharacters; ++i) evaluate(i, frame);
+		}, numIterations);
+
+		const auto parallelTime = Test::Measure([&]()
+		{
+			++frame;
+			jobSystem.ParallelFor(numCharacters, [&](uint32_t i) { evaluate(i, frame); }, 16);
+		}, numIterations);
+
+		const auto name = to_string(numCharacters) + " characters ";
+		Test::Report(name + "serial", serialTime / numCharacters, "ns/character");
+		Test::Report(name + "parallel", parallelTime / numCharacters, "ns/character");
+		Test::Report(name + "speedup", serialTime / parallelTime, "x");
+	}
+	Test::Report("Job system workers", jobSystem.GetNumWorkers() + 1.0, "threads");
+}
+
+// Track evaluation per character and frame at the animation LOD levels of the crowd sample,
+// on the synthetic rig: the tracks are evaluated every UpdateInterval frames, and the
+// groups of bones below MinBoneHeight are not evaluated at all
+BENCHMARK(AnimationLODTracks)
+{
+	struct Level
+	{
+		uint8_t UpdateInterval;
+		uint8_t MinBoneHeight;
+	};
+
+	static const Level levels[] = { { 1, 0 }, { 2, 1 }, { 4, 2 } };
+
+	for (const auto numBones : { 256u, 1024u })
+	{
+		AnimationClip clip;
+		CHECK(clip.Create(Test::CreateSyntheticAnimation(numBones, 31, 30)));
+		const auto &tracks = clip.GetTracks();
+
+		// Heights of the binary tree, and the max per track group as SDKMesh computes them
+		vector<uint8_t> heights(numBones, 0);
+		for (auto i = numBones - 1; i > 0; --i)
+		{
+			auto &parentHeight = heights[(i - 1) / 2];
+			parentHeight = (max)(parentHeight, static_cast<uint8_t>(heights[i] + 1));
+		}
+
+		vector<uint8_t> groupHeights(tracks.GetNumGroups(), 0);
+		for (auto i = 0u; i < numBones; ++i)
+		{
+			auto &groupHeight = groupHeights[i / AnimationTracks::GroupWidth];
+			groupHeight = (max)(groupHeight, heights[i]);
+		}
+
+		vector<BoneTransform> transforms(numBones);
+		double fullTime = 0.0;
+		auto l = 0u;
+		for (const auto &level : levels)
+		{
+			auto key = 0u;
+			const auto timePerCall = Test::Measure([&]()
+			{
+				key = (key + 1) % 30;
+				tracks.Evaluate(transforms.data(), key, key + 1, 0.5f, groupHeights.data(), level.MinBoneHeight);
+			}, 1000);
+
+			auto numEvaluated = 0u;
+			for (const auto height : heights) numEvaluated += height >= level.MinBoneHeight ? 1 : 0;
+
+			const auto timePerFrame = timePerCall / level.UpdateInterval;
+			if (l == 0) fullTime = timePerFrame;
+
+			const auto name = to_string(numBones) + " bones LOD " + to_string(l++);
+			Test::Report(name + " tracks", timePerFrame, "ns/frame");
+			Test::Report(name + " evaluated bones", numEvaluated, "bones");
+			Test::Report(name + " saving", 100.0 * (1.0 - timePerFrame / fullTime), "%");
+		}
+	}
+}
+
+// Per-clip report of the compressed format: size, error and decode speed against the
+// raw keys gathered from the tracks
+BENCHMARK(AnimationCompression)
+{
+	Test::ForEachClip([](const string &name, const wstring &fileName)
+	{
+		const auto compressedFile = Test::GetTempPath(L"XUSGCompressedAnimation.xanc");
+
+		CompressedAnimation::Report report;
+		CHECK(CompressedAnimation::Convert(fileName.c_str(), compressedFile.c_str(),
+			CompressedAnimation::Settings(), &report));
+		Test::RemoveFile(compressedFile);
+
+		AnimationClip clip;
+		CHECK(clip.Load(fileName.c_str()));
+
+		const auto numFrames = clip.GetHeader()->NumFrames;
+		const auto numKeys = clip.GetHeader()->NumAnimationKeys;
+		vector<SDKAnimationData> keyData(numFrames);
+		auto key = 0u;
+		const auto rawTime = Test::Measure([&]()
+		{
+			key = (key + 1) % numKeys;
+			clip.DecodeKey(keyData.data(), key);
+		}, 100);
+
+		Test::Report(name + " raw size", static_cast<double>(report.RawBytes) / 1024.0, "KiB");
+		Test::Report(name + " compressed size", static_cast<double>(report.CompressedBytes) / 1024.0, "KiB");
+		Test::Report(name + " ratio", 100.0 * report.CompressedBytes / report.RawBytes, "%");
+		Test::Report(name + " stored keys", 100.0 * report.NumStoredKeys / report.NumSourceKeys, "%");
+		Test::Report(name + " max translation error", report.MaxTranslationError * 1000.0, "x 1e-3");
+		Test::Report(name + " max rotation error", report.MaxRotationError * 1000.0, "mrad");
+		Test::Report(name + " max scaling error", report.MaxScalingError * 1000.0, "x 1e-3");
+		Test::Report(name + " compressed decode", report.DecodeTimePerKey, "ns/bone key");
+		Test::Report(name + " raw decode", rawTime / numFrames, "ns/bone key");
+	});
+}
+
+// Bone palette of a skeleton, in ns per bone: the matrix chain of the linear blend
+// palette, the matrix chain decomposed into dual quaternions with XMMatrixDecompose for
+// non-uniformly scaled skeletons, and the QTS chain of uniformly scaled ones
+BENCHMARK(BoneComposition)
+{
+	for (const auto numBones : { 63u, 255u, 1023u })
+	{
+		const auto skeleton = Test::CreateSyntheticSkeleton(numBones, true);
+
+		vector<XMFLOAT4X4> matrices(numBones);
+		vector<XMFLOAT4X4> dualQuats(numBones);
+		const auto matrixTime = Test::Measure([&]()
+		{
+			XMStoreFloat4x4(&matrices[0], skeleton[0].ToMatrix());
+			for (auto i = 1u; i < numBones; ++i)
+				XMStoreFloat4x4(&matrices[i], skeleton[i].ToMatrix() * XMLoadFloat4x4(&matrices[(i - 1) / 2]));
+		}, 1000);
+
+		const auto decomposeTime = Test::Measure([&]()
+		{
+			XMStoreFloat4x4(&matrices[0], skeleton[0].ToMatrix());
+			for (auto i = 1u; i < numBones; ++i)
+			{
+				const auto matrix = skeleton[i].ToMatrix() * XMLoadFloat4x4(&matrices[(i - 1) / 2]);
+				XMStoreFloat4x4(&matrices[i], matrix);
+				XMStoreFloat4x4(&dualQuats[i], BoneTransform::FromMatrix(matrix).ToDualQuat());
+			}
+		}, 1000);
+
+		vector<BoneTransform> transforms(numBones);
+		const auto composeTime = Test::Measure([&]()
+		{
+			transforms[0] = skeleton[0];
+			for (auto i = 1u; i < numBones; ++i)
+			{
+				transforms[i] = BoneTransform::Compose(skeleton[i], transforms[(i - 1) / 2]);
+				XMStoreFloat4x4(&matrices[i], transforms[i].ToMatrix());
+				XMStoreFloat4x4(&dualQuats[i], transforms[i].ToDualQuat());
+			}
+		}, 1000);
+
+		const auto name = to_string(numBones) + " bones ";
+		Test::Report(name + "matrix chain", matrixTime / numBones, "ns/bone");
+		Test::Report(name + "matrix chain + decompose", decomposeTime / numBones, "ns/bone");
+		Test::Report(name + "QTS chain", composeTime / numBones, "ns/bone");
+	}
+}
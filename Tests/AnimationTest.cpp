@@ -0,0 +1,325 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include "SyntheticAnimation.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+// Random keys of numTracks tracks, with rotations across the hemispheres, non-unit and
+// non-uniform scales, and a zero quaternion
+static vector<uint8_t> createRandomAnimation(uint32_t numTracks, uint32_t numKeys)
+{
+	auto animation = Test::CreateSyntheticAnimation(numTracks, numKeys, 30);
+	auto &header = *reinterpret_cast<SDKAnimationFileHeader*>(animation.data());
+	const auto pFrameData = reinterpret_cast<SDKAnimationFrameData*>(&animation[header.AnimationDataOffset]);
+
+	mt19937 generator(numTracks);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (auto i = 0u; i < numTracks; ++i)
+	{
+		const auto pKeys = reinterpret_cast<SDKAnimationData*>(&animation[sizeof(SDKAnimationFileHeader) +
+			static_cast<size_t>(pFrameData[i].DataOffset)]);
+		for (auto k = 0u; k < numKeys; ++k)
+		{
+			const auto axis = XMVectorSet(unit(generator), unit(generator), unit(generator) + 2.0f, 0.0f);
+			auto rotation = XMQuaternionRotationAxis(XMVector3Normalize(axis), XM_PI * unit(generator));
+			if (unit(generator) < 0.0f) rotation = -rotation;	// Same rotation, opposite hemisphere
+
+			pKeys[k].Translation = XMFLOAT3(unit(generator), unit(generator), unit(generator));
+			XMStoreFloat4(&pKeys[k].Orientation, rotation);
+			pKeys[k].Scaling = XMFLOAT3(1.5f + unit(generator), 1.0f, 1.5f + 0.5f * unit(generator));
+		}
+	}
+
+	const auto pKeys = reinterpret_cast<SDKAnimationData*>(&animation[sizeof(SDKAnimationFileHeader) +
+		static_cast<size_t>(pFrameData[numTracks - 1].DataOffset)]);
+	pKeys[1].Orientation = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+
+	return animation;
+}
+
+static float maxDifference(const XMFLOAT4X4 &a, const XMFLOAT4X4 &b)
+{
+	auto difference = 0.0f;
+	for (auto i = 0u; i < 4; ++i)
+		for (auto j = 0u; j < 4; ++j)
+			difference = (max)(fabs(a.m[i][j] - b.m[i][j]), difference);
+
+	return difference;
+}
+
+static float maxDifference(const BoneTransform &a, const BoneTransform &b)
+{
+	const auto rotation = XMVectorGetX(XMVector4Length(XMLoadFloat4(&a.Rotation) - XMLoadFloat4(&b.Rotation)));
+	const auto translation = XMVectorGetX(XMVector3Length(XMLoadFloat3(&a.Translation) - XMLoadFloat3(&b.Translation)));
+	const auto scaling = XMVectorGetX(XMVector3Length(XMLoadFloat3(&a.Scaling) - XMLoadFloat3(&b.Scaling)));
+
+	return (max)((max)(rotation, translation), scaling);
+}
+
+// Every kernel the CPU supports matches the scalar reference, including the partial group
+// and the groups skipped by height
+TEST_CASE(AnimationKernels)
+{
+	const auto numTracks = 2 * AnimationTracks::GroupWidth - 3;
+	const auto numKeys = 4u;
+
+	AnimationClip clip;
+	CHECK(clip.Create(createRandomAnimation(numTracks, numKeys)));
+
+	auto tracks = clip.GetTracks();
+	CHECK(tracks.GetNumTracks() == numTracks);
+	CHECK(tracks.GetNumGroups() == 2);
+	CHECK(tracks.SetKernel(ANIMATION_KERNEL_SCALAR));
+	CHECK(!tracks.SetKernel(static_cast<AnimationKernel>(AnimationTracks::GetBestKernel() + 1)));
+
+	const uint8_t groupHeights[] = { 0, 1 };
+	for (auto kernel = ANIMATION_KERNEL_SCALAR; kernel <= AnimationTracks::GetBestKernel();
+		kernel = static_cast<AnimationKernel>(kernel + 1))
+	{
+		CHECK(tracks.SetKernel(kernel));
+		CHECK(tracks.GetKernel() == kernel);
+
+		auto matrixDifference = 0.0f;
+		auto transformDifference = 0.0f;
+		auto isSkipped = true;
+		for (auto k = 0u; k + 1 < numKeys; ++k)
+		{
+			for (const auto blend : { 0.0f, 0.25f, 0.5f, 1.0f })
+			{
+				vector<XMFLOAT4X4> matrices(numTracks), refMatrices(numTracks);
+				tracks.Evaluate(matrices.data(), k, k + 1, blend);
+				tracks.EvaluateReference(refMatrices.data(), k, k + 1, blend);
+				for (auto i = 0u; i < numTracks; ++i)
+					matrixDifference = (max)(maxDifference(matrices[i], refMatrices[i]), matrixDifference);
+
+				// Only the second group is tall enough; the first keeps the sentinel
+				const auto sentinel = BoneTransform{ XMFLOAT4(9.0f, 9.0f, 9.0f, 9.0f),
+					XMFLOAT3(9.0f, 9.0f, 9.0f), XMFLOAT3(9.0f, 9.0f, 9.0f) };
+				vector<BoneTransform> transforms(numTracks, sentinel), refTransforms(numTracks);
+				tracks.Evaluate(transforms.data(), k, k + 1, blend, groupHeights, 1);
+				tracks.EvaluateReference(refTransforms.data(), k, k + 1, blend);
+				for (auto i = 0u; i < numTracks; ++i)
+				{
+					if (i < AnimationTracks::GroupWidth)
+						isSkipped = isSkipped && maxDifference(transforms[i], sentinel) == 0.0f;
+					else transformDifference = (max)(maxDifference(transforms[i], refTransforms[i]), transformDifference);
+				}
+			}
+		}
+
+		CHECK(matrixDifference < 1e-5f);
+		CHECK(transformDifference < 1e-5f);
+		CHECK(isSkipped);
+	}
+}
+
+// The tracks give the keys back, with the zero quaternion baked as identity, and the clip
+// keeps only the header and the frame table besides them
+TEST_CASE(AnimationKeys)
+{
+	const auto numTracks = 2 * AnimationTracks::GroupWidth - 3;
+	const auto numKeys = 4u;
+	const auto animation = createRandomAnimation(numTracks, numKeys);
+	const auto &header = *reinterpret_cast<const SDKAnimationFileHeader*>(animation.data());
+	const auto pFrameData = reinterpret_cast<const SDKAnimationFrameData*>(&animation[header.AnimationDataOffset]);
+
+	AnimationClip clip;
+	CHECK(clip.Create(vector<uint8_t>(animation)));
+
+	const auto &tracks = clip.GetTracks();
+	auto isEqual = true;
+	for (auto i = 0u; i < numTracks; ++i)
+	{
+		const auto pKeys = reinterpret_cast<const SDKAnimationData*>(&animation[sizeof(SDKAnimationFileHeader) +
+			static_cast<size_t>(pFrameData[i].DataOffset)]);
+		for (auto k = 0u; k < numKeys; ++k)
+		{
+			auto expected = pKeys[k];
+			if (i == numTracks - 1 && k == 1) expected.Orientation.w = 1.0f;
+			const auto key = tracks.GetKey(i, k);
+			isEqual = isEqual && memcmp(&key, &expected, sizeof(SDKAnimationData)) == 0;
+		}
+		isEqual = isEqual && strcmp(clip.GetFrameName(i), pFrameData[i].FrameName) == 0;
+	}
+	CHECK(isEqual);
+
+	const auto frameTableSize = header.AnimationDataOffset + sizeof(SDKAnimationFrameData) * numTracks;
+	const auto tracksSize = sizeof(AnimationTracks::KeyGroup) * tracks.GetNumGroups() * numKeys;
+	CHECK(clip.GetMemoryUsage() == frameTableSize + tracksSize);
+
+	// The saved file holds the same keys
+	const auto fileName = Test::GetTempPath(L"XUSGAnimationTracks.sdkmesh_anim");
+	CHECK(clip.Save(fileName.c_str()));
+
+	AnimationClip loadedClip;
+	CHECK(loadedClip.Load(fileName.c_str()));
+	Test::RemoveFile(fileName);
+
+	vector<SDKAnimationData> keys(numTracks), loadedKeys(numTracks);
+	isEqual = loadedClip.GetHeader()->NumFrames == numTracks;
+	for (auto k = 0u; k < numKeys && isEqual; ++k)
+	{
+		clip.DecodeKey(keys.data(), k);
+		loadedClip.DecodeKey(loadedKeys.data(), k);
+		isEqual = memcmp(keys.data(), loadedKeys.data(), sizeof(SDKAnimationData) * numTracks) == 0;
+	}
+	CHECK(isEqual);
+}
+
+// Compressed clips stay within the tolerances of their source, and loading rejects files
+// whose tables do not fit or point outside the streams
+TEST_CASE(AnimationCompression)
+{
+	Test::ForEachClip([](const string&, const wstring &fileName)
+	{
+		const CompressedAnimation::Settings settings;
+		const auto compressedFile = Test::GetTempPath(L"XUSGCompressedAnimation.xanc");
+
+		CompressedAnimation::Report report;
+		CHECK(CompressedAnimation::Convert(fileName.c_str(), compressedFile.c_str(), settings, &report));
+		CHECK(report.CompressedBytes < report.RawBytes);
+		CHECK(report.MaxTranslationError <= settings.TranslationTolerance * 1.01f);
+		CHECK(report.MaxRotationError <= settings.RotationTolerance * 1.01f);
+		CHECK(report.MaxScalingError <= settings.ScalingTolerance * 1.01f);
+
+		AnimationClip clip;
+		CHECK(clip.Load(compressedFile.c_str()));
+		CHECK(clip.IsCompressed());
+
+		vector<uint8_t> data;
+		CHECK(Test::ReadFile(compressedFile, data));
+
+		// The header is 8 words: magic, version, frame, key, FPS, channel, key index and value
+		// counts; the channel indices of the first frame follow its name
+		const auto load = [&](const vector<uint8_t> &corrupted)
+		{
+			CHECK(Test::WriteFile(compressedFile, corrupted));
+
+			return CompressedAnimation().Load(compressedFile.c_str());
+		};
+
+		const auto setWord = [&](size_t offset, uint32_t value)
+		{
+			auto corrupted = data;
+			memcpy(&corrupted[offset], &value, sizeof(uint32_t));
+
+			return corrupted;
+		};
+
+		CHECK(load(data));
+		CHECK(!load(vector<uint8_t>(data.cbegin(), data.cend() - 1)));
+		CHECK(!load(vector<uint8_t>(data.cbegin(), data.cbegin() + data.size() / 2)));
+		CHECK(!load(setWord(sizeof(uint32_t), CompressedAnimation::Version + 1)));
+		CHECK(!load(setWord(2 * sizeof(uint32_t), UINT32_MAX)));
+		CHECK(!load(setWord(5 * sizeof(uint32_t), UINT32_MAX / 8)));
+		CHECK(!load(setWord(7 * sizeof(uint32_t), UINT32_MAX)));
+		CHECK(!load(setWord(8 * sizeof(uint32_t) + MAX_FRAME_NAME, UINT32_MAX - 1)));
+
+		Test::RemoveFile(compressedFile);
+	});
+}
+
+// Characters spawned on one clip share it: the registry holds a single copy, whose memory
+// does not grow with the number of characters, and it is released with the last one
+TEST_CASE(AnimationClipSharing)
+{
+	Test::ForEachClip([](const string &name, const wstring &fileName)
+	{
+		const auto numClips = AnimationClipRegistry::GetNumClips();
+		const auto memoryUsage = AnimationClipRegistry::GetMemoryUsage();
+
+		vector<shared_ptr<const AnimationClip>> characters;
+		for (const auto numCharacters : { 1u, 100u, 1000u })
+		{
+			while (characters.size() < numCharacters)
+				characters.push_back(AnimationClipRegistry::GetClip(fileName));
+
+			const auto &clip = characters.front();
+			CHECK(clip && clip == characters.back());
+			CHECK(AnimationClipRegistry::GetNumClips() == numClips + 1);
+			CHECK(AnimationClipRegistry::GetMemoryUsage() == memoryUsage + clip->GetMemoryUsage());
+		}
+
+		const auto clipMemory = characters.front()->GetMemoryUsage();
+		Test::Report(name + " shared clip", static_cast<double>(clipMemory) / 1024.0, "KiB");
+		Test::Report(name + " clip per character (1000)", static_cast<double>(clipMemory) / characters.size(), "B");
+
+		characters.clear();
+		CHECK(AnimationClipRegistry::GetNumClips() == numClips);
+		CHECK(AnimationClipRegistry::GetMemoryUsage() == memoryUsage);
+	});
+}
+
+// Bones compose in QTS form as exactly as the matrix chain when the scales are uniform, and
+// the dual quaternions read off match those of XMMatrixDecompose; a non-uniform scale under
+// a rotated parent shears, so only the matrix chain is exact then
+TEST_CASE(BoneComposition)
+{
+	const auto numBones = 255u;
+	const auto skeleton = Test::CreateSyntheticSkeleton(numBones, true);
+
+	vector<BoneTransform> transforms(numBones);
+	vector<XMFLOAT4X4> matrices(numBones);
+	auto matrixError = 0.0f;
+	auto dualQuatError = 0.0f;
+	auto uniformError = 0.0f;
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		const auto parent = (i - 1) / 2;
+		transforms[i] = i > 0 ? BoneTransform::Compose(skeleton[i], transforms[parent]) : skeleton[i];
+		const auto matrix = i > 0 ? skeleton[i].ToMatrix() * XMLoadFloat4x4(&matrices[parent]) : skeleton[i].ToMatrix();
+		XMStoreFloat4x4(&matrices[i], matrix);
+
+		XMFLOAT4X4 composed;
+		XMStoreFloat4x4(&composed, transforms[i].ToMatrix());
+		const auto magnitude = (max)(transforms[i].Scaling.x, XMVectorGetX(XMVector3Length(XMLoadFloat3(&transforms[i].Translation))));
+		matrixError = (max)(maxDifference(composed, matrices[i]) / (max)(magnitude, 1.0f), matrixError);
+
+		// Against the decomposition of the exact matrix, in the same hemisphere
+		auto decomposed = BoneTransform::FromMatrix(matrix);
+		if (XMVectorGetX(XMVector4Dot(XMLoadFloat4(&decomposed.Rotation), XMLoadFloat4(&transforms[i].Rotation))) < 0.0f)
+			XMStoreFloat4(&decomposed.Rotation, -XMLoadFloat4(&decomposed.Rotation));
+		XMFLOAT4X4 dualQuat, decomposedDualQuat;
+		XMStoreFloat4x4(&dualQuat, transforms[i].ToDualQuat());
+		XMStoreFloat4x4(&decomposedDualQuat, decomposed.ToDualQuat());
+		dualQuatError = (max)(maxDifference(dualQuat, decomposedDualQuat) / (max)(magnitude, 1.0f), dualQuatError);
+
+		BoneTransform uniform;
+		CHECK(BoneTransform::FromUniformMatrix(uniform, matrix));
+		if (XMVectorGetX(XMVector4Dot(XMLoadFloat4(&uniform.Rotation), XMLoadFloat4(&transforms[i].Rotation))) < 0.0f)
+			XMStoreFloat4(&uniform.Rotation, -XMLoadFloat4(&uniform.Rotation));
+		uniformError = (max)(maxDifference(uniform, transforms[i]) / (max)(magnitude, 1.0f), uniformError);
+	}
+
+	CHECK(matrixError < 1e-5f);
+	CHECK(dualQuatError < 1e-5f);
+	CHECK(uniformError < 1e-5f);
+	Test::Report("Uniform QTS vs matrix chain", matrixError * 1e6, "x 1e-6");
+	Test::Report("Uniform QTS vs XMMatrixDecompose", dualQuatError * 1e6, "x 1e-6");
+
+	// A non-uniform child under a rotated parent shears, which the QTS form cannot hold
+	const auto nonUniform = Test::CreateSyntheticSkeleton(2, false);
+	XMFLOAT4X4 composed, chained;
+	XMStoreFloat4x4(&composed, BoneTransform::Compose(nonUniform[1], nonUniform[0]).ToMatrix());
+	XMStoreFloat4x4(&chained, nonUniform[1].ToMatrix() * nonUniform[0].ToMatrix());
+	BoneTransform transform;
+	CHECK(!BoneTransform::FromUniformMatrix(transform, XMLoadFloat4x4(&chained)));
+	CHECK(maxDifference(composed, chained) > 1e-3f);
+
+	// Reflections are not rotations
+	auto reflection = BoneTransform::Identity();
+	reflection.Scaling = XMFLOAT3(-1.0f, -1.0f, -1.0f);
+	CHECK(!BoneTransform::FromUniformMatrix(transform, reflection.ToMatrix()));
+
+	// The clips tell whether their keys scale uniformly
+	AnimationClip clip;
+	CHECK(clip.Create(Test::CreateSyntheticAnimation(8, 4, 30)) && clip.IsUniformScaling());
+	CHECK(clip.Create(createRandomAnimation(8, 4)) && !clip.IsUniformScaling());
+}
@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include <thread>
+#include "XUSGTest.h"
+#include "Advanced/XUSGJobSystem.h"
+
+using namespace std;
+using namespace XUSG;
+
+// Every submitted job runs once, and Wait(counter) returns after the jobs of the counter
+TEST_CASE(JobSystemCounters)
+{
+	JobSystem jobSystem(3);
+
+	const auto numJobs = 10000u;
+	vector<atomic<uint32_t>> runs(numJobs);
+	for (auto &run : runs) run = 0;
+
+	JobSystem::Counter counter(0);
+	for (auto i = 0u; i < numJobs; ++i) jobSystem.Submit([&runs, i]() { ++runs[i]; }, &counter);
+	jobSystem.Wait(counter);
+
+	CHECK(counter == 0);
+	auto numRuns = 0u;
+	for (const auto &run : runs) numRuns += run == 1 ? 1 : 0;
+	CHECK(numRuns == numJobs);
+
+	// Jobs without a counter are joined by the global Wait
+	atomic<uint32_t> numUncounted(0);
+	for (auto i = 0u; i < numJobs; ++i) jobSystem.Submit([&numUncounted]() { ++numUncounted; });
+	jobSystem.Wait();
+	CHECK(numUncounted == numJobs);
+}
+
+// ParallelFor inside the jobs of an outer ParallelFor, with fewer workers than jobs
+TEST_CASE(JobSystemNesting)
+{
+	for (const auto numWorkers : { 1u, 3u })
+	{
+		JobSystem jobSystem(numWorkers);
+
+		const auto numOuter = 16u;
+		const auto numInner = 64u;
+		vector<atomic<uint32_t>> sums(numOuter);
+		for (auto &sum : sums) sum = 0;
+
+		jobSystem.ParallelFor(numOuter, [&](uint32_t i)
+		{
+			jobSystem.ParallelFor(numInner, [&sums, i](uint32_t j) { sums[i] += j + 1; });
+		});
+
+		auto numDone = 0u;
+		for (const auto &sum : sums) numDone += sum == numInner * (numInner + 1) / 2 ? 1 : 0;
+		CHECK(numDone == numOuter);
+	}
+}
+
+// A frame's ParallelFor returns while an unrelated job, e.g. a mesh load, still runs
+TEST_CASE(JobSystemIndependence)
+{
+	JobSystem jobSystem(2);
+
+	atomic<bool> isReleased(false);
+	atomic<bool> isLoaded(false);
+	JobSystem::Counter loads(0);
+	jobSystem.Submit([&]()
+	{
+		while (!isReleased) this_thread::yield();
+		isLoaded = true;
+	}, &loads);
+
+	atomic<uint32_t> numDone(0);
+	jobSystem.ParallelFor(100, [&numDone](uint32_t) { ++numDone; });
+	CHECK(numDone == 100);
+	CHECK(!isLoaded);
+	CHECK(loads == 1);
+
+	isReleased = true;
+	jobSystem.Wait(loads);
+	CHECK(isLoaded);
+	CHECK(loads == 0);
+}
@@ -0,0 +1,112 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "Advanced/XUSGMeshLoader.h"
+#include "SyntheticMesh.h"
+
+using namespace std;
+using namespace XUSG;
+
+// Startup of a scene of 50 distinct character assets, each a mesh and its animation clip,
+// on a WARP device: the time from the first load call until every mesh has left IsLoading()
+// after its copy batch completed. Character::LoadSDKMesh() loads them one after another on
+// the calling thread; the mesh loader prepares them on the job system while the calling
+// thread uploads the meshes prepared so far. The files are in the page cache after the first
+// run, and the clips are released between the runs, so every run reads them again.
+BENCHMARK(SceneLoading)
+{
+	const auto numAssets = 50u;
+	const auto numTriangles = Test::IsQuick() ? 2048u : 32768u;
+
+	Device device;
+	{
+		com_ptr<IDXGIFactory4> factory;
+		com_ptr<IDXGIAdapter> warpAdapter;
+		if (FAILED(CreateDXGIFactory2(0, IID_PPV_ARGS(&factory))) ||
+			FAILED(factory->EnumWarpAdapter(IID_PPV_ARGS(&warpAdapter))) ||
+			FAILED(D3D12CreateDevice(warpAdapter.get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device))))
+		{
+			Test::Skip("SceneLoading", "no D3D12 WARP device");
+			return;
+		}
+	}
+
+	// Distinct rigs, so that no clip or mesh is shared between the assets
+	vector<wstring> meshFiles(numAssets);
+	for (auto i = 0u; i < numAssets; ++i)
+	{
+		const auto name = L"SceneLoading" + to_wstring(i);
+		meshFiles[i] = Test::WriteSyntheticMesh(name.c_str(), 32 + i % 8 * 16, numTriangles + i * 64);
+		if (meshFiles[i].empty())
+		{
+			Test::Fail(__FILE__, __LINE__, "WriteSyntheticMesh");
+			for (const auto &meshFile : meshFiles) if (!meshFile.empty()) Test::DeleteSyntheticMesh(meshFile);
+			return;
+		}
+	}
+
+	const auto uploadManager = make_shared<UploadManager>();
+	if (!uploadManager->Create(device, 32 << 20, L"SceneLoadingUpload"))
+	{
+		Test::Fail(__FILE__, __LINE__, "UploadManager::Create");
+		for (const auto &meshFile : meshFiles) Test::DeleteSyntheticMesh(meshFile);
+		return;
+	}
+
+	// Polls the meshes, as a sample's frame loop does, until every one has completed
+	const auto waitForMeshes = [](const vector<shared_ptr<SDKMesh>> &meshes)
+	{
+		for (;;)
+		{
+			auto numLoading = 0u;
+			for (const auto &mesh : meshes) numLoading += mesh && !mesh->CheckLoadDone() ? 1 : 0;
+			if (numLoading == 0) break;
+			SwitchToThread();
+		}
+	};
+
+	auto isLoaded = true;
+	const auto textureCache = make_shared<TextureCache::element_type>(0);
+	const auto serialTime = Test::Measure([&]()
+	{
+		vector<shared_ptr<SDKMesh>> meshes(numAssets);
+		for (auto i = 0u; i < numAssets; ++i)
+			meshes[i] = Character::LoadSDKMesh(device, meshFiles[i], meshFiles[i] + L"_anim",
+				textureCache, nullptr, nullptr, uploadManager);
+		isLoaded = uploadManager->Submit() && isLoaded;
+
+		for (const auto &mesh : meshes) isLoaded = mesh && isLoaded;
+		waitForMeshes(meshes);
+	}, 1, 3);
+
+	JobSystem jobSystem;
+	const auto pipelinedTime = Test::Measure([&]()
+	{
+		MeshLoader meshLoader(device, &jobSystem, uploadManager, textureCache);
+		vector<shared_ptr<SDKMesh>> meshes(numAssets);
+		for (auto i = 0u; i < numAssets; ++i)
+			meshes[i] = meshLoader.LoadCharacterSDKMesh(meshFiles[i], meshFiles[i] + L"_anim");
+
+		// Upload the meshes as the workers prepare them
+		while (meshLoader.GetNumPending() > 0)
+		{
+			isLoaded = meshLoader.Update() && isLoaded;
+			SwitchToThread();
+		}
+
+		for (const auto &mesh : meshes) isLoaded = mesh && isLoaded;
+		waitForMeshes(meshes);
+	}, 1, 3);
+
+	CHECK(isLoaded);
+	CHECK(AnimationClipRegistry::GetNumClips() == 0);
+
+	Test::Report("SceneLoading assets", numAssets, "meshes");
+	Test::Report("SceneLoading workers", jobSystem.GetNumWorkers(), "threads");
+	Test::Report("SceneLoading serial", serialTime * 1e-6, "ms");
+	Test::Report("SceneLoading pipelined", pipelinedTime * 1e-6, "ms");
+	Test::Report("SceneLoading speedup", serialTime / pipelinedTime, "x");
+
+	for (const auto &meshFile : meshFiles) Test::DeleteSyntheticMesh(meshFile);
+}
@@ -0,0 +1,328 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include <psapi.h>
+#include "XUSGTest.h"
+#include "SyntheticMesh.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+// Pose evaluation of the flattened hierarchy, in ns per call and bones per second
+BENCHMARK(TransformMesh)
+{
+	Test::ForEachMesh([](const string &name, SDKMesh &mesh)
+	{
+		AnimationPose pose;
+		mesh.InitPose(pose);
+
+		auto time = 0.0;
+		const auto timePerCall = Test::Measure([&]()
+		{
+			time += 1.0 / 60.0;
+			mesh.TransformMesh(pose, XMMatrixIdentity(), time);
+		}, 1000);
+
+		Test::Report(name + " TransformMesh", timePerCall, "ns/call");
+		Test::Report(name + " bones", mesh.GetNumFrames() * 1000.0 / timePerCall, "Mbones/s");
+	});
+}
+
+// Moving the posed frames to their final positions with the cached inverse bind pose,
+// against inverting the bind pose on every tick
+BENCHMARK(InvBindPose)
+{
+	Test::ForEachMesh([](const string &name, SDKMesh &mesh)
+	{
+		const auto numFrames = mesh.GetNumFrames();
+		vector<XMFLOAT4X4> transformed(numFrames);
+		for (auto i = 0u; i < numFrames; ++i) XMStoreFloat4x4(&transformed[i], mesh.GetBindMatrix(i));
+
+		vector<XMFLOAT4X4> final(numFrames);
+		const auto perTick = Test::Measure([&]()
+		{
+			for (auto i = 0u; i < numFrames; ++i)
+			{
+				const auto invBindPose = XMMatrixInverse(nullptr, mesh.GetBindMatrix(i));
+				XMStoreFloat4x4(&final[i], invBindPose * XMLoadFloat4x4(&transformed[i]));
+			}
+		}, 1000);
+
+		const auto cached = Test::Measure([&]()
+		{
+			for (auto i = 0u; i < numFrames; ++i)
+				XMStoreFloat4x4(&final[i], mesh.GetInvBindMatrix(i) * XMLoadFloat4x4(&transformed[i]));
+		}, 1000);
+
+		Test::Report(name + " per-tick inverse", perTick / numFrames, "ns/bone");
+		Test::Report(name + " cached inverse", cached / numFrames, "ns/bone");
+		Test::Report(name + " speedup", perTick / cached, "x");
+	});
+}
+
+// Pose evaluation between the keys with each sampling mode
+BENCHMARK(AnimationSampling)
+{
+	static const pair<AnimationSampling, const char*> samplings[] =
+	{
+		{ SAMPLE_NEAREST, "nearest" },
+		{ SAMPLE_NLERP, "nlerp" },
+		{ SAMPLE_SLERP, "slerp" }
+	};
+
+	Test::ForEachMesh([](const string &name, SDKMesh &mesh)
+	{
+		for (const auto &sampling : samplings)
+		{
+			mesh.SetAnimationSampling(sampling.first);
+
+			AnimationPose pose;
+			mesh.InitPose(pose);
+
+			auto time = 0.0;
+			const auto timePerCall = Test::Measure([&]()
+			{
+				time += 1.0 / 144.0;
+				mesh.TransformMesh(pose, XMMatrixIdentity(), time);
+			}, 1000);
+
+			Test::Report(name + " " + sampling.second, timePerCall, "ns/call");
+		}
+	});
+}
+
+// Pose evaluation per character and frame at the animation LOD levels of the crowd sample:
+// the pose is evaluated every UpdateInterval frames, holding the bones below MinBoneHeight
+BENCHMARK(AnimationLOD)
+{
+	struct Level
+	{
+		uint8_t UpdateInterval;
+		uint8_t MinBoneHeight;
+	};
+
+	static const Level levels[] = { { 1, 0 }, { 2, 1 }, { 4, 2 } };
+
+	Test::ForEachMesh([](const string &name, SDKMesh &mesh)
+	{
+		AnimationPose pose;
+		mesh.InitPose(pose);
+
+		double fullTime = 0.0;
+		auto l = 0u;
+		for (const auto &level : levels)
+		{
+			auto time = 0.0;
+			const auto timePerCall = Test::Measure([&]()
+			{
+				time += 1.0 / 60.0;
+				mesh.TransformMesh(pose, XMMatrixIdentity(), time, level.MinBoneHeight);
+			}, 1000);
+
+			const auto timePerFrame = timePerCall / level.UpdateInterval;
+			if (l == 0) fullTime = timePerFrame;
+
+			const auto levelName = name + " LOD " + to_string(l++);
+			Test::Report(levelName + " pose", timePerFrame, "ns/frame");
+			Test::Report(levelName + " evaluated bones", pose.NumEvaluatedBones, "bones");
+			Test::Report(levelName + " skipped bones", pose.NumSkippedBones, "bones");
+			Test::Report(levelName + " saving", 100.0 * (1.0 - timePerFrame / fullTime), "%");
+		}
+	});
+}
+
+// Reads the whole file into the heap, as the loader did before it mapped the file
+class FileReadMesh :
+	public SDKMesh
+{
+public:
+	virtual bool Prepare(const wchar_t *fileName, const TextureCache &textureCache, bool isStaticMesh = false)
+	{
+		N_RETURN(Test::ReadFile(fileName, m_fileData), false);
+
+		return prepareFromMemory(m_fileData.data(), textureCache, m_fileData.size(), isStaticMesh, false);
+	}
+
+protected:
+	vector<uint8_t> m_fileData;
+};
+
+// Private and working set bytes of the process
+static void getMemoryUsage(uint64_t &privateBytes, uint64_t &workingSet)
+{
+	PROCESS_MEMORY_COUNTERS counters = { sizeof(counters) };
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	privateBytes = counters.PagefileUsage;
+	workingSet = counters.WorkingSetSize;
+}
+
+// Loading a large mesh from the mapped file against reading it into the heap: the time to
+// prepare it and write its streams as for the upload, with the file in the page cache, and
+// the memory the loaded mesh holds at the end of the load, its peak. The working set of the
+// mapped loader includes the pages of the file it touched, which stay shared with the cache.
+BENCHMARK(MeshLoading)
+{
+	const auto numTriangles = Test::IsQuick() ? 65536u : 4194304u;
+	const auto meshFile = Test::WriteSyntheticMesh(L"MeshLoading", 64, numTriangles);
+	if (meshFile.empty())
+	{
+		Test::Fail(__FILE__, __LINE__, "WriteSyntheticMesh");
+		return;
+	}
+
+	// Stands in for the staging memory, which is allocated ahead, sized for the largest stream
+	vector<uint8_t> staging;
+	{
+		SDKMesh mesh;
+		CHECK(mesh.Prepare(meshFile.c_str(), make_shared<TextureCache::element_type>()));
+		for (auto m = 0u; m < mesh.GetNumMeshes(); ++m)
+		{
+			const auto indexSize = mesh.GetIndexType(m) == IT_32BIT ? sizeof(uint32_t) : sizeof(uint16_t);
+			staging.resize((max)(static_cast<size_t>(mesh.GetVertexStride(m, 0) * mesh.GetNumVertices(m, 0)), staging.size()));
+			staging.resize((max)(static_cast<size_t>(indexSize * mesh.GetNumIndices(m)), staging.size()));
+		}
+	}
+
+	const auto measure = [&](const string &loaderName, const function<SDKMesh*()> &createMesh)
+	{
+		uint64_t privateBytes, workingSet;
+		getMemoryUsage(privateBytes, workingSet);
+
+		auto isLoaded = true;
+		auto peakPrivateBytes = 0.0;
+		auto peakWorkingSet = 0.0;
+		const auto timePerLoad = Test::Measure([&]()
+		{
+			unique_ptr<SDKMesh> mesh(createMesh());
+			isLoaded = mesh->Prepare(meshFile.c_str(), make_shared<TextureCache::element_type>()) && isLoaded;
+			for (auto vb = 0u; vb < mesh->GetNumVertexBuffers(); ++vb) mesh->WriteVerticesAt(vb, staging.data());
+			for (auto ib = 0u; ib < mesh->GetNumIndexBuffers(); ++ib) mesh->WriteIndicesAt(ib, staging.data());
+
+			uint64_t loadedPrivateBytes, loadedWorkingSet;
+			getMemoryUsage(loadedPrivateBytes, loadedWorkingSet);
+			peakPrivateBytes = (max)(static_cast<double>(loadedPrivateBytes) - privateBytes, peakPrivateBytes);
+			peakWorkingSet = (max)(static_cast<double>(loadedWorkingSet) - workingSet, peakWorkingSet);
+		}, 4, 3);
+		CHECK(isLoaded);
+
+		Test::Report("MeshLoading " + loaderName + " time", timePerLoad * 1e-6, "ms");
+		Test::Report("MeshLoading " + loaderName + " private", peakPrivateBytes / (1 << 20), "MiB");
+		Test::Report("MeshLoading " + loaderName + " working set", peakWorkingSet / (1 << 20), "MiB");
+	};
+
+	measure("mapped", []() -> SDKMesh* { return new SDKMesh; });
+	measure("read into heap", []() -> SDKMesh* { return new FileReadMesh; });
+	Test::DeleteSyntheticMesh(meshFile);
+}
+
+// Exposes the bounds pass of the loader, and the per-index loop it replaced as the reference
+class BoundsMesh :
+	public SDKMesh
+{
+public:
+	void ComputeBounds(uint32_t mesh) { computeBounds(mesh); }
+
+	// Every index of every subset, the 16-bit ones decoded from 32-bit words, with the box
+	// updated one component at a time
+	void ComputeBoundsPerIndex(uint32_t mesh, XMFLOAT3 &center, XMFLOAT3 &extents) const
+	{
+		XMFLOAT3 lower(FLT_MAX, FLT_MAX, FLT_MAX);
+		XMFLOAT3 upper(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+		const auto pMesh = GetMesh(mesh);
+		const auto indSize = m_pIndexBufferArray[pMesh->IndexBuffer].IndexType == IT_16BIT ? 2 : 4;
+		const auto indices = reinterpret_cast<const uint32_t*>(m_indices[pMesh->IndexBuffer]);
+		const auto vertices = reinterpret_cast<const float*>(m_vertices[pMesh->VertexBuffers[0]]);
+		const auto stride = static_cast<uint32_t>(m_pVertexBufferArray[pMesh->VertexBuffers[0]].StrideBytes) / 4;
+		for (auto s = 0u; s < pMesh->NumSubsets; ++s)
+		{
+			const auto pSubset = GetSubset(mesh, s);
+			const auto indexStart = static_cast<uint32_t>(pSubset->IndexStart);
+			const auto indexCount = static_cast<uint32_t>(pSubset->IndexCount);
+			for (auto vertIdx = indexStart; vertIdx < indexStart + indexCount; ++vertIdx)
+			{
+				auto currentIndex = 0u;
+				if (indSize == 2)
+				{
+					currentIndex = indices[vertIdx / 2];
+					if (vertIdx % 2 == 0)
+					{
+						currentIndex = currentIndex << 16;
+						currentIndex = currentIndex >> 16;
+					}
+					else currentIndex = currentIndex >> 16;
+				}
+				else currentIndex = indices[vertIdx];
+
+				const auto pt = reinterpret_cast<const XMFLOAT3*>(&vertices[stride * currentIndex]);
+				if (pt->x < lower.x) lower.x = pt->x;
+				if (pt->y < lower.y) lower.y = pt->y;
+				if (pt->z < lower.z) lower.z = pt->z;
+				if (pt->x > upper.x) upper.x = pt->x;
+				if (pt->y > upper.y) upper.y = pt->y;
+				if (pt->z > upper.z) upper.z = pt->z;
+			}
+		}
+
+		extents = XMFLOAT3((upper.x - lower.x) * 0.5f, (upper.y - lower.y) * 0.5f, (upper.z - lower.z) * 0.5f);
+		center = XMFLOAT3(lower.x + extents.x, lower.y + extents.y, lower.z + extents.z);
+	}
+};
+
+// The load-time bounds of a mesh with 16-bit indices and of a multi-million-triangle mesh
+// with 32-bit indices: the pass over the referenced vertices against the per-index loop, in
+// ms per mesh, with the same boxes
+BENCHMARK(MeshBounds)
+{
+	for (const auto numTriangles : { 65536u, Test::IsQuick() ? 262144u : 4194304u })
+	{
+		const auto meshFile = Test::WriteSyntheticMesh(L"MeshBounds", 64, numTriangles);
+		if (meshFile.empty())
+		{
+			Test::Fail(__FILE__, __LINE__, "WriteSyntheticMesh");
+			return;
+		}
+
+		// The mapping of the file is released before the file is deleted
+		[&meshFile, numTriangles]()
+		{
+			BoundsMesh mesh;
+			if (!mesh.Prepare(meshFile.c_str(), make_shared<TextureCache::element_type>()))
+			{
+				Test::Fail(__FILE__, __LINE__, "mesh.Prepare");
+				return;
+			}
+
+			const auto numMeshes = mesh.GetNumMeshes();
+
+			auto boxError = 0.0f;
+			for (auto m = 0u; m < numMeshes; ++m)
+			{
+				XMFLOAT3 center, extents;
+				mesh.ComputeBoundsPerIndex(m, center, extents);
+				boxError = (max)(XMVectorGetX(XMVector3LengthEst(mesh.GetMeshBBoxCenter(m) - XMLoadFloat3(&center))), boxError);
+				boxError = (max)(XMVectorGetX(XMVector3LengthEst(mesh.GetMeshBBoxExtents(m) - XMLoadFloat3(&extents))), boxError);
+			}
+			CHECK(boxError < 1e-5f);
+
+			XMFLOAT3 center, extents;
+			const auto perIndex = Test::Measure([&]()
+			{
+				for (auto m = 0u; m < numMeshes; ++m) mesh.ComputeBoundsPerIndex(m, center, extents);
+			}, 4, 3);
+
+			const auto referenced = Test::Measure([&]()
+			{
+				for (auto m = 0u; m < numMeshes; ++m) mesh.ComputeBounds(m);
+			}, 4, 3);
+
+			const auto name = "MeshBounds " + to_string(numTriangles) + (mesh.GetIndexType(0) == IT_32BIT ? " 32-bit" : " 16-bit");
+			Test::Report(name + " per-index", perIndex * 1e-6 / numMeshes, "ms/mesh");
+			Test::Report(name + " referenced vertices", referenced * 1e-6 / numMeshes, "ms/mesh");
+			Test::Report(name + " speedup", perIndex / referenced, "x");
+		}();
+		Test::DeleteSyntheticMesh(meshFile);
+	}
+}
@@ -0,0 +1,358 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "XUSGTest.h"
+#include "SyntheticMesh.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+// Largest difference of the rows, with the translation relative to its length beyond 1
+static float maxDifference(CXMMATRIX a, CXMMATRIX b)
+{
+	auto difference = 0.0f;
+	for (auto i = 0u; i < 3; ++i)
+		difference = (max)(XMVectorGetX(XMVector4Length(a.r[i] - b.r[i])), difference);
+
+	const auto scale = (max)(XMVectorGetX(XMVector3Length(b.r[3])), 1.0f);
+
+	return (max)(XMVectorGetX(XMVector3Length(a.r[3] - b.r[3])) / scale, difference);
+}
+
+// The cached inverse bind pose matches the per-tick inverse it replaces
+TEST_CASE(InvBindPose)
+{
+	Test::ForEachMesh([](const string&, SDKMesh &mesh)
+	{
+		auto difference = 0.0f;
+		for (auto i = 0u; i < mesh.GetNumFrames(); ++i)
+		{
+			const auto bindPose = mesh.GetBindMatrix(i);
+			difference = (max)(maxDifference(mesh.GetInvBindMatrix(i), XMMatrixInverse(nullptr, bindPose)), difference);
+			difference = (max)(maxDifference(mesh.GetInvBindMatrix(i) * bindPose, XMMatrixIdentity()), difference);
+		}
+
+		CHECK(difference < 1e-4f);
+	});
+}
+
+static float maxDifference(const AnimationPose &a, const AnimationPose &b)
+{
+	auto difference = 0.0f;
+	for (size_t i = 0; i < a.TransformedFrameMatrices.size(); ++i)
+		difference = (max)(maxDifference(XMLoadFloat4x4(&a.TransformedFrameMatrices[i]),
+			XMLoadFloat4x4(&b.TransformedFrameMatrices[i])), difference);
+
+	return difference;
+}
+
+// All the sampling modes agree on the keys, and nlerp stays close to slerp between them
+TEST_CASE(AnimationSampling)
+{
+	Test::ForEachMesh([](const string&, SDKMesh &mesh)
+	{
+		uint32_t numKeys;
+		float frameTime;
+		CHECK(mesh.GetAnimationProperties(&numKeys, &frameTime));
+
+		AnimationPose poses[3];
+		const AnimationSampling samplings[] = { SAMPLE_NEAREST, SAMPLE_NLERP, SAMPLE_SLERP };
+		for (auto &pose : poses) mesh.InitPose(pose);
+
+		auto onKeys = 0.0f;
+		auto betweenKeys = 0.0f;
+		for (auto k = 1u; k + 1 < numKeys; ++k)
+		{
+			for (auto i = 0u; i < 3; ++i)
+			{
+				mesh.SetAnimationSampling(samplings[i]);
+				mesh.TransformMesh(poses[i], XMMatrixIdentity(), frameTime * (k - 1 + 0.001));
+			}
+			onKeys = (max)(maxDifference(poses[0], poses[1]), onKeys);
+			onKeys = (max)(maxDifference(poses[0], poses[2]), onKeys);
+
+			for (auto i = 1u; i < 3; ++i)
+			{
+				mesh.SetAnimationSampling(samplings[i]);
+				mesh.TransformMesh(poses[i], XMMatrixIdentity(), frameTime * (k - 0.5));
+			}
+			betweenKeys = (max)(maxDifference(poses[1], poses[2]), betweenKeys);
+		}
+
+		CHECK(onKeys < 1e-3f);
+		CHECK(betweenKeys < 1e-2f);
+	});
+}
+
+static size_t getMemoryUsage(const AnimationPose &pose)
+{
+	return sizeof(XMFLOAT4X4) * (pose.TransformedFrameMatrices.capacity() + pose.WorldPoseFrameMatrices.capacity()) +
+		sizeof(BoneTransform) * (pose.TransformedFrameTransforms.capacity() + pose.WorldPoseFrameTransforms.capacity() +
+		pose.LocalFrameTransforms.capacity()) + sizeof(SDKAnimationData) * pose.DecodedKeys.capacity();
+}
+
+// Characters on one mesh share its clip, and own only their pose: the clip memory stays
+// the same for any number of characters
+TEST_CASE(CharacterMemory)
+{
+	Test::ForEachMesh([](const string &name, SDKMesh &mesh)
+	{
+		const auto &clip = mesh.GetAnimationClip();
+		CHECK(clip != nullptr);
+
+		const auto clipMemory = clip->GetMemoryUsage();
+		const auto registryMemory = AnimationClipRegistry::GetMemoryUsage();
+		const auto useCount = clip.use_count();
+
+		vector<pair<shared_ptr<const AnimationClip>, AnimationPose>> characters;
+		for (const auto numCharacters : { 1u, 100u, 1000u })
+		{
+			characters.reserve(numCharacters);
+			while (characters.size() < numCharacters)
+			{
+				characters.emplace_back(clip, AnimationPose());
+				mesh.InitPose(characters.back().second);
+			}
+
+			CHECK(clip.use_count() == useCount + static_cast<long>(numCharacters));
+			CHECK(clip->GetMemoryUsage() == clipMemory);
+			CHECK(AnimationClipRegistry::GetMemoryUsage() == registryMemory);
+
+			size_t poseMemory = 0;
+			for (const auto &character : characters) poseMemory += getMemoryUsage(character.second);
+			Test::Report(name + " " + to_string(numCharacters) + " characters", static_cast<double>(clipMemory +
+				poseMemory) / 1024.0, "KiB");
+		}
+
+		Test::Report(name + " shared clip", static_cast<double>(clipMemory) / 1024.0, "KiB");
+		Test::Report(name + " pose per character", static_cast<double>(getMemoryUsage(characters.front().second)) / 1024.0, "KiB");
+	});
+}
+
+// The compact palettes of the animated poses decode within the bound of
+// Character::GetPaletteError(), and the traffic of both formats is reported per palette
+TEST_CASE(CompactBonePalette)
+{
+	Test::ForEachMesh([](const string &name, SDKMesh &mesh)
+	{
+		uint32_t numKeys;
+		float frameTime;
+		CHECK(mesh.GetAnimationProperties(&numKeys, &frameTime));
+
+		// The DQS palette as Character::setBoneMatrices()
+		const auto numBones = mesh.GetNumPaletteBones();
+		vector<XMFLOAT4X3> palette(numBones), decoded(numBones);
+		vector<CPUSkinning::CompactBone> compactBones(numBones);
+		vector<XMFLOAT3> scales(numBones);
+
+		AnimationPose pose;
+		mesh.InitPose(pose);
+
+		auto paletteError = 0.0f;
+		auto numScaledBones = 0u;
+		for (auto k = 0u; k < numKeys; ++k)
+		{
+			mesh.TransformMesh(pose, XMMatrixIdentity(), frameTime * (k + 0.5));
+			for (auto i = 0u; i < numBones; ++i)
+			{
+				const auto bone = BoneTransform::FromMatrix(XMLoadFloat4x4(&pose.TransformedFrameMatrices[mesh.GetPaletteFrame(i)]));
+				XMStoreFloat4x3(&palette[i], XMMatrixTranspose(bone.ToDualQuat()));
+			}
+
+			numScaledBones = (max)(CPUSkinning::EncodeCompact(compactBones.data(), scales.data(), palette.data(), numBones), numScaledBones);
+			CPUSkinning::DecodeCompact(decoded.data(), compactBones.data(), scales.data(), numBones);
+
+			for (auto i = 0u; i < numBones; ++i)
+				for (auto r = 0u; r < 4; ++r)
+					for (auto c = 0u; c < 3; ++c)
+						paletteError = (max)(fabs(decoded[i].m[r][c] - palette[i].m[r][c]), paletteError);
+		}
+
+		CHECK(paletteError < 1e-4f);
+
+		const auto referenceSize = static_cast<uint32_t>(sizeof(XMFLOAT4X3)) * numBones;
+		const auto uploadSize = static_cast<uint32_t>(sizeof(CPUSkinning::CompactBone)) * numBones +
+			static_cast<uint32_t>(sizeof(XMFLOAT3)) * numScaledBones;
+		Test::Report(name + " palette error", paletteError * 1e6, "x 1e-6");
+		Test::Report(name + " scaled bones of " + to_string(numBones), numScaledBones, "bones");
+		Test::Report(name + " palette DQ_SCALE", referenceSize, "bytes");
+		Test::Report(name + " palette COMPACT", uploadSize, "bytes");
+	});
+}
+
+// The influence ranges cover the vertices of each mesh, and the vertices of range i have
+// i + 1 nonzero weights, or none in the first range; the vertex counts per range and the
+// influence loop iterations saved are reported per mesh
+TEST_CASE(InfluenceRanges)
+{
+	Test::ForEachMesh([](const string &name, SDKMesh &mesh)
+	{
+		uint64_t numVertices[MAX_INFLUENCES] = {};
+		auto numMismatches = 0u;
+		for (auto m = 0u; m < mesh.GetNumMeshes(); ++m)
+		{
+			const auto &ranges = mesh.GetInfluenceRanges(m);
+			CHECK(ranges.FirstVertices[0] == 0);
+			CHECK(ranges.FirstVertices[MAX_INFLUENCES] == mesh.GetNumVertices(m, 0));
+
+			// The skinned vertices are laid out as the skinning input, and a single range is left
+			// unpartitioned
+			const auto isInput = mesh.GetVertexStride(m, 0) == sizeof(CPUSkinning::InputVertex) &&
+				ranges.FirstVertices[MAX_INFLUENCES - 1] > 0;
+			vector<CPUSkinning::InputVertex> vertices(isInput ? ranges.FirstVertices[MAX_INFLUENCES] : 0);
+			if (isInput) mesh.WriteVerticesAt(mesh.GetMesh(m)->VertexBuffers[0], reinterpret_cast<uint8_t*>(vertices.data()));
+			for (auto i = 0u; i < MAX_INFLUENCES; ++i)
+			{
+				CHECK(ranges.FirstVertices[i] <= ranges.FirstVertices[i + 1]);
+				numVertices[i] += ranges.FirstVertices[i + 1] - ranges.FirstVertices[i];
+
+				for (auto v = ranges.FirstVertices[i]; isInput && v < ranges.FirstVertices[i + 1]; ++v)
+				{
+					auto numWeights = 0u;
+					for (auto j = 0u; j < 4; ++j) numWeights += (vertices[v].Weights >> (8 * j)) & 0xff ? 1 : 0;
+					numMismatches += numWeights == i + 1 || (i == 0 && numWeights == 0) ? 0 : 1;
+				}
+			}
+		}
+
+		CHECK(numMismatches == 0);
+
+		auto numTotal = 0ull;
+		auto numIterations = 0ull;
+		for (auto i = 0u; i < MAX_INFLUENCES; ++i)
+		{
+			numTotal += numVertices[i];
+			numIterations += (i + 1) * numVertices[i];
+			Test::Report(name + " vertices with " + to_string(i + 1) + " influences", static_cast<double>(numVertices[i]), "vertices");
+		}
+
+		Test::Report(name + " influence iterations saved", numTotal ? 100.0 * (1.0 - static_cast<double>(numIterations) /
+			(MAX_INFLUENCES * numTotal)) : 0.0, "%");
+	});
+}
+
+// The streams as uploaded index the same vertices as the file, with the influences sorted
+// heaviest first and no weight lost to the reordering
+TEST_CASE(UploadStreams)
+{
+	Test::ForEachMesh([](const string&, SDKMesh &mesh)
+	{
+		auto numMismatches = 0u;
+		for (auto m = 0u; m < mesh.GetNumMeshes(); ++m)
+		{
+			const auto vb = mesh.GetMesh(m)->VertexBuffers[0];
+			const auto ib = mesh.GetMesh(m)->IndexBuffer;
+			const auto stride = mesh.GetVertexStride(m, 0);
+			const auto numIndices = static_cast<uint32_t>(mesh.GetNumIndices(m));
+			const auto is32Bit = mesh.GetIndexType(m) == IT_32BIT;
+			vector<uint8_t> vertices(static_cast<size_t>(stride * mesh.GetNumVertices(m, 0)));
+			vector<uint8_t> indices(static_cast<size_t>(numIndices * (is32Bit ? 4 : 2)));
+			mesh.WriteVerticesAt(vb, vertices.data());
+			mesh.WriteIndicesAt(ib, indices.data());
+
+			const auto getIndex = [is32Bit](const uint8_t *pIndices, uint32_t i) -> uint32_t
+			{
+				return is32Bit ? reinterpret_cast<const uint32_t*>(pIndices)[i] : reinterpret_cast<const uint16_t*>(pIndices)[i];
+			};
+
+			const auto pRawVertices = mesh.GetRawVerticesAt(vb);
+			const auto pRawIndices = mesh.GetRawIndicesAt(ib);
+			for (auto i = 0u; i < numIndices; ++i)
+			{
+				const auto pVertex = &vertices[stride * getIndex(indices.data(), i)];
+				const auto pRawVertex = &pRawVertices[stride * getIndex(pRawIndices, i)];
+				numMismatches += memcmp(pVertex, pRawVertex, sizeof(XMFLOAT3)) ? 1 : 0;
+				if (stride != sizeof(CPUSkinning::InputVertex)) continue;
+
+				const auto weights = reinterpret_cast<const CPUSkinning::InputVertex*>(pVertex)->Weights;
+				const auto rawWeights = reinterpret_cast<const CPUSkinning::InputVertex*>(pRawVertex)->Weights;
+				auto sum = 0u, rawSum = 0u;
+				for (auto j = 0u; j < 4; ++j)
+				{
+					sum += (weights >> (8 * j)) & 0xff;
+					rawSum += (rawWeights >> (8 * j)) & 0xff;
+					if (j > 0) numMismatches += ((weights >> (8 * j)) & 0xff) > ((weights >> (8 * j - 8)) & 0xff) ? 1 : 0;
+				}
+				numMismatches += sum == rawSum ? 0 : 1;
+			}
+		}
+
+		CHECK(numMismatches == 0);
+	});
+}
+
+// The skinned positions stay in the animated bounds, with the margin of the quantization box
+// for the poses between the sampled keys; the box is reported against the bind-pose heuristic
+TEST_CASE(AnimatedBounds)
+{
+	Test::ForEachMesh([](const string &name, SDKMesh &mesh)
+	{
+		mesh.ComputeAnimatedBounds();
+		XMFLOAT3 center, extents;
+		CHECK(mesh.GetAnimatedBounds(center, extents));
+
+		uint32_t numKeys;
+		float frameTime;
+		CHECK(mesh.GetAnimationProperties(&numKeys, &frameTime));
+
+		const auto numBones = mesh.GetNumPaletteBones();
+		vector<XMFLOAT4X3> palette(numBones);
+		vector<CPUSkinning::OutputVertex> skinned;
+		AnimationPose pose;
+		mesh.InitPose(pose);
+
+		// Largest distance out of the bounds over the half extents, sampled at quarter keys
+		auto overflow = 0.0f;
+		for (auto k = 0u; k < 4 * numKeys; ++k)
+		{
+			mesh.TransformMesh(pose, XMMatrixIdentity(), 0.25 * frameTime * k);
+			for (auto i = 0u; i < numBones; ++i)
+			{
+				const auto bone = BoneTransform::FromMatrix(XMLoadFloat4x4(&pose.TransformedFrameMatrices[mesh.GetPaletteFrame(i)]));
+				XMStoreFloat4x3(&palette[i], XMMatrixTranspose(bone.ToDualQuat()));
+			}
+
+			for (auto m = 0u; m < mesh.GetNumMeshes(); ++m)
+			{
+				if (mesh.GetNumInfluences(m) == 0 || mesh.GetVertexStride(m, 0) != sizeof(CPUSkinning::InputVertex)) continue;
+
+				// As uploaded, with the bone indices of the palette
+				const auto numVertices = static_cast<uint32_t>(mesh.GetNumVertices(m, 0));
+				vector<CPUSkinning::InputVertex> vertices(numVertices);
+				mesh.WriteVerticesAt(mesh.GetMesh(m)->VertexBuffers[0], reinterpret_cast<uint8_t*>(vertices.data()));
+				skinned.resize(numVertices);
+				const CPUSkinning::Batch batch =
+				{
+					skinned.data(), vertices.data(), numVertices,
+					&palette[mesh.GetFirstPaletteBone(m)], SKINNING_DQS4, 4
+				};
+				CPUSkinning::SkinReference(batch);
+
+				for (const auto &vertex : skinned)
+				{
+					const auto distance = XMVectorAbs(XMLoadFloat3(&vertex.Pos) - XMLoadFloat3(&center)) - XMLoadFloat3(&extents);
+					overflow = (max)(XMVectorGetX(XMVector3Length(XMVectorMax(distance, XMVectorZero()))) /
+						XMVectorGetX(XMVector3Length(XMLoadFloat3(&extents))), overflow);
+				}
+			}
+		}
+
+		// Within the margin of Character::Init()
+		CHECK(overflow < 0.125f);
+
+		auto bMin = XMVectorReplicate(FLT_MAX);
+		auto bMax = XMVectorReplicate(-FLT_MAX);
+		for (auto m = 0u; m < mesh.GetNumMeshes(); ++m)
+		{
+			bMin = XMVectorMin(mesh.GetMeshBBoxCenter(m) - mesh.GetMeshBBoxExtents(m), bMin);
+			bMax = XMVectorMax(mesh.GetMeshBBoxCenter(m) + mesh.GetMeshBBoxExtents(m), bMax);
+		}
+		const auto radius = XMVectorGetX(XMVector3Length(bMax - bMin)) * 0.5f;
+
+		Test::Report(name + " overflow of the animated bounds", overflow * 100.0f, "%");
+		Test::Report(name + " quantization box, bind-pose radius x 4", radius * 4.0f, "units");
+		Test::Report(name + " quantization box, animated bounds", (max)((max)(extents.x, extents.y), extents.z) * 2.25f, "units");
+	});
+}
@@ -0,0 +1,45 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "SyntheticAnimation.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+// CPU skinning throughput per mode: the scalar reference, the SIMD path, and the SIMD path
+// split across the job system
+BENCHMARK(CPUSkinningThroughput)
+{
+	static const pair<SkinningMode, const char*> modes[] =
+	{
+		{ SKINNING_DQS4, "DQS4" },
+		{ SKINNING_LBS4, "LBS4" },
+		{ SKINNING_LBS2, "LBS2" },
+		{ SKINNING_RIGID, "rigid" }
+	};
+
+	const auto numBones = 256u;
+	const auto numVertices = 65536u;
+	const auto skeleton = Test::CreateSyntheticSkeleton(numBones, true);
+	const auto vertices = Test::CreateSyntheticVertices(numVertices, numBones, 4);
+	vector<CPUSkinning::OutputVertex> output(numVertices);
+
+	JobSystem jobSystem;
+	for (const auto &mode : modes)
+	{
+		const auto palette = Test::CreateSyntheticPalette(skeleton, mode.first);
+		const CPUSkinning::Batch batch = { output.data(), vertices.data(), numVertices, palette.data(), mode.first, 4 };
+
+		const auto referenceTime = Test::Measure([&]() { CPUSkinning::SkinReference(batch); }, 10);
+		const auto simdTime = Test::Measure([&]() { CPUSkinning::Skin(batch); }, 10);
+		const auto parallelTime = Test::Measure([&]() { CPUSkinning::Skin(&batch, 1, &jobSystem); }, 10);
+
+		const auto name = string(mode.second) + " ";
+		Test::Report(name + "reference", numVertices * 1000.0 / referenceTime, "Mvertices/s");
+		Test::Report(name + "SIMD", numVertices * 1000.0 / simdTime, "Mvertices/s");
+		Test::Report(name + "parallel", numVertices * 1000.0 / parallelTime, "Mvertices/s");
+	}
+	Test::Report("Job system workers", jobSystem.GetNumWorkers() + 1.0, "threads");
+}
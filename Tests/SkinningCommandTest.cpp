@@ -0,0 +1,391 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include "Advanced/XUSGMeshLoader.h"
+#include "Advanced/XUSGSkinningBatcher.h"
+#include "SyntheticMesh.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+//--------------------------------------------------------------------------------------
+// Records the commands of the characters in place of a D3D12 command list; nothing
+// reaches the device, so the list is never opened, closed or executed.
+//--------------------------------------------------------------------------------------
+class RecordingCommandList :
+	public CommandList
+{
+public:
+	enum Command : uint8_t
+	{
+		DISPATCH,
+		DRAW,
+		DESCRIPTOR_TABLE,
+		ROOT_SRV,
+		VERTEX_BUFFERS,
+		OTHER
+	};
+
+	struct Record
+	{
+		Command		Type;
+		uint32_t	Index;		// Root parameter of the binds
+		uint64_t	Location;	// GPU address of the root SRVs and the vertex buffers
+	};
+
+	uint32_t Count(Command type) const
+	{
+		auto count = 0u;
+		for (const auto &record : m_records) count += record.Type == type ? 1 : 0;
+
+		return count;
+	}
+
+	const vector<Record> &GetRecords() const { return m_records; }
+	void Clear() { m_records.clear(); }
+
+	virtual void DrawIndexed(uint32_t, uint32_t, uint32_t, int32_t, uint32_t) const { record(DRAW); }
+	virtual void Dispatch(uint32_t, uint32_t, uint32_t) const { record(DISPATCH); }
+	virtual void IASetPrimitiveTopology(PrimitiveTopology) const { record(OTHER); }
+	virtual void SetPipelineState(const Pipeline&) const { record(OTHER); }
+	virtual void Barrier(uint32_t, const ResourceBarrier*) const { record(OTHER); }
+	virtual void SetDescriptorPools(uint32_t, const DescriptorPool*) const { record(OTHER); }
+	virtual void SetComputePipelineLayout(const PipelineLayout&) const { record(OTHER); }
+	virtual void SetGraphicsPipelineLayout(const PipelineLayout&) const { record(OTHER); }
+	virtual void SetComputeDescriptorTable(uint32_t index, const DescriptorTable&) const { record(DESCRIPTOR_TABLE, index); }
+	virtual void SetGraphicsDescriptorTable(uint32_t index, const DescriptorTable&) const { record(DESCRIPTOR_TABLE, index); }
+	virtual void SetCompute32BitConstants(uint32_t index, uint32_t, const void*, uint32_t) const { record(OTHER, index); }
+	virtual void SetGraphics32BitConstants(uint32_t index, uint32_t, const void*, uint32_t) const { record(OTHER, index); }
+	virtual void SetGraphicsRootConstantBufferView(uint32_t index, const Resource&, int) const { record(OTHER, index); }
+	virtual void SetComputeRootShaderResourceView(uint32_t index, const Resource &resource, int offset) const
+	{
+		record(ROOT_SRV, index, resource->GetGPUVirtualAddress() + offset);
+	}
+	virtual void SetGraphicsRootShaderResourceView(uint32_t index, const Resource &resource, int offset) const
+	{
+		record(ROOT_SRV, index, resource->GetGPUVirtualAddress() + offset);
+	}
+	virtual void IASetIndexBuffer(const IndexBufferView&) const { record(OTHER); }
+	virtual void IASetVertexBuffers(uint32_t, uint32_t numViews, const VertexBufferView *pViews) const
+	{
+		record(VERTEX_BUFFERS, 0, numViews > 0 && pViews ? pViews->BufferLocation : 0);
+	}
+
+protected:
+	void record(Command type, uint32_t index = 0, uint64_t location = 0) const
+	{
+		m_records.push_back({ type, index, location });
+	}
+
+	mutable vector<Record> m_records;
+};
+
+//--------------------------------------------------------------------------------------
+// The shaders and caches of the characters on a WARP device, and a synthetic character
+// mesh loaded through the mesh loader
+//--------------------------------------------------------------------------------------
+class SkinningScene
+{
+public:
+	SkinningScene() : m_numBones(64) {}
+	virtual ~SkinningScene()
+	{
+		// The uploads of the mesh complete before the scene is released
+		if (m_uploadManager) m_uploadManager->GetFence()->SetEventOnCompletion(m_uploadManager->GetFenceValue(), nullptr);
+		if (!m_meshFileName.empty()) Test::DeleteSyntheticMesh(m_meshFileName);
+	}
+
+	bool Init(const char *testName)
+	{
+		com_ptr<IDXGIFactory4> factory;
+		com_ptr<IDXGIAdapter> warpAdapter;
+		if (FAILED(CreateDXGIFactory2(0, IID_PPV_ARGS(&factory))) ||
+			FAILED(factory->EnumWarpAdapter(IID_PPV_ARGS(&warpAdapter))) ||
+			FAILED(D3D12CreateDevice(warpAdapter.get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&m_device))))
+		{
+			Test::Skip(testName, "no D3D12 WARP device");
+			return false;
+		}
+
+		static const struct
+		{
+			Shader::Stage	Stage;
+			uint32_t		Index;
+			const wchar_t	*FileName;
+		} shaders[] =
+		{
+			{ Shader::Stage::VS, VS_BASE_PASS, L"VSBasePass.cso" },
+			{ Shader::Stage::VS, VS_BASE_PASS_OCT, L"VSBasePassOct.cso" },
+			{ Shader::Stage::VS, VS_BASE_PASS_OCT_QUANTIZED, L"VSBasePassOctQuant.cso" },
+			{ Shader::Stage::VS, VS_BASE_PASS_SKINNING, L"VSBasePassSkinning.cso" },
+			{ Shader::Stage::VS, VS_BASE_PASS_SKINNING_COMPACT, L"VSBasePassSkinningCompact.cso" },
+			{ Shader::Stage::PS, PS_BASE_PASS, L"PSBasePass.cso" },
+			{ Shader::Stage::PS, PS_ALPHA_TEST, L"PSAlphaTest.cso" },
+			{ Shader::Stage::CS, CS_SKINNING, L"CSSkinning.cso" },
+			{ Shader::Stage::CS, CS_SKINNING_BATCH, L"CSSkinningBatch.cso" },
+			{ Shader::Stage::CS, CS_SKINNING_COMPACT, L"CSSkinningCompact.cso" },
+			{ Shader::Stage::CS, CS_SKINNING_BATCH_COMPACT, L"CSSkinningBatchCompact.cso" },
+			{ Shader::Stage::CS, CS_SKINNING_LBS4, L"CSSkinningLBS4.cso" },
+			{ Shader::Stage::CS, CS_SKINNING_LBS2, L"CSSkinningLBS2.cso" },
+			{ Shader::Stage::CS, CS_SKINNING_RIGID, L"CSSkinningRigid.cso" },
+			{ Shader::Stage::CS, CS_SKINNING_RIGID_COMPACT, L"CSSkinningRigidCompact.cso" }
+		};
+
+		m_shaderPool = make_shared<ShaderPool>();
+		for (const auto &shader : shaders)
+		{
+			if (!Test::FileExists(shader.FileName) || !m_shaderPool->CreateShader(shader.Stage, shader.Index, shader.FileName))
+			{
+				Test::Skip(testName, "shaders not found; build Character12 and run from the Bin folder");
+				return false;
+			}
+		}
+
+		m_graphicsPipelineCache = make_shared<Graphics::PipelineCache>(m_device);
+		m_computePipelineCache = make_shared<Compute::PipelineCache>(m_device);
+		m_pipelineLayoutCache = make_shared<PipelineLayoutCache>(m_device);
+		m_descriptorTableCache = make_shared<DescriptorTableCache>();
+		m_descriptorTableCache->SetDevice(m_device);
+		m_ringBuffer = make_shared<RingBuffer>();
+		m_inputLayout = Character::CreateInputLayout(*m_graphicsPipelineCache);
+
+		m_meshFileName = Test::WriteSyntheticMesh(L"SkinningCommands", m_numBones, 4096);
+		N_RETURN(!m_meshFileName.empty(), false);
+
+		m_uploadManager = make_shared<UploadManager>();
+		N_RETURN(m_uploadManager->Create(m_device, 32 << 20, L"TestUpload"), false);
+
+		JobSystem jobSystem(1);
+		MeshLoader meshLoader(m_device, &jobSystem, m_uploadManager, make_shared<TextureCache::element_type>(0));
+		m_mesh = meshLoader.LoadCharacterSDKMesh(m_meshFileName, m_meshFileName + L"_anim");
+		N_RETURN(m_mesh && meshLoader.Flush(), false);
+
+		return true;
+	}
+
+	unique_ptr<Character> CreateCharacter(const CommandList &commandList,
+		Character::BoneFormat boneFormat, bool isInlineSkinning = false) const
+	{
+		auto character = make_unique<Character>(m_device, commandList, L"Synthetic");
+		N_RETURN(character->Init(m_inputLayout, m_mesh, m_shaderPool,
+			m_graphicsPipelineCache, m_computePipelineCache,
+			m_pipelineLayoutCache, m_descriptorTableCache, m_ringBuffer,
+			nullptr, nullptr, nullptr, 0, Format(0), Format(0), boneFormat,
+			SKINNING_DQS4, Character::VERTEX_FORMAT_HALF, isInlineSkinning), nullptr);
+
+		return character;
+	}
+
+	bool InitBatcher(SkinningBatcher &batcher) const
+	{
+		return batcher.Init(m_shaderPool, m_computePipelineCache, m_pipelineLayoutCache,
+			m_descriptorTableCache, m_ringBuffer);
+	}
+
+	// Room for a single frame
+	bool CreateRingBuffer(uint32_t dynamicDataSize)
+	{
+		return m_ringBuffer->Create(m_device, dynamicDataSize, L"TestRing");
+	}
+
+	// Leaves no room in the ring buffer until the frames are reclaimed
+	void FillRingBuffer()
+	{
+		uint32_t offset;
+		while (m_ringBuffer->CanAllocate(256, 256)) m_ringBuffer->Allocate(256, 256, &offset);
+	}
+
+	// As if the GPU completed every frame recorded so far
+	void ReclaimRingBuffer(uint64_t fenceValue)
+	{
+		m_ringBuffer->EndFrame(fenceValue);
+		m_ringBuffer->Reclaim(fenceValue);
+	}
+
+	const Device &GetDevice() const { return m_device; }
+	const SDKMesh &GetMesh() const { return *m_mesh; }
+	const RingBuffer &GetRingBuffer() const { return *m_ringBuffer; }
+
+protected:
+	Device m_device;
+	InputLayout m_inputLayout;
+
+	shared_ptr<ShaderPool>					m_shaderPool;
+	shared_ptr<Graphics::PipelineCache>		m_graphicsPipelineCache;
+	shared_ptr<Compute::PipelineCache>		m_computePipelineCache;
+	shared_ptr<PipelineLayoutCache>			m_pipelineLayoutCache;
+	shared_ptr<DescriptorTableCache>		m_descriptorTableCache;
+	shared_ptr<RingBuffer>					m_ringBuffer;
+	shared_ptr<UploadManager>				m_uploadManager;
+	shared_ptr<SDKMesh>						m_mesh;
+
+	wstring m_meshFileName;
+	uint32_t m_numBones;
+};
+
+// The batcher skins every mesh of every character with 1 dispatch and 1 pair of descriptor
+// tables, where the characters on their own take 1 of each per mesh; its stats count the
+// commands recorded, also when it falls back to the characters on their own
+TEST_CASE(SkinningBatchCommands)
+{
+	SkinningScene scene;
+	if (!scene.Init("SkinningBatchCommands")) return;
+
+	const auto numCharacters = 16u;
+	RecordingCommandList commandList;
+	vector<unique_ptr<Character>> characters(numCharacters), batchedCharacters(numCharacters);
+	SkinningBatcher batcher(scene.GetDevice(), commandList, L"Crowd");
+
+	auto dynamicDataSize = 0u;
+	for (auto i = 0u; i < numCharacters; ++i)
+	{
+		characters[i] = scene.CreateCharacter(commandList, Character::BONE_FORMAT_COMPACT);
+		batchedCharacters[i] = scene.CreateCharacter(commandList, Character::BONE_FORMAT_COMPACT);
+		CHECK(characters[i] && batchedCharacters[i]);
+		if (!characters[i] || !batchedCharacters[i]) return;
+
+		batcher.Register(batchedCharacters[i].get());
+		dynamicDataSize += characters[i]->GetDynamicDataSize() + batchedCharacters[i]->GetDynamicDataSize();
+	}
+	CHECK(scene.InitBatcher(batcher));
+	CHECK(scene.CreateRingBuffer(dynamicDataSize + batcher.GetDynamicDataSize()));
+
+	// Every palette is new in the first frame, so every mesh is skinned
+	const auto viewProj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.0f, 1.0f, 1000.0f);
+	batcher.Update();
+	for (auto i = 0u; i < numCharacters; ++i)
+	{
+		characters[i]->Update(0, 0.5, viewProj, nullptr, nullptr, nullptr, 0, false);
+		batchedCharacters[i]->Update(0, 0.5, viewProj, nullptr, nullptr, nullptr, 0, false);
+	}
+
+	const auto numMeshes = scene.GetMesh().GetNumMeshes();
+	for (auto i = 0u; i < numCharacters; ++i) characters[i]->Skinning(i == 0);
+	const auto numDispatches = commandList.Count(RecordingCommandList::DISPATCH);
+	const auto numDescriptorTables = commandList.Count(RecordingCommandList::DESCRIPTOR_TABLE);
+	CHECK(numDispatches == numCharacters * numMeshes);
+	CHECK(numDescriptorTables == 2 * numCharacters * numMeshes);
+
+	commandList.Clear();
+	batcher.Skinning(true);
+	const auto &stats = batcher.GetStats();
+	CHECK(commandList.Count(RecordingCommandList::DISPATCH) == 1);
+	CHECK(commandList.Count(RecordingCommandList::DESCRIPTOR_TABLE) == 2);
+	CHECK(stats.NumDispatches == commandList.Count(RecordingCommandList::DISPATCH));
+	CHECK(stats.NumDescriptorTables == commandList.Count(RecordingCommandList::DESCRIPTOR_TABLE));
+	CHECK(stats.NumSkipped == 0);
+
+	Test::Report("SkinningBatchCommands/Dispatches/PerCharacter", numDispatches, "dispatches");
+	Test::Report("SkinningBatchCommands/Dispatches/Batched", stats.NumDispatches, "dispatches");
+	Test::Report("SkinningBatchCommands/DescriptorTables/PerCharacter", numDescriptorTables, "binds");
+	Test::Report("SkinningBatchCommands/DescriptorTables/Batched", stats.NumDescriptorTables, "binds");
+
+	// Without room for the shared palette, the characters skin one by one, and the stats
+	// count the commands they record
+	scene.FillRingBuffer();
+	batcher.Update();
+	scene.ReclaimRingBuffer(1);
+	for (auto i = 0u; i < numCharacters; ++i)
+		batchedCharacters[i]->Update(0, 1.0, viewProj, nullptr, nullptr, nullptr, 0, false);
+
+	commandList.Clear();
+	batcher.Skinning(true);
+	CHECK(commandList.Count(RecordingCommandList::DISPATCH) > 1);
+	CHECK(stats.NumDispatches == commandList.Count(RecordingCommandList::DISPATCH));
+	CHECK(stats.NumDescriptorTables == commandList.Count(RecordingCommandList::DESCRIPTOR_TABLE));
+	CHECK(stats.NumDispatches + stats.NumSkipped == numCharacters * numMeshes);
+}
+
+// The inline skinning records no compute pass; each draw reads the source vertex buffer of its
+// mesh, with the bone palette of the mesh bound from the ring buffer after the vertex buffer
+TEST_CASE(InlineSkinningCommands)
+{
+	SkinningScene scene;
+	if (!scene.Init("InlineSkinningCommands")) return;
+
+	RecordingCommandList commandList;
+	const auto character = scene.CreateCharacter(commandList, Character::BONE_FORMAT_DQ_SCALE, true);
+	const auto computeCharacter = scene.CreateCharacter(commandList, Character::BONE_FORMAT_DQ_SCALE);
+	CHECK(character && computeCharacter);
+	if (!character || !computeCharacter) return;
+	CHECK(character->IsInlineSkinning());
+	CHECK(scene.CreateRingBuffer(character->GetDynamicDataSize() + computeCharacter->GetDynamicDataSize()));
+
+	const auto viewProj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.0f, 1.0f, 1000.0f);
+	character->Update(0, 0.5, viewProj, nullptr, nullptr, nullptr, 0, false);
+	computeCharacter->Update(0, 0.5, viewProj, nullptr, nullptr, nullptr, 0, false);
+
+	const auto &mesh = scene.GetMesh();
+	const auto numMeshes = mesh.GetNumMeshes();
+	vector<uint64_t> sourceVBs(numMeshes);
+	for (auto m = 0u; m < numMeshes; ++m) sourceVBs[m] = mesh.GetVertexBufferView(m, 0).BufferLocation;
+	const auto isSourceVB = [&sourceVBs](uint64_t location)
+	{
+		return find(sourceVBs.cbegin(), sourceVBs.cend(), location) != sourceVBs.cend();
+	};
+
+	const auto ringBegin = scene.GetRingBuffer().GetResource()->GetGPUVirtualAddress();
+	const auto ringEnd = ringBegin + scene.GetRingBuffer().GetByteWidth();
+
+	// Skinning() only uploads the pose
+	character->Skinning(true);
+	CHECK(commandList.GetRecords().empty());
+
+	character->RenderTransformed(SUBSET_FULL, Character::CBV_MATRICES, Character::BASE_PASS);
+	CHECK(commandList.Count(RecordingCommandList::DISPATCH) == 0);
+	CHECK(commandList.Count(RecordingCommandList::DRAW) > 0);
+
+	auto numDraws = 0u;
+	auto numMismatches = 0u;
+	uint64_t vb = 0;
+	auto isBonesBound = false;
+	for (const auto &record : commandList.GetRecords())
+	{
+		switch (record.Type)
+		{
+		case RecordingCommandList::VERTEX_BUFFERS:
+			vb = record.Location;
+			isBonesBound = false;
+			break;
+		case RecordingCommandList::ROOT_SRV:
+			isBonesBound = isBonesBound || (record.Location >= ringBegin && record.Location < ringEnd);
+			break;
+		case RecordingCommandList::DRAW:
+			numMismatches += isSourceVB(vb) && isBonesBound ? 0 : 1;
+			++numDraws;
+			break;
+		default:
+			break;
+		}
+	}
+	CHECK(numDraws == commandList.Count(RecordingCommandList::DRAW));
+	CHECK(numMismatches == 0);
+
+	// The compute skinning draws from the skinned vertex buffers instead
+	commandList.Clear();
+	computeCharacter->Skinning(true);
+	CHECK(commandList.Count(RecordingCommandList::DISPATCH) == numMeshes);
+	computeCharacter->RenderTransformed(SUBSET_FULL, Character::CBV_MATRICES, Character::BASE_PASS);
+
+	auto numSourceVBs = 0u;
+	for (const auto &record : commandList.GetRecords())
+		if (record.Type == RecordingCommandList::VERTEX_BUFFERS && isSourceVB(record.Location)) ++numSourceVBs;
+	CHECK(numSourceVBs == 0);
+
+	// Without room in the ring buffer for the frame, nothing reads the ring space of earlier frames
+	scene.FillRingBuffer();
+	character->Update(0, 1.0, viewProj, nullptr, nullptr, nullptr, 0, false);
+	computeCharacter->Update(0, 1.0, viewProj, nullptr, nullptr, nullptr, 0, false);
+
+	commandList.Clear();
+	character->RenderTransformed(SUBSET_FULL, Character::CBV_MATRICES, Character::BASE_PASS);
+	computeCharacter->Skinning(true);
+	computeCharacter->RenderTransformed(SUBSET_FULL, Character::CBV_MATRICES, Character::BASE_PASS);
+	CHECK(commandList.Count(RecordingCommandList::DISPATCH) == 0);
+	CHECK(commandList.Count(RecordingCommandList::DRAW) == 0);
+	CHECK(!character->IsPoseResident(character->GetUpdateStamp()));
+	CHECK(!computeCharacter->IsPoseResident(computeCharacter->GetUpdateStamp()));
+}
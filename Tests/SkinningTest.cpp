@@ -0,0 +1,198 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include <DirectXPackedVector.h>
+#include "SyntheticAnimation.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+using namespace XUSG;
+
+static float maxDifference(const XMUINT2 &a, const XMUINT2 &b)
+{
+	const auto difference = [](uint32_t u, uint32_t v)
+	{
+		return fabs(XMConvertHalfToFloat(static_cast<HALF>(u)) - XMConvertHalfToFloat(static_cast<HALF>(v)));
+	};
+
+	return (max)((max)(difference(a.x & 0xffff, b.x & 0xffff), difference(a.x >> 16, b.x >> 16)),
+		difference(a.y, b.y));
+}
+
+// The SIMD path and the job system match the scalar reference for every mode and influence
+// count, to rounding: the kernels may contract into FMAs differently
+TEST_CASE(CPUSkinningParity)
+{
+	static const SkinningMode modes[] = { SKINNING_DQS4, SKINNING_LBS4, SKINNING_LBS2, SKINNING_RIGID };
+
+	const auto numBones = 64u;
+	const auto numVertices = 1004u;	// Not a multiple of the SIMD width
+	const auto skeleton = Test::CreateSyntheticSkeleton(numBones, false);
+
+	JobSystem jobSystem(3);
+	for (const auto mode : modes)
+	{
+		const auto palette = Test::CreateSyntheticPalette(skeleton, mode);
+		for (uint8_t numInfluences = 1; numInfluences <= 4; ++numInfluences)
+		{
+			const auto vertices = Test::CreateSyntheticVertices(numVertices, numBones, numInfluences);
+			vector<CPUSkinning::OutputVertex> reference(numVertices), skinned(numVertices), parallel(numVertices);
+
+			CPUSkinning::Batch batch = { reference.data(), vertices.data(), numVertices, palette.data(), mode, numInfluences };
+			CPUSkinning::SkinReference(batch);
+			batch.pOutput = skinned.data();
+			CPUSkinning::Skin(batch);
+
+			// Split in 2 meshes across the workers, at a multiple of the SIMD width, so that
+			// the same vertices take the scalar remainder path
+			const auto numFirst = 696u;
+			const CPUSkinning::Batch batches[] =
+			{
+				{ parallel.data(), vertices.data(), numFirst, palette.data(), mode, numInfluences },
+				{ &parallel[numFirst], &vertices[numFirst], numVertices - numFirst, palette.data(), mode, numInfluences }
+			};
+			CPUSkinning::Skin(batches, 2, &jobSystem);
+
+			auto posError = 0.0f;
+			auto vectorError = 0.0f;
+			auto numMismatches = 0u;
+			for (auto i = 0u; i < numVertices; ++i)
+			{
+				const auto &r = reference[i];
+				const auto &s = skinned[i];
+				posError = (max)(XMVectorGetX(XMVector3Length(XMLoadFloat3(&r.Pos) - XMLoadFloat3(&s.Pos))), posError);
+				vectorError = (max)((max)((max)(maxDifference(r.Norm, s.Norm), maxDifference(r.Tan, s.Tan)),
+					maxDifference(r.BiNorm, s.BiNorm)), vectorError);
+				numMismatches += r.Tex != s.Tex ? 1 : 0;
+				numMismatches += memcmp(&s, &parallel[i], sizeof(s)) ? 1 : 0;
+			}
+
+			CHECK(posError < 1e-4f);
+			CHECK(vectorError < 4e-3f);
+			CHECK(numMismatches == 0);
+		}
+	}
+}
+
+// The compact bones decode to the reference palette, and skin the same vertices; the palette
+// traffic of both formats is reported per palette
+TEST_CASE(CompactBoneParity)
+{
+	const auto numBones = 256u;
+	const auto numVertices = 1004u;
+	const auto vertices = Test::CreateSyntheticVertices(numVertices, numBones, 4);
+
+	// A rigid rig, one with a few scaled leaf bones, and one scaled throughout
+	auto rigid = Test::CreateSyntheticSkeleton(numBones, false);
+	auto scaledLeaves = rigid;
+	const auto scaled = rigid;
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		rigid[i].Scaling = XMFLOAT3(1.0f, 1.0f, 1.0f);
+		if (i < numBones / 2 || i % 16) scaledLeaves[i].Scaling = rigid[i].Scaling;
+	}
+
+	const struct
+	{
+		const char *Name;
+		const vector<BoneTransform> &Skeleton;
+	} skeletons[] =
+	{
+		{ "Rigid", rigid },
+		{ "ScaledLeaves", scaledLeaves },
+		{ "Scaled", scaled }
+	};
+
+	for (const auto &skeleton : skeletons)
+	{
+		const auto palette = Test::CreateSyntheticPalette(skeleton.Skeleton, SKINNING_DQS4);
+
+		vector<CPUSkinning::CompactBone> compactBones(numBones);
+		vector<XMFLOAT3> scales(numBones);
+		vector<XMFLOAT4X3> decoded(numBones);
+		const auto numScaledBones = CPUSkinning::EncodeCompact(compactBones.data(), scales.data(), palette.data(), numBones);
+		CPUSkinning::DecodeCompact(decoded.data(), compactBones.data(), scales.data(), numBones);
+
+		// As Character::GetPaletteError()
+		auto paletteError = 0.0f;
+		for (auto i = 0u; i < numBones; ++i)
+			for (auto r = 0u; r < 4; ++r)
+				for (auto c = 0u; c < 3; ++c)
+					paletteError = (max)(fabs(decoded[i].m[r][c] - palette[i].m[r][c]), paletteError);
+
+		vector<CPUSkinning::OutputVertex> reference(numVertices), skinned(numVertices);
+		CPUSkinning::Batch batch = { reference.data(), vertices.data(), numVertices, palette.data(), SKINNING_DQS4, 4 };
+		CPUSkinning::SkinReference(batch);
+		batch.pOutput = skinned.data();
+		batch.pPalette = decoded.data();
+		CPUSkinning::SkinReference(batch);
+
+		auto posError = 0.0f;
+		for (auto i = 0u; i < numVertices; ++i)
+			posError = (max)(XMVectorGetX(XMVector3Length(XMLoadFloat3(&reference[i].Pos) -
+				XMLoadFloat3(&skinned[i].Pos))), posError);
+
+		CHECK(paletteError < 1e-5f);
+		CHECK(posError < 1e-4f);
+
+		// Palette bytes written and fetched, as Character::PaletteStats
+		const auto referenceSize = static_cast<uint32_t>(sizeof(XMFLOAT4X3)) * numBones;
+		const auto uploadSize = static_cast<uint32_t>(sizeof(CPUSkinning::CompactBone)) * numBones +
+			static_cast<uint32_t>(sizeof(XMFLOAT3)) * numScaledBones;
+		CHECK(sizeof(CPUSkinning::CompactBone) < sizeof(XMFLOAT4X3));
+		CHECK(uploadSize < referenceSize + sizeof(XMFLOAT3) * numBones);
+
+		const auto name = string("CompactBoneParity/") + skeleton.Name;
+		Test::Report(name + "/PaletteError", paletteError * 1e6, "x 1e-6");
+		Test::Report(name + "/ScaledBones", numScaledBones, "bones");
+		Test::Report(name + "/UploadSize/DQScale", referenceSize, "bytes");
+		Test::Report(name + "/UploadSize/Compact", uploadSize, "bytes");
+		Test::Report(name + "/BytesPerInfluence/DQScale", sizeof(XMFLOAT4X3), "bytes");
+		Test::Report(name + "/BytesPerInfluence/Compact", sizeof(CPUSkinning::CompactBone), "bytes");
+	}
+}
+
+static XMVECTOR loadRGB16f(const XMUINT2 &u)
+{
+	return XMVectorSet(XMConvertHalfToFloat(static_cast<HALF>(u.x & 0xffff)),
+		XMConvertHalfToFloat(static_cast<HALF>(u.x >> 16)), XMConvertHalfToFloat(static_cast<HALF>(u.y & 0xffff)), 0.0f);
+}
+
+// The linear blends transform the normals by the inverse transpose of the blended matrix, so
+// the normals keep their angles to the tangent frame under non-uniform scaling: n' . t = n . t
+TEST_CASE(LBSNormals)
+{
+	const auto numBones = 64u;
+	const auto numVertices = 1004u;
+	const auto skeleton = Test::CreateSyntheticSkeleton(numBones, false);
+
+	for (const auto mode : { SKINNING_LBS4, SKINNING_LBS2 })
+	{
+		const auto palette = Test::CreateSyntheticPalette(skeleton, mode);
+		for (uint8_t numInfluences = 1; numInfluences <= 4; ++numInfluences)
+		{
+			const auto vertices = Test::CreateSyntheticVertices(numVertices, numBones, numInfluences);
+			vector<CPUSkinning::OutputVertex> skinned(numVertices);
+			const CPUSkinning::Batch batch = { skinned.data(), vertices.data(), numVertices, palette.data(), mode, numInfluences };
+			CPUSkinning::SkinReference(batch);
+
+			auto error = 0.0f;
+			for (auto i = 0u; i < numVertices; ++i)
+			{
+				const auto norm = loadRGB16f(skinned[i].Norm);
+				const auto tan = loadRGB16f(skinned[i].Tan);
+				const auto biNorm = loadRGB16f(skinned[i].BiNorm);
+				const auto dotTan = XMVectorGetX(XMVector3Dot(loadRGB16f(vertices[i].Norm), loadRGB16f(vertices[i].Tan)));
+				const auto dotBiNorm = XMVectorGetX(XMVector3Dot(loadRGB16f(vertices[i].Norm), loadRGB16f(vertices[i].BiNorm)));
+				error = (max)(fabs(XMVectorGetX(XMVector3Dot(norm, tan)) - dotTan) /
+					XMVectorGetX(XMVector3Length(norm) * XMVector3Length(tan)), error);
+				error = (max)(fabs(XMVectorGetX(XMVector3Dot(norm, biNorm)) - dotBiNorm) /
+					XMVectorGetX(XMVector3Length(norm) * XMVector3Length(biNorm)), error);
+			}
+
+			CHECK(error < 1e-2f);
+		}
+	}
+}
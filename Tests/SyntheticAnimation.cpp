@@ -0,0 +1,173 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <DirectXPackedVector.h>
+#include "SyntheticAnimation.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+using namespace XUSG;
+
+// Bones form a binary tree in breadth-first order, branching off to both sides
+void Test::GetSyntheticBindPose(uint32_t bone, XMFLOAT3 &translation, float &angle)
+{
+	const auto side = bone == 0 ? 0.0f : (bone % 2 ? -1.0f : 1.0f);
+	translation = XMFLOAT3(0.05f * side, bone == 0 ? 0.0f : 0.1f, 0.0f);
+	angle = 0.1f * side;
+}
+
+vector<BoneTransform> Test::CreateSyntheticSkeleton(uint32_t numBones, bool isUniformScaling)
+{
+	mt19937 generator(numBones);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	vector<BoneTransform> skeleton(numBones);
+	for (auto &bone : skeleton)
+	{
+		const auto axis = XMVectorSet(unit(generator), unit(generator), unit(generator) + 2.0f, 0.0f);
+		XMStoreFloat4(&bone.Rotation, XMQuaternionRotationAxis(XMVector3Normalize(axis), XM_PI * unit(generator)));
+		bone.Translation = XMFLOAT3(unit(generator), unit(generator), unit(generator));
+
+		const auto scale = 1.0f + 0.25f * unit(generator);
+		bone.Scaling = isUniformScaling ? XMFLOAT3(scale, scale, scale) :
+			XMFLOAT3(scale, 1.0f + 0.25f * unit(generator), 1.0f + 0.25f * unit(generator));
+	}
+
+	return skeleton;
+}
+
+vector<XMFLOAT4X3> Test::CreateSyntheticPalette(const vector<BoneTransform> &bones, SkinningMode mode)
+{
+	const auto isLinear = mode == SKINNING_LBS4 || mode == SKINNING_LBS2;
+
+	vector<XMFLOAT4X3> palette(bones.size());
+	for (size_t i = 0; i < bones.size(); ++i)
+		XMStoreFloat4x3(&palette[i], isLinear ? bones[i].ToMatrix() : XMMatrixTranspose(bones[i].ToDualQuat()));
+
+	return palette;
+}
+
+vector<CPUSkinning::InputVertex> Test::CreateSyntheticVertices(uint32_t numVertices,
+	uint32_t numBones, uint8_t numInfluences)
+{
+	mt19937 generator(numVertices + numInfluences);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	uniform_int_distribution<uint32_t> bone(0, (min)(numBones, 256u) - 1);
+
+	const auto encodeRGB16f = [&]()
+	{
+		XMFLOAT3 v;
+		XMStoreFloat3(&v, XMVector3Normalize(XMVectorSet(unit(generator), unit(generator), unit(generator) + 2.0f, 0.0f)));
+
+		return XMUINT2(XMConvertFloatToHalf(v.x) | (XMConvertFloatToHalf(v.y) << 16), XMConvertFloatToHalf(v.z));
+	};
+
+	vector<CPUSkinning::InputVertex> vertices(numVertices);
+	for (auto &vertex : vertices)
+	{
+		vertex.Pos = XMFLOAT3(unit(generator), unit(generator), unit(generator));
+
+		// Weights in bytes summing up to 255, in decreasing order
+		uint32_t weights[4] = {};
+		auto remaining = 255u;
+		for (auto j = 0u; j < numInfluences; ++j)
+		{
+			weights[j] = j + 1 < numInfluences ? (remaining + 1) / 2 + static_cast<uint32_t>(8.0f * unit(generator)) : remaining;
+			weights[j] = (min)(weights[j], remaining);
+			remaining -= weights[j];
+		}
+		sort(weights, weights + 4, greater<uint32_t>());
+
+		vertex.Weights = 0;
+		vertex.Bones = 0;
+		for (auto j = 0u; j < 4; ++j)
+		{
+			vertex.Weights |= weights[j] << (8 * j);
+			vertex.Bones |= bone(generator) << (8 * j);
+		}
+
+		vertex.Norm = encodeRGB16f();
+		vertex.Tex = static_cast<uint32_t>(generator());
+		vertex.Tan = encodeRGB16f();
+		vertex.BiNorm = encodeRGB16f();
+	}
+
+	return vertices;
+}
+
+vector<uint8_t> Test::CreateSyntheticAnimation(uint32_t numBones, uint32_t numKeys, uint32_t animationFPS)
+{
+	numBones = (max)(numBones, 1u);
+	numKeys = (max)(numKeys, 2u);
+
+	// Layout: header, frame data, then the keys of each frame
+	const auto frameDataSize = sizeof(SDKAnimationFrameData) * numBones;
+	const auto keyDataSize = sizeof(SDKAnimationData) * numKeys;
+
+	vector<uint8_t> animation(sizeof(SDKAnimationFileHeader) + frameDataSize + keyDataSize * numBones);
+	auto &header = *reinterpret_cast<SDKAnimationFileHeader*>(animation.data());
+	header.Version = 101;	// SDKMESH_FILE_VERSION
+	header.IsBigEndian = 0;
+	header.FrameTransformType = FTT_RELATIVE;
+	header.NumFrames = numBones;
+	header.NumAnimationKeys = numKeys;
+	header.AnimationFPS = animationFPS;
+	header.AnimationDataSize = frameDataSize + keyDataSize * numBones;
+	header.AnimationDataOffset = sizeof(SDKAnimationFileHeader);
+
+	const auto pFrameData = reinterpret_cast<SDKAnimationFrameData*>(&animation[sizeof(SDKAnimationFileHeader)]);
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		auto &frameData = pFrameData[i];
+		snprintf(frameData.FrameName, sizeof(frameData.FrameName), "Bone%u", i);
+		frameData.DataOffset = frameDataSize + keyDataSize * i;
+
+		XMFLOAT3 translation;
+		float angle;
+		GetSyntheticBindPose(i, translation, angle);
+
+		// Key 0 is the reference pose
+		const auto pKeys = reinterpret_cast<SDKAnimationData*>(&animation[sizeof(SDKAnimationFileHeader) +
+			static_cast<size_t>(frameData.DataOffset)]);
+		for (auto k = 0u; k < numKeys; ++k)
+		{
+			const auto sway = k > 0 ? 0.3f * sinf(XM_2PI * (k - 1) / (numKeys - 1) + 0.1f * i) : 0.0f;
+			pKeys[k].Translation = translation;
+			XMStoreFloat4(&pKeys[k].Orientation, XMQuaternionRotationAxis(g_XMIdentityR2, angle + sway));
+			pKeys[k].Scaling = XMFLOAT3(1.0f, 1.0f, 1.0f);
+		}
+	}
+
+	return animation;
+}
+
+void Test::ForEachClip(const function<void(const string&, const wstring&)> &run,
+	initializer_list<uint32_t> numBones, uint32_t numKeys)
+{
+	static const wchar_t starsAnimation[] = L"Media/Bright/Stars.sdkmesh_anim";
+
+	if (FileExists(starsAnimation)) run("Stars", starsAnimation);
+	else Skip("Stars", "not found; run from the Bin folder");
+
+	for (const auto n : numBones)
+	{
+		const auto name = "Synthetic" + to_string(n) + "x" + to_string(numKeys);
+		const auto fileName = GetTempPath(wstring(name.cbegin(), name.cend()).c_str()) + L".sdkmesh_anim";
+
+		AnimationClip clip;
+		if (!clip.Create(CreateSyntheticAnimation(n, numKeys, 30)) || !clip.Save(fileName.c_str()))
+		{
+			Fail(__FILE__, __LINE__, "CreateSyntheticAnimation");
+			continue;
+		}
+
+		run(name, fileName);
+		RemoveFile(fileName);
+	}
+}
@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Advanced/XUSGAnimation.h"
+#include "Advanced/XUSGSkinning.h"
+#include "XUSGTest.h"
+
+namespace XUSG
+{
+	namespace Test
+	{
+		// Bind pose of a bone of the synthetic rigs: the bones form a binary tree in
+		// breadth-first order, branching off to both sides about Z
+		void GetSyntheticBindPose(uint32_t bone, DirectX::XMFLOAT3 &translation, float &angle);
+
+		// Random local transforms of a synthetic rig, whose bone i > 0 has the parent (i - 1) / 2,
+		// with uniform or non-uniform scales
+		std::vector<BoneTransform> CreateSyntheticSkeleton(uint32_t numBones, bool isUniformScaling);
+
+		// Bone palette of the skinning mode from the random skeleton transforms
+		std::vector<DirectX::XMFLOAT4X3> CreateSyntheticPalette(const std::vector<BoneTransform> &bones,
+			SkinningMode mode);
+
+		// Random vertices with numInfluences nonzero weights each, heaviest first
+		std::vector<CPUSkinning::InputVertex> CreateSyntheticVertices(uint32_t numVertices,
+			uint32_t numBones, uint8_t numInfluences);
+
+		// .sdkmesh_anim image swaying the bones of a synthetic rig about their bind pose
+		std::vector<uint8_t> CreateSyntheticAnimation(uint32_t numBones, uint32_t numKeys,
+			uint32_t animationFPS);
+
+		// Run on the Stars clip, if found, and on synthetic clips of each bone count, written
+		// into the temporary folder and deleted afterwards
+		void ForEachClip(const std::function<void(const std::string&, const std::wstring&)> &run,
+			std::initializer_list<uint32_t> numBones = { 256, 1024 }, uint32_t numKeys = 61);
+	}
+}
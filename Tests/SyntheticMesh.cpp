@@ -0,0 +1,280 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include "SyntheticMesh.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+using namespace XUSG;
+
+// Vertex element types and usages (D3DDECLTYPE, D3DDECLUSAGE)
+enum DeclType : uint8_t
+{
+	DECLTYPE_FLOAT3 = 2,
+	DECLTYPE_UBYTE4 = 5,
+	DECLTYPE_UBYTE4N = 8,
+	DECLTYPE_FLOAT16_2 = 15,
+	DECLTYPE_FLOAT16_4 = 16,
+	DECLTYPE_UNUSED = 17
+};
+
+enum DeclUsage : uint8_t
+{
+	DECLUSAGE_POSITION,
+	DECLUSAGE_BLENDWEIGHT,
+	DECLUSAGE_BLENDINDICES,
+	DECLUSAGE_NORMAL,
+	DECLUSAGE_PSIZE,
+	DECLUSAGE_TEXCOORD,
+	DECLUSAGE_TANGENT,
+	DECLUSAGE_BINORMAL
+};
+
+static const uint16_t DECL_END = 0xff;
+
+// The skinned vertex layout of the shipped meshes, CS_Input of CSSkinning.hlsl
+struct SkinnedVertex
+{
+	XMFLOAT3	Pos;
+	uint8_t		Weights[4];
+	uint8_t		Bones[4];
+	XMHALF4		Norm;
+	XMHALF2		Tex;
+	XMHALF4		Tan;
+	XMHALF4		BiNorm;
+};
+
+static_assert(sizeof(SkinnedVertex) == 48, "SkinnedVertex must match CS_Input");
+
+template<typename T>
+static uint64_t allocate(vector<uint8_t> &data, size_t count)
+{
+	const auto offset = (data.size() + 15) / 16 * 16;
+	data.resize(offset + sizeof(T) * count);
+
+	return offset;
+}
+
+template<typename T>
+static T *getView(vector<uint8_t> &data, uint64_t offset)
+{
+	return reinterpret_cast<T*>(&data[static_cast<size_t>(offset)]);
+}
+
+vector<uint8_t> Test::CreateSyntheticMesh(uint32_t numBones, uint32_t numTriangles)
+{
+	numBones = (max)(numBones, 1u);
+	const auto numMeshBones = (min)(numBones, 256u);
+	const auto numColumns = (max)(static_cast<uint32_t>(ceil(sqrt(numTriangles / 2.0))), 3u);
+	const auto numRows = (max)((numTriangles / 2 + numColumns - 1) / numColumns, 1u);
+	const auto numVertices = (numColumns + 1) * (numRows + 1);
+	const auto numIndices = 6 * numColumns * numRows;
+	const auto is32Bit = numVertices > UINT16_MAX + 1;
+	const auto indexSize = is32Bit ? sizeof(uint32_t) : sizeof(uint16_t);
+
+	// Lay out the non-buffer data, then the buffer data
+	vector<uint8_t> data;
+	const auto headerOffset = allocate<SDKMeshHeader>(data, 1);
+	const auto vbHeaderOffset = allocate<SDKMeshVertexBufferHeader>(data, 1);
+	const auto ibHeaderOffset = allocate<SDKMeshIndexBufferHeader>(data, 1);
+	const auto meshOffset = allocate<SDKMeshData>(data, 1);
+	const auto subsetOffset = allocate<SDKMeshSubset>(data, 1);
+	const auto frameOffset = allocate<SDKMeshFrame>(data, numBones);
+	const auto materialOffset = allocate<SDKMeshMaterial>(data, 1);
+	const auto subsetIndexOffset = allocate<uint32_t>(data, 1);
+	const auto influenceOffset = allocate<uint32_t>(data, numMeshBones);
+	const auto vertexOffset = allocate<SkinnedVertex>(data, numVertices);
+	const auto indexOffset = allocate<uint8_t>(data, indexSize * numIndices);
+
+	auto &header = *getView<SDKMeshHeader>(data, headerOffset);
+	header.Version = SDKMESH_FILE_VERSION;
+	header.IsBigEndian = 0;
+	header.HeaderSize = sizeof(SDKMeshHeader);
+	header.NonBufferDataSize = vertexOffset - header.HeaderSize;
+	header.BufferDataSize = data.size() - vertexOffset;
+	header.NumVertexBuffers = 1;
+	header.NumIndexBuffers = 1;
+	header.NumMeshes = 1;
+	header.NumTotalSubsets = 1;
+	header.NumFrames = numBones;
+	header.NumMaterials = 1;
+	header.VertexStreamHeadersOffset = vbHeaderOffset;
+	header.IndexStreamHeadersOffset = ibHeaderOffset;
+	header.MeshDataOffset = meshOffset;
+	header.SubsetDataOffset = subsetOffset;
+	header.FrameDataOffset = frameOffset;
+	header.MaterialDataOffset = materialOffset;
+
+	auto &vbHeader = *getView<SDKMeshVertexBufferHeader>(data, vbHeaderOffset);
+	vbHeader.NumVertices = numVertices;
+	vbHeader.SizeBytes = sizeof(SkinnedVertex) * numVertices;
+	vbHeader.StrideBytes = sizeof(SkinnedVertex);
+	vbHeader.DataOffset = vertexOffset;
+	const SDKMeshVertexBufferHeader::VertexElement decl[] =
+	{
+		{ 0, offsetof(SkinnedVertex, Pos), DECLTYPE_FLOAT3, 0, DECLUSAGE_POSITION, 0 },
+		{ 0, offsetof(SkinnedVertex, Weights), DECLTYPE_UBYTE4N, 0, DECLUSAGE_BLENDWEIGHT, 0 },
+		{ 0, offsetof(SkinnedVertex, Bones), DECLTYPE_UBYTE4, 0, DECLUSAGE_BLENDINDICES, 0 },
+		{ 0, offsetof(SkinnedVertex, Norm), DECLTYPE_FLOAT16_4, 0, DECLUSAGE_NORMAL, 0 },
+		{ 0, offsetof(SkinnedVertex, Tex), DECLTYPE_FLOAT16_2, 0, DECLUSAGE_TEXCOORD, 0 },
+		{ 0, offsetof(SkinnedVertex, Tan), DECLTYPE_FLOAT16_4, 0, DECLUSAGE_TANGENT, 0 },
+		{ 0, offsetof(SkinnedVertex, BiNorm), DECLTYPE_FLOAT16_4, 0, DECLUSAGE_BINORMAL, 0 },
+		{ DECL_END, 0, DECLTYPE_UNUSED, 0, 0, 0 }
+	};
+	memcpy(vbHeader.Decl, decl, sizeof(decl));
+
+	auto &ibHeader = *getView<SDKMeshIndexBufferHeader>(data, ibHeaderOffset);
+	ibHeader.NumIndices = numIndices;
+	ibHeader.SizeBytes = indexSize * numIndices;
+	ibHeader.IndexType = is32Bit ? IT_32BIT : IT_16BIT;
+	ibHeader.DataOffset = indexOffset;
+
+	auto &mesh = *getView<SDKMeshData>(data, meshOffset);
+	snprintf(mesh.Name, sizeof(mesh.Name), "Synthetic");
+	mesh.NumVertexBuffers = 1;
+	mesh.VertexBuffers[0] = 0;
+	mesh.IndexBuffer = 0;
+	mesh.NumSubsets = 1;
+	mesh.NumFrameInfluences = numMeshBones;
+	mesh.SubsetOffset = subsetIndexOffset;
+	mesh.FrameInfluenceOffset = influenceOffset;
+
+	auto &subset = *getView<SDKMeshSubset>(data, subsetOffset);
+	snprintf(subset.Name, sizeof(subset.Name), "Synthetic");
+	subset.MaterialID = 0;
+	subset.PrimitiveType = PT_TRIANGLE_LIST;
+	subset.IndexStart = 0;
+	subset.IndexCount = numIndices;
+	subset.VertexStart = 0;
+	subset.VertexCount = numVertices;
+	*getView<uint32_t>(data, subsetIndexOffset) = 0;
+
+	// Untextured material
+	auto &material = *getView<SDKMeshMaterial>(data, materialOffset);
+	snprintf(material.Name, sizeof(material.Name), "Synthetic");
+	material.Albedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+
+	const auto pFrames = getView<SDKMeshFrame>(data, frameOffset);
+	for (auto i = 0u; i < numBones; ++i)
+	{
+		auto &frame = pFrames[i];
+		snprintf(frame.Name, sizeof(frame.Name), "Bone%u", i);
+		frame.Mesh = INVALID_MESH;
+		frame.ParentFrame = i > 0 ? (i - 1) / 2 : INVALID_FRAME;
+		frame.ChildFrame = 2 * i + 1 < numBones ? 2 * i + 1 : INVALID_FRAME;
+		frame.SiblingFrame = i % 2 == 1 && i + 1 < numBones ? i + 1 : INVALID_FRAME;
+		frame.AnimationDataIndex = INVALID_ANIMATION_DATA;
+
+		XMFLOAT3 translation;
+		float angle;
+		Test::GetSyntheticBindPose(i, translation, angle);
+		XMStoreFloat4x4(&frame.Matrix, XMMatrixRotationZ(angle) * XMMatrixTranslation(translation.x, translation.y, translation.z));
+	}
+
+	const auto pInfluences = getView<uint32_t>(data, influenceOffset);
+	for (auto i = 0u; i < numMeshBones; ++i) pInfluences[i] = i;
+
+	// Wrap the grid around a cylinder, with 1 to 4 influences in turn, stored lightest first
+	// so that the load has to sort them
+	static const uint8_t weights[4][4] = { { 255 }, { 85, 170 }, { 42, 85, 128 }, { 30, 50, 75, 100 } };
+	const auto pVertices = getView<SkinnedVertex>(data, vertexOffset);
+	for (auto y = 0u; y <= numRows; ++y)
+	{
+		const auto firstBone = numMeshBones * y / (numRows + 1);
+		for (auto x = 0u; x <= numColumns; ++x)
+		{
+			auto &vertex = pVertices[(numColumns + 1) * y + x];
+			const auto angle = XM_2PI * x / numColumns;
+			const auto c = cosf(angle);
+			const auto s = sinf(angle);
+			vertex.Pos = XMFLOAT3(0.3f * c, 2.0f * y / numRows, 0.3f * s);
+			vertex.Norm = XMHALF4(c, 0.0f, s, 0.0f);
+			vertex.Tex = XMHALF2(static_cast<float>(x) / numColumns, static_cast<float>(y) / numRows);
+			vertex.Tan = XMHALF4(-s, 0.0f, c, 0.0f);
+			vertex.BiNorm = XMHALF4(0.0f, 1.0f, 0.0f, 0.0f);
+
+			const auto numInfluences = (x + y) % 4 + 1;
+			for (auto j = 0u; j < 4; ++j)
+			{
+				vertex.Weights[j] = weights[numInfluences - 1][j];
+				vertex.Bones[j] = static_cast<uint8_t>(j < numInfluences ? (firstBone + j) % numMeshBones : 0);
+			}
+		}
+	}
+
+	const auto writeIndices = [&](auto *pIndices)
+	{
+		using Index = remove_pointer_t<decltype(pIndices)>;
+		for (auto y = 0u; y < numRows; ++y)
+			for (auto x = 0u; x < numColumns; ++x)
+			{
+				const auto v = (numColumns + 1) * y + x;
+				const uint32_t quad[] = { v, v + numColumns + 1, v + 1, v + 1, v + numColumns + 1, v + numColumns + 2 };
+				for (const auto &index : quad) *pIndices++ = static_cast<Index>(index);
+			}
+	};
+	if (is32Bit) writeIndices(getView<uint32_t>(data, indexOffset));
+	else writeIndices(getView<uint16_t>(data, indexOffset));
+
+	return data;
+}
+
+wstring Test::WriteSyntheticMesh(const wchar_t *name, uint32_t numBones, uint32_t numTriangles,
+	uint32_t numKeys, uint32_t animationFPS)
+{
+	const auto fileName = GetTempPath(name) + L".sdkmesh";
+	N_RETURN(WriteFile(fileName, CreateSyntheticMesh(numBones, numTriangles)), wstring());
+	N_RETURN(WriteFile(fileName + L"_anim", CreateSyntheticAnimation(numBones, numKeys, animationFPS)), wstring());
+
+	return fileName;
+}
+
+void Test::DeleteSyntheticMesh(const wstring &fileName)
+{
+	RemoveFile(fileName);
+	RemoveFile(fileName + L"_anim");
+}
+
+static bool prepareMesh(SDKMesh &mesh, const wchar_t *meshFile, const wchar_t *animationFile)
+{
+	N_RETURN(mesh.Prepare(meshFile, make_shared<TextureCache::element_type>()), false);
+	N_RETURN(mesh.LoadAnimation(animationFile), false);
+	mesh.TransformBindPose(XMMatrixIdentity());
+
+	return true;
+}
+
+void Test::ForEachMesh(const function<void(const string&, SDKMesh&)> &run,
+	initializer_list<uint32_t> numBones, uint32_t numTriangles)
+{
+	static const wchar_t starsMesh[] = L"Media/Bright/Stars.sdkmesh";
+	static const wchar_t starsAnimation[] = L"Media/Bright/Stars.sdkmesh_anim";
+
+	if (FileExists(starsMesh) && FileExists(starsAnimation))
+	{
+		SDKMesh mesh;
+		if (prepareMesh(mesh, starsMesh, starsAnimation)) run("Stars", mesh);
+		else Fail(__FILE__, __LINE__, "prepareMesh(Stars)");
+	}
+	else Skip("Stars", "not found; run from the Bin folder");
+
+	for (const auto n : numBones)
+	{
+		const auto name = "Synthetic" + to_string(n) + "x" + to_string(numTriangles);
+		const auto meshFile = WriteSyntheticMesh(wstring(name.cbegin(), name.cend()).c_str(), n, numTriangles);
+		if (meshFile.empty())
+		{
+			Fail(__FILE__, __LINE__, "WriteSyntheticMesh");
+			continue;
+		}
+
+		{
+			SDKMesh mesh;
+			if (prepareMesh(mesh, meshFile.c_str(), (meshFile + L"_anim").c_str())) run(name, mesh);
+			else Fail(__FILE__, __LINE__, "prepareMesh(Synthetic)");
+		}
+		DeleteSyntheticMesh(meshFile);
+	}
+}
@@ -0,0 +1,31 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Advanced/XUSGSDKMesh.h"
+#include "SyntheticAnimation.h"
+#include "XUSGTest.h"
+
+namespace XUSG
+{
+	namespace Test
+	{
+		// Skinned .sdkmesh image of the synthetic rig of numBones frames, and a cylinder of at least
+		// numTriangles triangles weighted by 1 to 4 of the first 256 bones in turn. The indices
+		// are 32-bit beyond 64K vertices.
+		std::vector<uint8_t> CreateSyntheticMesh(uint32_t numBones, uint32_t numTriangles);
+
+		// Write both into the temporary folder as <name>.sdkmesh and <name>.sdkmesh_anim, and
+		// return the path of the mesh, or an empty path on failure
+		std::wstring WriteSyntheticMesh(const wchar_t *name, uint32_t numBones, uint32_t numTriangles,
+			uint32_t numKeys = 31, uint32_t animationFPS = 30);
+		void DeleteSyntheticMesh(const std::wstring &fileName);
+
+		// Run on the animated Stars mesh, if found, and on synthetic rigs of each bone count.
+		// The meshes are prepared without a device, and the bind pose is transformed by identity.
+		void ForEachMesh(const std::function<void(const std::string&, SDKMesh&)> &run,
+			std::initializer_list<uint32_t> numBones = { 256, 1024 }, uint32_t numTriangles = 4096);
+	}
+}
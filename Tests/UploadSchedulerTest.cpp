@@ -0,0 +1,188 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <random>
+#include "XUSGTest.h"
+#include "Core/XUSGUploadScheduler.h"
+
+using namespace std;
+using namespace XUSG;
+
+// Copy queue that runs the batches when they are waited for, or when the test completes them
+class FakeQueue :
+	public UploadScheduler
+{
+public:
+	FakeQueue(uint32_t stagingSize) :
+		CompletedValue(0),
+		NumWaits(0),
+		NumResets(0),
+		NumRetired(0),
+		Executed()
+	{
+		init(stagingSize);
+	}
+
+	void Complete(uint64_t fenceValue) { CompletedValue = (max)(fenceValue, CompletedValue); }
+
+	uint64_t CompletedValue;
+	uint32_t NumWaits;
+	uint32_t NumResets;
+	uint32_t NumRetired;
+	vector<uint64_t> Executed;	// Fence values, in the submission order
+
+protected:
+	virtual bool openBatch(uint32_t, bool isReused)
+	{
+		NumResets += isReused ? 1 : 0;
+
+		return true;
+	}
+
+	virtual bool execute(uint32_t, uint64_t fenceValue)
+	{
+		Executed.push_back(fenceValue);
+
+		return true;
+	}
+
+	virtual uint64_t getCompletedValue() const { return CompletedValue; }
+
+	virtual bool waitForValue(uint64_t fenceValue)
+	{
+		++NumWaits;
+		Complete(fenceValue);
+
+		return true;
+	}
+
+	virtual void retireBatch(uint32_t) { ++NumRetired; }
+};
+
+// Many uploads share one batch and one slot, which is reused once the batch completes
+TEST_CASE(UploadBatching)
+{
+	FakeQueue queue(1 << 20);
+
+	uint32_t offset;
+	for (auto i = 0u; i < 100; ++i)
+	{
+		CHECK(queue.AllocateStaging(1024, 512, &offset));
+		CHECK(queue.Open());
+	}
+	CHECK(queue.Executed.empty());
+	CHECK(queue.IsRecording());
+	CHECK(queue.GetFenceValue() == 1);
+	CHECK(queue.GetNumBatchSlots() == 1);
+
+	CHECK(queue.Submit());
+	CHECK(queue.Executed.size() == 1 && queue.Executed[0] == 1);
+	CHECK(!queue.IsRecording());
+	CHECK(!queue.IsComplete(1));
+	CHECK(queue.GetNumBatchesInFlight() == 1);
+
+	// Still in flight, so the next batch takes a new slot
+	CHECK(queue.Open());
+	CHECK(queue.GetBatchSlot() == 1);
+	CHECK(queue.GetFenceValue() == 2);
+
+	// Waiting for the batch being recorded submits it first
+	CHECK(queue.Wait(queue.GetFenceValue()));
+	CHECK(queue.Executed.size() == 2 && queue.Executed[1] == 2);
+	CHECK(queue.IsComplete(2));
+	CHECK(queue.NumWaits == 1);
+	CHECK(queue.NumRetired == 2);
+	CHECK(queue.GetNumBatchesInFlight() == 0);
+	CHECK(queue.GetStaging().GetUsedSize() == 0);
+
+	CHECK(queue.Open());
+	CHECK(queue.NumResets == 1);
+	CHECK(queue.GetNumBatchSlots() == 2);
+}
+
+// Data larger than the ring is left to the caller, without submitting or waiting
+TEST_CASE(UploadOversized)
+{
+	FakeQueue queue(65536);
+
+	uint32_t offset;
+	CHECK(!queue.AllocateStaging(65537, 512, &offset));
+	CHECK(queue.Executed.empty());
+	CHECK(queue.NumWaits == 0);
+	CHECK(queue.GetStaging().GetUsedSize() == 0);
+
+	CHECK(queue.AllocateStaging(65536, 512, &offset));
+	CHECK(offset == 0);
+}
+
+// Under staging pressure, with the queue completing the batches at random, no allocation
+// overlaps the staging space of a batch that has not completed; the batch is submitted or
+// the oldest batches are waited for only when the ring is full
+TEST_CASE(UploadStagingPressure)
+{
+	struct Allocation
+	{
+		uint32_t Offset;
+		uint32_t Size;
+		uint64_t FenceValue;
+	};
+
+	const auto stagingSize = 65536u;
+	const auto alignment = 512u;
+	FakeQueue queue(stagingSize);
+	mt19937 rng(5489);
+	uniform_int_distribution<uint32_t> sizes(1, 16384);
+
+	vector<Allocation> allocations;
+	auto numOverlaps = 0u;
+	auto numMisplaced = 0u;
+	auto maxInFlight = 0u;
+	for (auto i = 0u; i < 4096; ++i)
+	{
+		const auto size = sizes(rng);
+		const auto numWaits = queue.NumWaits;
+		const auto numExecuted = queue.Executed.size();
+		const auto canAllocate = queue.GetStaging().CanAllocate(size, alignment);
+
+		Allocation allocation;
+		CHECK(queue.AllocateStaging(size, alignment, &allocation.Offset));
+		CHECK(queue.Open());
+		allocation.Size = size;
+		allocation.FenceValue = queue.GetFenceValue();
+
+		// The ring was full if the scheduler had to submit or wait
+		if (queue.NumWaits > numWaits || queue.Executed.size() > numExecuted)
+			numMisplaced += canAllocate ? 1 : 0;
+		numMisplaced += allocation.Offset % alignment || allocation.Offset + size > stagingSize ? 1 : 0;
+
+		for (const auto &other : allocations)
+			if (other.FenceValue > queue.CompletedValue && allocation.Offset < other.Offset + other.Size &&
+				other.Offset < allocation.Offset + allocation.Size) ++numOverlaps;
+
+		allocations.push_back(allocation);
+		allocations.erase(remove_if(allocations.begin(), allocations.end(),
+			[&queue](const Allocation &a) { return a.FenceValue <= queue.CompletedValue; }), allocations.end());
+
+		// Submit every few uploads, and complete the oldest batch now and then
+		if (i % 5 == 4) CHECK(queue.Submit());
+		if (i % 7 == 6 && !queue.Executed.empty()) queue.Complete(queue.CompletedValue + 1 < queue.Executed.back() ?
+			queue.CompletedValue + 1 : queue.Executed.back());
+		maxInFlight = (max)(queue.GetNumBatchesInFlight(), maxInFlight);
+	}
+
+	CHECK(numOverlaps == 0);
+	CHECK(numMisplaced == 0);
+	CHECK(queue.NumWaits > 0);
+
+	// The slots are bounded by the batches in flight, and the fence values are in order
+	CHECK(queue.GetNumBatchSlots() <= maxInFlight + 1);
+	CHECK(is_sorted(queue.Executed.cbegin(), queue.Executed.cend()));
+	CHECK(adjacent_find(queue.Executed.cbegin(), queue.Executed.cend()) == queue.Executed.cend());
+
+	// Draining the queue retires every batch and its staging space
+	CHECK(queue.Wait(queue.GetFenceValue()));
+	CHECK(queue.NumRetired == queue.Executed.size());
+	CHECK(queue.GetStaging().GetUsedSize() == 0);
+}
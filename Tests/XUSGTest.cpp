@@ -0,0 +1,183 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include "XUSGTest.h"
+
+using namespace std;
+using namespace XUSG;
+
+struct TestCase
+{
+	const char *Name;
+	Test::Case Run;
+	bool IsBenchmark;
+};
+
+// Function-local, so that the registrars of any translation unit find it constructed
+static vector<TestCase> &getCases()
+{
+	static vector<TestCase> cases;
+
+	return cases;
+}
+
+static uint32_t g_numFailures = 0;
+static bool g_isQuick = false;
+
+Test::Registrar::Registrar(const char *name, Case run, bool isBenchmark)
+{
+	getCases().push_back({ name, run, isBenchmark });
+}
+
+void Test::Fail(const char *fileName, int line, const char *expression)
+{
+	cerr << fileName << "(" << line << "): check failed: " << expression << endl;
+	++g_numFailures;
+}
+
+bool Test::IsQuick()
+{
+	return g_isQuick;
+}
+
+uint32_t Test::Iterations(uint32_t numIterations)
+{
+	return g_isQuick ? 1 : numIterations;
+}
+
+double Test::Measure(const function<void()> &run, uint32_t numIterations, uint32_t numRuns)
+{
+	numIterations = Iterations(numIterations);
+	numRuns = g_isQuick ? 1 : numRuns;
+
+	// Warm up the caches and the branch predictors first
+	run();
+
+	auto best = 0.0;
+	for (auto i = 0u; i < numRuns; ++i)
+	{
+		const auto start = chrono::steady_clock::now();
+		for (auto j = 0u; j < numIterations; ++j) run();
+		const chrono::duration<double, nano> time = chrono::steady_clock::now() - start;
+
+		const auto timePerIteration = time.count() / numIterations;
+		best = i > 0 ? (min)(timePerIteration, best) : timePerIteration;
+	}
+
+	return best;
+}
+
+wstring Test::GetTempPath(const wchar_t *name)
+{
+#ifdef _WIN32
+	wchar_t tempPath[MAX_PATH];
+	const auto length = GetTempPathW(MAX_PATH, tempPath);
+
+	return length > 0 && length <= MAX_PATH ? tempPath + wstring(name) : wstring(name);
+#else
+	return L"/tmp/" + wstring(name);
+#endif
+}
+
+// Wide paths are native on Windows only
+#ifdef _WIN32
+static const wstring &nativePath(const wstring &fileName)
+{
+	return fileName;
+}
+#else
+static string nativePath(const wstring &fileName)
+{
+	return string(fileName.cbegin(), fileName.cend());
+}
+#endif
+
+bool Test::FileExists(const wstring &fileName)
+{
+	return ifstream(nativePath(fileName), ios::in | ios::binary).is_open();
+}
+
+void Test::RemoveFile(const wstring &fileName)
+{
+#ifdef _WIN32
+	_wremove(fileName.c_str());
+#else
+	remove(nativePath(fileName).c_str());
+#endif
+}
+
+bool Test::ReadFile(const wstring &fileName, vector<uint8_t> &data)
+{
+	ifstream fileStream(nativePath(fileName), ios::in | ios::binary | ios::ate);
+	if (!fileStream) return false;
+
+	data.resize(static_cast<size_t>(fileStream.tellg()));
+	fileStream.seekg(0);
+
+	return static_cast<bool>(fileStream.read(reinterpret_cast<char*>(data.data()), data.size()));
+}
+
+bool Test::WriteFile(const wstring &fileName, const vector<uint8_t> &data)
+{
+	ofstream fileStream(nativePath(fileName), ios::out | ios::binary | ios::trunc);
+
+	return fileStream && fileStream.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+void Test::Report(const string &name, double value, const char *unit)
+{
+	cout << "  " << left << setw(56) << name << right << setw(14) << fixed <<
+		setprecision(2) << value << " " << unit << endl;
+}
+
+void Test::Skip(const string &name, const char *reason)
+{
+	cout << "  " << left << setw(56) << name << "skipped: " << reason << endl;
+}
+
+//--------------------------------------------------------------------------------------
+// Tests [-bench] [-quick] [name filter]
+//--------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	auto isBenchmark = false;
+	const char *filter = nullptr;
+	for (auto i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-bench") == 0) isBenchmark = true;
+		else if (strcmp(argv[i], "-quick") == 0) g_isQuick = true;
+		else filter = argv[i];
+	}
+
+	auto numCases = 0u;
+	auto numFailedCases = 0u;
+	for (const auto &testCase : getCases())
+	{
+		if (testCase.IsBenchmark != isBenchmark) continue;
+		if (filter && !strstr(testCase.Name, filter)) continue;
+
+		cout << "[ RUN  ] " << testCase.Name << endl;
+		const auto numFailures = g_numFailures;
+		testCase.Run();
+
+		const auto isPassed = g_numFailures == numFailures;
+		cout << (isPassed ? "[  OK  ] " : "[ FAIL ] ") << testCase.Name << endl;
+		numFailedCases += isPassed ? 0 : 1;
+		++numCases;
+	}
+
+	cout << numCases - numFailedCases << " of " << numCases << (isBenchmark ?
+		" benchmarks" : " tests") << " passed" << endl;
+
+	return numFailedCases > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
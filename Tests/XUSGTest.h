@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------------
+// By Stars XU Tianchen
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace XUSG
+{
+	namespace Test
+	{
+		//--------------------------------------------------------------------------------------
+		// Headless test runner shared by the unit tests and the benchmarks. The cases register
+		// themselves statically; the tests run by default and the benchmarks with -bench. A
+		// failed check is counted and reported, and the case goes on.
+		//--------------------------------------------------------------------------------------
+		using Case = void(*)();
+
+		struct Registrar
+		{
+			Registrar(const char *name, Case run, bool isBenchmark);
+		};
+
+		void Fail(const char *fileName, int line, const char *expression);
+
+		// With -quick, the benchmarks run a few iterations only, e.g. to check that they work
+		bool IsQuick();
+		uint32_t Iterations(uint32_t numIterations);
+
+		// Average nanoseconds per iteration of the fastest of the runs
+		double Measure(const std::function<void()> &run, uint32_t numIterations, uint32_t numRuns = 5);
+
+		// Path of a file in the temporary folder
+		std::wstring GetTempPath(const wchar_t *name);
+		bool FileExists(const std::wstring &fileName);
+		void RemoveFile(const std::wstring &fileName);
+		bool ReadFile(const std::wstring &fileName, std::vector<uint8_t> &data);
+		bool WriteFile(const std::wstring &fileName, const std::vector<uint8_t> &data);
+
+		// One aligned line per measurement
+		void Report(const std::string &name, double value, const char *unit);
+		void Skip(const std::string &name, const char *reason);
+	}
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static const XUSG::Test::Registrar name##Registrar(#name, name, false); \
+	static void name()
+
+#define BENCHMARK(name) \
+	static void name(); \
+	static const XUSG::Test::Registrar name##Registrar(#name, name, true); \
+	static void name()
+
+#define CHECK(x)			if (!(x)) XUSG::Test::Fail(__FILE__, __LINE__, #x)
+#define CHECK_NEAR(a, b, e)	CHECK(std::fabs((a) - (b)) <= (e))